@@ -0,0 +1,93 @@
+#include "main/bench_report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <sstream>
+
+namespace {
+
+std::string quote(const std::string& value) {
+    std::string result = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            result += escaped;
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+std::string number(double value) {
+    // JSON has no infinities or NaN.
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    std::ostringstream out;
+    out.precision(6);
+    out << value;
+    return out.str();
+}
+
+}  // namespace
+
+SampleSummary summarize(std::vector<double> samples) {
+    SampleSummary summary;
+    if (samples.empty()) {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    summary.count = samples.size();
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary.min = samples.front();
+    summary.max = samples.back();
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    return summary;
+}
+
+void BenchReport::setString(const std::string& key, const std::string& value) {
+    fields_.emplace_back(key, quote(value));
+}
+
+void BenchReport::setNumber(const std::string& key, double value) {
+    fields_.emplace_back(key, number(value));
+}
+
+void BenchReport::setBool(const std::string& key, bool value) {
+    fields_.emplace_back(key, value ? "true" : "false");
+}
+
+void BenchReport::setSamples(const std::string& key, const std::vector<double>& samples) {
+    SampleSummary summary = summarize(samples);
+    std::string value = "{\"count\": " + std::to_string(summary.count) +
+                        ", \"mean\": " + number(summary.mean) +
+                        ", \"min\": " + number(summary.min) +
+                        ", \"max\": " + number(summary.max) +
+                        ", \"p50\": " + number(summary.p50) +
+                        ", \"p95\": " + number(summary.p95) +
+                        ", \"p99\": " + number(summary.p99) + "}";
+    fields_.emplace_back(key, value);
+}
+
+void BenchReport::write(std::ostream& out) const {
+    out << "{\n";
+    for (size_t i = 0; i < fields_.size(); ++i) {
+        out << "  " << quote(fields_[i].first) << ": " << fields_[i].second << (i + 1 < fields_.size() ? ",\n" : "\n");
+    }
+    out << "}\n";
+}
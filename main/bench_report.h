@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Distribution of per-frame samples, percentiles by nearest rank.
+struct SampleSummary {
+    size_t count = 0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+};
+
+SampleSummary summarize(std::vector<double> samples);
+
+// Result of a benchmark run written as one JSON object, so runs can be
+// compared across commits and machines by scripts. Fields keep their order.
+class BenchReport {
+public:
+    void setString(const std::string& key, const std::string& value);
+    void setNumber(const std::string& key, double value);
+    void setBool(const std::string& key, bool value);
+    // Written as the SampleSummary of the samples.
+    void setSamples(const std::string& key, const std::vector<double>& samples);
+
+    void write(std::ostream& out) const;
+
+private:
+    // Values already encoded as JSON.
+    std::vector<std::pair<std::string, std::string>> fields_;
+};
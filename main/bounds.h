@@ -0,0 +1,80 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <limits>
+
+// Axis-aligned bounding box.
+struct BoundingBox {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    float surfaceArea() const {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    void expand(const BoundingBox& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    bool intersects(const BoundingBox& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    float distanceSquared(const glm::vec3& point) const {
+        glm::vec3 d = glm::max(glm::max(min - point, point - max), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    // Smallest axis-aligned box containing this box after an affine transform.
+    BoundingBox transform(const glm::mat4& m) const {
+        glm::vec3 new_center = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extents();
+        glm::vec3 new_extents = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+        return {new_center - new_extents, new_center + new_extents};
+    }
+};
+
+// Box that contains nothing; expanding it by another box yields that box.
+inline BoundingBox emptyBox() {
+    return {glm::vec3(std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::lowest())};
+}
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+// Slab test. inv_direction is 1 / ray.direction, hoisted out for traversal loops.
+// On a hit within [0, max_t], t_entry is where the ray enters the box (0 if it starts inside).
+inline bool intersectRay(const BoundingBox& box, const Ray& ray, const glm::vec3& inv_direction, float max_t, float& t_entry) {
+    glm::vec3 t0 = (box.min - ray.origin) * inv_direction;
+    glm::vec3 t1 = (box.max - ray.origin) * inv_direction;
+    glm::vec3 t_near = glm::min(t0, t1);
+    glm::vec3 t_far = glm::max(t0, t1);
+    float enter = std::max({t_near.x, t_near.y, t_near.z, 0.0f});
+    float exit = std::min({t_far.x, t_far.y, t_far.z, max_t});
+    t_entry = enter;
+    return enter <= exit;
+}
+
+// Bounding sphere (xyz - center, w - radius) after an affine transform.
+inline glm::vec4 transformSphere(const glm::vec4& sphere, const glm::mat4& m) {
+    float scale = std::max({glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))});
+    return glm::vec4(glm::vec3(m * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+}
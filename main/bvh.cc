@@ -0,0 +1,510 @@
+#include "main/bvh.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+constexpr uint32_t kInvalidNode = ~0u;
+constexpr uint32_t kNoItem = ~0u;
+constexpr uint32_t kBinCount = 16;
+constexpr uint32_t kMinLeafSize = 2;
+constexpr uint32_t kMaxLeafSize = 16;
+// Cost of visiting a node relative to testing one item.
+constexpr float kTraversalCost = 1.0f;
+constexpr float kRebuildRatio = 1.5f;
+// Fraction of the items added or removed since the last build.
+constexpr float kRebuildChurn = 0.25f;
+
+struct Bin {
+    BoundingBox bounds = emptyBox();
+    uint32_t count = 0;
+};
+
+// Signed distances of the box corners nearest to and furthest along the plane normal.
+void planeDistances(const glm::vec4& plane, const BoundingBox& box, float& nearest, float& furthest) {
+    glm::vec3 normal(plane);
+    glm::vec3 center = box.center();
+    glm::vec3 extents = box.extents();
+    float distance = glm::dot(normal, center) + plane.w;
+    float radius = glm::dot(glm::abs(normal), extents);
+    nearest = distance - radius;
+    furthest = distance + radius;
+}
+
+enum class Containment {
+    kOutside,
+    kIntersecting,
+    kInside
+};
+
+Containment classify(const Frustum& frustum, const BoundingBox& box) {
+    Containment result = Containment::kInside;
+    for (const glm::vec4& plane : frustum.planes) {
+        float nearest, furthest;
+        planeDistances(plane, box, nearest, furthest);
+        if (furthest < 0.0f) {
+            return Containment::kOutside;
+        }
+        if (nearest < 0.0f) {
+            result = Containment::kIntersecting;
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+void Bvh::build(const std::vector<BoundingBox>& boxes) {
+    boxes_ = boxes;
+    rebuild();
+}
+
+void Bvh::rebuild() {
+    size_t item_count = boxes_.size();
+    nodes_.clear();
+    dirty_items_.clear();
+    dirty_nodes_.clear();
+    items_.resize(item_count);
+    std::iota(items_.begin(), items_.end(), 0);
+    item_positions_.resize(item_count);
+    added_items_.clear();
+    removed_count_ = 0;
+    item_leaf_.assign(item_count, 0);
+    centroids_.resize(item_count);
+    for (size_t i = 0; i < item_count; ++i) {
+        centroids_[i] = boxes_[i].center();
+    }
+
+    total_area_ = 0.0f;
+    built_area_ = 0.0f;
+    if (item_count == 0) {
+        node_dirty_.clear();
+        return;
+    }
+
+    nodes_.reserve(2 * item_count / kMinLeafSize + 1);
+    BvhNode root;
+    root.first = 0;
+    root.count = static_cast<uint32_t>(item_count);
+    root.parent = kInvalidNode;
+    nodes_.push_back(root);
+
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        uint32_t node_index = stack.back();
+        stack.pop_back();
+        subdivide(node_index, stack);
+    }
+
+    for (const BvhNode& node : nodes_) {
+        total_area_ += node.bounds.surfaceArea();
+    }
+    built_area_ = total_area_;
+    node_dirty_.assign(nodes_.size(), false);
+}
+
+void Bvh::subdivide(uint32_t node_index, std::vector<uint32_t>& stack) {
+    uint32_t first = nodes_[node_index].first;
+    uint32_t count = nodes_[node_index].count;
+
+    BoundingBox bounds = emptyBox();
+    BoundingBox centroid_bounds = emptyBox();
+    for (uint32_t i = first; i < first + count; ++i) {
+        bounds.expand(boxes_[items_[i]]);
+        centroid_bounds.expand({centroids_[items_[i]], centroids_[items_[i]]});
+    }
+    nodes_[node_index].bounds = bounds;
+
+    if (count <= kMinLeafSize) {
+        makeLeaf(node_index);
+        return;
+    }
+
+    // Binned SAH over all three axes.
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    uint32_t best_split = 0;
+    glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+
+        std::array<Bin, kBinCount> bins;
+        float scale = kBinCount / extent[axis];
+        for (uint32_t i = first; i < first + count; ++i) {
+            uint32_t item = items_[i];
+            uint32_t bin = std::min(kBinCount - 1, static_cast<uint32_t>((centroids_[item][axis] - centroid_bounds.min[axis]) * scale));
+            bins[bin].bounds.expand(boxes_[item]);
+            ++bins[bin].count;
+        }
+
+        // right_area[i], right_count[i] describe bins [i, kBinCount).
+        std::array<float, kBinCount> right_area;
+        std::array<uint32_t, kBinCount> right_count;
+        BoundingBox right = emptyBox();
+        uint32_t right_items = 0;
+        for (uint32_t i = kBinCount - 1; i > 0; --i) {
+            right.expand(bins[i].bounds);
+            right_items += bins[i].count;
+            right_area[i] = right_items > 0 ? right.surfaceArea() : 0.0f;
+            right_count[i] = right_items;
+        }
+
+        BoundingBox left = emptyBox();
+        uint32_t left_items = 0;
+        for (uint32_t split = 1; split < kBinCount; ++split) {
+            left.expand(bins[split - 1].bounds);
+            left_items += bins[split - 1].count;
+            if (left_items == 0 || right_count[split] == 0) {
+                continue;
+            }
+            float cost = left.surfaceArea() * left_items + right_area[split] * right_count[split];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    float area = bounds.surfaceArea();
+    float leaf_cost = static_cast<float>(count);
+    float split_cost = area > 0.0f ? kTraversalCost + best_cost / area : leaf_cost;
+
+    uint32_t middle;
+    if (best_axis >= 0 && (split_cost < leaf_cost || count > kMaxLeafSize)) {
+        int axis = best_axis;
+        float min = centroid_bounds.min[axis];
+        float scale = kBinCount / extent[axis];
+        auto it = std::partition(items_.begin() + first, items_.begin() + first + count, [&](uint32_t item) {
+            return std::min(kBinCount - 1, static_cast<uint32_t>((centroids_[item][axis] - min) * scale)) < best_split;
+        });
+        middle = static_cast<uint32_t>(it - items_.begin());
+    } else if (count > kMaxLeafSize) {
+        // All centroids coincide, split the range in half to bound the leaf size.
+        middle = first + count / 2;
+    } else {
+        makeLeaf(node_index);
+        return;
+    }
+
+    uint32_t left_index = static_cast<uint32_t>(nodes_.size());
+    BvhNode left_node;
+    left_node.first = first;
+    left_node.count = middle - first;
+    left_node.parent = node_index;
+    BvhNode right_node;
+    right_node.first = middle;
+    right_node.count = first + count - middle;
+    right_node.parent = node_index;
+    nodes_.push_back(left_node);
+    nodes_.push_back(right_node);
+
+    nodes_[node_index].first = left_index;
+    nodes_[node_index].count = 0;
+    stack.push_back(left_index);
+    stack.push_back(left_index + 1);
+}
+
+void Bvh::makeLeaf(uint32_t node_index) {
+    const BvhNode& node = nodes_[node_index];
+    for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+        item_leaf_[items_[i]] = node_index;
+        item_positions_[items_[i]] = i;
+    }
+}
+
+void Bvh::setBounds(uint32_t item, const BoundingBox& box) {
+    boxes_[item] = box;
+    dirty_items_.push_back(item);
+}
+
+void Bvh::add(const BoundingBox& box) {
+    uint32_t item = static_cast<uint32_t>(boxes_.size());
+    boxes_.push_back(box);
+    centroids_.push_back(box.center());
+    item_leaf_.push_back(kInvalidNode);
+    item_positions_.push_back(static_cast<uint32_t>(added_items_.size()));
+    added_items_.push_back(item);
+}
+
+// The removed item's leaf keeps its bounds until the next refit or build.
+void Bvh::remove(uint32_t item) {
+    uint32_t position = item_positions_[item];
+    if (item_leaf_[item] == kInvalidNode) {
+        added_items_[position] = added_items_.back();
+        item_positions_[added_items_[position]] = position;
+        added_items_.pop_back();
+    } else {
+        items_[position] = kNoItem;
+        ++removed_count_;
+    }
+
+    uint32_t last = static_cast<uint32_t>(boxes_.size() - 1);
+    if (item != last) {
+        boxes_[item] = boxes_[last];
+        centroids_[item] = centroids_[last];
+        item_leaf_[item] = item_leaf_[last];
+        item_positions_[item] = item_positions_[last];
+        if (item_leaf_[item] == kInvalidNode) {
+            added_items_[item_positions_[item]] = item;
+        } else {
+            items_[item_positions_[item]] = item;
+        }
+        // Bounds set on the last item but not refitted yet now belong to item.
+        dirty_items_.push_back(item);
+    }
+    boxes_.pop_back();
+    centroids_.pop_back();
+    item_leaf_.pop_back();
+    item_positions_.pop_back();
+}
+
+bool Bvh::isChurned() const {
+    return added_items_.size() + removed_count_ > kRebuildChurn * boxes_.size();
+}
+
+bool Bvh::update() {
+    if (dirty_items_.empty() && !isChurned()) {
+        return false;
+    }
+
+    for (uint32_t item : dirty_items_) {
+        // Removed since, or added and not in a leaf yet.
+        if (item >= boxes_.size()) {
+            continue;
+        }
+        for (uint32_t node = item_leaf_[item]; node != kInvalidNode && !node_dirty_[node]; node = nodes_[node].parent) {
+            node_dirty_[node] = true;
+            dirty_nodes_.push_back(node);
+        }
+    }
+    dirty_items_.clear();
+
+    // Children are always stored after their parent, so descending order refits bottom-up.
+    std::sort(dirty_nodes_.begin(), dirty_nodes_.end(), std::greater<uint32_t>());
+    for (uint32_t node_index : dirty_nodes_) {
+        BvhNode& node = nodes_[node_index];
+        BoundingBox bounds = emptyBox();
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i] != kNoItem) {
+                    bounds.expand(boxes_[items_[i]]);
+                }
+            }
+        } else {
+            bounds.expand(nodes_[node.first].bounds);
+            bounds.expand(nodes_[node.first + 1].bounds);
+        }
+        total_area_ += bounds.surfaceArea() - node.bounds.surfaceArea();
+        node.bounds = bounds;
+        node_dirty_[node_index] = false;
+    }
+    dirty_nodes_.clear();
+
+    if (isChurned() || total_area_ > kRebuildRatio * built_area_) {
+        rebuild();
+        return true;
+    }
+    return false;
+}
+
+void Bvh::collectItems(uint32_t node_index, std::vector<uint32_t>& items) const {
+    // Nodes of a subtree are not contiguous, but their leaves cover a contiguous
+    // range of items_: from the leftmost leaf to the rightmost one.
+    uint32_t left = node_index;
+    while (nodes_[left].count == 0) {
+        left = nodes_[left].first;
+    }
+    uint32_t right = node_index;
+    while (nodes_[right].count == 0) {
+        right = nodes_[right].first + 1;
+    }
+    for (uint32_t i = nodes_[left].first; i < nodes_[right].first + nodes_[right].count; ++i) {
+        if (items_[i] != kNoItem) {
+            items.push_back(items_[i]);
+        }
+    }
+}
+
+void Bvh::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const {
+    items.clear();
+    for (uint32_t item : added_items_) {
+        if (classify(frustum, boxes_[item]) != Containment::kOutside) {
+            items.push_back(item);
+        }
+    }
+    if (nodes_.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode& node = nodes_[stack.back()];
+        uint32_t node_index = stack.back();
+        stack.pop_back();
+
+        Containment containment = classify(frustum, node.bounds);
+        if (containment == Containment::kOutside) {
+            continue;
+        }
+        if (containment == Containment::kInside) {
+            collectItems(node_index, items);
+        } else if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i] != kNoItem && classify(frustum, boxes_[items_[i]]) != Containment::kOutside) {
+                    items.push_back(items_[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void Bvh::queryBox(const BoundingBox& box, std::vector<uint32_t>& items) const {
+    items.clear();
+    for (uint32_t item : added_items_) {
+        if (boxes_[item].intersects(box)) {
+            items.push_back(item);
+        }
+    }
+    if (nodes_.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode& node = nodes_[stack.back()];
+        stack.pop_back();
+        if (!node.bounds.intersects(box)) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i] != kNoItem && boxes_[items_[i]].intersects(box)) {
+                    items.push_back(items_[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void Bvh::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& items) const {
+    items.clear();
+    float radius_squared = radius * radius;
+    for (uint32_t item : added_items_) {
+        if (boxes_[item].distanceSquared(center) <= radius_squared) {
+            items.push_back(item);
+        }
+    }
+    if (nodes_.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const BvhNode& node = nodes_[stack.back()];
+        stack.pop_back();
+        if (node.bounds.distanceSquared(center) > radius_squared) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i] != kNoItem && boxes_[items_[i]].distanceSquared(center) <= radius_squared) {
+                    items.push_back(items_[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+std::optional<RayHit> Bvh::raycast(const Ray& ray, float max_distance, const ItemIntersector& intersector) const {
+    std::optional<RayHit> closest;
+    glm::vec3 inv_direction = 1.0f / ray.direction;
+    float best = max_distance;
+    auto test_item = [&](uint32_t item) {
+        float item_entry;
+        if (!intersectRay(boxes_[item], ray, inv_direction, best, item_entry)) {
+            return;
+        }
+
+        std::optional<float> distance = intersector ? intersector(item, ray, best) : std::optional<float>(item_entry);
+        if (distance && *distance <= best) {
+            best = *distance;
+            closest = RayHit{item, best};
+        }
+    };
+    for (uint32_t item : added_items_) {
+        test_item(item);
+    }
+    if (nodes_.empty()) {
+        return closest;
+    }
+
+    // Entries are (node, entry distance); the nearer child is visited first so
+    // that later subtrees can be skipped once a closer hit is known.
+    std::vector<std::pair<uint32_t, float>> stack;
+    float root_entry;
+    if (!intersectRay(nodes_[0].bounds, ray, inv_direction, best, root_entry)) {
+        return closest;
+    }
+    stack.push_back({0, root_entry});
+
+    while (!stack.empty()) {
+        auto [node_index, entry] = stack.back();
+        stack.pop_back();
+        if (entry > best) {
+            continue;
+        }
+
+        const BvhNode& node = nodes_[node_index];
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                if (items_[i] != kNoItem) {
+                    test_item(items_[i]);
+                }
+            }
+            continue;
+        }
+
+        float left_entry, right_entry;
+        bool left_hit = intersectRay(nodes_[node.first].bounds, ray, inv_direction, best, left_entry);
+        bool right_hit = intersectRay(nodes_[node.first + 1].bounds, ray, inv_direction, best, right_entry);
+        if (left_hit && right_hit) {
+            if (left_entry <= right_entry) {
+                stack.push_back({node.first + 1, right_entry});
+                stack.push_back({node.first, left_entry});
+            } else {
+                stack.push_back({node.first, left_entry});
+                stack.push_back({node.first + 1, right_entry});
+            }
+        } else if (left_hit) {
+            stack.push_back({node.first, left_entry});
+        } else if (right_hit) {
+            stack.push_back({node.first + 1, right_entry});
+        }
+    }
+    return closest;
+}
+
+size_t Bvh::getItemCount() const {
+    return boxes_.size();
+}
+
+size_t Bvh::getNodeCount() const {
+    return nodes_.size();
+}
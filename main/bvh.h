@@ -0,0 +1,87 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/frustum.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+struct BvhNode {
+    BoundingBox bounds;
+    // Leaf: items [first, first + count) of the item order. Interior: count is 0
+    // and the children are nodes first and first + 1.
+    uint32_t first = 0;
+    uint32_t count = 0;
+    uint32_t parent = 0;
+};
+
+struct RayHit {
+    uint32_t item;
+    float distance;
+};
+
+// Bounding volume hierarchy over item AABBs. Used for the scene's spatial
+// queries and, per mesh, over triangles for precise picking.
+// Trees are built top-down with a binned surface area heuristic. Moving items
+// only refits the nodes above them; once refitting has inflated the summed
+// node area past kRebuildRatio times its value after the last build, update()
+// rebuilds the tree instead.
+// Added items wait in an unsorted list that queries scan, removed ones leave
+// a hole in their leaf; update() rebuilds once these exceed kRebuildChurn of
+// the items, so adding and removing stay cheap between rebuilds.
+class Bvh {
+public:
+    // Exact test for a ray that reached an item's box. Returns the hit distance
+    // if it is closer than max_distance.
+    using ItemIntersector = std::function<std::optional<float>(uint32_t item, const Ray& ray, float max_distance)>;
+
+    void build(const std::vector<BoundingBox>& boxes);
+    // Takes effect on the next update().
+    void setBounds(uint32_t item, const BoundingBox& box);
+    // Appends an item, its index is the previous item count.
+    void add(const BoundingBox& box);
+    // Moves the last item into item and shrinks by one, as ObjectStore::remove
+    // does with the objects.
+    void remove(uint32_t item);
+    // Refits or rebuilds after setBounds. Returns true if the tree was rebuilt.
+    bool update();
+
+    // Queries replace the contents of items with the matching item indices.
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const;
+    void queryBox(const BoundingBox& box, std::vector<uint32_t>& items) const;
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& items) const;
+    // Closest hit along the ray, distances are in units of ray.direction.
+    // Without an intersector the item boxes are the hit surfaces.
+    std::optional<RayHit> raycast(const Ray& ray, float max_distance, const ItemIntersector& intersector = nullptr) const;
+
+    size_t getItemCount() const;
+    size_t getNodeCount() const;
+
+private:
+    void rebuild();
+    void subdivide(uint32_t node_index, std::vector<uint32_t>& stack);
+    void makeLeaf(uint32_t node_index);
+    void collectItems(uint32_t node_index, std::vector<uint32_t>& items) const;
+    bool isChurned() const;
+
+    std::vector<BvhNode> nodes_;
+    std::vector<BoundingBox> boxes_;
+    std::vector<glm::vec3> centroids_;
+    // Item indices ordered so that every leaf references a contiguous range,
+    // kNoItem where an item was removed since the last build.
+    std::vector<uint32_t> items_;
+    // kInvalidNode for the items added since the last build.
+    std::vector<uint32_t> item_leaf_;
+    // Position of every item in items_, or in added_items_ if it has no leaf.
+    std::vector<uint32_t> item_positions_;
+    std::vector<uint32_t> added_items_;
+    uint32_t removed_count_ = 0;
+
+    std::vector<uint32_t> dirty_items_;
+    std::vector<uint32_t> dirty_nodes_;
+    std::vector<bool> node_dirty_;
+    float total_area_ = 0.0f;
+    float built_area_ = 0.0f;
+};
@@ -0,0 +1,177 @@
+// Compares the scene BVH against linear scans for 1k to 1M objects.
+// Usage: bvh_benchmark [max_object_count]
+
+#include "main/bvh.h"
+#include "main/frustum_culler.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kQueryRepetitions = 10;
+constexpr int kRayCount = 1000;
+// Enough frames of churn to include the rebuild it triggers.
+constexpr int kChurnFrames = 20;
+
+template <typename Function>
+double measureMs(Function&& function, int repetitions = 1) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+}
+
+// Objects sized like the demo spheres, at the density of the kv3d stress grid.
+std::vector<BoundingBox> randomBoxes(size_t count, float world_size, std::mt19937& rng) {
+    std::uniform_real_distribution<float> position(0.0f, world_size);
+    std::uniform_real_distribution<float> size(5.0f, 40.0f);
+    std::vector<BoundingBox> boxes(count);
+    for (BoundingBox& box : boxes) {
+        glm::vec3 min(position(rng), position(rng), position(rng));
+        box = {min, min + glm::vec3(size(rng), size(rng), size(rng))};
+    }
+    return boxes;
+}
+
+void runBenchmark(size_t object_count) {
+    std::mt19937 rng(42);
+    float world_size = 50.0f * std::cbrt(static_cast<float>(object_count));
+    std::vector<BoundingBox> boxes = randomBoxes(object_count, world_size, rng);
+
+    Bvh bvh;
+    double build_ms = measureMs([&] { bvh.build(boxes); });
+
+    // Move 1% of the objects a little, as animated objects would between frames.
+    std::uniform_int_distribution<size_t> pick(0, object_count - 1);
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+    double refit_ms = measureMs([&] {
+        for (size_t i = 0; i < object_count / 100 + 1; ++i) {
+            size_t item = pick(rng);
+            glm::vec3 delta(offset(rng), offset(rng), offset(rng));
+            boxes[item] = {boxes[item].min + delta, boxes[item].max + delta};
+            bvh.setBounds(static_cast<uint32_t>(item), boxes[item]);
+        }
+        bvh.update();
+    });
+
+    // Camera at one corner of the world looking at the center.
+    glm::vec3 eye(-100.0f, world_size * 0.5f, -100.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(world_size * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    FrustumCuller culler;
+    culler.resize(object_count);
+    for (size_t i = 0; i < object_count; ++i) {
+        glm::vec3 center = boxes[i].center();
+        culler.setBounds(i, glm::vec4(center, glm::length(boxes[i].extents())), boxes[i]);
+    }
+
+    // Remove and add 1% of the objects, as spawning and despawning would in a
+    // frame, against rebuilding both structures as for a new scene.
+    std::vector<BoundingBox> spawned = randomBoxes(object_count / 100 + 1, world_size, rng);
+    double churn_ms = measureMs([&] {
+        for (const BoundingBox& box : spawned) {
+            size_t item = pick(rng);
+            boxes[item] = boxes.back();
+            boxes.pop_back();
+            bvh.remove(static_cast<uint32_t>(item));
+            culler.remove(item);
+            boxes.push_back(box);
+            bvh.add(box);
+            culler.resize(boxes.size());
+            culler.setBounds(boxes.size() - 1, glm::vec4(box.center(), glm::length(box.extents())), box);
+        }
+        bvh.update();
+    }, kChurnFrames);
+    double rebuild_ms = measureMs([&] {
+        bvh.build(boxes);
+        culler.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            glm::vec3 center = boxes[i].center();
+            culler.setBounds(i, glm::vec4(center, glm::length(boxes[i].extents())), boxes[i]);
+        }
+    });
+
+    std::vector<uint32_t> items;
+    double bvh_frustum_ms = measureMs([&] { bvh.queryFrustum(frustum, items); }, kQueryRepetitions);
+    size_t bvh_visible = items.size();
+    double linear_frustum_ms = measureMs([&] { culler.cull(frustum, items); }, kQueryRepetitions);
+    size_t linear_visible = items.size();
+
+    glm::vec3 query_center(world_size * 0.5f);
+    const float query_radius = 100.0f;
+    double bvh_sphere_ms = measureMs([&] { bvh.querySphere(query_center, query_radius, items); }, kQueryRepetitions);
+    double linear_sphere_ms = measureMs([&] {
+        items.clear();
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            if (boxes[i].distanceSquared(query_center) <= query_radius * query_radius) {
+                items.push_back(i);
+            }
+        }
+    }, kQueryRepetitions);
+
+    std::vector<Ray> rays(kRayCount);
+    std::uniform_real_distribution<float> target(0.0f, world_size);
+    for (Ray& ray : rays) {
+        ray.origin = eye;
+        ray.direction = glm::normalize(glm::vec3(target(rng), target(rng), target(rng)) - eye);
+    }
+    size_t bvh_hits = 0;
+    double bvh_ray_ms = measureMs([&] {
+        for (const Ray& ray : rays) {
+            bvh_hits += bvh.raycast(ray, 1e9f).has_value();
+        }
+    });
+    // Linear ray casts are slow at the top end, so they use a tenth of the rays.
+    double linear_ray_ms = measureMs([&] {
+        for (int r = 0; r < kRayCount / 10; ++r) {
+            const Ray& ray = rays[r];
+            glm::vec3 inv_direction = 1.0f / ray.direction;
+            float best = 1e9f;
+            for (const BoundingBox& box : boxes) {
+                float t;
+                if (intersectRay(box, ray, inv_direction, best, t)) {
+                    best = t;
+                }
+            }
+        }
+    }) * 10.0;
+
+    if (bvh_visible != linear_visible) {
+        std::fprintf(stderr, "Frustum query mismatch: bvh %zu, linear %zu\n", bvh_visible, linear_visible);
+    }
+
+    std::printf("%9zu %9.2f %9.3f %9.3f %9.2f %11.3f %11.3f %9zu %11.4f %11.4f %11.2f %11.2f\n",
+                object_count, build_ms, refit_ms, churn_ms, rebuild_ms,
+                bvh_frustum_ms, linear_frustum_ms, bvh_visible,
+                bvh_sphere_ms, linear_sphere_ms,
+                bvh_ray_ms, linear_ray_ms);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t max_object_count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    std::printf("All times in ms. Frustum and sphere queries are per query, rays are per %d casts.\n", kRayCount);
+    std::printf("%9s %9s %9s %9s %9s %11s %11s %9s %11s %11s %11s %11s\n",
+                "objects", "build", "refit1%", "churn1%", "rebuild", "bvh-frust", "simd-frust", "visible",
+                "bvh-sphere", "lin-sphere", "bvh-rays", "lin-rays");
+    for (size_t count = 1000; count <= max_object_count; count *= 10) {
+        runBenchmark(count);
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "main/camera.h"
 
 #include <algorithm>
+#include <cmath>
 
 glm::mat4 Camera::getPerspectiveMatrix() const {
     return perspective_matrix_;
@@ -39,10 +40,29 @@ void Camera::rotateBy(float d_yaw_, float d_pitch_) {
     computeDirection();
 }
 
+void Camera::lookAt(const glm::vec3& position, const glm::vec3& target) {
+    camera_pos_ = position;
+    glm::vec3 direction = glm::normalize(target - position);
+    pitch_ = std::clamp(glm::degrees(std::asin(direction.y)), -89.9f, 89.9f);
+    yaw_ = glm::degrees(std::atan2(direction.z, direction.x));
+    computeDirection();
+}
+
 glm::vec3 Camera::getPosition() const {
     return camera_pos_;
 }
 
+Ray Camera::getRay(float u, float v) const {
+    // The viewport is flipped, so NDC y points up like in OpenGL.
+    glm::mat4 inv_view_projection = glm::inverse(perspective_matrix_ * getViewMatrix());
+    glm::vec4 near_point = inv_view_projection * glm::vec4(2.0f * u - 1.0f, 1.0f - 2.0f * v, 0.0f, 1.0f);
+    glm::vec4 far_point = inv_view_projection * glm::vec4(2.0f * u - 1.0f, 1.0f - 2.0f * v, 1.0f, 1.0f);
+
+    glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+    glm::vec3 target = glm::vec3(far_point) / far_point.w;
+    return {origin, glm::normalize(target - origin)};
+}
+
 void Camera::computeDirection() {
     glm::vec3 direction;
     direction.x = std::cos(glm::radians(yaw_)) * std::cos(glm::radians(pitch_));
@@ -6,6 +6,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "main/bounds.h"
+
 class Camera {
 public:
     glm::mat4 getPerspectiveMatrix() const;
@@ -15,7 +17,11 @@ public:
     void setScreenSize(size_t width, size_t height);
     void move(float dx, float dy);
     void rotateBy(float d_yaw_, float d_pitch_);
+    // Places the camera, later moves and rotations continue from there.
+    void lookAt(const glm::vec3& position, const glm::vec3& target);
     glm::vec3 getPosition() const;
+    // World-space ray through a point on the screen, in [0, 1] from the top left corner.
+    Ray getRay(float u, float v) const;
 
 private:
     void computeDirection();
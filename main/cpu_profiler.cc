@@ -0,0 +1,159 @@
+#include "main/cpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Zone {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+// Single producer ring: only the owning thread writes, writeChromeTrace reads
+// up to the published head.
+struct ZoneBuffer {
+    std::vector<Zone> zones = std::vector<Zone>(kCpuProfilerRingSize);
+    std::atomic<uint64_t> head{0};
+    uint32_t track_id = 0;
+    std::string name;
+
+    void push(const Zone& zone) {
+        uint64_t index = head.load(std::memory_order_relaxed);
+        zones[index & (kCpuProfilerRingSize - 1)] = zone;
+        head.store(index + 1, std::memory_order_release);
+    }
+};
+
+static_assert((kCpuProfilerRingSize & (kCpuProfilerRingSize - 1)) == 0, "The ring size must be a power of two");
+
+// The GPU track comes first in the trace.
+constexpr uint32_t kGpuTrackId = 0;
+
+// Buffers outlive their threads, so zones of finished threads still make it into the trace.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ZoneBuffer>> buffers;
+    std::shared_ptr<ZoneBuffer> gpu_buffer;
+};
+
+Registry& getRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+std::chrono::steady_clock::time_point getEpoch() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+// Taken during static initialization, so the epoch is the start of the process.
+[[maybe_unused]] const std::chrono::steady_clock::time_point kProcessStart = getEpoch();
+
+std::shared_ptr<ZoneBuffer> createBuffer(uint32_t track_id, std::string name) {
+    auto buffer = std::make_shared<ZoneBuffer>();
+    buffer->track_id = track_id;
+    buffer->name = std::move(name);
+    return buffer;
+}
+
+ZoneBuffer& getThreadBuffer() {
+    thread_local ZoneBuffer* buffer = nullptr;
+    if (!buffer) {
+        Registry& registry = getRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        uint32_t track_id = static_cast<uint32_t>(registry.buffers.size()) + 1;
+        registry.buffers.push_back(createBuffer(track_id, "thread " + std::to_string(track_id)));
+        buffer = registry.buffers.back().get();
+    }
+    return *buffer;
+}
+
+ZoneBuffer& getGpuBuffer() {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (!registry.gpu_buffer) {
+        registry.gpu_buffer = createBuffer(kGpuTrackId, "GPU");
+    }
+    return *registry.gpu_buffer;
+}
+
+void writeEscaped(std::ostream& out, const char* text) {
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') {
+            out << '\\';
+        }
+        out << *text;
+    }
+}
+
+void writeBuffer(std::ostream& out, const ZoneBuffer& buffer, bool& first) {
+    out << (first ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer.track_id << R"(,"args":{"name":")";
+    writeEscaped(out, buffer.name.c_str());
+    out << R"("}})";
+    first = false;
+
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(head, kCpuProfilerRingSize);
+    for (uint64_t i = head - count; i < head; ++i) {
+        const Zone& zone = buffer.zones[i & (kCpuProfilerRingSize - 1)];
+        // Trace times are in microseconds.
+        out << ",\n" << R"({"name":")";
+        writeEscaped(out, zone.name);
+        out << R"(","ph":"X","pid":1,"tid":)" << buffer.track_id
+            << R"(,"ts":)" << static_cast<double>(zone.begin_ns) / 1e3
+            << R"(,"dur":)" << static_cast<double>(zone.end_ns - zone.begin_ns) / 1e3 << "}";
+    }
+}
+
+}  // namespace
+
+uint64_t profilerNow() {
+    return profilerTime(std::chrono::steady_clock::now());
+}
+
+uint64_t profilerTime(std::chrono::steady_clock::time_point time) {
+    std::chrono::steady_clock::time_point epoch = getEpoch();
+    return time > epoch ? std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count() : 0;
+}
+
+void recordCpuZone(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    getThreadBuffer().push({name, begin_ns, end_ns});
+}
+
+void setProfilerThreadName(const char* name) {
+    ZoneBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(getRegistry().mutex);
+    buffer.name = name;
+}
+
+void recordGpuZone(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    static ZoneBuffer& buffer = getGpuBuffer();
+    buffer.push({name, begin_ns, end_ns});
+}
+
+bool writeChromeTrace(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    file.precision(15);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    if (registry.gpu_buffer) {
+        writeBuffer(file, *registry.gpu_buffer, first);
+    }
+    for (const std::shared_ptr<ZoneBuffer>& buffer : registry.buffers) {
+        writeBuffer(file, *buffer, first);
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return file.good();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// CPU zone profiler. Zones are recorded with the PROFILE_SCOPE macros into a
+// ring buffer per thread and written out as Chrome trace events, viewable in
+// Perfetto or chrome://tracing.
+// Zones are only recorded in builds with KV3D_PROFILE defined, see the
+// :profile config setting in main/BUILD (bazel build --define=profile=1).
+// Without it the macros expand to nothing and a trace holds no CPU zones.
+#ifdef KV3D_PROFILE
+constexpr inline bool kCpuProfilerEnabled = true;
+#else
+constexpr inline bool kCpuProfilerEnabled = false;
+#endif
+
+// Zones a thread keeps, older ones are overwritten.
+constexpr inline uint32_t kCpuProfilerRingSize = 1u << 16;
+
+// Nanoseconds on the steady clock since the profiler's epoch, the start of the process.
+uint64_t profilerNow();
+uint64_t profilerTime(std::chrono::steady_clock::time_point time);
+
+// Records a finished zone on the calling thread. The thread's buffer is
+// created on its first zone, after that recording takes no locks. name must
+// outlive the trace, string literals are expected.
+void recordCpuZone(const char* name, uint64_t begin_ns, uint64_t end_ns);
+// Names the calling thread's track in the trace.
+void setProfilerThreadName(const char* name);
+// Records a zone on the GPU track, only the thread collecting GPU results may
+// call it. Times are on the CPU timeline, see GpuProfiler::getLastFrameScopes.
+void recordGpuZone(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+// Writes every recorded zone as Chrome trace-event JSON. Zones recorded
+// while it runs may be missing or, in the oldest slots, torn. Returns false
+// when the file cannot be written.
+bool writeChromeTrace(const std::string& path);
+
+class CpuProfileZone {
+public:
+    explicit CpuProfileZone(const char* name) : name_(name), begin_ns_(profilerNow()) {}
+    ~CpuProfileZone() {
+        recordCpuZone(name_, begin_ns_, profilerNow());
+    }
+    CpuProfileZone(const CpuProfileZone&) = delete;
+    CpuProfileZone& operator =(const CpuProfileZone&) = delete;
+
+private:
+    const char* name_;
+    uint64_t begin_ns_;
+};
+
+#ifdef KV3D_PROFILE
+#define KV3D_PROFILE_CONCAT_(a, b) a##b
+#define KV3D_PROFILE_CONCAT(a, b) KV3D_PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) CpuProfileZone KV3D_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#define PROFILE_THREAD(name) setProfilerThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
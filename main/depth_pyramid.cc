@@ -0,0 +1,361 @@
+#include "main/depth_pyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace {
+
+// Level 0 texels covered by one workgroup along each axis, must match depth_pyramid.comp.
+constexpr uint32_t kPyramidTileSize = 32;
+
+uint32_t previousPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while (result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+}  // namespace
+
+bool DepthPyramid::isSupported(const VulkanDevice& device) {
+    return device.getEnabledFeatures().shaderStorageImageArrayDynamicIndexing;
+}
+
+void DepthPyramid::init(VulkanDevice* device, const std::vector<char>& shader_code) {
+    device_ = device;
+    createPipeline(shader_code);
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = static_cast<float>(kMaxDepthPyramidLevels);
+
+    if (vkCreateSampler(*device_, &sampler_info, nullptr, &sampler_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid sampler!");
+    }
+
+    counter_buffer_.size = sizeof(uint32_t);
+    counter_buffer_.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    counter_buffer_.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    counter_buffer_.device = *device_;
+    device_->createBuffer(counter_buffer_);
+    counter_buffer_.map();
+    // The last workgroup of every build resets it.
+    *static_cast<uint32_t*>(counter_buffer_.mapped) = 0;
+}
+
+void DepthPyramid::createPipeline(const std::vector<char>& shader_code) {
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorCount = 1;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorCount = kMaxDepthPyramidLevels;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorCount = 1;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(*device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(DepthPyramidPushConstant);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader_code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(*device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout_;
+
+    VkResult result = vkCreateComputePipelines(*device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(*device_, shader_module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline!");
+    }
+}
+
+void DepthPyramid::destroy() {
+    if (device_ == nullptr) {
+        return;
+    }
+
+    destroyPyramid();
+    counter_buffer_.unmap();
+    counter_buffer_.destroy();
+    counter_buffer_ = Buffer{};
+    vkDestroySampler(*device_, sampler_, nullptr);
+    vkDestroyPipeline(*device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(*device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(*device_, descriptor_set_layout_, nullptr);
+    sampler_ = VK_NULL_HANDLE;
+    pipeline_ = VK_NULL_HANDLE;
+    pipeline_layout_ = VK_NULL_HANDLE;
+    descriptor_set_layout_ = VK_NULL_HANDLE;
+    device_ = nullptr;
+}
+
+void DepthPyramid::resize(VkImageView depth_view, VkExtent2D depth_extent) {
+    retirePyramid();
+
+    depth_extent_ = depth_extent;
+    rendered_extent_ = depth_extent;
+    extent_.width = previousPowerOfTwo(std::max(depth_extent.width, 1u));
+    extent_.height = previousPowerOfTwo(std::max(depth_extent.height, 1u));
+    level_count_ = 1;
+    while ((std::max(extent_.width, extent_.height) >> level_count_) > 0) {
+        ++level_count_;
+    }
+    level_count_ = std::min(level_count_, kMaxDepthPyramidLevels);
+    group_count_x_ = (extent_.width + kPyramidTileSize - 1) / kPyramidTileSize;
+    group_count_y_ = (extent_.height + kPyramidTileSize - 1) / kPyramidTileSize;
+
+    createPyramid(depth_view);
+}
+
+void DepthPyramid::setRenderedExtent(VkExtent2D extent) {
+    rendered_extent_.width = std::clamp(extent.width, 1u, std::max(depth_extent_.width, 1u));
+    rendered_extent_.height = std::clamp(extent.height, 1u, std::max(depth_extent_.height, 1u));
+}
+
+void DepthPyramid::createPyramid(VkImageView depth_view) {
+    device_->createImage(extent_.width, extent_.height, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+                         VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         image_, image_memory_, level_count_);
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image_;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = VK_FORMAT_R32_SFLOAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = level_count_;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+    VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &view_));
+
+    level_views_.resize(level_count_);
+    for (uint32_t level = 0; level < level_count_; ++level) {
+        view_info.subresourceRange.baseMipLevel = level;
+        view_info.subresourceRange.levelCount = 1;
+        VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &level_views_[level]));
+    }
+
+    // Moved to the general layout by the first build.
+    layout_pending_ = true;
+
+    std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = 1;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[1].descriptorCount = kMaxDepthPyramidLevels;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = 1;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &descriptor_set_layout_;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, &descriptor_set_));
+
+    VkDescriptorImageInfo depth_info{};
+    depth_info.sampler = sampler_;
+    depth_info.imageView = depth_view;
+    depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    // Unused array slots repeat the last level, every descriptor has to be valid.
+    std::array<VkDescriptorImageInfo, kMaxDepthPyramidLevels> level_infos{};
+    for (uint32_t level = 0; level < kMaxDepthPyramidLevels; ++level) {
+        level_infos[level].imageView = level_views_[std::min(level, level_count_ - 1)];
+        level_infos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkDescriptorBufferInfo counter_info{};
+    counter_info.buffer = counter_buffer_.buffer;
+    counter_info.offset = 0;
+    counter_info.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
+    for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding) {
+        descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_writes[binding].dstSet = descriptor_set_;
+        descriptor_writes[binding].dstBinding = binding;
+        descriptor_writes[binding].dstArrayElement = 0;
+    }
+    descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_writes[0].descriptorCount = 1;
+    descriptor_writes[0].pImageInfo = &depth_info;
+    descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptor_writes[1].descriptorCount = kMaxDepthPyramidLevels;
+    descriptor_writes[1].pImageInfo = level_infos.data();
+    descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_writes[2].descriptorCount = 1;
+    descriptor_writes[2].pBufferInfo = &counter_info;
+
+    vkUpdateDescriptorSets(*device_, descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+}
+
+void DepthPyramid::destroyPyramid() {
+    if (descriptor_pool_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+        descriptor_pool_ = VK_NULL_HANDLE;
+        descriptor_set_ = VK_NULL_HANDLE;
+    }
+    for (VkImageView level_view : level_views_) {
+        vkDestroyImageView(*device_, level_view, nullptr);
+    }
+    level_views_.clear();
+    if (view_ != VK_NULL_HANDLE) {
+        vkDestroyImageView(*device_, view_, nullptr);
+        vkDestroyImage(*device_, image_, nullptr);
+        vkFreeMemory(*device_, image_memory_, nullptr);
+        view_ = VK_NULL_HANDLE;
+        image_ = VK_NULL_HANDLE;
+        image_memory_ = VK_NULL_HANDLE;
+    }
+    level_count_ = 0;
+}
+
+void DepthPyramid::retirePyramid() {
+    if (!isReady()) {
+        return;
+    }
+
+    // Frames in flight may still build or sample the old pyramid.
+    VkDevice device = *device_;
+    device_->retire([device, descriptor_pool = descriptor_pool_, level_views = level_views_, view = view_, image = image_, image_memory = image_memory_]() {
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        for (VkImageView level_view : level_views) {
+            vkDestroyImageView(device, level_view, nullptr);
+        }
+        vkDestroyImageView(device, view, nullptr);
+        vkDestroyImage(device, image, nullptr);
+        vkFreeMemory(device, image_memory, nullptr);
+    });
+    descriptor_pool_ = VK_NULL_HANDLE;
+    descriptor_set_ = VK_NULL_HANDLE;
+    level_views_.clear();
+    view_ = VK_NULL_HANDLE;
+    image_ = VK_NULL_HANDLE;
+    image_memory_ = VK_NULL_HANDLE;
+    level_count_ = 0;
+}
+
+void DepthPyramid::build(VkCommandBuffer command_buffer) {
+    if (layout_pending_) {
+        // Storage writes and sampled reads share the image, it never leaves the general layout.
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image_;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = level_count_;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        layout_pending_ = false;
+    }
+
+    // Reads of the previous pyramid by the culling shader have to finish
+    // before it is rewritten. The depth buffer is synchronized by the caller.
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    DepthPyramidPushConstant push_constant{};
+    push_constant.depth_width = rendered_extent_.width;
+    push_constant.depth_height = rendered_extent_.height;
+    push_constant.width = extent_.width;
+    push_constant.height = extent_.height;
+    push_constant.level_count = level_count_;
+    push_constant.group_count = group_count_x_ * group_count_y_;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &descriptor_set_, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstant), &push_constant);
+    vkCmdDispatch(command_buffer, group_count_x_, group_count_y_, 1);
+
+    VkMemoryBarrier pyramid_barrier{};
+    pyramid_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    pyramid_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    pyramid_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &pyramid_barrier, 0, nullptr, 0, nullptr);
+}
+
+bool DepthPyramid::isReady() const {
+    return view_ != VK_NULL_HANDLE;
+}
+
+VkImageView DepthPyramid::getView() const {
+    return view_;
+}
+
+VkSampler DepthPyramid::getSampler() const {
+    return sampler_;
+}
+
+VkExtent2D DepthPyramid::getExtent() const {
+    return extent_;
+}
+
+uint32_t DepthPyramid::getLevelCount() const {
+    return level_count_;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <vector>
+
+// Upper bound on the pyramid levels. Must match the levels array in depth_pyramid.comp.
+constexpr inline uint32_t kMaxDepthPyramidLevels = 16;
+
+struct DepthPyramidPushConstant {
+    uint32_t depth_width;
+    uint32_t depth_height;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t group_count;
+};
+
+// Hierarchical-Z buffer: a mip chain of the depth buffer where every texel holds
+// the farthest depth of the area it covers, so a single texel fetch bounds the
+// depth behind any screen rectangle of a matching size. Level 0 is the depth
+// buffer scaled down to a power of two, which keeps every further level an
+// exact 2x2 reduction.
+// The whole chain is built with one compute dispatch, see depth_pyramid.comp.
+class DepthPyramid {
+public:
+    // Needs shaderStorageImageArrayDynamicIndexing.
+    static bool isSupported(const VulkanDevice& device);
+
+    void init(VulkanDevice* device, const std::vector<char>& shader_code);
+    void destroy();
+    // Recreates the pyramid for a depth buffer. The depth image must have been
+    // created with VK_IMAGE_USAGE_SAMPLED_BIT. The old pyramid is destroyed once
+    // the frames in flight are done with it, see VulkanDevice::retire.
+    void resize(VkImageView depth_view, VkExtent2D depth_extent);
+    // The top-left part of the depth buffer drawn into when rendering below
+    // its resolution, the pyramid then covers only that part. Clamped to the
+    // depth extent, resize resets it to the whole buffer.
+    void setRenderedExtent(VkExtent2D extent);
+
+    // Must be recorded outside of a render pass, with the depth buffer's writes
+    // made visible to compute shader reads and the image in
+    // VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, as a render graph pass
+    // sampling it does.
+    void build(VkCommandBuffer command_buffer);
+
+    bool isReady() const;
+    // All levels, in VK_IMAGE_LAYOUT_GENERAL.
+    VkImageView getView() const;
+    VkSampler getSampler() const;
+    VkExtent2D getExtent() const;
+    uint32_t getLevelCount() const;
+
+private:
+    void createPipeline(const std::vector<char>& shader_code);
+    void createPyramid(VkImageView depth_view);
+    void destroyPyramid();
+    void retirePyramid();
+
+    VulkanDevice* device_ = nullptr;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+
+    VkImage image_ = VK_NULL_HANDLE;
+    VkDeviceMemory image_memory_ = VK_NULL_HANDLE;
+    VkImageView view_ = VK_NULL_HANDLE;
+    std::vector<VkImageView> level_views_;
+    // The image is still in VK_IMAGE_LAYOUT_UNDEFINED, build() transitions it.
+    bool layout_pending_ = false;
+    // Workgroups that finished their tile, the last one reduces the top levels.
+    Buffer counter_buffer_;
+
+    VkExtent2D depth_extent_{};
+    VkExtent2D rendered_extent_{};
+    VkExtent2D extent_{};
+    uint32_t level_count_ = 0;
+    uint32_t group_count_x_ = 0;
+    uint32_t group_count_y_ = 0;
+};
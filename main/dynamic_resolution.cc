@@ -0,0 +1,39 @@
+#include "main/dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Weight of a new sample in the full resolution estimate.
+constexpr double kSmoothing = 0.1;
+// Aims below the target, frame times spike above their average.
+constexpr double kHeadroom = 0.9;
+// Largest change of the scale per sample, and the smallest one made.
+constexpr float kMaxStep = 0.02f;
+constexpr float kDeadBand = 0.01f;
+
+}  // namespace
+
+DynamicResolution::DynamicResolution(double target_ms, float min_scale, float max_scale)
+    : target_ms_(target_ms), min_scale_(min_scale), max_scale_(std::max(max_scale, min_scale)), scale_(max_scale_) {}
+
+void DynamicResolution::addSample(double gpu_ms, float scale) {
+    double full_ms = gpu_ms / std::max(static_cast<double>(scale) * scale, 1e-4);
+    full_resolution_ms_ = full_resolution_ms_ == 0.0 ? full_ms : full_resolution_ms_ + (full_ms - full_resolution_ms_) * kSmoothing;
+
+    float wanted = static_cast<float>(std::sqrt(target_ms_ * kHeadroom / full_resolution_ms_));
+    wanted = std::clamp(wanted, min_scale_, max_scale_);
+    float step = std::clamp(wanted - scale_, -kMaxStep, kMaxStep);
+    if (std::abs(wanted - scale_) >= kDeadBand || wanted == min_scale_ || wanted == max_scale_) {
+        scale_ += step;
+    }
+}
+
+float DynamicResolution::getScale() const {
+    return scale_;
+}
+
+double DynamicResolution::getFullResolutionMs() const {
+    return full_resolution_ms_;
+}
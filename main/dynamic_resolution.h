@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+// Picks the render scale per axis from measured GPU frame times. GPU time is
+// modeled as proportional to the rendered area, so every sample, divided by
+// the area of the frame it measured, estimates the cost of a full resolution
+// frame. The scale then heads for the area that fits the target, in limited
+// steps and only past a dead band, since a frame is measured several frames
+// after it was recorded and single frames are noisy.
+class DynamicResolution {
+public:
+    DynamicResolution(double target_ms, float min_scale, float max_scale = 1.0f);
+
+    // gpu_ms of a completed frame rendered at scale.
+    void addSample(double gpu_ms, float scale);
+    float getScale() const;
+    // Full resolution GPU time as currently estimated, 0 before any sample.
+    double getFullResolutionMs() const;
+
+private:
+    double target_ms_;
+    float min_scale_;
+    float max_scale_;
+    float scale_;
+    double full_resolution_ms_ = 0.0;
+};
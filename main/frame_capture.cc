@@ -0,0 +1,212 @@
+#include "main/frame_capture.h"
+
+#include "main/cpu_profiler.h"
+#include "main/image_writer.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+bool FrameCapture::isFormatSupported(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void FrameCapture::init(VulkanDevice* device) {
+    device_ = device;
+    slots_.resize(device_->getFramesInFlight());
+    stopping_ = false;
+    encoder_ = std::thread(&FrameCapture::encoderLoop, this);
+}
+
+void FrameCapture::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    encoder_.join();
+
+    for (Slot& slot : slots_) {
+        slot.buffer.unmap();
+        slot.buffer.destroy();
+    }
+    slots_.clear();
+    free_pixels_.clear();
+    device_ = nullptr;
+}
+
+bool FrameCapture::isReady() const {
+    return !slots_.empty();
+}
+
+void FrameCapture::setCallback(CaptureCallback callback) {
+    callback_ = std::move(callback);
+}
+
+// Host cached memory makes reading the pixels back a plain memcpy, uncached
+// reads are several times slower. Coherent memory is the fallback every
+// implementation has.
+void FrameCapture::createSlotBuffer(Slot& slot, VkDeviceSize size) {
+    slot.buffer.unmap();
+    slot.buffer.destroy();
+    slot.buffer = Buffer{};
+    slot.buffer.size = size;
+    slot.buffer.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    slot.buffer.device = *device_;
+    slot.buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    try {
+        device_->createBuffer(slot.buffer);
+    } catch (const std::runtime_error&) {
+        slot.buffer.destroy();
+        slot.buffer.buffer = VK_NULL_HANDLE;
+        slot.buffer.memory = VK_NULL_HANDLE;
+        slot.buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        device_->createBuffer(slot.buffer);
+    }
+    slot.buffer.map();
+}
+
+void FrameCapture::record(VkCommandBuffer command_buffer, uint32_t frame, VkImage image, VkFormat format, VkExtent2D extent,
+                          uint64_t frame_number, std::string path) {
+    if (!isFormatSupported(format)) {
+        throw std::runtime_error("Unsupported capture format!");
+    }
+
+    // The frame's fence was waited for before recording it, so the buffer is
+    // idle and can be replaced right away when the extent grew.
+    Slot& slot = slots_[frame];
+    VkDeviceSize size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    if (slot.buffer.size < size) {
+        createSlotBuffer(slot, size);
+    }
+    slot.pending = true;
+    slot.swizzle = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    slot.extent = extent;
+    slot.frame_number = frame_number;
+    slot.path = std::move(path);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer.buffer, 1, &region);
+
+    VkBufferMemoryBarrier buffer_barrier{};
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = slot.buffer.buffer;
+    buffer_barrier.offset = 0;
+    buffer_barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0, nullptr);
+}
+
+// Only the copy out of the mapped buffer happens here, the swizzle and the
+// encoding are left to the encoder thread.
+void FrameCapture::collect(uint32_t frame) {
+    Slot& slot = slots_[frame];
+    if (!slot.pending) {
+        return;
+    }
+    slot.pending = false;
+    PROFILE_SCOPE("FrameCapture::collect");
+
+    QueuedCapture capture;
+    CapturedFrame& captured = capture.frame;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= kMaxQueuedCaptures) {
+            ++dropped_;
+            return;
+        }
+        if (!free_pixels_.empty()) {
+            captured.pixels = std::move(free_pixels_.back());
+            free_pixels_.pop_back();
+        }
+    }
+
+    captured.frame_number = slot.frame_number;
+    captured.width = slot.extent.width;
+    captured.height = slot.extent.height;
+    captured.path = std::move(slot.path);
+    size_t size = static_cast<size_t>(slot.extent.width) * slot.extent.height * 4;
+    captured.pixels.resize(size);
+    std::memcpy(captured.pixels.data(), slot.buffer.mapped, size);
+    capture.swizzle = slot.swizzle;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(capture));
+    }
+    wake_.notify_one();
+}
+
+void FrameCapture::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return queue_.empty() && !encoding_; });
+}
+
+uint32_t FrameCapture::getDroppedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+void FrameCapture::encoderLoop() {
+    PROFILE_THREAD("capture encoder");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        QueuedCapture capture = std::move(queue_.front());
+        queue_.pop_front();
+        encoding_ = true;
+        lock.unlock();
+
+        encode(capture);
+
+        lock.lock();
+        free_pixels_.push_back(std::move(capture.frame.pixels));
+        encoding_ = false;
+        idle_.notify_all();
+    }
+}
+
+// Errors are reported and the capture skipped, the encoder keeps running.
+void FrameCapture::encode(QueuedCapture& capture) {
+    PROFILE_SCOPE("FrameCapture::encode");
+    CapturedFrame& frame = capture.frame;
+    if (capture.swizzle) {
+        for (size_t i = 0; i < frame.pixels.size(); i += 4) {
+            std::swap(frame.pixels[i], frame.pixels[i + 2]);
+        }
+    }
+
+    try {
+        if (callback_) {
+            callback_(frame);
+        } else if (!frame.path.empty()) {
+            writeImage(frame.path, frame.width, frame.height, frame.pixels.data());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Capture of frame " << frame.frame_number << " failed: " << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Captures waiting for the encoder, further ones are dropped instead of
+// stalling the frame loop.
+constexpr inline uint32_t kMaxQueuedCaptures = 8;
+
+struct CapturedFrame {
+    // The number the capture was requested with.
+    uint64_t frame_number = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // RGBA8, tightly packed with the top row first.
+    std::vector<uint8_t> pixels;
+    // Where the image is written, empty when it only goes to the callback.
+    std::string path;
+};
+
+// Called on the encoder thread, the pixels are only valid during the call.
+using CaptureCallback = std::function<void(const CapturedFrame& frame)>;
+
+// Frame readback without stalls. The copy of a frame's color image into a
+// host-visible buffer is recorded into the frame itself; every frame in flight
+// has its own buffer, which is read once the frame's fence has signaled and
+// handed to a background thread that writes the image or runs the callback.
+class FrameCapture {
+public:
+    // 8-bit RGBA and BGRA formats, UNORM or SRGB.
+    static bool isFormatSupported(VkFormat format);
+
+    void init(VulkanDevice* device);
+    // Writes out what is still queued, then stops the encoder thread.
+    void destroy();
+    bool isReady() const;
+    // Replaces writing images. Set before capturing.
+    void setCallback(CaptureCallback callback);
+
+    // Copies image into the frame's buffer. The image must be in
+    // VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL with its writes visible to transfer
+    // reads, as in a render graph pass using it as a transfer source. collect
+    // must have been called for the frame since its previous capture. path may
+    // be empty with a callback.
+    void record(VkCommandBuffer command_buffer, uint32_t frame, VkImage image, VkFormat format, VkExtent2D extent,
+                uint64_t frame_number, std::string path);
+    // Queues the frame's capture for the encoder, to be called once its fence
+    // has signaled. Does nothing when the frame recorded no capture.
+    void collect(uint32_t frame);
+    // Blocks until everything queued has been written.
+    void flush();
+    // Captures dropped because the encoder fell behind.
+    uint32_t getDroppedCount() const;
+
+private:
+    struct Slot {
+        Buffer buffer;
+        bool pending = false;
+        bool swizzle = false;
+        VkExtent2D extent{};
+        uint64_t frame_number = 0;
+        std::string path;
+    };
+
+    struct QueuedCapture {
+        CapturedFrame frame;
+        // BGRA pixels, swapped to RGBA by the encoder.
+        bool swizzle;
+    };
+
+    void createSlotBuffer(Slot& slot, VkDeviceSize size);
+    void encoderLoop();
+    void encode(QueuedCapture& capture);
+
+    VulkanDevice* device_ = nullptr;
+    std::vector<Slot> slots_;
+    CaptureCallback callback_;
+
+    std::thread encoder_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<QueuedCapture> queue_;
+    // Pixel storage handed back by the encoder, reused to avoid reallocating.
+    std::vector<std::vector<uint8_t>> free_pixels_;
+    bool encoding_ = false;
+    bool stopping_ = false;
+    uint32_t dropped_ = 0;
+};
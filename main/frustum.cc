@@ -0,0 +1,30 @@
+#include "main/frustum.h"
+
+Frustum Frustum::fromMatrix(const glm::mat4& m) {
+    // GLM matrices are column-major, so row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    auto row = [&m](int i) {
+        return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+
+    Frustum frustum;
+    frustum.planes[kLeft] = row(3) + row(0);
+    frustum.planes[kRight] = row(3) - row(0);
+    frustum.planes[kBottom] = row(3) + row(1);
+    frustum.planes[kTop] = row(3) - row(1);
+    frustum.planes[kNear] = row(2);
+    frustum.planes[kFar] = row(3) - row(2);
+
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+
+// View frustum as six inward-facing planes (xyz - normal, w - distance).
+// Points inside the frustum have a non-negative distance to every plane.
+struct Frustum {
+    enum Plane {
+        kLeft = 0,
+        kRight,
+        kBottom,
+        kTop,
+        kNear,
+        kFar,
+        kPlaneCount
+    };
+
+    std::array<glm::vec4, kPlaneCount> planes;
+
+    // Extracts the planes from a projection * view matrix with a [0, 1] depth range.
+    static Frustum fromMatrix(const glm::mat4& view_projection);
+
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
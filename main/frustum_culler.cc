@@ -0,0 +1,180 @@
+#include "main/frustum_culler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KV3D_CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KV3D_CULL_SSE2
+#endif
+
+void FrustumCuller::resize(size_t count) {
+    count_ = count;
+    for (std::vector<float>* values : {&sphere_x_, &sphere_y_, &sphere_z_, &sphere_radius_,
+                                       &box_center_x_, &box_center_y_, &box_center_z_,
+                                       &box_extent_x_, &box_extent_y_, &box_extent_z_}) {
+        values->resize(count);
+    }
+}
+
+void FrustumCuller::setBounds(size_t index, const glm::vec4& sphere, const BoundingBox& box) {
+    sphere_x_[index] = sphere.x;
+    sphere_y_[index] = sphere.y;
+    sphere_z_[index] = sphere.z;
+    sphere_radius_[index] = sphere.w;
+
+    glm::vec3 center = box.center();
+    glm::vec3 extents = box.extents();
+    box_center_x_[index] = center.x;
+    box_center_y_[index] = center.y;
+    box_center_z_[index] = center.z;
+    box_extent_x_[index] = extents.x;
+    box_extent_y_[index] = extents.y;
+    box_extent_z_[index] = extents.z;
+}
+
+void FrustumCuller::remove(size_t index) {
+    size_t last = count_ - 1;
+    for (std::vector<float>* values : {&sphere_x_, &sphere_y_, &sphere_z_, &sphere_radius_,
+                                       &box_center_x_, &box_center_y_, &box_center_z_,
+                                       &box_extent_x_, &box_extent_y_, &box_extent_z_}) {
+        (*values)[index] = (*values)[last];
+        values->pop_back();
+    }
+    count_ = last;
+}
+
+size_t FrustumCuller::size() const {
+    return count_;
+}
+
+void FrustumCuller::cullScalar(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& visible) const {
+    for (size_t i = begin; i < end; ++i) {
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            float sphere_distance = plane.x * sphere_x_[i] + plane.y * sphere_y_[i] + plane.z * sphere_z_[i] + plane.w;
+            // Distance of the box corner furthest along the plane normal.
+            float box_distance = plane.x * box_center_x_[i] + plane.y * box_center_y_[i] + plane.z * box_center_z_[i] + plane.w
+                + std::abs(plane.x) * box_extent_x_[i] + std::abs(plane.y) * box_extent_y_[i] + std::abs(plane.z) * box_extent_z_[i];
+            if (sphere_distance < -sphere_radius_[i] || box_distance < 0.0f) {
+                inside = false;
+                break;
+            }
+        }
+        if (inside) {
+            visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const {
+    visible.clear();
+    cullRange(frustum, 0, count_, visible);
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<uint32_t>& visible, JobSystem& jobs) {
+    size_t chunk_count = (count_ + kChunkSize - 1) / kChunkSize;
+    if (chunk_count <= 1 || jobs.getThreadCount() == 1) {
+        cull(frustum, visible);
+        return;
+    }
+    chunk_visible_.resize(chunk_count);
+    jobs.parallelFor(static_cast<uint32_t>(chunk_count), [&](uint32_t chunk) {
+        std::vector<uint32_t>& chunk_visible = chunk_visible_[chunk];
+        chunk_visible.clear();
+        cullRange(frustum, chunk * kChunkSize, std::min(count_, (chunk + 1) * kChunkSize), chunk_visible);
+    });
+    visible.clear();
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        visible.insert(visible.end(), chunk_visible_[chunk].begin(), chunk_visible_[chunk].end());
+    }
+}
+
+void FrustumCuller::cullRange(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& visible) const {
+    size_t i = begin;
+
+#if defined(KV3D_CULL_AVX2)
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= end; i += 8) {
+        __m256 sx = _mm256_loadu_ps(&sphere_x_[i]);
+        __m256 sy = _mm256_loadu_ps(&sphere_y_[i]);
+        __m256 sz = _mm256_loadu_ps(&sphere_z_[i]);
+        __m256 neg_radius = _mm256_xor_ps(_mm256_loadu_ps(&sphere_radius_[i]), sign_mask);
+        __m256 bx = _mm256_loadu_ps(&box_center_x_[i]);
+        __m256 by = _mm256_loadu_ps(&box_center_y_[i]);
+        __m256 bz = _mm256_loadu_ps(&box_center_z_[i]);
+        __m256 ex = _mm256_loadu_ps(&box_extent_x_[i]);
+        __m256 ey = _mm256_loadu_ps(&box_extent_y_[i]);
+        __m256 ez = _mm256_loadu_ps(&box_extent_z_[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m256 nx = _mm256_set1_ps(plane.x);
+            __m256 ny = _mm256_set1_ps(plane.y);
+            __m256 nz = _mm256_set1_ps(plane.z);
+            __m256 w = _mm256_set1_ps(plane.w);
+
+            __m256 sphere_distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, sx), _mm256_mul_ps(ny, sy)), _mm256_add_ps(_mm256_mul_ps(nz, sz), w));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(sphere_distance, neg_radius, _CMP_GE_OQ));
+
+            __m256 box_distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, bx), _mm256_mul_ps(ny, by)), _mm256_add_ps(_mm256_mul_ps(nz, bz), w));
+            __m256 box_radius = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex),
+                _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(box_distance, box_radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+            if (mask & 1) {
+                visible.push_back(static_cast<uint32_t>(i + lane));
+            }
+        }
+    }
+#elif defined(KV3D_CULL_SSE2)
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= end; i += 4) {
+        __m128 sx = _mm_loadu_ps(&sphere_x_[i]);
+        __m128 sy = _mm_loadu_ps(&sphere_y_[i]);
+        __m128 sz = _mm_loadu_ps(&sphere_z_[i]);
+        __m128 neg_radius = _mm_xor_ps(_mm_loadu_ps(&sphere_radius_[i]), sign_mask);
+        __m128 bx = _mm_loadu_ps(&box_center_x_[i]);
+        __m128 by = _mm_loadu_ps(&box_center_y_[i]);
+        __m128 bz = _mm_loadu_ps(&box_center_z_[i]);
+        __m128 ex = _mm_loadu_ps(&box_extent_x_[i]);
+        __m128 ey = _mm_loadu_ps(&box_extent_y_[i]);
+        __m128 ez = _mm_loadu_ps(&box_extent_z_[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m128 nx = _mm_set1_ps(plane.x);
+            __m128 ny = _mm_set1_ps(plane.y);
+            __m128 nz = _mm_set1_ps(plane.z);
+            __m128 w = _mm_set1_ps(plane.w);
+
+            __m128 sphere_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)), _mm_add_ps(_mm_mul_ps(nz, sz), w));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(sphere_distance, neg_radius));
+
+            __m128 box_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, bx), _mm_mul_ps(ny, by)), _mm_add_ps(_mm_mul_ps(nz, bz), w));
+            __m128 box_radius = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex),
+                _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey)),
+                _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(box_distance, box_radius), _mm_setzero_ps()));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+            if (mask & 1) {
+                visible.push_back(static_cast<uint32_t>(i + lane));
+            }
+        }
+    }
+#endif
+
+    cullScalar(frustum, i, end, visible);
+}
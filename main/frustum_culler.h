@@ -0,0 +1,50 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/frustum.h"
+#include "main/job_system.h"
+
+#include <cstdint>
+#include <vector>
+
+// Batch frustum test over many objects. Bounds are kept as a structure of
+// arrays so the test runs on 8 (AVX2) or 4 (SSE2) objects per instruction;
+// builds without either fall back to a scalar loop.
+// An object is visible when both its bounding sphere and its AABB intersect
+// the frustum: the sphere rejects most objects cheaply, the box is tighter
+// for elongated meshes such as the ground plane.
+class FrustumCuller {
+public:
+    void resize(size_t count);
+    void setBounds(size_t index, const glm::vec4& sphere, const BoundingBox& box);
+    // Moves the last object's bounds into index and shrinks by one, as
+    // ObjectStore::remove does with the objects.
+    void remove(size_t index);
+    size_t size() const;
+
+    // Replaces the contents of visible with the indices of the objects
+    // intersecting the frustum, in increasing order.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+    // Same result, chunks of objects are tested on jobs.
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible, JobSystem& jobs);
+
+private:
+    static constexpr size_t kChunkSize = 4096;
+
+    void cullRange(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+    void cullScalar(const Frustum& frustum, size_t begin, size_t end, std::vector<uint32_t>& visible) const;
+
+    size_t count_ = 0;
+    std::vector<float> sphere_x_;
+    std::vector<float> sphere_y_;
+    std::vector<float> sphere_z_;
+    std::vector<float> sphere_radius_;
+    std::vector<float> box_center_x_;
+    std::vector<float> box_center_y_;
+    std::vector<float> box_center_z_;
+    std::vector<float> box_extent_x_;
+    std::vector<float> box_extent_y_;
+    std::vector<float> box_extent_z_;
+    // Visible objects of every chunk, kept between frames to reuse the memory.
+    std::vector<std::vector<uint32_t>> chunk_visible_;
+};
@@ -0,0 +1,93 @@
+#include "main/geometry_pool.h"
+
+#include "main/vertex.h"
+#include "main/vulkan_device.h"
+
+void GeometryPool::build(VulkanDevice* device, const std::vector<Model*>& models) {
+    destroy();
+
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    for (const Model* model : models) {
+        ranges_.push_back({index_count, model->getIndexCount(), static_cast<int32_t>(vertex_count)});
+        vertex_count += model->getVertexCount();
+        index_count += model->getIndexCount();
+    }
+
+    if (models.empty()) {
+        return;
+    }
+
+    vertex_buffer_.size = sizeof(Vertex) * vertex_count;
+    vertex_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    vertex_buffer_.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    vertex_buffer_.device = *device;
+    device->createBuffer(vertex_buffer_);
+
+    position_buffer_.size = sizeof(glm::vec3) * vertex_count;
+    position_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    position_buffer_.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    position_buffer_.device = *device;
+    device->createBuffer(position_buffer_);
+
+    index_buffer_.size = sizeof(uint32_t) * index_count;
+    index_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    index_buffer_.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    index_buffer_.device = *device;
+    device->createBuffer(index_buffer_);
+
+    // The models already live in device memory, so the pool is filled with GPU-side copies.
+    VkCommandBuffer command_buffer = device->beginCommandBuffer();
+    for (size_t i = 0; i < models.size(); ++i) {
+        VkBufferCopy vertex_region{};
+        vertex_region.srcOffset = 0;
+        vertex_region.dstOffset = sizeof(Vertex) * ranges_[i].vertex_offset;
+        vertex_region.size = models[i]->getVertexBuffer().size;
+        vkCmdCopyBuffer(command_buffer, models[i]->getVertexBuffer().buffer, vertex_buffer_.buffer, 1, &vertex_region);
+
+        VkBufferCopy position_region{};
+        position_region.srcOffset = 0;
+        position_region.dstOffset = sizeof(glm::vec3) * ranges_[i].vertex_offset;
+        position_region.size = models[i]->getPositionBuffer().size;
+        vkCmdCopyBuffer(command_buffer, models[i]->getPositionBuffer().buffer, position_buffer_.buffer, 1, &position_region);
+
+        VkBufferCopy index_region{};
+        index_region.srcOffset = 0;
+        index_region.dstOffset = sizeof(uint32_t) * ranges_[i].first_index;
+        index_region.size = models[i]->getIndexBuffer().size;
+        vkCmdCopyBuffer(command_buffer, models[i]->getIndexBuffer().buffer, index_buffer_.buffer, 1, &index_region);
+    }
+    device->submitCommandBuffer(command_buffer, device->getGraphicsQueue());
+}
+
+void GeometryPool::destroy() {
+    vertex_buffer_.destroy();
+    position_buffer_.destroy();
+    index_buffer_.destroy();
+    vertex_buffer_ = Buffer{};
+    position_buffer_ = Buffer{};
+    index_buffer_ = Buffer{};
+    ranges_.clear();
+}
+
+void GeometryPool::bind(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = {vertex_buffer_.buffer};
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, index_buffer_.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GeometryPool::bindPositions(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = {position_buffer_.buffer};
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, index_buffer_.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+const MeshRange& GeometryPool::getMeshRange(uint32_t mesh_id) const {
+    return ranges_[mesh_id];
+}
+
+size_t GeometryPool::getMeshCount() const {
+    return ranges_.size();
+}
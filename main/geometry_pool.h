@@ -0,0 +1,34 @@
+#pragma once
+
+#include "main/model.h"
+#include "main/vulkan_buffer.h"
+
+#include <vector>
+
+class VulkanDevice;
+
+// Location of one mesh inside the pooled vertex and index buffers.
+struct MeshRange {
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t vertex_offset;
+};
+
+// Concatenates the geometry of several models into a single vertex and index
+// buffer, so draws of different meshes can be issued by one indirect call.
+class GeometryPool {
+public:
+    void build(VulkanDevice* device, const std::vector<Model*>& models);
+    void destroy();
+    void bind(VkCommandBuffer command_buffer);
+    // Binds the pooled position-only stream with the same index buffer.
+    void bindPositions(VkCommandBuffer command_buffer);
+    const MeshRange& getMeshRange(uint32_t mesh_id) const;
+    size_t getMeshCount() const;
+
+private:
+    Buffer vertex_buffer_;
+    Buffer position_buffer_;
+    Buffer index_buffer_;
+    std::vector<MeshRange> ranges_;
+};
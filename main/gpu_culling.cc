@@ -0,0 +1,392 @@
+#include "main/gpu_culling.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Must match local_size_x in cull.comp.
+constexpr uint32_t kCullGroupSize = 64;
+
+}  // namespace
+
+bool GpuCulling::isSupported(const VulkanDevice& device) {
+    const VkPhysicalDeviceFeatures& features = device.getEnabledFeatures();
+    return features.multiDrawIndirect && features.drawIndirectFirstInstance;
+}
+
+void GpuCulling::init(VulkanDevice* device, const std::vector<char>& shader_code) {
+    device_ = device;
+    if (device_->isExtensionEnabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+        draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+            vkGetDeviceProcAddr(*device_, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    createPipeline(shader_code);
+}
+
+void GpuCulling::createPipeline(const std::vector<char>& shader_code) {
+    std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+    std::array<VkDescriptorBindingFlags, 6> binding_flags{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    // The depth pyramid only exists with occlusion culling.
+    binding_flags[5] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create{};
+    binding_flags_create.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_create.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    binding_flags_create.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+    layout_info.pNext = &binding_flags_create;
+
+    if (vkCreateDescriptorSetLayout(*device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor set layout!");
+    }
+
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(CullPhase);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader_code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(*device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout_;
+
+    VkResult result = vkCreateComputePipelines(*device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(*device_, shader_module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline!");
+    }
+}
+
+void GpuCulling::destroy() {
+    if (device_ == nullptr) {
+        return;
+    }
+
+    destroyFrameResources();
+    vkDestroyPipeline(*device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(*device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(*device_, descriptor_set_layout_, nullptr);
+    pipeline_ = VK_NULL_HANDLE;
+    pipeline_layout_ = VK_NULL_HANDLE;
+    descriptor_set_layout_ = VK_NULL_HANDLE;
+    draw_indexed_indirect_count_ = nullptr;
+    pyramid_view_ = VK_NULL_HANDLE;
+    pyramid_sampler_ = VK_NULL_HANDLE;
+    pyramid_levels_ = 0;
+    device_ = nullptr;
+}
+
+void GpuCulling::resize(size_t object_capacity) {
+    retireFrameResources();
+    createFrameResources(object_capacity);
+}
+
+void GpuCulling::createFrameResources(size_t object_capacity) {
+    uint32_t frame_count = device_->getFramesInFlight();
+    object_capacity_ = object_capacity;
+    object_buffers_.resize(frame_count);
+    indirect_buffers_.resize(frame_count);
+    count_buffers_.resize(frame_count);
+    uniform_buffers_.resize(frame_count);
+    object_counts_.assign(frame_count, 0);
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        Buffer& object_buffer = object_buffers_[i];
+        object_buffer.size = sizeof(GpuObject) * object_capacity_;
+        object_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        object_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        object_buffer.device = *device_;
+        device_->createBuffer(object_buffer);
+        object_buffer.map();
+
+        Buffer& indirect_buffer = indirect_buffers_[i];
+        // Early and late draws.
+        indirect_buffer.size = 2 * sizeof(VkDrawIndexedIndirectCommand) * object_capacity_;
+        indirect_buffer.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        indirect_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        indirect_buffer.device = *device_;
+        device_->createBuffer(indirect_buffer);
+
+        // Host visible so the counts can be read back for stats.
+        Buffer& count_buffer = count_buffers_[i];
+        count_buffer.size = sizeof(DrawCounts);
+        count_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        count_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        count_buffer.device = *device_;
+        device_->createBuffer(count_buffer);
+        count_buffer.map();
+        *static_cast<DrawCounts*>(count_buffer.mapped) = DrawCounts{};
+
+        Buffer& uniform_buffer = uniform_buffers_[i];
+        uniform_buffer.size = sizeof(CullUniforms);
+        uniform_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        uniform_buffer.usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        uniform_buffer.device = *device_;
+        device_->createBuffer(uniform_buffer);
+        uniform_buffer.map();
+    }
+
+    visibility_buffer_.size = sizeof(uint32_t) * object_capacity_;
+    visibility_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    visibility_buffer_.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    visibility_buffer_.device = *device_;
+    device_->createBuffer(visibility_buffer_);
+    visibility_cleared_ = false;
+
+    std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 4 * frame_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[1].descriptorCount = frame_count;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[2].descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = frame_count;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = frame_count;
+    alloc_info.pSetLayouts = layouts.data();
+
+    descriptor_sets_.resize(frame_count);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, descriptor_sets_.data()));
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        std::array<VkDescriptorBufferInfo, 5> buffer_infos{};
+        buffer_infos[0].buffer = object_buffers_[i].buffer;
+        buffer_infos[1].buffer = indirect_buffers_[i].buffer;
+        buffer_infos[2].buffer = count_buffers_[i].buffer;
+        buffer_infos[3].buffer = uniform_buffers_[i].buffer;
+        buffer_infos[4].buffer = visibility_buffer_.buffer;
+
+        std::array<VkWriteDescriptorSet, 5> descriptor_writes{};
+        for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding) {
+            buffer_infos[binding].offset = 0;
+            buffer_infos[binding].range = VK_WHOLE_SIZE;
+
+            descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_writes[binding].dstSet = descriptor_sets_[i];
+            descriptor_writes[binding].dstBinding = binding;
+            descriptor_writes[binding].dstArrayElement = 0;
+            descriptor_writes[binding].descriptorType = binding == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptor_writes[binding].descriptorCount = 1;
+            descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+        }
+
+        vkUpdateDescriptorSets(*device_, descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+    }
+    // The new sets are not in use yet.
+    pyramid_dirty_.assign(frame_count, false);
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        writePyramidDescriptor(i);
+    }
+}
+
+void GpuCulling::setDepthPyramid(VkImageView view, VkSampler sampler, VkExtent2D extent, uint32_t level_count) {
+    pyramid_view_ = view;
+    pyramid_sampler_ = sampler;
+    pyramid_extent_ = extent;
+    pyramid_levels_ = level_count;
+    // Sets of frames still in flight may read the old pyramid, each one is
+    // rewritten by the next update of its frame.
+    std::fill(pyramid_dirty_.begin(), pyramid_dirty_.end(), true);
+}
+
+void GpuCulling::writePyramidDescriptor(uint32_t frame) {
+    if (pyramid_view_ == VK_NULL_HANDLE) {
+        return;
+    }
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = pyramid_sampler_;
+    image_info.imageView = pyramid_view_;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_sets_[frame];
+    descriptor_write.dstBinding = 5;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(*device_, 1, &descriptor_write, 0, nullptr);
+    pyramid_dirty_[frame] = false;
+}
+
+void GpuCulling::destroyFrameResources() {
+    for (std::vector<Buffer>* buffers : {&object_buffers_, &indirect_buffers_, &count_buffers_, &uniform_buffers_}) {
+        for (Buffer& buffer : *buffers) {
+            buffer.unmap();
+            buffer.destroy();
+        }
+        buffers->clear();
+    }
+    descriptor_sets_.clear();
+    object_counts_.clear();
+    pyramid_dirty_.clear();
+    visibility_buffer_.destroy();
+    visibility_buffer_ = Buffer{};
+
+    if (descriptor_pool_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+        descriptor_pool_ = VK_NULL_HANDLE;
+    }
+    object_capacity_ = 0;
+}
+
+// Frames in flight may still cull into the old buffers, they are destroyed
+// once those frames have completed.
+void GpuCulling::retireFrameResources() {
+    VkDevice device = *device_;
+    std::vector<Buffer> buffers;
+    for (std::vector<Buffer>* frame_buffers : {&object_buffers_, &indirect_buffers_, &count_buffers_, &uniform_buffers_}) {
+        buffers.insert(buffers.end(), frame_buffers->begin(), frame_buffers->end());
+        frame_buffers->clear();
+    }
+    buffers.push_back(visibility_buffer_);
+    device_->retire([device, buffers = std::move(buffers), descriptor_pool = descriptor_pool_] {
+        for (Buffer buffer : buffers) {
+            buffer.unmap();
+            buffer.destroy();
+        }
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    });
+    descriptor_sets_.clear();
+    object_counts_.clear();
+    pyramid_dirty_.clear();
+    visibility_buffer_ = Buffer{};
+    descriptor_pool_ = VK_NULL_HANDLE;
+    object_capacity_ = 0;
+}
+
+GpuObject* GpuCulling::getObjects(uint32_t frame) {
+    return static_cast<GpuObject*>(object_buffers_[frame].mapped);
+}
+
+void GpuCulling::update(uint32_t frame, const Frustum& frustum, const glm::mat4& view, const glm::mat4& proj, uint32_t object_count) {
+    if (pyramid_dirty_[frame]) {
+        writePyramidDescriptor(frame);
+    }
+
+    CullUniforms uniforms{};
+    uniforms.view = view;
+    for (int i = 0; i < Frustum::kPlaneCount; ++i) {
+        uniforms.planes[i] = frustum.planes[i];
+    }
+    uniforms.projection = glm::vec4(proj[0][0], proj[1][1], proj[2][2], proj[3][2]);
+    uniforms.pyramid_size = glm::vec2(static_cast<float>(pyramid_extent_.width), static_cast<float>(pyramid_extent_.height));
+    // Near plane distance of a zero-to-one depth perspective projection.
+    uniforms.znear = proj[3][2] / proj[2][2];
+    uniforms.object_count = object_count;
+    uniforms.compact = usesDrawIndirectCount() ? 1 : 0;
+    uniforms.pyramid_levels = pyramid_levels_;
+    std::memcpy(uniform_buffers_[frame].mapped, &uniforms, sizeof(uniforms));
+    object_counts_[frame] = object_count;
+}
+
+void GpuCulling::dispatch(VkCommandBuffer command_buffer, uint32_t frame, CullPhase phase) {
+    uint32_t object_count = object_counts_[frame];
+
+    if (phase != CullPhase::kLate) {
+        vkCmdFillBuffer(command_buffer, count_buffers_[frame].buffer, 0, sizeof(DrawCounts), 0);
+        if (!visibility_cleared_) {
+            vkCmdFillBuffer(command_buffer, visibility_buffer_.buffer, 0, visibility_buffer_.size, 0);
+            visibility_cleared_ = true;
+        }
+
+        // Also orders the visibility reads after the previous frame's late phase.
+        VkMemoryBarrier fill_barrier{};
+        fill_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        fill_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        fill_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &fill_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &descriptor_sets_[frame], 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPhase), &phase);
+    vkCmdDispatch(command_buffer, (object_count + kCullGroupSize - 1) / kCullGroupSize, 1, 1);
+
+    VkMemoryBarrier cull_barrier{};
+    cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::draw(VkCommandBuffer command_buffer, uint32_t frame, CullPhase phase) {
+    uint32_t object_count = object_counts_[frame];
+    bool late = phase == CullPhase::kLate;
+    VkDeviceSize command_offset = late ? object_count * sizeof(VkDrawIndexedIndirectCommand) : 0;
+    VkDeviceSize count_offset = late ? offsetof(DrawCounts, late) : offsetof(DrawCounts, early);
+
+    if (usesDrawIndirectCount()) {
+        draw_indexed_indirect_count_(command_buffer, indirect_buffers_[frame].buffer, command_offset, count_buffers_[frame].buffer, count_offset, object_count, sizeof(VkDrawIndexedIndirectCommand));
+    } else {
+        vkCmdDrawIndexedIndirect(command_buffer, indirect_buffers_[frame].buffer, command_offset, object_count, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+uint32_t GpuCulling::getVisibleCount(uint32_t frame) const {
+    const DrawCounts* counts = static_cast<const DrawCounts*>(count_buffers_[frame].mapped);
+    return counts->early + counts->late;
+}
+
+uint32_t GpuCulling::getOccludedCount(uint32_t frame) const {
+    return static_cast<const DrawCounts*>(count_buffers_[frame].mapped)->occluded;
+}
+
+bool GpuCulling::usesDrawIndirectCount() const {
+    return draw_indexed_indirect_count_ != nullptr;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "main/frustum.h"
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <vector>
+
+// Per-object record read by cull.comp (set 0, binding 0). Must match GpuObject in cull.comp.
+struct GpuObject {
+    // World-space bounding sphere: xyz - center, w - radius.
+    glm::vec4 sphere;
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    // Index into the instance buffer, passed on as firstInstance.
+    uint32_t instance_index;
+};
+
+// Per-frame culling parameters (binding 3). Must match CullUniforms in cull.comp.
+struct CullUniforms {
+    glm::mat4 view;
+    glm::vec4 planes[Frustum::kPlaneCount];
+    // x - P00, y - P11, z - P22, w - P32 of the projection matrix.
+    glm::vec4 projection;
+    glm::vec2 pyramid_size;
+    float znear;
+    uint32_t object_count;
+    // Non-zero when drawn objects are compacted for vkCmdDrawIndexedIndirectCount.
+    uint32_t compact;
+    uint32_t pyramid_levels;
+};
+
+// Must match the phase constants in cull.comp.
+enum class CullPhase : uint32_t {
+    // Frustum culling only, every object inside the frustum is drawn.
+    kFrustum = 0,
+    // Two-phase occlusion culling. The early phase draws the objects that were
+    // visible last frame; the late phase tests every object against a depth
+    // pyramid of the early draws and draws the ones that became visible.
+    kEarly = 1,
+    kLate = 2
+};
+
+// Frustum and occlusion culling on the GPU. A compute shader tests the bounds
+// of every object and writes a VkDrawIndexedIndirectCommand per drawn object
+// plus a draw count, which the graphics pass consumes with a single indirect
+// draw per phase.
+// Draws use firstInstance = GpuObject::instance_index, so the graphics shaders
+// find the object's InstanceData through gl_InstanceIndex.
+class GpuCulling {
+public:
+    // Needs multiDrawIndirect and drawIndirectFirstInstance. The count variant of
+    // the draw is used when VK_KHR_draw_indirect_count is enabled, otherwise a
+    // draw is emitted for every object and culled ones get instanceCount = 0.
+    static bool isSupported(const VulkanDevice& device);
+
+    void init(VulkanDevice* device, const std::vector<char>& shader_code);
+    void destroy();
+    // The buffers of frames in flight are retired, not destroyed.
+    void resize(size_t object_capacity);
+    // Depth pyramid read by the late phase, in VK_IMAGE_LAYOUT_GENERAL. Frames
+    // switch to it in their next update, the old one has to outlive the frames
+    // in flight.
+    void setDepthPyramid(VkImageView view, VkSampler sampler, VkExtent2D extent, uint32_t level_count);
+
+    GpuObject* getObjects(uint32_t frame);
+    // Must be called before the frame's dispatches are recorded.
+    void update(uint32_t frame, const Frustum& frustum, const glm::mat4& view, const glm::mat4& proj, uint32_t object_count);
+    // Must be recorded outside of a render pass. kLate needs the depth pyramid
+    // built from this frame's early draws.
+    void dispatch(VkCommandBuffer command_buffer, uint32_t frame, CullPhase phase);
+    void draw(VkCommandBuffer command_buffer, uint32_t frame, CullPhase phase);
+    // Objects drawn, and objects rejected by the occlusion test, when this
+    // frame's commands last completed.
+    uint32_t getVisibleCount(uint32_t frame) const;
+    uint32_t getOccludedCount(uint32_t frame) const;
+    bool usesDrawIndirectCount() const;
+
+private:
+    // Mapped layout of the count buffer, see CountBuffer in cull.comp.
+    struct DrawCounts {
+        uint32_t early;
+        uint32_t late;
+        uint32_t occluded;
+    };
+
+    void createPipeline(const std::vector<char>& shader_code);
+    void createFrameResources(size_t object_capacity);
+    void destroyFrameResources();
+    void retireFrameResources();
+    void writePyramidDescriptor(uint32_t frame);
+
+    VulkanDevice* device_ = nullptr;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count_ = nullptr;
+
+    // Per frame in flight.
+    std::vector<Buffer> object_buffers_;
+    std::vector<Buffer> indirect_buffers_;
+    std::vector<Buffer> count_buffers_;
+    std::vector<Buffer> uniform_buffers_;
+    std::vector<uint32_t> object_counts_;
+    std::vector<VkDescriptorSet> descriptor_sets_;
+    std::vector<bool> pyramid_dirty_;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    size_t object_capacity_ = 0;
+
+    // Shared by all frames: frames execute in submission order, so each one
+    // reads the visibility the previous one wrote.
+    Buffer visibility_buffer_;
+    bool visibility_cleared_ = false;
+
+    VkImageView pyramid_view_ = VK_NULL_HANDLE;
+    VkSampler pyramid_sampler_ = VK_NULL_HANDLE;
+    VkExtent2D pyramid_extent_{};
+    uint32_t pyramid_levels_ = 0;
+};
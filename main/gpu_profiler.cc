@@ -0,0 +1,281 @@
+#include "main/gpu_profiler.h"
+
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+
+// The frame's own timestamps come first, then a begin and end pair per scope.
+constexpr uint32_t kFrameTimestamps = 2;
+constexpr uint32_t kTimestampsPerFrame = kFrameTimestamps + 2 * kMaxGpuScopes;
+constexpr uint32_t kNoScope = ~0u;
+
+// Results come back in the order of the flag bits, matching GpuPipelineStatistics.
+constexpr VkQueryPipelineStatisticFlags kStatisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+constexpr uint32_t kStatisticCount = 7;
+
+}  // namespace
+
+bool GpuProfiler::isSupported(const VulkanDevice& device) {
+    return device.getProperties().limits.timestampComputeAndGraphics && device.getTimestampValidBits() > 0;
+}
+
+void GpuProfiler::init(VulkanDevice* device) {
+    device_ = device;
+    statistics_supported_ = device_->getEnabledFeatures().pipelineStatisticsQuery;
+    timestamp_period_ = device_->getProperties().limits.timestampPeriod;
+    uint32_t valid_bits = device_->getTimestampValidBits();
+    timestamp_mask_ = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+    frames_.resize(device_->getFramesInFlight());
+    for (FrameQueries& frame : frames_) {
+        VkQueryPoolCreateInfo query_pool_info{};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_info.queryCount = kTimestampsPerFrame;
+        if (vkCreateQueryPool(*device_, &query_pool_info, nullptr, &frame.timestamp_pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timestamp query pool!");
+        }
+
+        if (statistics_supported_) {
+            query_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            query_pool_info.queryCount = kMaxGpuScopes;
+            query_pool_info.pipelineStatistics = kStatisticFlags;
+            if (vkCreateQueryPool(*device_, &query_pool_info, nullptr, &frame.statistics_pool) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create pipeline statistics query pool!");
+            }
+        }
+        frame.scopes.reserve(kMaxGpuScopes);
+    }
+}
+
+void GpuProfiler::destroy() {
+    for (FrameQueries& frame : frames_) {
+        vkDestroyQueryPool(*device_, frame.timestamp_pool, nullptr);
+        if (frame.statistics_pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(*device_, frame.statistics_pool, nullptr);
+        }
+    }
+    frames_.clear();
+    device_ = nullptr;
+}
+
+bool GpuProfiler::isReady() const {
+    return !frames_.empty();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer command_buffer, uint32_t frame) {
+    current_frame_ = frame;
+    open_scopes_.clear();
+
+    FrameQueries& queries = frames_[frame];
+    queries.scopes.clear();
+    queries.statistics_count = 0;
+    queries.recorded = true;
+
+    vkCmdResetQueryPool(command_buffer, queries.timestamp_pool, 0, kTimestampsPerFrame);
+    if (queries.statistics_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, queries.statistics_pool, 0, kMaxGpuScopes);
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamp_pool, 0);
+}
+
+void GpuProfiler::endFrame(VkCommandBuffer command_buffer) {
+    while (!open_scopes_.empty()) {
+        endScope(command_buffer);
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frames_[current_frame_].timestamp_pool, 1);
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer command_buffer, const char* name) {
+    FrameQueries& queries = frames_[current_frame_];
+    if (queries.scopes.size() == kMaxGpuScopes) {
+        open_scopes_.push_back(kNoScope);
+        return;
+    }
+
+    RecordedScope scope;
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(open_scopes_.size());
+    scope.timestamp_query = kFrameTimestamps + 2 * static_cast<uint32_t>(queries.scopes.size());
+    scope.statistics_query = -1;
+    if (scope.depth == 0 && queries.statistics_pool != VK_NULL_HANDLE) {
+        scope.statistics_query = static_cast<int32_t>(queries.statistics_count++);
+        vkCmdBeginQuery(command_buffer, queries.statistics_pool, scope.statistics_query, 0);
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamp_pool, scope.timestamp_query);
+
+    open_scopes_.push_back(static_cast<uint32_t>(queries.scopes.size()));
+    queries.scopes.push_back(scope);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer command_buffer) {
+    uint32_t index = open_scopes_.back();
+    open_scopes_.pop_back();
+    if (index == kNoScope) {
+        return;
+    }
+
+    FrameQueries& queries = frames_[current_frame_];
+    const RecordedScope& scope = queries.scopes[index];
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.timestamp_pool, scope.timestamp_query + 1);
+    if (scope.statistics_query >= 0) {
+        vkCmdEndQuery(command_buffer, queries.statistics_pool, scope.statistics_query);
+    }
+}
+
+std::optional<double> GpuProfiler::collect(uint32_t frame) {
+    FrameQueries& queries = frames_[frame];
+    if (!queries.recorded) {
+        return std::nullopt;
+    }
+    queries.recorded = false;
+
+    // No VK_QUERY_RESULT_WAIT_BIT: the frame is complete, VK_NOT_READY would
+    // only come from a frame that never reached the GPU.
+    uint32_t timestamp_count = kFrameTimestamps + 2 * static_cast<uint32_t>(queries.scopes.size());
+    uint64_t timestamps[kTimestampsPerFrame];
+    VkResult result = vkGetQueryPoolResults(*device_, queries.timestamp_pool, 0, timestamp_count, sizeof(timestamps), timestamps,
+                                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return std::nullopt;
+    }
+
+    uint64_t statistics[kMaxGpuScopes * kStatisticCount];
+    bool has_statistics = false;
+    if (queries.statistics_count > 0) {
+        result = vkGetQueryPoolResults(*device_, queries.statistics_pool, 0, queries.statistics_count, sizeof(statistics), statistics,
+                                       kStatisticCount * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        has_statistics = result == VK_SUCCESS;
+    }
+
+    last_frame_scopes_.clear();
+    for (const RecordedScope& scope : queries.scopes) {
+        double begin_ms = toMilliseconds(timestamps[0], timestamps[scope.timestamp_query]);
+        double end_ms = toMilliseconds(timestamps[0], timestamps[scope.timestamp_query + 1]);
+        last_frame_scopes_.push_back({scope.name, scope.depth, begin_ms, end_ms});
+
+        ScopeAccumulator& accumulator = getAccumulator(scope);
+        accumulator.total_ms += end_ms - begin_ms;
+        ++accumulator.stats.samples;
+
+        if (has_statistics && scope.statistics_query >= 0) {
+            const uint64_t* values = &statistics[scope.statistics_query * kStatisticCount];
+            GpuPipelineStatistics& total = accumulator.total_statistics;
+            total.input_vertices += values[0];
+            total.input_primitives += values[1];
+            total.vertex_invocations += values[2];
+            total.clipping_invocations += values[3];
+            total.clipping_primitives += values[4];
+            total.fragment_invocations += values[5];
+            total.compute_invocations += values[6];
+            ++accumulator.statistics_samples;
+        }
+    }
+
+    double frame_ms = toMilliseconds(timestamps[0], timestamps[1]);
+    frame_total_ms_ += frame_ms;
+    ++frame_samples_;
+    return frame_ms;
+}
+
+const std::vector<GpuScopeTiming>& GpuProfiler::getLastFrameScopes() const {
+    return last_frame_scopes_;
+}
+
+double GpuProfiler::getAverageFrameMs() const {
+    return frame_samples_ > 0 ? frame_total_ms_ / frame_samples_ : 0.0;
+}
+
+std::vector<GpuScopeStats> GpuProfiler::getScopeStats() const {
+    std::vector<GpuScopeStats> result;
+    result.reserve(accumulators_.size());
+    for (const ScopeAccumulator& accumulator : accumulators_) {
+        if (accumulator.stats.samples == 0) {
+            continue;
+        }
+        GpuScopeStats stats = accumulator.stats;
+        stats.average_ms = accumulator.total_ms / stats.samples;
+        stats.has_statistics = accumulator.statistics_samples > 0;
+        if (stats.has_statistics) {
+            double count = accumulator.statistics_samples;
+            const GpuPipelineStatistics& total = accumulator.total_statistics;
+            stats.statistics.input_vertices = total.input_vertices / count;
+            stats.statistics.input_primitives = total.input_primitives / count;
+            stats.statistics.vertex_invocations = total.vertex_invocations / count;
+            stats.statistics.clipping_invocations = total.clipping_invocations / count;
+            stats.statistics.clipping_primitives = total.clipping_primitives / count;
+            stats.statistics.fragment_invocations = total.fragment_invocations / count;
+            stats.statistics.compute_invocations = total.compute_invocations / count;
+        }
+        result.push_back(stats);
+    }
+    return result;
+}
+
+// Scopes keep their place in the order, so the log does not reshuffle when a
+// scope is skipped for a while.
+void GpuProfiler::resetStats() {
+    frame_total_ms_ = 0.0;
+    frame_samples_ = 0;
+    for (ScopeAccumulator& accumulator : accumulators_) {
+        accumulator.stats.samples = 0;
+        accumulator.total_ms = 0.0;
+        accumulator.total_statistics = {};
+        accumulator.statistics_samples = 0;
+    }
+}
+
+void GpuProfiler::log(std::ostream& out) const {
+    out << "gpu frame: " << getAverageFrameMs() << " ms" << std::endl;
+    for (const GpuScopeStats& stats : getScopeStats()) {
+        out << std::string(2 * (stats.depth + 1), ' ') << stats.name << ": " << stats.average_ms << " ms";
+        if (stats.has_statistics) {
+            const GpuPipelineStatistics& s = stats.statistics;
+            out << std::fixed << std::setprecision(0)
+                << " primitives: " << s.input_primitives
+                << " vs: " << s.vertex_invocations
+                << " clipped: " << s.clipping_primitives << "/" << s.clipping_invocations
+                << " fs: " << s.fragment_invocations
+                << " cs: " << s.compute_invocations
+                << std::defaultfloat << std::setprecision(6);
+        }
+        out << std::endl;
+    }
+}
+
+double GpuProfiler::toMilliseconds(uint64_t begin, uint64_t end) const {
+    return static_cast<double>((end - begin) & timestamp_mask_) * timestamp_period_ / 1e6;
+}
+
+GpuProfiler::ScopeAccumulator& GpuProfiler::getAccumulator(const RecordedScope& scope) {
+    auto it = accumulator_ids_.find(scope.name);
+    if (it != accumulator_ids_.end()) {
+        return accumulators_[it->second];
+    }
+    accumulator_ids_.emplace(scope.name, accumulators_.size());
+    ScopeAccumulator& accumulator = accumulators_.emplace_back();
+    accumulator.stats.name = scope.name;
+    accumulator.stats.depth = scope.depth;
+    return accumulator;
+}
+
+GpuProfileScope::GpuProfileScope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const char* name)
+    : profiler_(profiler), command_buffer_(command_buffer) {
+    if (profiler_) {
+        profiler_->beginScope(command_buffer_, name);
+    }
+}
+
+GpuProfileScope::~GpuProfileScope() {
+    if (profiler_) {
+        profiler_->endScope(command_buffer_);
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "main/vulkan_device.h"
+
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Upper bound on the scopes recorded in one frame, further scopes are ignored.
+constexpr inline uint32_t kMaxGpuScopes = 64;
+
+// Pipeline statistics of a scope, averaged over the frames it was recorded in.
+struct GpuPipelineStatistics {
+    double input_vertices = 0.0;
+    double input_primitives = 0.0;
+    double vertex_invocations = 0.0;
+    double clipping_invocations = 0.0;
+    double clipping_primitives = 0.0;
+    double fragment_invocations = 0.0;
+    double compute_invocations = 0.0;
+};
+
+struct GpuScopeStats {
+    std::string name;
+    // Nesting depth, 0 for scopes opened directly in the frame.
+    uint32_t depth = 0;
+    double average_ms = 0.0;
+    uint32_t samples = 0;
+    // Only top level scopes have statistics, and only with pipelineStatisticsQuery.
+    bool has_statistics = false;
+    GpuPipelineStatistics statistics;
+};
+
+// One scope of a collected frame, relative to the start of the frame.
+struct GpuScopeTiming {
+    const char* name;
+    uint32_t depth;
+    double begin_ms;
+    double end_ms;
+};
+
+// Named GPU timings of the regions of a frame. Every frame in flight has its own
+// timestamp and pipeline statistics query pools; a frame's results are read once
+// its fence has signaled, so reading them never waits for the GPU.
+// Scopes nest. Vulkan allows one active pipeline statistics query per command
+// buffer, so only top level scopes collect statistics, and like any query they
+// have to end on the same side of a render pass boundary as they began.
+class GpuProfiler {
+public:
+    // Needs timestampComputeAndGraphics.
+    static bool isSupported(const VulkanDevice& device);
+
+    void init(VulkanDevice* device);
+    void destroy();
+    bool isReady() const;
+
+    // Resets the frame's queries and starts its timing, must be recorded first,
+    // outside of a render pass. endFrame closes it and any scope left open.
+    void beginFrame(VkCommandBuffer command_buffer, uint32_t frame);
+    void endFrame(VkCommandBuffer command_buffer);
+    // name must outlive the frame's collect, string literals are expected.
+    void beginScope(VkCommandBuffer command_buffer, const char* name);
+    void endScope(VkCommandBuffer command_buffer);
+
+    // Reads the results of a frame recorded earlier, to be called once its fence
+    // has signaled. Returns the GPU time of the whole frame, nothing if the slot
+    // holds no results.
+    std::optional<double> collect(uint32_t frame);
+    // Scopes of the frame read by the last successful collect, for timelines.
+    const std::vector<GpuScopeTiming>& getLastFrameScopes() const;
+
+    // Averages since the last reset. Scopes come in the order they first appeared.
+    double getAverageFrameMs() const;
+    std::vector<GpuScopeStats> getScopeStats() const;
+    void resetStats();
+    // One line per scope, indented by depth.
+    void log(std::ostream& out) const;
+
+private:
+    struct RecordedScope {
+        const char* name;
+        uint32_t depth;
+        // Into the frame's timestamp pool, the end timestamp follows.
+        uint32_t timestamp_query;
+        // Into the frame's statistics pool, -1 without statistics.
+        int32_t statistics_query;
+    };
+
+    struct FrameQueries {
+        VkQueryPool timestamp_pool = VK_NULL_HANDLE;
+        VkQueryPool statistics_pool = VK_NULL_HANDLE;
+        std::vector<RecordedScope> scopes;
+        uint32_t statistics_count = 0;
+        bool recorded = false;
+    };
+
+    struct ScopeAccumulator {
+        GpuScopeStats stats;
+        double total_ms = 0.0;
+        GpuPipelineStatistics total_statistics;
+        uint32_t statistics_samples = 0;
+    };
+
+    double toMilliseconds(uint64_t begin, uint64_t end) const;
+    ScopeAccumulator& getAccumulator(const RecordedScope& scope);
+
+    VulkanDevice* device_ = nullptr;
+    std::vector<FrameQueries> frames_;
+    uint32_t current_frame_ = 0;
+    // Indices into the current frame's scopes, innermost last.
+    std::vector<uint32_t> open_scopes_;
+    bool statistics_supported_ = false;
+    float timestamp_period_ = 1.0f;
+    uint64_t timestamp_mask_ = ~0ull;
+
+    std::vector<GpuScopeTiming> last_frame_scopes_;
+    double frame_total_ms_ = 0.0;
+    uint32_t frame_samples_ = 0;
+    std::vector<ScopeAccumulator> accumulators_;
+    std::unordered_map<std::string, size_t> accumulator_ids_;
+};
+
+// Scope ending with the C++ scope. A null profiler records nothing, so callers
+// do not have to check whether profiling is on.
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const char* name);
+    ~GpuProfileScope();
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator =(const GpuProfileScope&) = delete;
+
+private:
+    GpuProfiler* profiler_;
+    VkCommandBuffer command_buffer_;
+};
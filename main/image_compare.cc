@@ -0,0 +1,93 @@
+#include "main/image_compare.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+
+struct Lab {
+    float l;
+    float a;
+    float b;
+};
+
+const std::array<float, 256>& getLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> result;
+        for (int i = 0; i < 256; ++i) {
+            float c = static_cast<float>(i) / 255.0f;
+            result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table;
+}
+
+float labCurve(float t) {
+    constexpr float kEpsilon = 216.0f / 24389.0f;
+    constexpr float kKappa = 24389.0f / 27.0f;
+    return t > kEpsilon ? std::cbrt(t) : (kKappa * t + 16.0f) / 116.0f;
+}
+
+// sRGB to CIELAB under the D65 white point.
+Lab toLab(const uint8_t* pixel) {
+    const std::array<float, 256>& linear = getLinearTable();
+    float r = linear[pixel[0]];
+    float g = linear[pixel[1]];
+    float b = linear[pixel[2]];
+    float x = labCurve((0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f);
+    float y = labCurve(0.2126729f * r + 0.7151522f * g + 0.0721750f * b);
+    float z = labCurve((0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f);
+    return {116.0f * y - 16.0f, 500.0f * (x - y), 200.0f * (y - z)};
+}
+
+}  // namespace
+
+bool ImageDifference::isWithin(const ImageTolerance& tolerance) const {
+    return differing_fraction <= tolerance.differing_fraction && mean_delta_e <= tolerance.mean_delta_e;
+}
+
+ImageDifference compareImages(const uint8_t* actual, const uint8_t* expected, uint32_t width, uint32_t height,
+                              const ImageTolerance& tolerance, std::vector<uint8_t>* diff) {
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    if (diff != nullptr) {
+        diff->resize(pixel_count * 4);
+    }
+
+    ImageDifference result;
+    size_t differing = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < pixel_count; ++i) {
+        Lab a = toLab(actual + i * 4);
+        Lab e = toLab(expected + i * 4);
+        double delta_e = std::sqrt((a.l - e.l) * (a.l - e.l) + (a.a - e.a) * (a.a - e.a) + (a.b - e.b) * (a.b - e.b));
+        sum += delta_e;
+        result.max_delta_e = std::max(result.max_delta_e, delta_e);
+        bool differs = delta_e > tolerance.pixel_delta_e;
+        if (differs) {
+            ++differing;
+        }
+
+        if (diff != nullptr) {
+            uint8_t* out = diff->data() + i * 4;
+            if (differs) {
+                out[0] = 255;
+                out[1] = 0;
+                out[2] = 0;
+            } else {
+                uint8_t gray = static_cast<uint8_t>(std::clamp(e.l * 0.25f * 2.55f, 0.0f, 255.0f));
+                out[0] = gray;
+                out[1] = gray;
+                out[2] = gray;
+            }
+            out[3] = 255;
+        }
+    }
+
+    if (pixel_count > 0) {
+        result.mean_delta_e = sum / static_cast<double>(pixel_count);
+        result.differing_fraction = static_cast<double>(differing) / static_cast<double>(pixel_count);
+    }
+    return result;
+}
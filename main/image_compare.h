@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// How far a rendered image may drift from its golden image. Pixels are
+// compared by their CIE76 color difference (delta E) in CIELAB, which follows
+// perceived difference far better than RGB distance: drivers rounding a
+// dark shade differently stay below the threshold, a missing highlight
+// does not.
+struct ImageTolerance {
+    // Delta E up to which a pixel counts as unchanged, 2.3 is about the
+    // smallest difference people notice.
+    double pixel_delta_e = 4.0;
+    // Share of pixels that may differ, for rasterization differences along
+    // edges between GPUs and drivers.
+    double differing_fraction = 0.005;
+    // Bound on the average delta E over the image, against small shifts of the
+    // whole image that stay below the pixel threshold.
+    double mean_delta_e = 1.0;
+};
+
+struct ImageDifference {
+    double mean_delta_e = 0.0;
+    double max_delta_e = 0.0;
+    double differing_fraction = 0.0;
+
+    bool isWithin(const ImageTolerance& tolerance) const;
+};
+
+// Compares two sRGB RGBA8 images of the same size, tightly packed. Alpha is
+// ignored. When diff is not null it receives an RGBA8 image of the expected
+// one dimmed to gray, with the pixels past the threshold in red.
+ImageDifference compareImages(const uint8_t* actual, const uint8_t* expected, uint32_t width, uint32_t height,
+                              const ImageTolerance& tolerance, std::vector<uint8_t>* diff = nullptr);
@@ -0,0 +1,158 @@
+#include "main/image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Largest payload of a stored deflate block.
+constexpr size_t kStoredBlockSize = 65535;
+// Longest run of bytes the Adler-32 sums take without a reduction.
+constexpr size_t kAdlerRun = 5552;
+
+const std::array<uint32_t, 256>& getCrcTable() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            result[i] = c;
+        }
+        return result;
+    }();
+    return table;
+}
+
+uint32_t updateCrc(uint32_t crc, const uint8_t* data, size_t size) {
+    const std::array<uint32_t, 256>& table = getCrcTable();
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> header;
+    appendBigEndian(header, static_cast<uint32_t>(data.size()));
+    header.insert(header.end(), type, type + 4);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+    // The CRC covers the type and the data, not the length.
+    uint32_t crc = updateCrc(0xffffffffu, header.data() + 4, 4);
+    crc = updateCrc(crc, data.data(), data.size()) ^ 0xffffffffu;
+    std::vector<uint8_t> trailer;
+    appendBigEndian(trailer, crc);
+    file.write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+}
+
+std::ofstream openFile(const std::string& path) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    return file;
+}
+
+}  // namespace
+
+void writePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels) {
+    // Scanlines with filter type 0 (none) in front of every row.
+    size_t row_size = static_cast<size_t>(width) * 3 + 1;
+    std::vector<uint8_t> raw(row_size * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t* dst = raw.data() + y * row_size;
+        const uint8_t* src = pixels + static_cast<size_t>(y) * width * 4;
+        *dst++ = 0;
+        for (uint32_t x = 0; x < width; ++x) {
+            *dst++ = src[x * 4 + 0];
+            *dst++ = src[x * 4 + 1];
+            *dst++ = src[x * 4 + 2];
+        }
+    }
+
+    // zlib stream of stored blocks, closed by the Adler-32 of the raw data.
+    size_t block_count = std::max<size_t>((raw.size() + kStoredBlockSize - 1) / kStoredBlockSize, 1);
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + block_count * 5 + 6);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (size_t block = 0; block < block_count; ++block) {
+        size_t offset = block * kStoredBlockSize;
+        size_t size = std::min(kStoredBlockSize, raw.size() - offset);
+        zlib.push_back(block + 1 == block_count ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+        // The sums cannot overflow within kAdlerRun bytes, the modulo waits until then.
+        for (size_t run = offset; run < offset + size; run += kAdlerRun) {
+            size_t run_end = std::min(run + kAdlerRun, offset + size);
+            for (size_t i = run; i < run_end; ++i) {
+                adler_a += raw[i];
+                adler_b += adler_a;
+            }
+            adler_a %= 65521;
+            adler_b %= 65521;
+        }
+    }
+    appendBigEndian(zlib, (adler_b << 16) | adler_a);
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    // 8 bits per channel, color type 2 (RGB), default compression, filter and no interlace.
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    std::ofstream file = openFile(path);
+    static const uint8_t kSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+    writeChunk(file, "IHDR", header);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+    if (!file.good()) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+void writePpm(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels) {
+    std::ofstream file = openFile(path);
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(static_cast<size_t>(width) * 3);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t* src = pixels + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x * 3 + 0] = static_cast<char>(src[x * 4 + 0]);
+            row[x * 3 + 1] = static_cast<char>(src[x * 4 + 1]);
+            row[x * 3 + 2] = static_cast<char>(src[x * 4 + 2]);
+        }
+        file.write(row.data(), row.size());
+    }
+    if (!file.good()) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+void writeImage(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels) {
+    bool ppm = path.size() >= 4 && path.compare(path.size() - 4, 4, ".ppm") == 0;
+    if (ppm) {
+        writePpm(path, width, height, pixels);
+    } else {
+        writePng(path, width, height, pixels);
+    }
+}
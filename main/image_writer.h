@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Writers for RGBA8 pixels, tightly packed with the top row first. Alpha is
+// dropped, both formats store RGB. They throw when the file cannot be written.
+
+// PNG with stored (uncompressed) deflate blocks: no zlib needed, and encoding
+// costs little more than a copy, which keeps up with captures at frame rate.
+void writePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels);
+// Binary PPM.
+void writePpm(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels);
+// PPM for a .ppm extension, PNG otherwise.
+void writeImage(const std::string& path, uint32_t width, uint32_t height, const uint8_t* pixels);
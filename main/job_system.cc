@@ -0,0 +1,317 @@
+#include "main/job_system.h"
+
+#include "main/cpu_profiler.h"
+#include "main/work_deque.h"
+
+#include <algorithm>
+
+struct Job {
+    std::function<void()> function;
+    JobCounter* counter;
+};
+
+namespace {
+
+// Tries to find work this often before a worker goes to sleep, which keeps
+// workers awake between the parallel loops of one frame.
+constexpr int kIdleSpinCount = 256;
+
+// The system whose deque the current thread owns, and its index there.
+thread_local JobSystem* tls_system = nullptr;
+thread_local uint32_t tls_thread_index = 0;
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+}  // namespace
+
+struct alignas(64) JobSystem::ThreadState {
+    WorkDeque<Job> deque;
+    std::atomic<uint64_t> jobs{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> busy_ns{0};
+};
+
+struct JobSystem::ForLoop {
+    const std::function<void(uint32_t, uint32_t)>* task;
+    uint32_t grain;
+    JobCounter counter;
+};
+
+bool JobCounter::isDone() const {
+    return pending_.load(std::memory_order_acquire) == 0;
+}
+
+JobSystem::JobSystem(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency(), 2u);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.push_back(std::make_unique<ThreadState>());
+    }
+    tls_system = this;
+    tls_thread_index = 0;
+    stats_start_ = std::chrono::steady_clock::now();
+
+    workers_.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back(&JobSystem::workerLoop, this, static_cast<uint32_t>(i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+    if (tls_system == this) {
+        tls_system = nullptr;
+    }
+}
+
+size_t JobSystem::getThreadCount() const {
+    return threads_.size();
+}
+
+void JobSystem::run(std::function<void()> function, JobCounter* counter) {
+    Job* job = new Job{std::move(function), counter};
+    if (counter) {
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (workers_.empty()) {
+        execute(job);
+        return;
+    }
+    push(job);
+}
+
+void JobSystem::runAfter(JobCounter& dependencies, std::function<void()> function, JobCounter* counter) {
+    Job* job = new Job{std::move(function), counter};
+    if (counter) {
+        counter->pending_.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        // finish() takes the continuations under the same lock once the
+        // count reaches zero, so the job is either taken there or seen done here.
+        std::lock_guard<std::mutex> lock(dependencies.mutex_);
+        if (!dependencies.isDone()) {
+            dependencies.continuations_.push_back(job);
+            return;
+        }
+    }
+    if (workers_.empty()) {
+        execute(job);
+        return;
+    }
+    push(job);
+}
+
+void JobSystem::push(Job* job) {
+    bool pushed = false;
+    if (tls_system == this) {
+        pushed = threads_[tls_thread_index]->deque.push(job);
+    } else {
+        std::lock_guard<std::mutex> lock(injected_mutex_);
+        injected_.push_back(job);
+        injected_count_.fetch_add(1, std::memory_order_release);
+        pushed = true;
+    }
+    if (!pushed) {
+        // A full deque means plenty of queued work, this one runs inline.
+        execute(job);
+        return;
+    }
+
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping_.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_.notify_one();
+    }
+}
+
+Job* JobSystem::take() {
+    bool owner = tls_system == this;
+    uint32_t self = owner ? tls_thread_index : 0;
+    Job* job = owner ? threads_[self]->deque.pop() : nullptr;
+
+    if (!job && injected_count_.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(injected_mutex_);
+        if (!injected_.empty()) {
+            job = injected_.front();
+            injected_.pop_front();
+            injected_count_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Victims in turn, starting after this thread.
+    for (size_t i = owner ? 1 : 0; !job && i < threads_.size(); ++i) {
+        job = threads_[(self + i) % threads_.size()]->deque.steal();
+        if (job && owner) {
+            threads_[self]->steals.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (job) {
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::execute(Job* job) {
+    auto start = std::chrono::steady_clock::now();
+    job->function();
+    if (tls_system == this) {
+        ThreadState& thread = *threads_[tls_thread_index];
+        thread.busy_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+        thread.jobs.fetch_add(1, std::memory_order_relaxed);
+    }
+    JobCounter* counter = job->counter;
+    delete job;
+    finish(counter);
+}
+
+// The last decrement happens under the counter's lock, and wait() takes the
+// lock before returning, so a counter is never destroyed while it is locked here.
+void JobSystem::finish(JobCounter* counter) {
+    if (!counter) {
+        return;
+    }
+    uint32_t pending = counter->pending_.load(std::memory_order_acquire);
+    while (pending > 1) {
+        if (counter->pending_.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    std::vector<Job*> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex_);
+        if (counter->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            continuations.swap(counter->continuations_);
+        }
+    }
+    for (Job* continuation : continuations) {
+        if (workers_.empty()) {
+            execute(continuation);
+        } else {
+            push(continuation);
+        }
+    }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    while (!counter.isDone()) {
+        if (Job* job = take()) {
+            execute(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    std::lock_guard<std::mutex> lock(counter.mutex_);
+}
+
+bool JobSystem::isLocalQueueEmpty() const {
+    if (tls_system == this) {
+        return threads_[tls_thread_index]->deque.empty();
+    }
+    return injected_count_.load(std::memory_order_relaxed) == 0;
+}
+
+// Lazy binary splitting: the range is worked through min_grain items at a
+// time, and half of what is left goes to the deque whenever the deque is
+// empty, that is when the half offered before was stolen.
+void JobSystem::runRange(ForLoop& loop, uint32_t begin, uint32_t end) {
+    while (begin < end) {
+        if (end - begin >= 2 * loop.grain && isLocalQueueEmpty()) {
+            uint32_t middle = begin + (end - begin) / 2;
+            run([this, &loop, middle, end] { runRange(loop, middle, end); }, &loop.counter);
+            end = middle;
+            continue;
+        }
+        uint32_t piece_end = std::min(end, begin + loop.grain);
+        (*loop.task)(begin, piece_end);
+        begin = piece_end;
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t min_grain, const std::function<void(uint32_t, uint32_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+    min_grain = std::max(min_grain, 1u);
+    if (workers_.empty() || count <= min_grain) {
+        task(0, count);
+        return;
+    }
+
+    ForLoop loop{&task, min_grain, {}};
+    auto start = std::chrono::steady_clock::now();
+    runRange(loop, 0, count);
+    if (tls_system == this) {
+        threads_[tls_thread_index]->busy_ns.fetch_add(elapsedNs(start), std::memory_order_relaxed);
+    }
+    wait(loop.counter);
+}
+
+void JobSystem::parallelFor(uint32_t count, const std::function<void(uint32_t)>& task) {
+    parallelFor(count, 1, [&task](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            task(i);
+        }
+    });
+}
+
+std::vector<JobThreadStats> JobSystem::getStats() const {
+    std::vector<JobThreadStats> stats(threads_.size());
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        stats[i].jobs = threads_[i]->jobs.load(std::memory_order_relaxed);
+        stats[i].steals = threads_[i]->steals.load(std::memory_order_relaxed);
+        stats[i].busy_ms = static_cast<double>(threads_[i]->busy_ns.load(std::memory_order_relaxed)) / 1e6;
+    }
+    return stats;
+}
+
+double JobSystem::getStatsElapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stats_start_).count();
+}
+
+void JobSystem::resetStats() {
+    for (const std::unique_ptr<ThreadState>& thread : threads_) {
+        thread->jobs.store(0, std::memory_order_relaxed);
+        thread->steals.store(0, std::memory_order_relaxed);
+        thread->busy_ns.store(0, std::memory_order_relaxed);
+    }
+    stats_start_ = std::chrono::steady_clock::now();
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+    PROFILE_THREAD("worker");
+    tls_system = this;
+    tls_thread_index = index;
+    int idle = 0;
+    while (true) {
+        if (Job* job = take()) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < kIdleSpinCount) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        wake_.wait(lock, [this] { return stopping_ || queued_.load(std::memory_order_seq_cst) > 0; });
+        sleeping_.fetch_sub(1, std::memory_order_seq_cst);
+        if (stopping_) {
+            return;
+        }
+        idle = 0;
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+// A queued function, defined by the job system.
+struct Job;
+
+// Counts the unfinished jobs run with it. Jobs can wait for a counter or be
+// queued to start once it is done, which is how dependencies between jobs
+// are expressed.
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator =(const JobCounter&) = delete;
+
+    bool isDone() const;
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending_{0};
+    std::mutex mutex_;
+    // Jobs queued with JobSystem::runAfter, started when pending_ drops to 0.
+    std::vector<Job*> continuations_;
+};
+
+struct JobThreadStats {
+    uint64_t jobs = 0;
+    // Jobs taken from another thread's queue.
+    uint64_t steals = 0;
+    // Time spent running jobs.
+    double busy_ms = 0.0;
+};
+
+// Runs jobs on a fixed pool of worker threads. Every thread owns a Chase-Lev
+// deque: it pushes and pops jobs at the bottom without locking, idle threads
+// steal from the top of the others. Waiting threads run queued jobs instead
+// of blocking. Jobs are queued from the thread that created the system or
+// from jobs, other threads go through a locked queue. Jobs must not throw.
+class JobSystem {
+public:
+    // thread_count includes the calling thread: 0 starts one worker per
+    // hardware thread besides the caller, 1 runs every job on the caller.
+    explicit JobSystem(size_t thread_count = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator =(const JobSystem&) = delete;
+
+    // Workers plus the calling thread.
+    size_t getThreadCount() const;
+
+    // Queues job, counted on counter until it returns. Without workers the
+    // job runs right away.
+    void run(std::function<void()> job, JobCounter* counter = nullptr);
+    // Queues job once dependencies is done, counted on counter from now on.
+    void runAfter(JobCounter& dependencies, std::function<void()> job, JobCounter* counter = nullptr);
+    // Runs queued jobs on the calling thread until counter is done.
+    void wait(JobCounter& counter);
+
+    // Runs task(begin, end) over ranges covering [0, count) and returns once
+    // all of them are done. A thread working on a range hands half of the rest
+    // out whenever its previous half was stolen, down to min_grain items, so
+    // the ranges get only as small as the idle threads need.
+    void parallelFor(uint32_t count, uint32_t min_grain, const std::function<void(uint32_t, uint32_t)>& task);
+    // task(i) for every i in [0, count), for tasks heavy enough to be balanced
+    // one at a time.
+    void parallelFor(uint32_t count, const std::function<void(uint32_t)>& task);
+
+    // Per thread since the last resetStats, index 0 is the creating thread.
+    std::vector<JobThreadStats> getStats() const;
+    double getStatsElapsedMs() const;
+    void resetStats();
+
+private:
+    struct ThreadState;
+    struct ForLoop;
+
+    void push(Job* job);
+    Job* take();
+    void execute(Job* job);
+    void finish(JobCounter* counter);
+    bool isLocalQueueEmpty() const;
+    void runRange(ForLoop& loop, uint32_t begin, uint32_t end);
+    void workerLoop(uint32_t index);
+
+    // Thread 0 is the creating thread, which has a deque but no std::thread.
+    std::vector<std::unique_ptr<ThreadState>> threads_;
+    std::vector<std::thread> workers_;
+
+    // Jobs queued from threads without a deque.
+    std::mutex injected_mutex_;
+    std::deque<Job*> injected_;
+    std::atomic<size_t> injected_count_{0};
+
+    // Idle workers sleep until queued_ becomes positive.
+    std::atomic<int64_t> queued_{0};
+    std::atomic<uint32_t> sleeping_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+
+    std::chrono::steady_clock::time_point stats_start_;
+};
@@ -0,0 +1,199 @@
+// Stress tests of the job system and its work-stealing deque. Every check
+// runs under contention, so a failure may only show up on some runs; the
+// loops are repeated to make those likely.
+
+#include "main/job_system.h"
+#include "main/work_deque.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// The owner pushes and pops while thieves steal: every item must come out
+// exactly once.
+void testWorkDeque() {
+    constexpr int kItemCount = 200000;
+    constexpr int kThiefCount = 3;
+    std::vector<int> items(kItemCount);
+    std::vector<std::atomic<int>> taken(kItemCount);
+    WorkDeque<int> deque;
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < kThiefCount; ++i) {
+        thieves.emplace_back([&] {
+            while (!done.load(std::memory_order_acquire)) {
+                if (int* item = deque.steal()) {
+                    taken[item - items.data()].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    // Bursts of pushes, then pops of a part of them, so the deque often
+    // holds one item with thieves racing the owner for it.
+    int next = 0;
+    while (next < kItemCount) {
+        int burst = 1 + next % 7;
+        for (int i = 0; i < burst && next < kItemCount; ++i, ++next) {
+            while (!deque.push(&items[next])) {
+                if (int* item = deque.pop()) {
+                    taken[item - items.data()].fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        for (int i = 0; i < burst / 2; ++i) {
+            if (int* item = deque.pop()) {
+                taken[item - items.data()].fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    while (int* item = deque.pop()) {
+        taken[item - items.data()].fetch_add(1, std::memory_order_relaxed);
+    }
+    done.store(true, std::memory_order_release);
+    for (std::thread& thief : thieves) {
+        thief.join();
+    }
+
+    bool once = true;
+    for (const std::atomic<int>& count : taken) {
+        once = once && count.load() == 1;
+    }
+    check(once, "WorkDeque hands out every item exactly once");
+    check(deque.empty(), "WorkDeque is empty once drained");
+
+    WorkDeque<int> full;
+    int item = 0;
+    for (int64_t i = 0; i < WorkDeque<int>::kCapacity; ++i) {
+        full.push(&item);
+    }
+    check(!full.push(&item), "WorkDeque refuses pushes when full");
+}
+
+void testParallelFor() {
+    for (size_t thread_count : {1u, 2u, 4u, 8u}) {
+        JobSystem jobs(thread_count);
+        for (uint32_t count : {0u, 1u, 7u, 1000u, 100000u}) {
+            for (uint32_t grain : {1u, 16u, 4096u}) {
+                std::vector<std::atomic<int>> visits(count);
+                jobs.parallelFor(count, grain, [&visits](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; ++i) {
+                        visits[i].fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+                bool once = true;
+                for (const std::atomic<int>& visit : visits) {
+                    once = once && visit.load() == 1;
+                }
+                check(once, "parallelFor handles every index exactly once");
+            }
+        }
+
+        // Nested loops wait inside jobs, which then run other queued jobs.
+        std::vector<std::atomic<int>> visits(64 * 64);
+        jobs.parallelFor(64, [&](uint32_t outer) {
+            jobs.parallelFor(64, [&](uint32_t inner) {
+                visits[outer * 64 + inner].fetch_add(1, std::memory_order_relaxed);
+            });
+        });
+        bool once = true;
+        for (const std::atomic<int>& visit : visits) {
+            once = once && visit.load() == 1;
+        }
+        check(once, "nested parallelFor handles every index exactly once");
+    }
+}
+
+void testRunAfter() {
+    for (size_t thread_count : {1u, 4u}) {
+        JobSystem jobs(thread_count);
+        for (int repetition = 0; repetition < 200; ++repetition) {
+            constexpr int kDependencyCount = 16;
+            std::atomic<int> finished{0};
+            std::atomic<int> seen_by_first{-1};
+            std::atomic<int> seen_by_second{-1};
+            JobCounter dependencies;
+            JobCounter first;
+            JobCounter second;
+            for (int i = 0; i < kDependencyCount; ++i) {
+                jobs.run([&finished, i] {
+                    if (i % 4 == 0) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    }
+                    finished.fetch_add(1, std::memory_order_relaxed);
+                }, &dependencies);
+            }
+            jobs.runAfter(dependencies, [&] { seen_by_first = finished.load(); }, &first);
+            // A chain: the second continuation waits for the first.
+            jobs.runAfter(first, [&] { seen_by_second = seen_by_first.load(); }, &second);
+            jobs.wait(second);
+            check(seen_by_first.load() == kDependencyCount, "runAfter starts once every dependency finished");
+            check(seen_by_second.load() == kDependencyCount, "chained runAfter starts after its dependency");
+            check(first.isDone() && dependencies.isDone(), "waiting on a continuation covers its dependencies");
+        }
+
+        JobCounter done;
+        JobCounter after_done;
+        bool ran = false;
+        jobs.runAfter(done, [&ran] { ran = true; }, &after_done);
+        jobs.wait(after_done);
+        check(ran, "runAfter on a finished counter runs the job");
+    }
+}
+
+// Jobs from threads without a deque go through the injected queue. The
+// queuing thread never waits, so sleeping workers have to wake up for them.
+void testInjectedAndWake() {
+    JobSystem jobs(4);
+    for (int repetition = 0; repetition < 20; ++repetition) {
+        // Long enough for every worker to go to sleep.
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::atomic<int> ran{0};
+        JobCounter counter;
+        std::thread producer([&] {
+            for (int i = 0; i < 1000; ++i) {
+                jobs.run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+            }
+        });
+        producer.join();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!counter.isDone() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        check(counter.isDone(), "sleeping workers wake up for injected jobs");
+        // The counter's last decrement is followed by its lock, wait() takes it.
+        jobs.wait(counter);
+        check(ran.load() == 1000, "every injected job runs once");
+    }
+}
+
+}  // namespace
+
+int main() {
+    testWorkDeque();
+    testParallelFor();
+    testRunAfter();
+    testInjectedAndWake();
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "All job system checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
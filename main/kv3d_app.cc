@@ -0,0 +1,1883 @@
+#include "main/kv3d_app.h"
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "main/bench_report.h"
+#include "main/cpu_profiler.h"
+#include "main/depth_pyramid.h"
+#include "main/dynamic_resolution.h"
+#include "main/frame_capture.h"
+#include "main/gpu_culling.h"
+#include "main/gpu_profiler.h"
+#include "main/light_clustering.h"
+#include "main/render_graph.h"
+#include "main/scene.h"
+#include "main/vulkan_device.h"
+#include "main/model.h"
+#include "main/offscreen_target.h"
+#include "main/pipeline_compiler.h"
+#include "main/render_target.h"
+#include "main/scene_file.h"
+#include "main/scene_generator.h"
+#include "main/shader_watcher.h"
+#include "main/vulkan_swapchain.h"
+#include "main/texture.h"
+#include "main/upscaler.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <cstdlib>
+#include <set>
+#include <unordered_set>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+#include "tools/cpp/runfiles/runfiles.h"
+
+using bazel::tools::cpp::runfiles::Runfiles;
+
+bool checkValidationLayerSupport() {
+    uint32_t layer_count;
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+
+    std::vector<VkLayerProperties> available_layers(layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, available_layers.data());
+
+    for (const char* layer_name : kValidationLayers) {
+        bool layer_found = false;
+
+        for (const auto& layer_properties : available_layers) {
+            if (*layer_name == *layer_properties.layerName) {
+                layer_found = true;
+                break;
+            }
+        }
+
+        if (!layer_found)
+            return false;
+    }
+    
+    return true;
+}
+
+
+// Frames drawn by headless runs without --frames, and the rate their animation
+// clock advances at, so that runs are reproducible.
+constexpr uint32_t kDefaultHeadlessFrames = 100;
+// Where T writes the trace when no --trace path was given.
+constexpr char kDefaultTracePath[] = "kv3d_trace.json";
+// Where P captures frames to when no --capture directory was given.
+constexpr char kDefaultCaptureDir[] = "captures";
+// Loaded when neither --scene nor --objects is given.
+constexpr char kDefaultScenePath[] = "main/scenes/demo.scene";
+constexpr float kHeadlessFrameRate = 60.0f;
+
+const std::string MODEL_PATH = "main/models/viking_room.obj";
+const std::string TEXTURE_PATH = "main/textures/Stone_Tiles_003_COLOR.png";
+const std::string TEXTURE_PATH2 = "main/textures/Blue_Marble_002_COLOR.png";
+
+const std::array<std::pair<std::string_view, VkPresentModeKHR>, 4> kPresentModes = {{
+    {"fifo", VK_PRESENT_MODE_FIFO_KHR},
+    {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+    {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR},
+    {"fifo-relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+}};
+
+std::string_view presentModeName(VkPresentModeKHR present_mode) {
+    for (const auto& [name, mode] : kPresentModes) {
+        if (mode == present_mode) {
+            return name;
+        }
+    }
+    return "unknown";
+}
+
+VkPresentModeKHR parsePresentMode(std::string_view name) {
+    for (const auto& [mode_name, mode] : kPresentModes) {
+        if (mode_name == name) {
+            return mode;
+        }
+    }
+    throw std::runtime_error("Unknown present mode: " + std::string(name));
+}
+
+// Position and target as six comma separated numbers.
+CameraPose parseCameraPose(std::string_view value) {
+    std::array<float, 6> numbers;
+    std::string rest(value);
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        size_t separator = rest.find(',');
+        if ((separator == std::string::npos) != (i + 1 == numbers.size())) {
+            throw std::runtime_error("Expected --camera=X,Y,Z,TARGET_X,TARGET_Y,TARGET_Z: " + std::string(value));
+        }
+        numbers[i] = std::stof(rest.substr(0, separator));
+        rest = separator == std::string::npos ? "" : rest.substr(separator + 1);
+    }
+    return {glm::vec3(numbers[0], numbers[1], numbers[2]), glm::vec3(numbers[3], numbers[4], numbers[5])};
+}
+
+// Fills in the defaults that depend on other settings and rejects
+// combinations that cannot run.
+void finishConfig(AppConfig& config) {
+    if (config.headless && config.frames == 0) {
+        config.frames = kDefaultHeadlessFrames;
+    }
+    if (!config.headless && !config.readback_path.empty()) {
+        throw std::runtime_error("--readback needs --headless");
+    }
+    if (config.bench && config.frames <= config.warmup_frames) {
+        throw std::runtime_error("The benchmark needs more frames than warmup frames");
+    }
+    if (!(config.resolution_scale > 0.0f && config.resolution_scale <= 1.0f) ||
+        !(config.min_resolution_scale > 0.0f && config.min_resolution_scale <= 1.0f)) {
+        throw std::runtime_error("Resolution scales must be in (0, 1]");
+    }
+    config.min_resolution_scale = std::min(config.min_resolution_scale, config.resolution_scale);
+}
+
+// Applies the command line flags on top of config.
+AppConfig parseArgs(int argc, char** argv, AppConfig config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg.rfind("--stress=", 0) == 0) {
+            config.scene.object_count = std::stoul(std::string(arg.substr(9)));
+            config.print_stats = true;
+        } else if (arg.rfind("--objects=", 0) == 0) {
+            config.scene.object_count = std::stoul(std::string(arg.substr(10)));
+        } else if (arg.rfind("--distribution=", 0) == 0) {
+            config.scene.distribution = parseDistribution(arg.substr(15));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            config.scene.seed = std::stoul(std::string(arg.substr(7)));
+        } else if (arg.rfind("--lights=", 0) == 0) {
+            config.point_lights = std::min<uint32_t>(std::stoul(std::string(arg.substr(9))), kMaxPointLights - 1);
+        } else if (arg == "--no-instancing") {
+            config.instancing = false;
+        } else if (arg == "--no-gpu-driven") {
+            config.gpu_driven = false;
+        } else if (arg == "--no-occlusion") {
+            config.occlusion_culling = false;
+        } else if (arg == "--shadows") {
+            config.shadows = true;
+        } else if (arg == "--depth-prepass") {
+            config.depth_prepass = true;
+        } else if (arg == "--software-occlusion") {
+            config.software_occlusion = true;
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            config.threads = std::stoul(std::string(arg.substr(10)));
+        } else if (arg == "--dense") {
+            config.scene.buried = true;
+        } else if (arg == "--stats") {
+            config.print_stats = true;
+        } else if (arg == "--gpu-profile") {
+            config.print_stats = true;
+            config.gpu_profile = true;
+        } else if (arg.rfind("--frames-in-flight=", 0) == 0) {
+            config.frames_in_flight = std::clamp<uint32_t>(std::stoul(std::string(arg.substr(19))), 1, kMaxFramesInFlight);
+        } else if (arg.rfind("--swapchain-images=", 0) == 0) {
+            config.swapchain.image_count = std::stoul(std::string(arg.substr(19)));
+        } else if (arg.rfind("--present-mode=", 0) == 0) {
+            config.swapchain.present_mode = parsePresentMode(arg.substr(15));
+        } else if (arg == "--headless") {
+            config.headless = true;
+        } else if (arg == "--windowed") {
+            config.headless = false;
+        } else if (arg.rfind("--size=", 0) == 0) {
+            std::string size(arg.substr(7));
+            size_t separator = size.find('x');
+            if (separator == std::string::npos) {
+                throw std::runtime_error("Expected --size=WIDTHxHEIGHT: " + size);
+            }
+            config.resolution.width = std::max<uint32_t>(std::stoul(size.substr(0, separator)), 1);
+            config.resolution.height = std::max<uint32_t>(std::stoul(size.substr(separator + 1)), 1);
+        } else if (arg.rfind("--resolution-scale=", 0) == 0) {
+            config.resolution_scale = std::stof(std::string(arg.substr(19)));
+        } else if (arg.rfind("--min-resolution-scale=", 0) == 0) {
+            config.min_resolution_scale = std::stof(std::string(arg.substr(23)));
+        } else if (arg.rfind("--dynamic-resolution=", 0) == 0) {
+            config.dynamic_resolution_ms = std::stod(std::string(arg.substr(21)));
+        } else if (arg.rfind("--frames=", 0) == 0) {
+            config.frames = std::stoul(std::string(arg.substr(9)));
+        } else if (arg.rfind("--readback=", 0) == 0) {
+            config.readback_path = std::string(arg.substr(11));
+        } else if (arg.rfind("--capture=", 0) == 0) {
+            config.capture_dir = std::string(arg.substr(10));
+        } else if (arg.rfind("--warmup=", 0) == 0) {
+            config.warmup_frames = std::stoul(std::string(arg.substr(9)));
+        } else if (arg.rfind("--json=", 0) == 0) {
+            config.json_path = std::string(arg.substr(7));
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            config.trace_path = std::string(arg.substr(8));
+        } else if (arg.rfind("--scene=", 0) == 0) {
+            config.scene_file = std::string(arg.substr(8));
+        } else if (arg.rfind("--camera=", 0) == 0) {
+            config.camera = parseCameraPose(arg.substr(9));
+        } else if (arg.rfind("--shader-dir=", 0) == 0) {
+            config.shader_dir = std::string(arg.substr(13));
+        } else if (arg.rfind("--shader-compiler=", 0) == 0) {
+            config.shader_compiler = std::string(arg.substr(18));
+        } else {
+            throw std::runtime_error("Unknown argument: " + std::string(arg));
+        }
+    }
+    finishConfig(config);
+    return config;
+}
+
+// SPIR-V of the scene's graphics pipelines.
+struct SceneShaderCode {
+    std::vector<char> vert;
+    std::vector<char> frag;
+    std::vector<char> depth_vert;
+};
+
+VkShaderModule createShaderModule(VkDevice device, const std::vector<char>& code) {
+    VkShaderModuleCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size();
+    create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shader module!");
+    }
+
+    return shader_module;
+}
+
+// The scene's pipelines in the order of ScenePipelines. Without shadows the
+// fragment shader is specialized to skip the shadow lookup. Only uses its
+// arguments, so pipeline compiler threads can run it.
+std::vector<VkPipeline> createScenePipelines(VkDevice device, VkPipelineLayout pipeline_layout, VkRenderPass render_pass,
+                                             VkPipelineCache cache, const SceneShaderCode& code, bool shadows) {
+    PROFILE_SCOPE("createScenePipelines");
+    std::vector<VkPipeline> pipelines;
+    VkShaderModule vert_shader_module = createShaderModule(device, code.vert);
+    VkShaderModule frag_shader_module = createShaderModule(device, code.frag);
+    VkShaderModule depth_vert_shader_module = createShaderModule(device, code.depth_vert);
+    auto destroyModules = [&] {
+        vkDestroyShaderModule(device, depth_vert_shader_module, nullptr);
+        vkDestroyShaderModule(device, frag_shader_module, nullptr);
+        vkDestroyShaderModule(device, vert_shader_module, nullptr);
+    };
+
+    VkBool32 shadows_constant = shadows ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry shadows_entry{};
+    shadows_entry.constantID = 0;
+    shadows_entry.offset = 0;
+    shadows_entry.size = sizeof(VkBool32);
+
+    VkSpecializationInfo specialization_info{};
+    specialization_info.mapEntryCount = 1;
+    specialization_info.pMapEntries = &shadows_entry;
+    specialization_info.dataSize = sizeof(VkBool32);
+    specialization_info.pData = &shadows_constant;
+
+    VkPipelineShaderStageCreateInfo vert_shader_stage_info{};
+    vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_shader_stage_info.module = vert_shader_module;
+    vert_shader_stage_info.pName = "main";
+
+    VkPipelineShaderStageCreateInfo frag_shader_stage_info{};
+    frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_shader_stage_info.module = frag_shader_module;
+    frag_shader_stage_info.pName = "main";
+    frag_shader_stage_info.pSpecializationInfo = &specialization_info;
+
+    VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = 1;
+    auto binding_description = Vertex::getBindingDescription();
+    vertex_input_info.pVertexBindingDescriptions = &binding_description;
+    auto attribute_description = Vertex::getAttributeDescriptions();
+    vertex_input_info.vertexAttributeDescriptionCount = attribute_description.size();
+    vertex_input_info.pVertexAttributeDescriptions = attribute_description.data();
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    std::vector<VkDynamicState> dynamic_states = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
+    // Both are dynamic, set by every pass that draws.
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+    rasterizer.depthBiasConstantFactor = 0.0f;
+    rasterizer.depthBiasClamp = 0.0f;
+    rasterizer.depthBiasSlopeFactor = 0.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+    multisampling.pSampleMask = nullptr;
+    multisampling.alphaToCoverageEnable = VK_FALSE;
+    multisampling.alphaToOneEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.logicOpEnable = VK_FALSE;
+    color_blending.logicOp = VK_LOGIC_OP_COPY; // Optional
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+    color_blending.blendConstants[0] = 0.0f; // Optional
+    color_blending.blendConstants[1] = 0.0f; // Optional
+    color_blending.blendConstants[2] = 0.0f; // Optional
+    color_blending.blendConstants[3] = 0.0f; // Optional
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = pipeline_layout;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = 0;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    auto createPipeline = [&]() {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, cache, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+            for (VkPipeline created : pipelines) {
+                vkDestroyPipeline(device, created, nullptr);
+            }
+            destroyModules();
+            throw std::runtime_error("Failed to create graphics pipeline!");
+        }
+        pipelines.push_back(pipeline);
+    };
+
+    createPipeline();
+
+    // Transparent objects are blended over the opaque ones, tested against
+    // their depth but not writing it, so sorted draws don't hide each other.
+    color_blend_attachment.blendEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_FALSE;
+    createPipeline();
+
+    // The pre-pass itself: the position stream, no fragment shader and no color writes.
+    VkPipelineShaderStageCreateInfo depth_vert_shader_stage_info = vert_shader_stage_info;
+    depth_vert_shader_stage_info.module = depth_vert_shader_module;
+
+    auto position_binding_description = Vertex::getPositionBindingDescription();
+    auto position_attribute_description = Vertex::getPositionAttributeDescription();
+    VkPipelineVertexInputStateCreateInfo position_input_info = vertex_input_info;
+    position_input_info.pVertexBindingDescriptions = &position_binding_description;
+    position_input_info.vertexAttributeDescriptionCount = 1;
+    position_input_info.pVertexAttributeDescriptions = &position_attribute_description;
+
+    VkPipelineColorBlendAttachmentState depth_only_attachment = color_blend_attachment;
+    depth_only_attachment.blendEnable = VK_FALSE;
+    depth_only_attachment.colorWriteMask = 0;
+    color_blending.pAttachments = &depth_only_attachment;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    pipeline_info.stageCount = 1;
+    pipeline_info.pStages = &depth_vert_shader_stage_info;
+    pipeline_info.pVertexInputState = &position_input_info;
+    createPipeline();
+
+    // After the depth pre-pass, opaque objects only shade the fragments
+    // that ended up nearest.
+    color_blend_attachment.blendEnable = VK_FALSE;
+    color_blending.pAttachments = &color_blend_attachment;
+    depth_stencil.depthWriteEnable = VK_FALSE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stages;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    createPipeline();
+
+    destroyModules();
+    return pipelines;
+}
+
+class HelloTriangleApplication {
+public:
+    HelloTriangleApplication(Runfiles* runfiles, const AppConfig& config)
+        : runfiles_(runfiles), config_(config) {}
+
+    void run() {
+        PROFILE_THREAD("main");
+        if (!config_.headless) {
+            initWindow();
+        }
+        initVulkan();
+        mainLoop();
+        cleanup();
+    }
+
+    // Frame times recorded by a benchmark run.
+    AppResult getResult() const {
+        return {summarize(bench_samples_.cpu_ms), summarize(bench_samples_.gpu_ms), summarize(bench_samples_.frame_ms)};
+    }
+
+private:
+    void cursorEvent(double x_pos, double y_pos) {
+        if (left_mouse_button_down_) {
+            float dx = x_pos - mouse_x;
+            float dy = y_pos - mouse_y;
+            scene_.moveCamera(dx, -dy);
+        }
+
+        if (right_mouse_button_down_) {
+            float dx = x_pos - mouse_x;
+            float dy = y_pos - mouse_y;
+            scene_.rotateCamera(dx, -dy);
+        }
+
+        if (!left_mouse_button_down_ && !right_mouse_button_down_) {
+            pickObject(x_pos, y_pos);
+        }
+
+        mouse_x = x_pos;
+        mouse_y = y_pos;
+    }
+
+    // Tracks the object under the cursor, shown in the stats line.
+    void pickObject(double x_pos, double y_pos) {
+        int width, height;
+        glfwGetWindowSize(window_, &width, &height);
+        if (width == 0 || height == 0) {
+            return;
+        }
+
+        hovered_object_ = scene_.pick(static_cast<float>(x_pos / width), static_cast<float>(y_pos / height));
+    }
+
+    void mouseEvent(int key, int event) {
+        if (key == GLFW_MOUSE_BUTTON_1) {
+            if (event == GLFW_PRESS) { 
+                left_mouse_button_down_ = true;
+            }
+
+            if (event == GLFW_RELEASE) {
+                left_mouse_button_down_ = false;
+            }
+        } else if (key == GLFW_MOUSE_BUTTON_2) {
+            if (event == GLFW_PRESS) { 
+                right_mouse_button_down_ = true;
+            }
+
+            if (event == GLFW_RELEASE) {
+                right_mouse_button_down_ = false;
+            }
+        }
+    }
+
+    void keyEvent(int key, int action) {
+        if (action != GLFW_PRESS) {
+            return;
+        }
+
+        if (key == GLFW_KEY_I) {
+            scene_.setInstancing(!scene_.isInstancing());
+            std::cout << "Instancing " << (scene_.isInstancing() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_C) {
+            static const char* kModeNames[] = {"off", "linear", "bvh"};
+            int mode = (static_cast<int>(scene_.getCullingMode()) + 1) % 3;
+            scene_.setCullingMode(static_cast<CullingMode>(mode));
+            std::cout << "CPU frustum culling: " << kModeNames[mode] << std::endl;
+        } else if (key == GLFW_KEY_G) {
+            scene_.setGpuDriven(!scene_.isGpuDriven());
+            std::cout << "GPU-driven rendering " << (scene_.isGpuDriven() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_O) {
+            scene_.setOcclusionCulling(!scene_.isOcclusionCulling());
+            std::cout << "Occlusion culling " << (scene_.isOcclusionCulling() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_Z) {
+            scene_.setDepthPrepass(!scene_.isDepthPrepass());
+            std::cout << "Depth pre-pass " << (scene_.isDepthPrepass() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_S) {
+            scene_.setSoftwareOcclusion(!scene_.isSoftwareOcclusion());
+            std::cout << "Software occlusion culling " << (scene_.isSoftwareOcclusion() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_H) {
+            scene_.setShadows(!scene_.isShadows());
+            std::cout << "Shadows " << (scene_.isShadows() ? "enabled" : "disabled") << std::endl;
+        } else if (key == GLFW_KEY_L) {
+            key_light_paused_ = !key_light_paused_;
+            std::cout << "Key light " << (key_light_paused_ ? "paused" : "moving") << std::endl;
+        } else if (key == GLFW_KEY_D) {
+            scene_.dumpOcclusionBuffer("occlusion_buffer.pgm");
+            std::cout << "Software occlusion buffer written to occlusion_buffer.pgm" << std::endl;
+        } else if (key == GLFW_KEY_T && isTracing()) {
+            writeTrace();
+        } else if (key == GLFW_KEY_P && frame_capture_.isReady()) {
+            capturing_ = !capturing_;
+            std::string dir = config_.capture_dir.empty() ? kDefaultCaptureDir : config_.capture_dir;
+            if (capturing_) {
+                std::filesystem::create_directories(dir);
+            }
+            std::cout << "Frame capture " << (capturing_ ? "started, writing to " + dir : "stopped") << std::endl;
+        }
+    }
+
+    std::optional<PickResult> hovered_object_;
+    bool left_mouse_button_down_ = false;
+    bool right_mouse_button_down_ = false;
+    float mouse_x;
+    float mouse_y;
+
+    // Paths that don't exist as given are looked up in the runfiles.
+    std::string resolvePath(const std::string& path) const {
+        if (std::filesystem::exists(path)) {
+            return path;
+        }
+        std::string runfile = runfiles_->Rlocation("_main/" + path);
+        return runfile.empty() ? path : runfile;
+    }
+
+    std::vector<char> readFile(const std::string& filename) {
+        std::string file_path = runfiles_->Rlocation("_main/" + filename);
+
+        std::ifstream file(file_path, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file!");
+        }
+
+        size_t file_size = static_cast<size_t>(file.tellg());
+        std::vector<char> buffer(file_size);
+
+        file.seekg(0);
+        file.read(buffer.data(), file_size);
+        file.close();
+
+        return buffer;
+    }
+
+    void initWindow() {
+        PROFILE_SCOPE("initWindow");
+        glfwInit();
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+
+        window_ = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        
+        glfwSetWindowUserPointer(window_, this);
+        auto callback = [](GLFWwindow* window, int width, int height) {
+            static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->framebufferResizeCallback(width, height);
+        };
+        glfwSetFramebufferSizeCallback(window_, callback);
+    
+        auto cursor_callback = [](GLFWwindow* window, double x_pos, double y_pos) {
+            static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->cursorEvent(x_pos, y_pos);
+        };
+        glfwSetCursorPosCallback(window_, cursor_callback);
+
+        auto mouse_button_callback = [](GLFWwindow* window, int button, int action, int mods) {
+            static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->mouseEvent(button, action);
+        };
+        glfwSetMouseButtonCallback(window_, mouse_button_callback);
+
+        auto key_callback = [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+            static_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window))->keyEvent(key, action);
+        };
+        glfwSetKeyCallback(window_, key_callback);
+    }
+
+    void framebufferResizeCallback(int width, int height) {
+        framebuffer_resized_ = true;
+    }
+
+    void createInstance() {
+        PROFILE_SCOPE("createInstance");
+        if (kEnableValidationLayers && !checkValidationLayerSupport()) {
+            throw std::runtime_error("validation layers requested, but not available!");
+        }
+
+        VkApplicationInfo app_info{};
+        app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        app_info.pApplicationName = "Hello Triangle";
+        app_info.applicationVersion = VK_MAKE_VERSION(0, 0, 1);
+        app_info.pEngineName = "No Engine";
+        app_info.engineVersion = VK_MAKE_VERSION(0, 0, 1);
+        app_info.apiVersion = VK_API_VERSION_1_0;
+
+        VkInstanceCreateInfo create_info{};
+        create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        create_info.pApplicationInfo = &app_info;
+
+        // Headless runs render offscreen and need no surface extensions.
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions = nullptr;
+
+        if (!config_.headless) {
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        }
+        std::vector<VkExtensionProperties> available_extensions = getAvailableExtensions();
+        for (int i = 0; i < glfwExtensionCount; ++i) {
+            std::string_view extension_name(glfwExtensions[i]);
+            bool found = false;
+            for (const auto& extension : available_extensions) {
+                if (extension.extensionName == extension_name) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                throw std::runtime_error("Required extension is missing! " + std::string(extension_name));
+            }
+        }
+
+        create_info.enabledExtensionCount = glfwExtensionCount;
+        create_info.ppEnabledExtensionNames = glfwExtensions;
+
+        if (kEnableValidationLayers) {
+            create_info.enabledLayerCount = static_cast<uint32_t>(std::size(kValidationLayers));
+            create_info.ppEnabledLayerNames = kValidationLayers;
+        } else {
+            create_info.enabledLayerCount = 0;
+        }
+
+        if (vkCreateInstance(&create_info, nullptr, &instance_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create VK instance!");
+        }
+    }
+
+    std::vector<VkExtensionProperties> getAvailableExtensions() {
+        uint32_t extension_count = 0;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
+        return extensions;
+    }
+
+    void initVulkan() {
+        PROFILE_SCOPE("initVulkan");
+        createInstance();
+        if (config_.headless) {
+            // One offscreen image per frame in flight, frames never wait for a presentation engine.
+            vulkan_device_ = std::make_unique<VulkanDevice>(instance_, VK_NULL_HANDLE);
+            vulkan_device_->setFramesInFlight(config_.frames_in_flight);
+            offscreen_ = OffscreenTarget::create(vulkan_device_.get(), config_.resolution, vulkan_device_->getFramesInFlight());
+            target_ = offscreen_.get();
+            std::cout << "headless: " << config_.resolution.width << "x" << config_.resolution.height
+                      << " on " << vulkan_device_->getProperties().deviceName
+                      << " frames in flight: " << vulkan_device_->getFramesInFlight()
+                      << " frames: " << config_.frames << std::endl;
+        } else {
+            createSurface();
+            vulkan_device_ = std::make_unique<VulkanDevice>(instance_, surface_);
+            vulkan_device_->setFramesInFlight(config_.frames_in_flight);
+            swapchain_ = VulkanSwapchain::createSwapChain(vulkan_device_.get(), surface_, window_, config_.swapchain);
+            target_ = swapchain_.get();
+            std::cout << "frames in flight: " << vulkan_device_->getFramesInFlight()
+                      << " swapchain images: " << swapchain_->getImageCount()
+                      << " present mode: " << presentModeName(swapchain_->getPresentMode()) << std::endl;
+        }
+
+        render_graph_.init(vulkan_device_.get());
+        depth_format_ = findDepthFormat();
+        createDescriptorSetLayout();
+        createGraphicsPipeline();
+
+        createScene();
+
+        createCommandBuffers();
+        createSyncObjects();
+        createGpuProfiler();
+        createUpscaler();
+        createFrameCapture();
+    }
+
+    // Rendering below the target's resolution draws the scene into a target
+    // sized image and upscales the rendered part. Scale changes only change
+    // the render area, so they never reallocate or recompile anything.
+    void createUpscaler() {
+        if (config_.resolution_scale == 1.0f && config_.dynamic_resolution_ms <= 0.0) {
+            return;
+        }
+        if (config_.dynamic_resolution_ms > 0.0) {
+            if (gpu_profiler_.isReady()) {
+                dynamic_resolution_.emplace(config_.dynamic_resolution_ms, config_.min_resolution_scale, config_.resolution_scale);
+            } else {
+                std::cout << "Dynamic resolution needs GPU timestamps, rendering at a fixed scale" << std::endl;
+            }
+        }
+        upscaler_.init(vulkan_device_.get(), render_graph_.getCompatibleRenderPass({target_->getImageFormat()}, VK_FORMAT_UNDEFINED),
+                       readFile("main/shaders/upscale.vert.spv"), readFile("main/shaders/upscale.frag.spv"));
+        frame_scales_.assign(vulkan_device_->getFramesInFlight(), 1.0f);
+    }
+
+    float getResolutionScale() const {
+        return dynamic_resolution_ ? dynamic_resolution_->getScale() : config_.resolution_scale;
+    }
+
+    // Sets the part of the targets the frame renders into, before the scene's
+    // uniforms are written since light clustering follows it.
+    void updateRenderExtent() {
+        VkExtent2D extent = target_->getExtent();
+        render_extent_ = extent;
+        if (!upscaler_.isReady()) {
+            return;
+        }
+        float scale = getResolutionScale();
+        render_extent_.width = std::clamp(static_cast<uint32_t>(std::lround(extent.width * scale)), 1u, extent.width);
+        render_extent_.height = std::clamp(static_cast<uint32_t>(std::lround(extent.height * scale)), 1u, extent.height);
+        frame_scales_[current_frame_] = scale;
+        scene_.setRenderExtent(render_extent_);
+    }
+
+    void createFrameCapture() {
+        capturing_ = !config_.capture_dir.empty();
+        if (!target_->isCopySource() || !FrameCapture::isFormatSupported(target_->getImageFormat())) {
+            if (capturing_) {
+                std::cout << "Frame capture is not supported by the swapchain" << std::endl;
+            }
+            capturing_ = false;
+            return;
+        }
+        frame_capture_.init(vulkan_device_.get());
+        if (capturing_) {
+            std::filesystem::create_directories(config_.capture_dir);
+        }
+    }
+
+    // Where the frame being drawn is written, nothing when it is not captured.
+    // --readback takes the last frame of a headless run, continuous capture
+    // every frame.
+    std::optional<std::string> getCapturePath() const {
+        if (!frame_capture_.isReady()) {
+            return std::nullopt;
+        }
+        if (!config_.readback_path.empty() && frames_drawn_ + 1 == config_.frames) {
+            return config_.readback_path;
+        }
+        if (capturing_) {
+            std::string name = std::to_string(frames_drawn_);
+            name.insert(0, name.size() < 6 ? 6 - name.size() : 0, '0');
+            return (std::filesystem::path(config_.capture_dir.empty() ? kDefaultCaptureDir : config_.capture_dir) / ("frame_" + name + ".png")).string();
+        }
+        return std::nullopt;
+    }
+
+    // The key light orbits the scene like the single light used to, the
+    // others are scattered over light_area_ with random colors.
+    void createScene() {
+        PROFILE_SCOPE("createScene");
+        VkExtent2D extent = target_->getExtent();
+        scene_.init(vulkan_device_.get(), config_.threads);
+        scene_.setScreenSize(extent.width, extent.height);
+        scene_.setInstancing(config_.instancing);
+        scene_.setSoftwareOcclusion(config_.software_occlusion);
+        scene_.setPipelines(getScenePipelines(generic_pipelines_));
+        scene_.setDepthPrepass(config_.depth_prepass);
+        if (config_.gpu_driven) {
+            if (GpuCulling::isSupported(*vulkan_device_)) {
+                scene_.initGpuCulling(readFile("main/shaders/cull.comp.spv"));
+                if (config_.occlusion_culling && DepthPyramid::isSupported(*vulkan_device_)) {
+                    // The depth buffer is set once the first frame's render graph is compiled.
+                    scene_.initOcclusionCulling(readFile("main/shaders/depth_pyramid.comp.spv"));
+                }
+            } else {
+                std::cout << "GPU-driven rendering is not supported, falling back to CPU submission" << std::endl;
+            }
+        }
+        scene_.initLighting(readFile("main/shaders/cluster.comp.spv"));
+        scene_.initShadows(readFile("main/shaders/shadow.vert.spv"));
+        scene_.setShadows(config_.shadows);
+        std::vector<PointLight> scene_lights = loadScene();
+        // --lights is clamped on its own, the scattered lights also leave room
+        // for the key light and the scene file's lights.
+        size_t light_room = kMaxPointLights - 1 - std::min<size_t>(scene_lights.size(), kMaxPointLights - 1);
+        createLights(static_cast<uint32_t>(std::min<size_t>(config_.point_lights, light_room)));
+        for (const PointLight& light : scene_lights) {
+            scene_.addPointLight(light);
+        }
+        scene_.createDescriptorSets(descriptor_set_layout_);
+        if (config_.camera) {
+            scene_.setCamera(config_.camera->position, config_.camera->target);
+        }
+    }
+
+    // Generates the scene or reads the scene file, then loads its assets in
+    // one batch. Returns the lights of the file, which go after the app's own.
+    std::vector<PointLight> loadScene() {
+        auto start = std::chrono::steady_clock::now();
+        SceneDescription description;
+        std::string source = "generated";
+        if (config_.scene.object_count > 0) {
+            light_area_ = generateSceneDescription(config_.scene, description);
+        } else {
+            source = config_.scene_file.empty() ? kDefaultScenePath : config_.scene_file;
+            description = readSceneFile(resolvePath(source));
+        }
+        auto described = std::chrono::steady_clock::now();
+
+        SceneLoadStats stats = instantiateScene(scene_, description);
+        if (config_.scene.object_count == 0) {
+            light_area_ = scene_.getBounds();
+        }
+        for (uint32_t i = 0; i < description.objects.size(); ++i) {
+            if (description.objects[i].dynamic) {
+                bobbing_objects_.emplace_back(stats.handles[i], description.objects[i].position);
+            }
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "scene: " << source << " objects: " << stats.objects
+                  << " meshes: " << stats.assets.meshes << " textures: " << stats.assets.textures
+                  << " loaded in " << std::chrono::duration<float, std::milli>(end - start).count() << " ms"
+                  << " (read " << std::chrono::duration<float, std::milli>(described - start).count() << " ms"
+                  << ", decode " << stats.assets.decode_ms << " ms"
+                  << ", upload " << stats.assets.upload_ms << " ms of " << stats.assets.uploaded_bytes / (1 << 20) << " MiB"
+                  << ", build " << stats.build_ms << " ms)" << std::endl;
+        return description.lights;
+    }
+
+    void createLights(uint32_t count) {
+        PointLight key_light;
+        key_light.position = glm::vec4(0.0f, 200.0f, 200.0f, 1000.0f);
+        key_light.color = glm::vec4(1.0f);
+        key_light_ = scene_.addPointLight(key_light);
+
+        std::mt19937 random(42);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        glm::vec3 area_size = light_area_.max - light_area_.min;
+        for (uint32_t i = 0; i < count; ++i) {
+            glm::vec3 pos = light_area_.min + glm::vec3(unit(random), unit(random), unit(random)) * area_size;
+            PointLight light;
+            light.position = glm::vec4(pos, 40.0f + 40.0f * unit(random));
+            light.color = glm::vec4(unit(random), unit(random), unit(random), 1.0f) * 2.0f;
+            scattered_lights_.push_back(light);
+            scene_.addPointLight(light);
+        }
+    }
+
+    // Moves the lights and the dynamic objects. Every light moves every frame,
+    // so the clusters are rebuilt from scratch.
+    // A paused key light keeps the static shadow casters cached.
+    void animateScene() {
+        static auto s_start_time = std::chrono::high_resolution_clock::now();
+        float time = config_.headless ? static_cast<float>(frames_drawn_) / kHeadlessFrameRate
+                                      : std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - s_start_time).count();
+        if (!key_light_paused_) {
+            key_light_angle_ = time;
+        }
+
+        PointLight key_light;
+        key_light.position = glm::vec4(std::sin(key_light_angle_) * 200.0f, 200.0f, std::cos(key_light_angle_) * 200.0f, 1000.0f);
+        key_light.color = glm::vec4(1.0f);
+        scene_.setPointLight(key_light_, key_light);
+
+        for (uint32_t i = 0; i < scattered_lights_.size(); ++i) {
+            PointLight light = scattered_lights_[i];
+            light.position.y += std::sin(time + static_cast<float>(i)) * 20.0f;
+            scene_.setPointLight(key_light_ + 1 + i, light);
+        }
+
+        for (const auto& [object, position] : bobbing_objects_) {
+            scene_.setObjectPosition(object, position + glm::vec3(0.0f, std::sin(time * 2.0f) * 15.0f, 0.0f));
+        }
+    }
+
+    void createDescriptorSetLayout() {
+        std::vector<VkDescriptorBindingFlags> bindings_flags;
+
+        VkDescriptorSetLayoutBinding ubo_layout_binding{};
+        ubo_layout_binding.binding = 0;
+        ubo_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        ubo_layout_binding.descriptorCount = 1;
+        ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        ubo_layout_binding.pImmutableSamplers = nullptr;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        // Every scene texture is bound at once and selected per instance.
+        VkDescriptorSetLayoutBinding sampler_layout_binding{};
+        sampler_layout_binding.binding = 1;
+        sampler_layout_binding.descriptorCount = kMaxTextures;
+        sampler_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        sampler_layout_binding.pImmutableSamplers = nullptr;
+        sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        VkDescriptorSetLayoutBinding instance_layout_binding{};
+        instance_layout_binding.binding = 2;
+        instance_layout_binding.descriptorCount = 1;
+        instance_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        instance_layout_binding.pImmutableSamplers = nullptr;
+        instance_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        // Clustered lighting: the light list, the lights of every cluster and the grid parameters.
+        VkDescriptorSetLayoutBinding light_layout_binding{};
+        light_layout_binding.binding = 3;
+        light_layout_binding.descriptorCount = 1;
+        light_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        light_layout_binding.pImmutableSamplers = nullptr;
+        light_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        VkDescriptorSetLayoutBinding cluster_layout_binding = light_layout_binding;
+        cluster_layout_binding.binding = 4;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        VkDescriptorSetLayoutBinding cluster_uniform_layout_binding = light_layout_binding;
+        cluster_uniform_layout_binding.binding = 5;
+        cluster_uniform_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        // Shadow cube map of the scene light.
+        VkDescriptorSetLayoutBinding shadow_map_layout_binding{};
+        shadow_map_layout_binding.binding = 6;
+        shadow_map_layout_binding.descriptorCount = 1;
+        shadow_map_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        shadow_map_layout_binding.pImmutableSamplers = nullptr;
+        shadow_map_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings_flags.push_back(VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
+
+        std::array<VkDescriptorSetLayoutBinding, 7> bindings = {ubo_layout_binding, sampler_layout_binding, instance_layout_binding,
+                                                                light_layout_binding, cluster_layout_binding, cluster_uniform_layout_binding,
+                                                                shadow_map_layout_binding};
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create{};
+        binding_flags_create.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        binding_flags_create.pBindingFlags = bindings_flags.data();
+        binding_flags_create.bindingCount = bindings_flags.size();
+        binding_flags_create.pNext = nullptr;
+
+        VkDescriptorSetLayoutCreateInfo layout_info{};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.bindingCount = bindings.size();
+        layout_info.pBindings = bindings.data();
+        layout_info.pNext = &binding_flags_create;
+
+        if (vkCreateDescriptorSetLayout(*vulkan_device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout!");
+        }
+    }
+
+    VkFormat findDepthFormat() {
+        return vulkan_device_->findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+    }
+
+    void createSyncObjects() {
+        uint32_t frame_count = vulkan_device_->getFramesInFlight();
+        image_available_semaphores_.resize(frame_count);
+        render_finished_semaphores_.resize(frame_count);
+        in_flight_fences_.resize(frame_count);
+        submit_times_.resize(frame_count);
+        submit_ns_.assign(frame_count, 0);
+        submit_pending_.assign(frame_count, false);
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fence_info{};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (uint32_t i = 0; i < frame_count; ++i) {
+            if (vkCreateSemaphore(*vulkan_device_, &semaphore_info, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(*vulkan_device_, &semaphore_info, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
+                vkCreateFence(*vulkan_device_, &fence_info, nullptr, &in_flight_fences_[i]) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create semaphores!");
+            }
+        }
+    }
+
+    void recordCommandBuffer(VkCommandBuffer command_buffer, uint32_t image_index) {
+        PROFILE_SCOPE("recordCommandBuffer");
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = 0;
+        begin_info.pInheritanceInfo = nullptr;
+
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording command buffer!");
+        }
+
+        GpuProfiler* profiler = gpu_profiler_.isReady() ? &gpu_profiler_ : nullptr;
+        if (profiler) {
+            profiler->beginFrame(command_buffer, current_frame_);
+            timestamps_measured_[current_frame_] = isMeasuring();
+        }
+
+        RenderGraphImage depth = declareFrame(image_index);
+        render_graph_.compile();
+        // The depth pyramid is built from the transient depth image, which is
+        // replaced along with the target. Creating the pyramid enables
+        // occlusion culling, which changes the frame's passes.
+        VkImageView depth_view = render_graph_.getImageView(depth);
+        if (depth_view != depth_view_) {
+            depth_view_ = depth_view;
+            bool occlusion_culling = scene_.isOcclusionCulling();
+            scene_.setDepthBuffer(depth_view, target_->getExtent());
+            if (scene_.isOcclusionCulling() != occlusion_culling) {
+                declareFrame(image_index);
+                render_graph_.compile();
+            }
+        }
+        render_graph_.execute(command_buffer, profiler);
+
+        if (profiler) {
+            profiler->endFrame(command_buffer);
+        }
+
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record command buffer!");
+        }
+    }
+
+    // Declares the frame's passes and returns its depth image. Barriers
+    // between the passes, layout transitions and attachment load and store
+    // operations all follow from the declared uses, see RenderGraph.
+    RenderGraphImage declareFrame(uint32_t image_index) {
+        VkExtent2D extent = target_->getExtent();
+        VkExtent2D render_extent = render_extent_;
+        bool occlusion_culling = scene_.isOcclusionCulling();
+        bool upscaling = upscaler_.isReady();
+        render_graph_.reset();
+        // Nothing of the previous frame is kept, the acquire semaphore is
+        // waited for at color attachment output.
+        RenderGraphImage color = render_graph_.importImage("color", target_->getImage(image_index), target_->getImageView(image_index),
+                                                           {target_->getImageFormat(), extent}, VK_IMAGE_LAYOUT_UNDEFINED,
+                                                           VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, target_->getFinalLayout());
+        // Sampled by the depth pyramid. Declared sampled in every frame, so
+        // frames with and without occlusion culling share the image.
+        RenderGraphImage depth = render_graph_.createImage("depth", {depth_format_, extent, VK_IMAGE_USAGE_SAMPLED_BIT});
+        // Rendered below the resolution, in the target's format so the scene
+        // pipelines work on both.
+        RenderGraphImage scene_color = upscaling ? render_graph_.createImage("scene color", {target_->getImageFormat(), extent}) : color;
+
+        // Light clustering, shadow maps and culling, which open their own
+        // profiler scopes and synchronize the buffers they write.
+        render_graph_.addPass("culling", RenderGraphPassType::kCompute, [this](VkCommandBuffer command_buffer) {
+            scene_.dispatchCulling(command_buffer, current_frame_);
+        }, kRenderGraphSideEffects | kRenderGraphNoProfileScope);
+
+        RenderGraphPass main_pass = render_graph_.addPass(occlusion_culling ? "early pass" : "main pass", RenderGraphPassType::kGraphics,
+                                                          [this, render_extent](VkCommandBuffer command_buffer) {
+            setViewport(command_buffer, render_extent);
+            scene_.draw(command_buffer, pipeline_layout_, current_frame_);
+        });
+        VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+        VkClearValue clear_depth{};
+        clear_depth.depthStencil = {1.0f, 0};
+        render_graph_.use(main_pass, scene_color, ImageUsage::kColorAttachment);
+        render_graph_.use(main_pass, depth, ImageUsage::kDepthAttachment);
+        render_graph_.clear(main_pass, scene_color, clear_color);
+        render_graph_.clear(main_pass, depth, clear_depth);
+        render_graph_.setRenderArea(main_pass, render_extent);
+
+        if (occlusion_culling) {
+            // Builds the depth pyramid from the early pass's depth and culls
+            // what the early pass skipped into the late pass's draws.
+            RenderGraphPass occlusion_pass = render_graph_.addPass("occlusion culling", RenderGraphPassType::kCompute,
+                                                                   [this](VkCommandBuffer command_buffer) {
+                scene_.dispatchOcclusionCulling(command_buffer, current_frame_);
+            }, kRenderGraphSideEffects);
+            render_graph_.use(occlusion_pass, depth, ImageUsage::kComputeSampled);
+
+            RenderGraphPass late_pass = render_graph_.addPass("late pass", RenderGraphPassType::kGraphics,
+                                                              [this, render_extent](VkCommandBuffer command_buffer) {
+                setViewport(command_buffer, render_extent);
+                scene_.drawLate(command_buffer, pipeline_layout_, current_frame_);
+            });
+            render_graph_.use(late_pass, scene_color, ImageUsage::kColorAttachment);
+            render_graph_.use(late_pass, depth, ImageUsage::kDepthAttachment);
+            render_graph_.setRenderArea(late_pass, render_extent);
+        }
+
+        if (upscaling) {
+            RenderGraphPass upscale_pass = render_graph_.addPass("upscale", RenderGraphPassType::kGraphics,
+                                                                 [this, scene_color, extent, render_extent](VkCommandBuffer command_buffer) {
+                upscaler_.record(command_buffer, current_frame_, render_graph_.getImageView(scene_color), extent, render_extent, extent);
+            });
+            render_graph_.use(upscale_pass, scene_color, ImageUsage::kFragmentSampled);
+            render_graph_.use(upscale_pass, color, ImageUsage::kColorAttachment);
+        }
+
+        if (capture_path_) {
+            RenderGraphPass capture_pass = render_graph_.addPass("capture", RenderGraphPassType::kTransfer,
+                                                                 [this, image_index, extent](VkCommandBuffer command_buffer) {
+                frame_capture_.record(command_buffer, current_frame_, target_->getImage(image_index), target_->getImageFormat(), extent,
+                                      frames_drawn_, *capture_path_);
+            }, kRenderGraphSideEffects);
+            render_graph_.use(capture_pass, color, ImageUsage::kTransferSource);
+        }
+        return depth;
+    }
+
+    void setViewport(VkCommandBuffer command_buffer, VkExtent2D extent) {
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = static_cast<float>(extent.height);
+        viewport.width = static_cast<float>(extent.width);
+        viewport.height = -static_cast<float>(extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = extent;
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    }
+
+    void createCommandBuffers() {
+        command_buffers_.resize(vulkan_device_->getFramesInFlight());
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = vulkan_device_->getCommandPool();
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = command_buffers_.size();
+
+        if (vkAllocateCommandBuffers(*vulkan_device_, &alloc_info, command_buffers_.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate command buffers!");
+        }
+    }
+
+    // The whole command buffer is timed, and split into scopes per pass.
+    void createGpuProfiler() {
+        if (!GpuProfiler::isSupported(*vulkan_device_)) {
+            return;
+        }
+        gpu_profiler_.init(vulkan_device_.get());
+        scene_.setProfiler(&gpu_profiler_);
+        timestamps_measured_.assign(vulkan_device_->getFramesInFlight(), false);
+    }
+
+    // Submit-to-completion latency of every frame in flight, polled without
+    // blocking. Completion is when the present engine may take the image, a
+    // FIFO swapchain then holds it for up to a refresh interval per queued image.
+    void collectLatency() {
+        auto now = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < submit_pending_.size(); ++i) {
+            if (submit_pending_[i] && vkGetFenceStatus(*vulkan_device_, in_flight_fences_[i]) == VK_SUCCESS) {
+                double latency_ms = std::chrono::duration<double, std::milli>(now - submit_times_[i]).count();
+                stats_.latency_ms += latency_ms;
+                stats_.max_latency_ms = std::max(stats_.max_latency_ms, latency_ms);
+                ++stats_.latency_samples;
+                submit_pending_[i] = false;
+            }
+        }
+    }
+
+    // Called once the frame's fence has signaled, so the results are available without waiting.
+    void collectGpuTime(uint32_t frame) {
+        if (!gpu_profiler_.isReady()) {
+            return;
+        }
+        std::optional<double> gpu_ms = gpu_profiler_.collect(frame);
+        if (gpu_ms && isTracing()) {
+            traceGpuFrame(frame, *gpu_ms);
+        }
+        if (gpu_ms && dynamic_resolution_) {
+            dynamic_resolution_->addSample(*gpu_ms, frame_scales_[frame]);
+        }
+        if (gpu_ms) {
+            stats_.gpu_ms += *gpu_ms;
+            ++stats_.gpu_samples;
+            if (timestamps_measured_[frame]) {
+                bench_samples_.gpu_ms.push_back(*gpu_ms);
+            }
+        }
+        // Warmup frames complete before any measured one, dropping the scope
+        // averages after each leaves only the measured frames in the report.
+        if (config_.bench && !timestamps_measured_[frame]) {
+            gpu_profiler_.resetStats();
+        }
+    }
+
+    // Puts the frame's GPU scopes on the trace timeline. Without calibrated
+    // timestamps the GPU clock is unrelated to the CPU one, so a frame is
+    // placed at its submission or, when the GPU was still busy, at the end of
+    // the previous one.
+    void traceGpuFrame(uint32_t frame, double gpu_ms) {
+        uint64_t begin_ns = std::max(submit_ns_[frame], last_gpu_end_ns_);
+        auto toTraceTime = [begin_ns](double ms) {
+            return begin_ns + static_cast<uint64_t>(ms * 1e6);
+        };
+        recordGpuZone("frame", begin_ns, toTraceTime(gpu_ms));
+        for (const GpuScopeTiming& scope : gpu_profiler_.getLastFrameScopes()) {
+            recordGpuZone(scope.name, toTraceTime(scope.begin_ms), toTraceTime(scope.end_ms));
+        }
+        last_gpu_end_ns_ = toTraceTime(gpu_ms);
+    }
+
+    // GPU scopes are traced in profiling builds, or whenever a trace is requested.
+    bool isTracing() const {
+        return kCpuProfilerEnabled || !config_.trace_path.empty();
+    }
+
+    void writeTrace() {
+        std::string path = config_.trace_path.empty() ? kDefaultTracePath : config_.trace_path;
+        if (!writeChromeTrace(path)) {
+            throw std::runtime_error("Failed to write " + path + "!");
+        }
+        std::cout << "Trace written to " << path << (kCpuProfilerEnabled ? "" : ", CPU zones need a --define=profile=1 build") << std::endl;
+    }
+
+    // Benchmark frames past the warmup are recorded for the report.
+    bool isMeasuring() const {
+        return config_.bench && frames_drawn_ >= config_.warmup_frames;
+    }
+
+    // Orbits the scene once over the benchmark run, starting on the side of
+    // the default camera and looking at the center.
+    void updateBenchCamera() {
+        constexpr float kTwoPi = 6.28318531f;
+        float angle = kTwoPi * static_cast<float>(frames_drawn_) / static_cast<float>(config_.frames);
+        glm::vec3 center = light_area_.center();
+        glm::vec3 extents = light_area_.extents();
+        float radius = 1.5f * std::max(glm::length(glm::vec2(extents.x, extents.z)), 100.0f);
+        glm::vec3 position = center + glm::vec3(std::sin(angle) * radius, extents.y + 0.25f * radius, std::cos(angle) * radius);
+        scene_.setCamera(position, center);
+    }
+
+    void writeBenchReport() {
+        BenchReport report;
+        report.setString("benchmark", "kv3d_bench");
+        report.setString("device", vulkan_device_->getProperties().deviceName);
+        report.setString("resolution", std::to_string(target_->getExtent().width) + "x" + std::to_string(target_->getExtent().height));
+        report.setBool("headless", config_.headless);
+        report.setNumber("objects", static_cast<double>(scene_.getObjectCount()));
+        report.setString("distribution", std::string(distributionName(config_.scene.distribution)));
+        report.setNumber("seed", config_.scene.seed);
+        report.setNumber("lights", static_cast<double>(scene_.getPointLightCount()));
+        report.setNumber("frames", config_.frames);
+        report.setNumber("warmup_frames", config_.warmup_frames);
+        report.setNumber("frames_in_flight", vulkan_device_->getFramesInFlight());
+        report.setBool("gpu_driven", scene_.isGpuDriven());
+        report.setBool("occlusion_culling", scene_.isOcclusionCulling());
+        report.setBool("instancing", scene_.isInstancing());
+        report.setBool("depth_prepass", scene_.isDepthPrepass());
+        report.setBool("shadows", scene_.isShadows());
+        report.setNumber("draws", scene_.getDrawCallCount());
+        // Share of the measured time every thread spent running jobs, thread 0
+        // is the main thread.
+        JobSystem& jobs = scene_.getJobSystem();
+        report.setNumber("threads", static_cast<double>(jobs.getThreadCount()));
+        std::vector<JobThreadStats> thread_stats = jobs.getStats();
+        double elapsed_ms = jobs.getStatsElapsedMs();
+        for (size_t i = 0; i < thread_stats.size(); ++i) {
+            std::string prefix = "thread_" + std::to_string(i) + "_";
+            report.setNumber(prefix + "busy", elapsed_ms > 0.0 ? thread_stats[i].busy_ms / elapsed_ms : 0.0);
+            report.setNumber(prefix + "jobs", static_cast<double>(thread_stats[i].jobs));
+            report.setNumber(prefix + "steals", static_cast<double>(thread_stats[i].steals));
+        }
+        report.setSamples("cpu_ms", bench_samples_.cpu_ms);
+        report.setSamples("gpu_ms", bench_samples_.gpu_ms);
+        report.setSamples("frame_ms", bench_samples_.frame_ms);
+        SampleSummary frame_ms = summarize(bench_samples_.frame_ms);
+        report.setNumber("fps", frame_ms.mean > 0.0 ? 1000.0 / frame_ms.mean : 0.0);
+        // Averages of the profiler scopes over the measured frames.
+        for (const GpuScopeStats& scope : gpu_profiler_.getScopeStats()) {
+            std::string key = "gpu_" + scope.name + "_ms";
+            std::replace(key.begin(), key.end(), ' ', '_');
+            report.setNumber(key, scope.average_ms);
+        }
+
+        if (config_.json_path.empty()) {
+            report.write(std::cout);
+            return;
+        }
+        std::ofstream file(config_.json_path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open " + config_.json_path + "!");
+        }
+        report.write(file);
+        std::cout << "Benchmark results written to " << config_.json_path << std::endl;
+    }
+
+    void printStats() {
+        auto now = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration<double>(now - stats_.start).count();
+        if (elapsed < 1.0) {
+            return;
+        }
+
+        std::cout << "objects: " << scene_.getObjectCount()
+                  << " drawn: " << scene_.getVisibleCount()
+                  << " culled: " << scene_.getCulledCount()
+                  << " occluded: " << scene_.getOccludedCount()
+                  << " gpu-driven: " << (scene_.isGpuDriven() ? "on" : "off")
+                  << " instancing: " << (scene_.isInstancing() ? "on" : "off")
+                  << " pre-pass: " << (scene_.isDepthPrepass() ? "on" : "off")
+                  << " lights: " << scene_.getPointLightCount()
+                  << " shadow draws: " << scene_.getShadowDrawCount() << (scene_.isShadowCacheRebuilt() ? " (rebuilt)" : "")
+                  << " draws: " << scene_.getDrawCallCount()
+                  << " hovered: " << (hovered_object_ ? std::to_string(hovered_object_->object.slot) : "none")
+                  << " fps: " << stats_.frames / elapsed
+                  << " cpu: " << stats_.cpu_ms / std::max(stats_.frames, 1u) << " ms"
+                  << " gpu: " << stats_.gpu_ms / std::max(stats_.gpu_samples, 1u) << " ms";
+        if (pipeline_compiler_.getPendingCount() > 0) {
+            std::cout << " compiling pipelines: " << pipeline_compiler_.getPendingCount();
+        }
+        if (upscaler_.isReady()) {
+            std::cout << " scale: " << static_cast<int>(100.0f * getResolutionScale() + 0.5f) << "%";
+        }
+
+        // Frame pacing: the spread of frame intervals matters as much as their mean.
+        if (stats_.frame_intervals > 0) {
+            double mean = stats_.frame_ms / stats_.frame_intervals;
+            double variance = std::max(stats_.frame_ms_squared / stats_.frame_intervals - mean * mean, 0.0);
+            std::cout << " frame: " << mean << " +- " << std::sqrt(variance) << " ms";
+        }
+        if (stats_.latency_samples > 0) {
+            std::cout << " latency: " << stats_.latency_ms / stats_.latency_samples << " ms (max " << stats_.max_latency_ms << " ms)";
+        }
+
+        // GPU time of the last second measured with and without occlusion culling,
+        // toggle it with O to compare on the same view.
+        // The same for the depth pre-pass, toggled with Z.
+        if (stats_.gpu_samples > 0) {
+            gpu_ms_by_occlusion_[scene_.isOcclusionCulling() ? 1 : 0] = stats_.gpu_ms / stats_.gpu_samples;
+            gpu_ms_by_prepass_[scene_.isDepthPrepass() ? 1 : 0] = stats_.gpu_ms / stats_.gpu_samples;
+        }
+        if (gpu_ms_by_occlusion_[0] > 0.0 && gpu_ms_by_occlusion_[1] > 0.0) {
+            std::cout << " occlusion saves: " << gpu_ms_by_occlusion_[0] - gpu_ms_by_occlusion_[1] << " ms";
+        }
+        if (gpu_ms_by_prepass_[0] > 0.0 && gpu_ms_by_prepass_[1] > 0.0) {
+            std::cout << " pre-pass saves: " << gpu_ms_by_prepass_[0] - gpu_ms_by_prepass_[1] << " ms";
+        }
+        if (scene_.isSoftwareOcclusion() && !scene_.isGpuDriven()) {
+            std::cout << " software occlusion: " << scene_.getSoftwareOcclusionMs() << " ms";
+        }
+        const RenderGraphStats& graph = render_graph_.getStats();
+        std::cout << " passes: " << graph.passes << " (" << graph.culled_passes << " culled)"
+                  << " barriers: " << graph.barriers
+                  << " transient: " << graph.transient_bytes / (1024 * 1024) << " MiB"
+                  << " (" << graph.unaliased_bytes / (1024 * 1024) << " MiB unaliased)";
+        // How busy every thread was with jobs, the main thread first.
+        JobSystem& jobs = scene_.getJobSystem();
+        if (jobs.getThreadCount() > 1) {
+            double jobs_elapsed_ms = jobs.getStatsElapsedMs();
+            std::cout << " threads busy:";
+            for (const JobThreadStats& thread : jobs.getStats()) {
+                std::cout << " " << static_cast<int>(100.0 * thread.busy_ms / jobs_elapsed_ms) << "%";
+            }
+            // Benchmarks report the stats over all measured frames.
+            if (!config_.bench) {
+                jobs.resetStats();
+            }
+        }
+        std::cout << std::endl;
+        if (config_.gpu_profile && gpu_profiler_.isReady()) {
+            gpu_profiler_.log(std::cout);
+        }
+        gpu_profiler_.resetStats();
+        stats_ = FrameStats{};
+    }
+
+    // The generic pipelines are created right away, so the first frame can
+    // draw. The ones specialized for drawing without shadows are compiled in
+    // the background and take over once ready, see updateScenePipelines.
+    void createGraphicsPipeline() {
+        PROFILE_SCOPE("createGraphicsPipeline");
+        VkPushConstantRange push_constant_range{};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(ScenePushConstant);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount = 1;
+        pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+        pipeline_layout_info.pushConstantRangeCount = 1;
+        pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+        if (vkCreatePipelineLayout(*vulkan_device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout!");
+        }
+
+        pipeline_compiler_.init(vulkan_device_.get());
+        scene_render_pass_ = render_graph_.getCompatibleRenderPass({target_->getImageFormat()}, depth_format_);
+        SceneShaderCode code{readFile("main/shaders/shader.vert.spv"), readFile("main/shaders/shader.frag.spv"),
+                             readFile("main/shaders/depth.vert.spv")};
+        std::vector<VkPipeline> generic = createScenePipelines(*vulkan_device_, pipeline_layout_, scene_render_pass_,
+                                                               pipeline_compiler_.getCache(), code, true);
+        for (size_t i = 0; i < generic.size(); ++i) {
+            generic_pipelines_[i] = pipeline_compiler_.addSlot(generic[i]);
+            unshadowed_pipelines_[i] = pipeline_compiler_.addSlot();
+        }
+        pipeline_compiler_.compile(std::vector<PipelineSlot>(unshadowed_pipelines_.begin(), unshadowed_pipelines_.end()),
+                                   [device = static_cast<VkDevice>(*vulkan_device_), layout = pipeline_layout_,
+                                    render_pass = scene_render_pass_, code = std::move(code)](VkPipelineCache cache) {
+            return createScenePipelines(device, layout, render_pass, cache, code, false);
+        });
+
+        if (!config_.shader_dir.empty()) {
+            shader_watcher_ = std::make_unique<ShaderWatcher>(resolvePath(config_.shader_dir), config_.shader_compiler);
+            for (const char* name : {"shader.vert", "shader.frag", "depth.vert"}) {
+                shader_watcher_->watch(name);
+            }
+            std::cout << "Watching the scene shaders in " << config_.shader_dir << std::endl;
+        }
+    }
+
+    // Edited scene shaders are compiled to SPIR-V and into both pipeline
+    // variants on a compiler thread, the frames keep drawing with the old
+    // pipelines until then. Compile errors leave the old ones in place.
+    void reloadShaders() {
+        if (!shader_watcher_ || shader_watcher_->poll().empty()) {
+            return;
+        }
+        std::cout << "Recompiling the scene shaders" << std::endl;
+        std::vector<PipelineSlot> slots(generic_pipelines_.begin(), generic_pipelines_.end());
+        slots.insert(slots.end(), unshadowed_pipelines_.begin(), unshadowed_pipelines_.end());
+        pipeline_compiler_.compile(std::move(slots), [watcher = shader_watcher_.get(), device = static_cast<VkDevice>(*vulkan_device_),
+                                                      layout = pipeline_layout_, render_pass = scene_render_pass_](VkPipelineCache cache) {
+            SceneShaderCode code{watcher->compile("shader.vert"), watcher->compile("shader.frag"), watcher->compile("depth.vert")};
+            std::vector<VkPipeline> pipelines = createScenePipelines(device, layout, render_pass, cache, code, true);
+            std::vector<VkPipeline> unshadowed;
+            try {
+                unshadowed = createScenePipelines(device, layout, render_pass, cache, code, false);
+            } catch (const std::exception&) {
+                for (VkPipeline pipeline : pipelines) {
+                    vkDestroyPipeline(device, pipeline, nullptr);
+                }
+                throw;
+            }
+            pipelines.insert(pipelines.end(), unshadowed.begin(), unshadowed.end());
+            return pipelines;
+        });
+    }
+
+    // Swaps compiled pipelines in. Frames without shadows draw with the
+    // specialized pipelines once they exist, all others with the generic ones.
+    void updateScenePipelines() {
+        bool changed = pipeline_compiler_.update();
+        bool specialized = !scene_.isShadows() && pipeline_compiler_.isFilled(unshadowed_pipelines_[0]);
+        if (changed || specialized != specialized_pipelines_) {
+            specialized_pipelines_ = specialized;
+            scene_.setPipelines(getScenePipelines(specialized ? unshadowed_pipelines_ : generic_pipelines_));
+        }
+    }
+
+    ScenePipelines getScenePipelines(const std::array<PipelineSlot, 4>& slots) const {
+        return {pipeline_compiler_.get(slots[0]), pipeline_compiler_.get(slots[1]), pipeline_compiler_.get(slots[2]),
+                pipeline_compiler_.get(slots[3])};
+    }
+
+    void createSurface() {
+        if (glfwCreateWindowSurface(instance_, window_, nullptr, &surface_) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create window surface!");
+        }
+    }
+
+    void recreateSwapChain() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window_, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(window_, &width, &height);
+            glfwWaitEvents();
+        }
+
+        // No idle wait: frames in flight finish against the old images, which
+        // are destroyed with the graph's framebuffers and transient images
+        // once those frames complete. The next frame sets the new depth buffer.
+        std::shared_ptr<VulkanSwapchain> old_swapchain = std::move(swapchain_);
+        swapchain_ = VulkanSwapchain::createSwapChain(vulkan_device_.get(), surface_, window_, config_.swapchain, *old_swapchain);
+        target_ = swapchain_.get();
+        vulkan_device_->retire([old_swapchain]() mutable {
+            old_swapchain.reset();
+        });
+        render_graph_.invalidate();
+        depth_view_ = VK_NULL_HANDLE;
+        scene_.setScreenSize(width, height);
+    }
+
+    void mainLoop() {
+        while (!shouldStop()) {
+            if (!config_.headless) {
+                glfwPollEvents();
+            }
+            drawFrame();
+        }
+
+        vkDeviceWaitIdle(*vulkan_device_);
+
+        if (frame_capture_.isReady()) {
+            // The last frames in flight were not waited for by drawFrame.
+            for (uint32_t i = 0; i < vulkan_device_->getFramesInFlight(); ++i) {
+                frame_capture_.collect(i);
+            }
+            frame_capture_.flush();
+            if (!config_.readback_path.empty()) {
+                std::cout << "Frame " << frames_drawn_ << " written to " << config_.readback_path << std::endl;
+            }
+            if (frame_capture_.getDroppedCount() > 0) {
+                std::cout << "Captures dropped while the encoder was busy: " << frame_capture_.getDroppedCount() << std::endl;
+            }
+        }
+
+        if (config_.bench) {
+            // The last frames in flight were not waited for by drawFrame.
+            for (uint32_t i = 0; i < vulkan_device_->getFramesInFlight(); ++i) {
+                collectGpuTime(i);
+            }
+            writeBenchReport();
+        }
+        if (!config_.trace_path.empty()) {
+            writeTrace();
+        }
+    }
+
+    bool shouldStop() {
+        if (config_.frames > 0 && frames_drawn_ >= config_.frames) {
+            return true;
+        }
+        return !config_.headless && glfwWindowShouldClose(window_);
+    }
+
+    void drawFrame() {
+        PROFILE_SCOPE("drawFrame");
+        collectLatency();
+        {
+            PROFILE_SCOPE("waitForFrame");
+            vkWaitForFences(*vulkan_device_, 1, &in_flight_fences_[current_frame_], VK_TRUE, UINT64_MAX);
+        }
+        vulkan_device_->collectRetired();
+        collectLatency();
+        collectGpuTime(current_frame_);
+        if (frame_capture_.isReady()) {
+            frame_capture_.collect(current_frame_);
+        }
+
+        // Headless frames render into the offscreen image of their frame slot.
+        uint32_t image_index = current_frame_;
+        if (swapchain_) {
+            PROFILE_SCOPE("acquireNextImage");
+            VkResult result = vkAcquireNextImageKHR(*vulkan_device_, *swapchain_, UINT64_MAX, image_available_semaphores_[current_frame_], VK_NULL_HANDLE, &image_index);
+
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                recreateSwapChain();
+                return;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error("Failed to acquire swap chain image!");
+            }
+        }
+
+        capture_path_ = getCapturePath();
+
+        vkResetFences(*vulkan_device_, 1, &in_flight_fences_[current_frame_]);
+
+        if (config_.bench && frames_drawn_ == config_.warmup_frames) {
+            scene_.getJobSystem().resetStats();
+        }
+        auto cpu_start = std::chrono::high_resolution_clock::now();
+        animateScene();
+        if (config_.bench && !config_.camera) {
+            updateBenchCamera();
+        }
+        reloadShaders();
+        updateScenePipelines();
+        updateRenderExtent();
+        scene_.updateUniformBuffers(current_frame_);
+
+        vkResetCommandBuffer(command_buffers_[current_frame_], 0);
+        recordCommandBuffer(command_buffers_[current_frame_], image_index);
+        double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cpu_start).count();
+        stats_.cpu_ms += cpu_ms;
+        if (isMeasuring()) {
+            bench_samples_.cpu_ms.push_back(cpu_ms);
+        }
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore wait_semaphores[] = {image_available_semaphores_[current_frame_]};
+        VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        submit_info.waitSemaphoreCount = swapchain_ ? 1 : 0;
+        submit_info.pWaitSemaphores = wait_semaphores;
+        submit_info.pWaitDstStageMask = wait_stages;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &command_buffers_[current_frame_];
+        VkSemaphore signal_semaphores[] = {render_finished_semaphores_[current_frame_]};
+        submit_info.signalSemaphoreCount = swapchain_ ? 1 : 0;
+        submit_info.pSignalSemaphores = signal_semaphores;
+
+        if (vkQueueSubmit(vulkan_device_->getGraphicsQueue(), 1, &submit_info, in_flight_fences_[current_frame_]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit draw command buffer!");
+        }
+        vulkan_device_->endFrame();
+        submit_times_[current_frame_] = std::chrono::high_resolution_clock::now();
+        if (isTracing()) {
+            submit_ns_[current_frame_] = profilerNow();
+        }
+        submit_pending_[current_frame_] = true;
+
+        if (swapchain_) {
+            present(image_index, signal_semaphores[0]);
+        }
+
+        current_frame_ = (current_frame_ + 1) % vulkan_device_->getFramesInFlight();
+
+        ++frames_drawn_;
+        ++stats_.frames;
+        auto frame_end = std::chrono::high_resolution_clock::now();
+        if (last_frame_end_) {
+            double frame_ms = std::chrono::duration<double, std::milli>(frame_end - *last_frame_end_).count();
+            stats_.frame_ms += frame_ms;
+            stats_.frame_ms_squared += frame_ms * frame_ms;
+            if (isMeasuring()) {
+                bench_samples_.frame_ms.push_back(frame_ms);
+            }
+            ++stats_.frame_intervals;
+        }
+        last_frame_end_ = frame_end;
+        if (config_.print_stats) {
+            printStats();
+        }
+    }
+
+    void present(uint32_t image_index, VkSemaphore render_finished) {
+        PROFILE_SCOPE("present");
+        VkPresentInfoKHR present_info{};
+        present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        present_info.waitSemaphoreCount = 1;
+        present_info.pWaitSemaphores = &render_finished;
+
+        VkSwapchainKHR swap_chains[] = {*swapchain_};
+        present_info.swapchainCount = 1;
+        present_info.pSwapchains = swap_chains;
+        present_info.pImageIndices = &image_index;
+        present_info.pResults = nullptr;
+
+        VkResult result = vkQueuePresentKHR(vulkan_device_->getPresentationQueue(), &present_info);
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized_) {
+            framebuffer_resized_ = false;
+            recreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swap chain image!");
+        }
+    }
+
+    void cleanup() {
+        if (frame_capture_.isReady()) {
+            frame_capture_.destroy();
+        }
+        vulkan_device_->flushRetired();
+        target_ = nullptr;
+        swapchain_.reset();
+        offscreen_.reset();
+
+        // Compiles in progress use the graph's render pass.
+        pipeline_compiler_.destroy();
+        render_graph_.destroy();
+        if (upscaler_.isReady()) {
+            upscaler_.destroy();
+        }
+
+        vkDestroyDescriptorSetLayout(*vulkan_device_, descriptor_set_layout_, nullptr);
+
+        scene_.clear();
+
+        for (uint32_t i = 0; i < vulkan_device_->getFramesInFlight(); ++i) {
+            vkDestroySemaphore(*vulkan_device_, image_available_semaphores_[i], nullptr);
+            vkDestroySemaphore(*vulkan_device_, render_finished_semaphores_[i], nullptr);
+            vkDestroyFence(*vulkan_device_, in_flight_fences_[i], nullptr);
+        }
+
+        if (gpu_profiler_.isReady()) {
+            gpu_profiler_.destroy();
+        }
+
+        vkDestroyPipelineLayout(*vulkan_device_, pipeline_layout_, nullptr);
+        
+        vulkan_device_.reset();
+        if (!config_.headless) {
+            vkDestroySurfaceKHR(instance_, surface_, nullptr);
+        }
+        vkDestroyInstance(instance_, nullptr);
+
+        if (!config_.headless) {
+            glfwDestroyWindow(window_);
+            glfwTerminate();
+        }
+    }
+
+    std::vector<VkCommandBuffer> command_buffers_;
+    uint32_t current_frame_ = 0;
+    std::unique_ptr<VulkanDevice> vulkan_device_;
+    VkDescriptorSetLayout descriptor_set_layout_;
+    bool framebuffer_resized_ = false;
+    // Scene pipelines in the order of ScenePipelines, generic and specialized
+    // for drawing without shadows, see createGraphicsPipeline.
+    PipelineCompiler pipeline_compiler_;
+    std::array<PipelineSlot, 4> generic_pipelines_;
+    std::array<PipelineSlot, 4> unshadowed_pipelines_;
+    bool specialized_pipelines_ = false;
+    VkRenderPass scene_render_pass_ = VK_NULL_HANDLE;
+    // Set in development mode, see reloadShaders.
+    std::unique_ptr<ShaderWatcher> shader_watcher_;
+    std::vector<VkFence> in_flight_fences_;
+    VkInstance instance_;
+    std::vector<VkSemaphore> image_available_semaphores_;
+    VkPipelineLayout pipeline_layout_;
+    std::vector<VkSemaphore> render_finished_semaphores_;
+    // Declared anew every frame, see declareFrame.
+    RenderGraph render_graph_;
+    VkFormat depth_format_;
+    // Last depth view given to the scene.
+    VkImageView depth_view_ = VK_NULL_HANDLE;
+    // Set when rendering below the target's resolution, see createUpscaler.
+    Upscaler upscaler_;
+    std::optional<DynamicResolution> dynamic_resolution_;
+    // The frame's part of the targets, and per frame in flight the scale it
+    // was rendered at, for matching GPU times to scales.
+    VkExtent2D render_extent_{};
+    std::vector<float> frame_scales_;
+    Runfiles* runfiles_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
+    std::unique_ptr<VulkanSwapchain> swapchain_;
+    std::unique_ptr<OffscreenTarget> offscreen_;
+    // Whichever of the two the frame is rendered into.
+    RenderTarget* target_ = nullptr;
+    uint32_t frames_drawn_ = 0;
+    // Copies frames out for --capture and --readback, see getCapturePath.
+    FrameCapture frame_capture_;
+    bool capturing_ = false;
+    std::optional<std::string> capture_path_;
+
+    Scene scene_;
+    
+    GLFWwindow* window_ = nullptr;
+
+    struct FrameStats {
+        double cpu_ms = 0.0;
+        double gpu_ms = 0.0;
+        uint32_t frames = 0;
+        uint32_t gpu_samples = 0;
+        // Sums over the intervals between consecutive presents, for the mean and the variance.
+        double frame_ms = 0.0;
+        double frame_ms_squared = 0.0;
+        uint32_t frame_intervals = 0;
+        double latency_ms = 0.0;
+        double max_latency_ms = 0.0;
+        uint32_t latency_samples = 0;
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    };
+
+    AppConfig config_;
+    FrameStats stats_;
+    std::optional<std::chrono::high_resolution_clock::time_point> last_frame_end_;
+    // Per frame in flight, when it was submitted and whether its latency is still to be read.
+    std::vector<std::chrono::high_resolution_clock::time_point> submit_times_;
+    std::vector<bool> submit_pending_;
+    // Per frame in flight, the submission on the trace clock, see traceGpuFrame.
+    std::vector<uint64_t> submit_ns_;
+    uint64_t last_gpu_end_ns_ = 0;
+    // Indexed by whether occlusion culling was on.
+    std::array<double, 2> gpu_ms_by_occlusion_ = {0.0, 0.0};
+    // Indexed by whether the depth pre-pass was on.
+    std::array<double, 2> gpu_ms_by_prepass_ = {0.0, 0.0};
+    // Region the scattered point lights are placed in.
+    BoundingBox light_area_;
+    uint32_t key_light_ = 0;
+    float key_light_angle_ = 0.0f;
+    bool key_light_paused_ = false;
+    // Dynamic objects of the scene file bob up and down around their position.
+    std::vector<std::pair<ObjectHandle, glm::vec3>> bobbing_objects_;
+    std::vector<PointLight> scattered_lights_;
+    GpuProfiler gpu_profiler_;
+    // Whether the frame's timestamps go into the benchmark samples.
+    std::vector<bool> timestamps_measured_;
+
+    struct BenchSamples {
+        std::vector<double> cpu_ms;
+        std::vector<double> gpu_ms;
+        std::vector<double> frame_ms;
+    };
+    BenchSamples bench_samples_;
+};
+
+int runApp(int argc, char** argv, const AppConfig& defaults) {
+    std::string error;
+    std::unique_ptr<Runfiles> runfiles(Runfiles::Create(argv[0], &error));
+
+    if (runfiles == nullptr) {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        HelloTriangleApplication app(runfiles.get(), parseArgs(argc, argv, defaults));
+        app.run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+AppResult runAppConfig(const char* argv0, AppConfig config) {
+    std::string error;
+    std::unique_ptr<Runfiles> runfiles(Runfiles::Create(argv0, &error));
+    if (runfiles == nullptr) {
+        throw std::runtime_error(error);
+    }
+
+    finishConfig(config);
+    HelloTriangleApplication app(runfiles.get(), config);
+    app.run();
+    return app.getResult();
+}
\ No newline at end of file
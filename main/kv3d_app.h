@@ -0,0 +1,100 @@
+#pragma once
+
+#include "main/bench_report.h"
+#include "main/scene_generator.h"
+#include "main/vulkan_constants.h"
+#include "main/vulkan_swapchain.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+constexpr int WIDTH = 800;
+constexpr int HEIGHT = 600;
+
+struct CameraPose {
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+struct AppConfig {
+    // Generated scene, no objects loads scene_file.
+    SceneGeneratorConfig scene;
+    // Text or binary scene file, see scene_file.h. Empty loads the demo scene.
+    std::string scene_file;
+    // Where the camera starts instead of the default pose.
+    std::optional<CameraPose> camera;
+    bool instancing = true;
+    // Culls and draws on the GPU when the device supports it.
+    bool gpu_driven = true;
+    // Two-phase Hi-Z occlusion culling on top of the GPU-driven path.
+    bool occlusion_culling = true;
+    // Point lights scattered over the scene besides the orbiting key light.
+    uint32_t point_lights = 0;
+    // Lays down opaque depth before shading, against overdraw.
+    bool depth_prepass = false;
+    // Omnidirectional shadows of the key light.
+    bool shadows = false;
+    // Occlusion culling on the CPU against the floor, for the CPU paths.
+    bool software_occlusion = false;
+    // Threads running the frame's CPU work and the asset loading, the main
+    // thread included. 0 uses every hardware thread, 1 only the main thread.
+    uint32_t threads = 0;
+    // Prints CPU and GPU frame times once per second.
+    bool print_stats = false;
+    // Adds the GPU time of every profiler scope to the stats.
+    bool gpu_profile = false;
+    // Latency against throughput: fewer frames in flight and swapchain images
+    // cut input-to-display latency, more of them absorb CPU or GPU stalls.
+    uint32_t frames_in_flight = kDefaultFramesInFlight;
+    SwapchainConfig swapchain;
+    // Renders into offscreen images without a window, for batch runs and
+    // render servers.
+    bool headless = false;
+    VkExtent2D resolution = {WIDTH, HEIGHT};
+    // Renders the scene at this fraction of the resolution per axis and
+    // upscales it, below 1 only.
+    float resolution_scale = 1.0f;
+    // GPU frame time in milliseconds the resolution scale is adjusted to,
+    // between min_resolution_scale and resolution_scale. 0 keeps the scale
+    // fixed. Needs GPU timestamps.
+    double dynamic_resolution_ms = 0.0;
+    float min_resolution_scale = 0.5f;
+    // Frames to draw before exiting, 0 runs until the window is closed.
+    uint32_t frames = 0;
+    // Headless only: where the last frame is written, as PPM for a .ppm
+    // extension and PNG otherwise.
+    std::string readback_path;
+    // Directory every frame is written to as PNG, without stalling the frame
+    // loop. P toggles capturing in a window.
+    std::string capture_dir;
+    // Benchmark mode, see kv3d_bench.cc: the camera orbits the scene, unless
+    // a camera pose was given, and the frames after the warmup ones are
+    // reported as JSON, to json_path or standard output when it is empty.
+    bool bench = false;
+    uint32_t warmup_frames = 0;
+    std::string json_path;
+    // Chrome trace of the CPU zones and GPU scopes, written at exit and with
+    // T. CPU zones are only recorded by builds with KV3D_PROFILE.
+    std::string trace_path;
+    // Development mode: the scene's GLSL sources in this directory are
+    // watched, and edits are compiled with shader_compiler and swapped in
+    // without a restart.
+    std::string shader_dir;
+    std::string shader_compiler = "glslc";
+};
+
+// Frame times of a benchmark run, over the frames after the warmup ones.
+struct AppResult {
+    SampleSummary cpu_ms;
+    SampleSummary gpu_ms;
+    SampleSummary frame_ms;
+};
+
+// Runs kv3d with the command line flags applied on top of defaults, until its
+// window is closed or the configured frames are drawn. Returns the process
+// exit code.
+int runApp(int argc, char** argv, const AppConfig& defaults = {});
+// Runs kv3d with config as is, for tools driving several runs from one
+// process. argv0 locates the runfiles. Throws when the run fails.
+AppResult runAppConfig(const char* argv0, AppConfig config);
@@ -0,0 +1,21 @@
+// Repeatable frame benchmark: renders a generated scene headless for a fixed
+// number of frames on an orbiting camera and prints CPU, GPU and frame time
+// percentiles as JSON.
+// Usage: kv3d_bench [--objects=N] [--distribution=grid|uniform|clustered]
+//                   [--frames=N] [--warmup=N] [--json=PATH] [kv3d flags]
+
+#include "main/kv3d_app.h"
+
+int main(int argc, char** argv) {
+    AppConfig defaults;
+    defaults.bench = true;
+    defaults.headless = true;
+    defaults.frames = 600;
+    defaults.warmup_frames = 60;
+    defaults.scene.object_count = 10000;
+    defaults.scene.distribution = SceneDistribution::kUniform;
+    defaults.scene.models = {"main/models/sphere.obj", "main/models/teapot.obj"};
+    defaults.scene.textures = {"main/textures/Stone_Tiles_003_COLOR.png", "main/textures/Blue_Marble_002_COLOR.png", "main/textures/brick_color_map.png"};
+    defaults.point_lights = 256;
+    return runApp(argc, argv, defaults);
+}
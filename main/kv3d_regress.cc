@@ -0,0 +1,347 @@
+// Golden-image and performance regression suite. Renders fixed scenes
+// headless at fixed camera poses, compares the last frame of each against its
+// golden image with a perceptual tolerance, and with --perf times the same
+// scenes against stored baselines. Exits with a failure when an image differs
+// or a scene got slower than the threshold allows, so it runs as a Bazel test.
+// Goldens are recorded on lavapipe, so that any machine can check them with
+// the same software rasterizer; --update records goldens and baselines with
+// the device the suite runs on. Baselines only hold for the machine they were
+// recorded on, so the performance half runs with --perf. Scenes without a
+// golden or baseline are reported as skipped rather than failed.
+// Usage: kv3d_regress [--images] [--perf] [--update] [--scene=NAME]
+//                     [--golden-dir=DIR] [--out=DIR] [--threshold=FRACTION]
+//                     [--delta-e=N]
+
+#include "main/image_compare.h"
+#include "main/image_writer.h"
+#include "main/kv3d_app.h"
+#include "third_party/stb_image.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr VkExtent2D kResolution = {640, 360};
+// Frames rendered before the compared one. The headless animation clock is
+// driven by the frame count, so the last frame is the same on every run.
+constexpr uint32_t kImageFrames = 30;
+constexpr uint32_t kPerfFrames = 300;
+constexpr uint32_t kPerfWarmupFrames = 30;
+// Slowdown past the baseline that fails the suite.
+constexpr double kDefaultThreshold = 0.1;
+constexpr char kBaselineFile[] = "perf_baseline.txt";
+
+enum class CheckResult {
+    kPassed,
+    kFailed,
+    // Nothing recorded to compare against.
+    kSkipped
+};
+
+struct RegressionScene {
+    std::string name;
+    CameraPose camera;
+    // Changes the default configuration, which draws the demo scene.
+    std::function<void(AppConfig&)> configure;
+};
+
+const CameraPose kDemoPose = {glm::vec3(0.0f, 25.0f, 180.0f), glm::vec3(0.0f, 0.0f, 0.0f)};
+// In front of the 5x5x5 grid of generated objects, see generateScene.
+const CameraPose kGridPose = {glm::vec3(0.0f, 150.0f, 350.0f), glm::vec3(0.0f, 100.0f, -100.0f)};
+
+void useGrid(AppConfig& config, float textured_fraction, float transparent_fraction) {
+    config.scene.object_count = 125;
+    config.scene.distribution = SceneDistribution::kGrid;
+    config.scene.models = {"main/models/sphere.obj"};
+    config.scene.textured_fraction = textured_fraction;
+    config.scene.transparent_fraction = transparent_fraction;
+}
+
+// The demo scene has the textured spheres, the material spheres and the
+// textured floor plane; the grids isolate textures, materials and blending.
+std::vector<RegressionScene> getScenes() {
+    return {
+        {"demo", kDemoPose, [](AppConfig&) {}},
+        {"demo_cpu", kDemoPose, [](AppConfig& config) { config.gpu_driven = false; }},
+        {"demo_shadows", {glm::vec3(120.0f, 150.0f, 150.0f), glm::vec3(0.0f, 0.0f, 0.0f)}, [](AppConfig& config) { config.shadows = true; }},
+        {"demo_lights", kDemoPose, [](AppConfig& config) {
+             config.point_lights = 64;
+             config.depth_prepass = true;
+         }},
+        {"textured", kGridPose, [](AppConfig& config) { useGrid(config, 1.0f, 0.0f); }},
+        {"materials", kGridPose, [](AppConfig& config) { useGrid(config, 0.0f, 0.0f); }},
+        {"transparent", kGridPose, [](AppConfig& config) { useGrid(config, 0.4f, 0.5f); }},
+    };
+}
+
+struct Options {
+    bool images = false;
+    bool perf = false;
+    bool update = false;
+    std::string scene;
+    std::filesystem::path golden_dir;
+    std::filesystem::path out_dir;
+    double threshold = kDefaultThreshold;
+    ImageTolerance tolerance;
+};
+
+// Both bazel test and bazel run start in the runfiles tree, where the test's
+// data holds the goldens. Only bazel run sets BUILD_WORKSPACE_DIRECTORY, its
+// goldens are read from and recorded to the workspace instead.
+std::filesystem::path getDefaultGoldenDir() {
+    const char* workspace = std::getenv("BUILD_WORKSPACE_DIRECTORY");
+    std::filesystem::path root = workspace != nullptr ? std::filesystem::path(workspace) : std::filesystem::path();
+    return root / "main" / "regression";
+}
+
+// Under bazel test, renders and difference images are kept with the test logs.
+std::filesystem::path getDefaultOutDir() {
+    const char* outputs = std::getenv("TEST_UNDECLARED_OUTPUTS_DIR");
+    if (outputs != nullptr) {
+        return outputs;
+    }
+    return std::filesystem::temp_directory_path() / "kv3d_regress";
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    options.golden_dir = getDefaultGoldenDir();
+    options.out_dir = getDefaultOutDir();
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg == "--images") {
+            options.images = true;
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else if (arg == "--update") {
+            options.update = true;
+        } else if (arg.rfind("--scene=", 0) == 0) {
+            options.scene = std::string(arg.substr(8));
+        } else if (arg.rfind("--golden-dir=", 0) == 0) {
+            options.golden_dir = std::string(arg.substr(13));
+        } else if (arg.rfind("--out=", 0) == 0) {
+            options.out_dir = std::string(arg.substr(6));
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            options.threshold = std::stod(std::string(arg.substr(12)));
+        } else if (arg.rfind("--delta-e=", 0) == 0) {
+            options.tolerance.pixel_delta_e = std::stod(std::string(arg.substr(10)));
+        } else {
+            throw std::runtime_error("Unknown argument: " + std::string(arg));
+        }
+    }
+    if (!options.images && !options.perf) {
+        options.images = true;
+    }
+    return options;
+}
+
+AppConfig makeConfig(const RegressionScene& scene) {
+    AppConfig config;
+    config.headless = true;
+    config.resolution = kResolution;
+    config.camera = scene.camera;
+    scene.configure(config);
+    return config;
+}
+
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+Image loadImage(const std::filesystem::path& path) {
+    int width, height, channels;
+    stbi_uc* pixels = stbi_load(path.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("Failed to load " + path.string() + "!");
+    }
+    Image image;
+    image.width = static_cast<uint32_t>(width);
+    image.height = static_cast<uint32_t>(height);
+    image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+    return image;
+}
+
+// Renders the scene and compares its last frame with the golden image, or
+// replaces the golden image with it when updating.
+CheckResult checkImage(const char* argv0, const RegressionScene& scene, const Options& options) {
+    std::filesystem::path actual_path = options.out_dir / (scene.name + ".png");
+    std::filesystem::path golden_path = options.golden_dir / "golden" / (scene.name + ".png");
+
+    AppConfig config = makeConfig(scene);
+    config.frames = kImageFrames;
+    config.readback_path = actual_path.string();
+    runAppConfig(argv0, config);
+
+    if (options.update) {
+        std::filesystem::create_directories(golden_path.parent_path());
+        std::filesystem::copy_file(actual_path, golden_path, std::filesystem::copy_options::overwrite_existing);
+        std::cout << "[image] " << scene.name << ": golden image written to " << golden_path.string() << std::endl;
+        return CheckResult::kPassed;
+    }
+    if (!std::filesystem::exists(golden_path)) {
+        std::cout << "[image] " << scene.name << ": skipped, no golden image at " << golden_path.string() << ", record one with --update" << std::endl;
+        return CheckResult::kSkipped;
+    }
+
+    Image actual = loadImage(actual_path);
+    Image golden = loadImage(golden_path);
+    if (actual.width != golden.width || actual.height != golden.height) {
+        std::cout << "[image] " << scene.name << ": FAILED, rendered " << actual.width << "x" << actual.height
+                  << " against a golden image of " << golden.width << "x" << golden.height << std::endl;
+        return CheckResult::kFailed;
+    }
+
+    std::vector<uint8_t> diff;
+    ImageDifference difference = compareImages(actual.pixels.data(), golden.pixels.data(), actual.width, actual.height, options.tolerance, &diff);
+    bool passed = difference.isWithin(options.tolerance);
+    std::cout << "[image] " << scene.name << ": " << (passed ? "ok" : "FAILED")
+              << " differing: " << difference.differing_fraction * 100.0 << "%"
+              << " mean delta E: " << difference.mean_delta_e
+              << " max delta E: " << difference.max_delta_e << std::endl;
+    if (!passed) {
+        std::filesystem::path diff_path = options.out_dir / (scene.name + "_diff.png");
+        writePng(diff_path.string(), actual.width, actual.height, diff.data());
+        std::cout << "  rendered: " << actual_path.string() << " difference: " << diff_path.string() << std::endl;
+    }
+    return passed ? CheckResult::kPassed : CheckResult::kFailed;
+}
+
+struct Baseline {
+    double frame_ms = 0.0;
+    double gpu_ms = 0.0;
+};
+
+// One scene per line: name, then the median frame and GPU times in
+// milliseconds. Lines starting with # are comments.
+std::map<std::string, Baseline> readBaselines(const std::filesystem::path& path) {
+    std::map<std::string, Baseline> baselines;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        Baseline baseline;
+        if (!(fields >> name >> baseline.frame_ms >> baseline.gpu_ms)) {
+            throw std::runtime_error("Malformed baseline in " + path.string() + ": " + line);
+        }
+        baselines[name] = baseline;
+    }
+    return baselines;
+}
+
+void writeBaselines(const std::filesystem::path& path, const std::map<std::string, Baseline>& baselines) {
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path.string() + "!");
+    }
+    file << "# kv3d_regress baselines: scene, median frame ms, median GPU ms\n";
+    file << std::fixed << std::setprecision(4);
+    for (const auto& [name, baseline] : baselines) {
+        file << name << " " << baseline.frame_ms << " " << baseline.gpu_ms << "\n";
+    }
+}
+
+// Medians rather than means, a single hitch should not fail the suite.
+CheckResult checkPerf(const char* argv0, const RegressionScene& scene, const Options& options, std::map<std::string, Baseline>& baselines) {
+    AppConfig config = makeConfig(scene);
+    config.bench = true;
+    config.frames = kPerfFrames;
+    config.warmup_frames = kPerfWarmupFrames;
+    config.json_path = (options.out_dir / (scene.name + ".json")).string();
+    AppResult result = runAppConfig(argv0, config);
+    Baseline measured = {result.frame_ms.p50, result.gpu_ms.p50};
+
+    auto found = baselines.find(scene.name);
+    if (options.update) {
+        baselines[scene.name] = measured;
+        std::cout << "[perf] " << scene.name << ": baseline frame: " << measured.frame_ms << " ms gpu: " << measured.gpu_ms << " ms" << std::endl;
+        return CheckResult::kPassed;
+    }
+    if (found == baselines.end()) {
+        std::cout << "[perf] " << scene.name << ": skipped, no baseline, record one with --update" << std::endl;
+        return CheckResult::kSkipped;
+    }
+
+    const Baseline& baseline = found->second;
+    double limit = 1.0 + options.threshold;
+    bool frame_ok = measured.frame_ms <= baseline.frame_ms * limit;
+    // No GPU time on devices without timestamps, nothing to compare then.
+    bool gpu_ok = measured.gpu_ms == 0.0 || baseline.gpu_ms == 0.0 || measured.gpu_ms <= baseline.gpu_ms * limit;
+    std::cout << "[perf] " << scene.name << ": " << (frame_ok && gpu_ok ? "ok" : "FAILED")
+              << " frame: " << measured.frame_ms << " ms (baseline " << baseline.frame_ms << " ms)"
+              << " gpu: " << measured.gpu_ms << " ms (baseline " << baseline.gpu_ms << " ms)" << std::endl;
+    return frame_ok && gpu_ok ? CheckResult::kPassed : CheckResult::kFailed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        Options options = parseOptions(argc, argv);
+        std::filesystem::create_directories(options.out_dir);
+
+        std::vector<RegressionScene> scenes;
+        for (RegressionScene& scene : getScenes()) {
+            if (options.scene.empty() || options.scene == scene.name) {
+                scenes.push_back(std::move(scene));
+            }
+        }
+        if (scenes.empty()) {
+            throw std::runtime_error("Unknown scene: " + options.scene);
+        }
+
+        uint32_t failures = 0;
+        uint32_t skipped = 0;
+        auto count = [&failures, &skipped](CheckResult result) {
+            failures += result == CheckResult::kFailed ? 1 : 0;
+            skipped += result == CheckResult::kSkipped ? 1 : 0;
+        };
+        if (options.images) {
+            for (const RegressionScene& scene : scenes) {
+                count(checkImage(argv[0], scene, options));
+            }
+        }
+        if (options.perf) {
+            std::filesystem::path baseline_path = options.golden_dir / kBaselineFile;
+            std::map<std::string, Baseline> baselines = readBaselines(baseline_path);
+            for (const RegressionScene& scene : scenes) {
+                count(checkPerf(argv[0], scene, options, baselines));
+            }
+            if (options.update) {
+                writeBaselines(baseline_path, baselines);
+                std::cout << "Baselines written to " << baseline_path.string() << std::endl;
+            }
+        }
+
+        if (skipped > 0) {
+            std::cout << skipped << " regression check(s) skipped, nothing recorded for this device" << std::endl;
+        }
+        if (failures > 0) {
+            std::cout << failures << " regression check(s) failed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "All recorded regression checks passed" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
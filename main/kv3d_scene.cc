@@ -0,0 +1,78 @@
+// Converts scene files between the text and the binary form, and writes
+// generated scenes as files, e.g. to time loading scenes of thousands of
+// objects with kv3d --scene=PATH.
+// Usage: kv3d_scene convert INPUT OUTPUT
+//        kv3d_scene generate OUTPUT [--objects=N] [--distribution=grid|uniform|clustered] [--seed=N] [--dense]
+// Outputs with a .bin extension are binary, others text.
+
+#include "main/scene_file.h"
+#include "main/scene_generator.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace {
+
+void printUsage() {
+    std::cerr << "Usage: kv3d_scene convert INPUT OUTPUT\n"
+              << "       kv3d_scene generate OUTPUT [--objects=N] [--distribution=grid|uniform|clustered] [--seed=N] [--dense]" << std::endl;
+}
+
+SceneGeneratorConfig parseGeneratorArgs(int argc, char** argv, int first) {
+    SceneGeneratorConfig config;
+    config.object_count = 10000;
+    for (int i = first; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        if (arg.rfind("--objects=", 0) == 0) {
+            config.object_count = std::stoul(std::string(arg.substr(10)));
+        } else if (arg.rfind("--distribution=", 0) == 0) {
+            config.distribution = parseDistribution(arg.substr(15));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            config.seed = std::stoul(std::string(arg.substr(7)));
+        } else if (arg == "--dense") {
+            config.buried = true;
+        } else {
+            throw std::runtime_error("Unknown argument: " + std::string(arg));
+        }
+    }
+    return config;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        std::string_view command(argv[1]);
+        SceneDescription description;
+        std::string output;
+        if (command == "convert" && argc == 4) {
+            auto start = std::chrono::steady_clock::now();
+            description = readSceneFile(argv[2]);
+            std::cout << "Read " << argv[2] << " in " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+            output = argv[3];
+        } else if (command == "generate") {
+            generateSceneDescription(parseGeneratorArgs(argc, argv, 3), description);
+            output = argv[2];
+        } else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        writeSceneFile(output, description);
+        std::cout << "Wrote " << output << ": " << description.objects.size() << " objects, " << description.meshes.size() << " meshes, "
+                  << description.textures.size() << " textures, " << description.lights.size() << " lights" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,230 @@
+#include "main/light_clustering.h"
+
+#include "main/vulkan_constants.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Must match local_size_x in cluster.comp.
+constexpr uint32_t kClusterGroupSize = 128;
+
+}  // namespace
+
+void LightClustering::init(VulkanDevice* device, const std::vector<char>& shader_code) {
+    device_ = device;
+    createPipeline(shader_code);
+    createFrameResources();
+}
+
+void LightClustering::createPipeline(const std::vector<char>& shader_code) {
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(*device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light clustering descriptor set layout!");
+    }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+
+    if (vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light clustering pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader_code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(*device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light clustering shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader_module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline_layout_;
+
+    VkResult result = vkCreateComputePipelines(*device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(*device_, shader_module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light clustering pipeline!");
+    }
+}
+
+void LightClustering::createFrameResources() {
+    uint32_t frame_count = device_->getFramesInFlight();
+    light_buffers_.resize(frame_count);
+    cluster_buffers_.resize(frame_count);
+    uniform_buffers_.resize(frame_count);
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        // Lights move every frame, so they are written straight into host visible memory.
+        Buffer& light_buffer = light_buffers_[i];
+        light_buffer.size = sizeof(PointLight) * kMaxPointLights;
+        light_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        light_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        light_buffer.device = *device_;
+        device_->createBuffer(light_buffer);
+        light_buffer.map();
+
+        Buffer& cluster_buffer = cluster_buffers_[i];
+        cluster_buffer.size = sizeof(uint32_t) * (kMaxLightsPerCluster + 1) * kClusterCount;
+        cluster_buffer.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        cluster_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        cluster_buffer.device = *device_;
+        device_->createBuffer(cluster_buffer);
+
+        Buffer& uniform_buffer = uniform_buffers_[i];
+        uniform_buffer.size = sizeof(ClusterUniforms);
+        uniform_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        uniform_buffer.usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        uniform_buffer.device = *device_;
+        device_->createBuffer(uniform_buffer);
+        uniform_buffer.map();
+    }
+
+    std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 2 * frame_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[1].descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = frame_count;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light clustering descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = frame_count;
+    alloc_info.pSetLayouts = layouts.data();
+
+    descriptor_sets_.resize(frame_count);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, descriptor_sets_.data()));
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        std::array<VkDescriptorBufferInfo, 3> buffer_infos{};
+        buffer_infos[0].buffer = light_buffers_[i].buffer;
+        buffer_infos[1].buffer = cluster_buffers_[i].buffer;
+        buffer_infos[2].buffer = uniform_buffers_[i].buffer;
+
+        std::array<VkWriteDescriptorSet, 3> descriptor_writes{};
+        for (uint32_t binding = 0; binding < descriptor_writes.size(); ++binding) {
+            buffer_infos[binding].offset = 0;
+            buffer_infos[binding].range = VK_WHOLE_SIZE;
+
+            descriptor_writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_writes[binding].dstSet = descriptor_sets_[i];
+            descriptor_writes[binding].dstBinding = binding;
+            descriptor_writes[binding].dstArrayElement = 0;
+            descriptor_writes[binding].descriptorType = binding == 2 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptor_writes[binding].descriptorCount = 1;
+            descriptor_writes[binding].pBufferInfo = &buffer_infos[binding];
+        }
+
+        vkUpdateDescriptorSets(*device_, descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+    }
+}
+
+void LightClustering::destroy() {
+    if (device_ == nullptr) {
+        return;
+    }
+
+    for (std::vector<Buffer>* buffers : {&light_buffers_, &cluster_buffers_, &uniform_buffers_}) {
+        for (Buffer& buffer : *buffers) {
+            buffer.unmap();
+            buffer.destroy();
+        }
+        buffers->clear();
+    }
+    descriptor_sets_.clear();
+    vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+    vkDestroyPipeline(*device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(*device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(*device_, descriptor_set_layout_, nullptr);
+    descriptor_pool_ = VK_NULL_HANDLE;
+    pipeline_ = VK_NULL_HANDLE;
+    pipeline_layout_ = VK_NULL_HANDLE;
+    descriptor_set_layout_ = VK_NULL_HANDLE;
+    device_ = nullptr;
+}
+
+bool LightClustering::isReady() const {
+    return device_ != nullptr;
+}
+
+void LightClustering::update(uint32_t frame, const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+                             uint32_t screen_width, uint32_t screen_height) {
+    uint32_t light_count = static_cast<uint32_t>(std::min<size_t>(lights.size(), kMaxPointLights));
+    if (light_count > 0) {
+        std::memcpy(light_buffers_[frame].mapped, lights.data(), sizeof(PointLight) * light_count);
+    }
+
+    ClusterUniforms uniforms{};
+    uniforms.view = view;
+    uniforms.projection = glm::vec4(proj[0][0], proj[1][1], proj[2][2], proj[3][2]);
+    uniforms.grid = glm::uvec4(kClusterGridX, kClusterGridY, kClusterGridZ, light_count);
+    uniforms.screen_size = glm::vec2(static_cast<float>(screen_width), static_cast<float>(screen_height));
+    // Near and far plane distances of a zero-to-one depth perspective projection.
+    uniforms.znear = proj[3][2] / proj[2][2];
+    uniforms.zfar = proj[3][2] / (proj[2][2] + 1.0f);
+    float log_depth_range = std::log(uniforms.zfar / uniforms.znear);
+    uniforms.slice_scale = static_cast<float>(kClusterGridZ) / log_depth_range;
+    uniforms.slice_bias = -static_cast<float>(kClusterGridZ) * std::log(uniforms.znear) / log_depth_range;
+    std::memcpy(uniform_buffers_[frame].mapped, &uniforms, sizeof(uniforms));
+}
+
+void LightClustering::dispatch(VkCommandBuffer command_buffer, uint32_t frame) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout_, 0, 1, &descriptor_sets_[frame], 0, nullptr);
+    vkCmdDispatch(command_buffer, (kClusterCount + kClusterGroupSize - 1) / kClusterGroupSize, 1, 1);
+
+    VkMemoryBarrier cluster_barrier{};
+    cluster_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cluster_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cluster_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &cluster_barrier, 0, nullptr, 0, nullptr);
+}
+
+const Buffer& LightClustering::getLightBuffer(uint32_t frame) const {
+    return light_buffers_[frame];
+}
+
+const Buffer& LightClustering::getClusterBuffer(uint32_t frame) const {
+    return cluster_buffers_[frame];
+}
+
+const Buffer& LightClustering::getUniformBuffer(uint32_t frame) const {
+    return uniform_buffers_[frame];
+}
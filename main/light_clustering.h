@@ -0,0 +1,86 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <vector>
+
+// Froxel grid: screen tiles times exponential depth slices. Must match the
+// grid used by cluster.comp and shader.frag through ClusterUniforms::grid.
+constexpr inline uint32_t kClusterGridX = 16;
+constexpr inline uint32_t kClusterGridY = 9;
+constexpr inline uint32_t kClusterGridZ = 24;
+constexpr inline uint32_t kClusterCount = kClusterGridX * kClusterGridY * kClusterGridZ;
+// Every cluster holds its light count followed by up to this many light
+// indices. Must match kClusterStride in cluster.comp and shader.frag.
+constexpr inline uint32_t kMaxLightsPerCluster = 255;
+constexpr inline uint32_t kMaxPointLights = 4096;
+
+// Point light record (set 0, binding 3 of the scene). Layout follows std430
+// and must match PointLight in cluster.comp and shader.frag.
+struct PointLight {
+    // xyz - world position, w - radius of influence.
+    glm::vec4 position = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    // rgb - color times intensity.
+    glm::vec4 color = glm::vec4(1.0f);
+};
+
+// Per-frame clustering parameters (set 0, binding 5 of the scene). Layout
+// follows std140 and must match ClusterUniforms in cluster.comp and shader.frag.
+struct ClusterUniforms {
+    glm::mat4 view;
+    // x - P00, y - P11, z - P22, w - P32 of the projection matrix.
+    glm::vec4 projection;
+    // xyz - cluster counts, w - light count.
+    glm::uvec4 grid;
+    glm::vec2 screen_size;
+    // The depth slice of view depth d is log(d) * slice_scale + slice_bias.
+    float slice_scale;
+    float slice_bias;
+    float znear;
+    float zfar;
+    float padding[2];
+};
+
+// Clustered forward lighting. A compute pass bins the point lights into the
+// clusters they touch, shader.frag then loops over its own cluster's lights
+// only, so shading cost follows local light density instead of the total
+// light count.
+class LightClustering {
+public:
+    void init(VulkanDevice* device, const std::vector<char>& shader_code);
+    void destroy();
+    bool isReady() const;
+
+    // Must be called before the frame's dispatch is recorded. Lights past
+    // kMaxPointLights are ignored.
+    void update(uint32_t frame, const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& proj,
+                uint32_t screen_width, uint32_t screen_height);
+    // Must be recorded outside of a render pass, before the draws reading the clusters.
+    void dispatch(VkCommandBuffer command_buffer, uint32_t frame);
+
+    // Bound by the scene for shader.frag.
+    const Buffer& getLightBuffer(uint32_t frame) const;
+    const Buffer& getClusterBuffer(uint32_t frame) const;
+    const Buffer& getUniformBuffer(uint32_t frame) const;
+
+private:
+    void createPipeline(const std::vector<char>& shader_code);
+    void createFrameResources();
+
+    VulkanDevice* device_ = nullptr;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+
+    // Per frame in flight.
+    std::vector<Buffer> light_buffers_;
+    std::vector<Buffer> cluster_buffers_;
+    std::vector<Buffer> uniform_buffers_;
+    std::vector<VkDescriptorSet> descriptor_sets_;
+};
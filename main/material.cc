@@ -1,5 +1,20 @@
 #include "main/material.h"
 
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+const std::array<std::pair<std::string_view, MaterialType>, 3> kMaterialNames = {{
+    {"gold", MaterialType::kGold},
+    {"emerald", MaterialType::kEmerald},
+    {"plastic", MaterialType::kPlastic},
+}};
+
+}  // namespace
+
 std::unique_ptr<Material> getMaterial(MaterialType material) {  
     switch (material) {
         case MaterialType::kGold:
@@ -9,4 +24,22 @@ std::unique_ptr<Material> getMaterial(MaterialType material) {
         case MaterialType::kPlastic:
             return std::make_unique<PlasticMaterial>();
     }
-};
\ No newline at end of file
+};
+
+std::string_view materialName(MaterialType material) {
+    for (const auto& [name, value] : kMaterialNames) {
+        if (value == material) {
+            return name;
+        }
+    }
+    return "unknown";
+}
+
+MaterialType parseMaterial(std::string_view name) {
+    for (const auto& [material_name, value] : kMaterialNames) {
+        if (material_name == name) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Unknown material: " + std::string(name));
+}
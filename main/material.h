@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string_view>
 
 #include <glm/glm.hpp>
 
@@ -76,3 +77,6 @@ class PlasticMaterial : public Material {
 };
 
 std::unique_ptr<Material> getMaterial(MaterialType material);
+// Lowercase names, as used by scene files.
+std::string_view materialName(MaterialType material);
+MaterialType parseMaterial(std::string_view name);
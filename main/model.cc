@@ -1,5 +1,7 @@
 #include "main/model.h"
 
+#include "main/cpu_profiler.h"
+#include "main/upload_batch.h"
 #include "main/vulkan_buffer.h"
 #include "main/vertex.h"
 #include "main/vulkan_device.h"
@@ -7,9 +9,21 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "third_party/tiny_obj_loader.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 std::unique_ptr<Model> Model::loadFromFile(const std::string& file, VulkanDevice* device) {
+    PROFILE_SCOPE("Model::loadFromFile");
+    UploadBatch batch(device);
+    std::unique_ptr<Model> model = create(loadMeshData(file), device, batch);
+    batch.submit();
+    return model;
+}
+
+MeshData Model::loadMeshData(const std::string& file) {
+    PROFILE_SCOPE("Model::loadMeshData");
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -19,8 +33,9 @@ std::unique_ptr<Model> Model::loadFromFile(const std::string& file, VulkanDevice
         throw std::runtime_error(warn + err);
     }
 
-    std::vector<uint32_t> indices;
-    std::vector<Vertex> vertices;
+    MeshData data;
+    std::vector<uint32_t>& indices = data.indices;
+    std::vector<Vertex>& vertices = data.vertices;
     std::unordered_map<Vertex, uint32_t> unique_vertices;
 
     for (const auto& shape : shapes) {
@@ -54,87 +69,160 @@ std::unique_ptr<Model> Model::loadFromFile(const std::string& file, VulkanDevice
             indices.push_back(unique_vertices[vertex]);
         }
     }
-    
-    std::unique_ptr<Model> model(new Model(device, vertices, indices));
-    return model;
+
+    return data;
+}
+
+std::unique_ptr<Model> Model::create(const MeshData& data, VulkanDevice* device, UploadBatch& batch) {
+    return std::unique_ptr<Model>(new Model(device, data.vertices, data.indices, batch));
 }
 
-Model::Model(VulkanDevice* device, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
-    createVertexBuffer(vertices, device);
-    createIndexBuffer(indices, device);
+Model::Model(VulkanDevice* device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, UploadBatch& batch) {
+    createDeviceBuffer(vertex_buffer_, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.data(), sizeof(vertices[0]) * vertices.size(), device, batch);
+    createDeviceBuffer(index_buffer_, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices.data(), sizeof(indices[0]) * indices.size(), device, batch);
     indices_count_ = indices.size();
+    vertices_count_ = vertices.size();
+
+    // Centered on the bounding box, which is tight enough for the meshes we load.
+    glm::vec3 min_pos(std::numeric_limits<float>::max());
+    glm::vec3 max_pos(std::numeric_limits<float>::lowest());
+    for (const Vertex& vertex : vertices) {
+        min_pos = glm::min(min_pos, vertex.pos);
+        max_pos = glm::max(max_pos, vertex.pos);
+    }
+    bounding_box_ = {min_pos, max_pos};
+    glm::vec3 center = bounding_box_.center();
+    float radius = 0.0f;
+    for (const Vertex& vertex : vertices) {
+        radius = std::max(radius, glm::length(vertex.pos - center));
+    }
+    bounding_sphere_ = glm::vec4(center, radius);
+
+    positions_.reserve(vertices.size());
+    for (const Vertex& vertex : vertices) {
+        positions_.push_back(vertex.pos);
+    }
+    indices_ = indices;
+    // Positions alone, for depth-only passes that don't need the other attributes.
+    createDeviceBuffer(position_buffer_, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, positions_.data(), sizeof(positions_[0]) * positions_.size(), device, batch);
+
+    std::vector<BoundingBox> triangle_boxes(indices_.size() / 3);
+    for (size_t i = 0; i < triangle_boxes.size(); ++i) {
+        const glm::vec3& p0 = positions_[indices_[3 * i]];
+        const glm::vec3& p1 = positions_[indices_[3 * i + 1]];
+        const glm::vec3& p2 = positions_[indices_[3 * i + 2]];
+        triangle_boxes[i] = {glm::min(p0, glm::min(p1, p2)), glm::max(p0, glm::max(p1, p2))};
+    }
+    triangle_bvh_.build(triangle_boxes);
 }
 
-void Model::createVertexBuffer(std::vector<Vertex>& vertices, VulkanDevice* device) {
-    Buffer staging_buffer;
-    staging_buffer.size = sizeof(vertices[0]) * vertices.size();
-    staging_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    staging_buffer.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    staging_buffer.device = *device;
-    device->createBuffer(staging_buffer);
+void Model::createDeviceBuffer(Buffer& buffer, VkBufferUsageFlags usage, const void* data, VkDeviceSize size, VulkanDevice* device,
+                               UploadBatch& batch) {
+    buffer.size = size;
+    buffer.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    buffer.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage;
+    buffer.device = *device;
+    device->createBuffer(buffer);
+    batch.uploadBuffer(buffer.buffer, data, size);
+}
 
-    staging_buffer.map();
-    staging_buffer.copyTo(vertices.data(), staging_buffer.size);
-    staging_buffer.unmap();
+void Model::bind(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = {vertex_buffer_.buffer};
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, index_buffer_.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
 
-    vertex_buffer_.size = sizeof(vertices[0]) * vertices.size();
-    vertex_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    vertex_buffer_.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    vertex_buffer_.device = *device;
-    device->createBuffer(vertex_buffer_);
+void Model::bindPositions(VkCommandBuffer command_buffer) {
+    VkBuffer vertex_buffers[] = {position_buffer_.buffer};
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+    vkCmdBindIndexBuffer(command_buffer, index_buffer_.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
 
-    VkCommandBuffer command_buffer = device->beginCommandBuffer();
+// Per-instance data is fetched in the shaders with gl_InstanceIndex, which includes first_instance.
+void Model::draw(VkCommandBuffer command_buffer, uint32_t instance_count, uint32_t first_instance) {
+    vkCmdDrawIndexed(command_buffer, indices_count_, instance_count, 0, 0, first_instance);
+}
 
-    VkBufferCopy copy_region{};
-    copy_region.srcOffset = 0;
-    copy_region.dstOffset = 0;
-    copy_region.size = staging_buffer.size;
-    vkCmdCopyBuffer(command_buffer, staging_buffer.buffer, vertex_buffer_.buffer, 1, &copy_region);
-    device->submitCommandBuffer(command_buffer, device->getGraphicsQueue());
+uint32_t Model::getIndexCount() const {
+    return indices_count_;
+}
 
-    staging_buffer.destroy();
+uint32_t Model::getVertexCount() const {
+    return vertices_count_;
 }
 
-void Model::createIndexBuffer(std::vector<uint32_t>& indices, VulkanDevice* device) {
-    Buffer staging_buffer;
-    staging_buffer.size = sizeof(indices[0]) * indices.size();
-    staging_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    staging_buffer.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    staging_buffer.device = *device;
-    device->createBuffer(staging_buffer);
+const Buffer& Model::getVertexBuffer() const {
+    return vertex_buffer_;
+}
 
-    void* data;
-    staging_buffer.map();
-    staging_buffer.copyTo(indices.data(), staging_buffer.size);
-    staging_buffer.unmap();
+const Buffer& Model::getPositionBuffer() const {
+    return position_buffer_;
+}
 
-    index_buffer_.size = sizeof(indices[0]) * indices.size();
-    index_buffer_.property_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    index_buffer_.usage_flags = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-    index_buffer_.device = *device;
-    device->createBuffer(index_buffer_);
+const Buffer& Model::getIndexBuffer() const {
+    return index_buffer_;
+}
 
-    VkCommandBuffer command_buffer = device->beginCommandBuffer();
-    VkBufferCopy copy_region{};
-    copy_region.srcOffset = 0;
-    copy_region.dstOffset = 0;
-    copy_region.size = staging_buffer.size;
-    vkCmdCopyBuffer(command_buffer, staging_buffer.buffer, index_buffer_.buffer, 1, &copy_region);
-    device->submitCommandBuffer(command_buffer, device->getGraphicsQueue());
+glm::vec4 Model::getBoundingSphere() const {
+    return bounding_sphere_;
+}
 
-    staging_buffer.destroy();
+const BoundingBox& Model::getBoundingBox() const {
+    return bounding_box_;
 }
 
-void Model::draw(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, VkDescriptorSet& descriptor_set) {
-    VkBuffer vertex_buffers[] = {vertex_buffer_.buffer};
-    const VkDeviceSize offsets[1] = {0};
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-    vkCmdBindIndexBuffer(command_buffer, index_buffer_.buffer, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
-    vkCmdDrawIndexed(command_buffer, indices_count_, 1, 0, 0, 0);
+const std::vector<glm::vec3>& Model::getPositions() const {
+    return positions_;
+}
+
+const std::vector<uint32_t>& Model::getIndices() const {
+    return indices_;
+}
+
+std::optional<float> Model::intersectRay(const Ray& ray, float max_distance) const {
+    // Moller-Trumbore, both triangle faces count as hits.
+    auto intersect_triangle = [this](uint32_t triangle, const Ray& ray, float max_distance) -> std::optional<float> {
+        const glm::vec3& p0 = positions_[indices_[3 * triangle]];
+        glm::vec3 edge1 = positions_[indices_[3 * triangle + 1]] - p0;
+        glm::vec3 edge2 = positions_[indices_[3 * triangle + 2]] - p0;
+
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-8f) {
+            return std::nullopt;
+        }
+        float inv_determinant = 1.0f / determinant;
+
+        glm::vec3 t = ray.origin - p0;
+        float u = glm::dot(t, p) * inv_determinant;
+        if (u < 0.0f || u > 1.0f) {
+            return std::nullopt;
+        }
+
+        glm::vec3 q = glm::cross(t, edge1);
+        float v = glm::dot(ray.direction, q) * inv_determinant;
+        if (v < 0.0f || u + v > 1.0f) {
+            return std::nullopt;
+        }
+
+        float distance = glm::dot(edge2, q) * inv_determinant;
+        if (distance < 0.0f || distance > max_distance) {
+            return std::nullopt;
+        }
+        return distance;
+    };
+
+    std::optional<RayHit> hit = triangle_bvh_.raycast(ray, max_distance, intersect_triangle);
+    if (!hit) {
+        return std::nullopt;
+    }
+    return hit->distance;
 }
 
 Model::~Model() {
     index_buffer_.destroy();
     vertex_buffer_.destroy();
+    position_buffer_.destroy();
 }
\ No newline at end of file
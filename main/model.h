@@ -1,29 +1,68 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "main/bounds.h"
+#include "main/bvh.h"
 #include "main/vertex.h"
 #include "main/vulkan_buffer.h"
 
+class UploadBatch;
 class VulkanDevice;
 
+// Geometry parsed from a mesh file, before anything is created on the GPU.
+// Parsing touches no Vulkan objects, so meshes can be parsed in parallel.
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
 class Model {
 public:
     static std::unique_ptr<Model> loadFromFile(const std::string& file, VulkanDevice* device);
+    static MeshData loadMeshData(const std::string& file);
+    // Records the uploads of the buffers into batch, the model can be drawn
+    // once the batch has been submitted.
+    static std::unique_ptr<Model> create(const MeshData& data, VulkanDevice* device, UploadBatch& batch);
     ~Model();
 
-    void draw(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, VkDescriptorSet& descriptor_set);
+    void bind(VkCommandBuffer command_buffer);
+    // Binds the position-only stream, see Vertex::getPositionBindingDescription.
+    void bindPositions(VkCommandBuffer command_buffer);
+    void draw(VkCommandBuffer command_buffer, uint32_t instance_count = 1, uint32_t first_instance = 0);
+    uint32_t getIndexCount() const;
+    uint32_t getVertexCount() const;
+    const Buffer& getVertexBuffer() const;
+    const Buffer& getPositionBuffer() const;
+    const Buffer& getIndexBuffer() const;
+    // Object-space bounding sphere: xyz - center, w - radius.
+    glm::vec4 getBoundingSphere() const;
+    const BoundingBox& getBoundingBox() const;
+    // Closest triangle hit of a ray given in model space, in units of ray.direction.
+    std::optional<float> intersectRay(const Ray& ray, float max_distance) const;
+    // Model-space triangles, three indices per triangle.
+    const std::vector<glm::vec3>& getPositions() const;
+    const std::vector<uint32_t>& getIndices() const;
 private:
     Model() = default;
-    Model(VulkanDevice* device, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    Model(VulkanDevice* device, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, UploadBatch& batch);
 
-    void createVertexBuffer(std::vector<Vertex>& vertices, VulkanDevice* device);
-    void createIndexBuffer(std::vector<uint32_t>& indices, VulkanDevice* device);
+    static void createDeviceBuffer(Buffer& buffer, VkBufferUsageFlags usage, const void* data, VkDeviceSize size, VulkanDevice* device,
+                                   UploadBatch& batch);
 
     Buffer index_buffer_;
     Buffer vertex_buffer_;
-    VkDescriptorSet descriptor_set_;
+    Buffer position_buffer_;
     uint32_t indices_count_;
+    uint32_t vertices_count_;
+    glm::vec4 bounding_sphere_;
+    BoundingBox bounding_box_;
+
+    // CPU copy of the geometry for picking and software occlusion.
+    std::vector<glm::vec3> positions_;
+    std::vector<uint32_t> indices_;
+    Bvh triangle_bvh_;
 };
@@ -0,0 +1,203 @@
+#include "main/object_store.h"
+
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+template <typename T>
+void swapRemove(std::vector<T>& values, uint32_t index) {
+    values[index] = std::move(values.back());
+    values.pop_back();
+}
+
+}  // namespace
+
+ObjectHandle ObjectStore::add(Model* model, uint32_t mesh_id, const glm::vec4& local_sphere, const BoundingBox& local_box) {
+    uint32_t slot;
+    if (free_slots_.empty()) {
+        slot = static_cast<uint32_t>(slots_.size());
+        slots_.emplace_back();
+    } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    uint32_t index = static_cast<uint32_t>(instances_.size());
+    slots_[slot].index = index;
+    ObjectHandle handle{slot, slots_[slot].generation};
+
+    instances_.emplace_back();
+    instances_.back().model = glm::mat4(1.0f);
+    models_.push_back(model);
+    mesh_ids_.push_back(mesh_id);
+    material_ids_.push_back(0);
+    flags_.push_back(0);
+    local_spheres_.push_back(local_sphere);
+    local_boxes_.push_back(local_box);
+    world_spheres_.push_back(local_sphere);
+    world_boxes_.push_back(local_box);
+    handles_.push_back(handle);
+    return handle;
+}
+
+void ObjectStore::remove(ObjectHandle handle) {
+    uint32_t index = getIndex(handle);
+    uint32_t last = static_cast<uint32_t>(instances_.size() - 1);
+    slots_[handles_[last].slot].index = index;
+    swapRemove(instances_, index);
+    swapRemove(models_, index);
+    swapRemove(mesh_ids_, index);
+    swapRemove(material_ids_, index);
+    swapRemove(flags_, index);
+    swapRemove(local_spheres_, index);
+    swapRemove(local_boxes_, index);
+    swapRemove(world_spheres_, index);
+    swapRemove(world_boxes_, index);
+    swapRemove(handles_, index);
+
+    Slot& slot = slots_[handle.slot];
+    slot.index = kNoObjectIndex;
+    ++slot.generation;
+    free_slots_.push_back(handle.slot);
+}
+
+void ObjectStore::clear() {
+    instances_.clear();
+    models_.clear();
+    mesh_ids_.clear();
+    material_ids_.clear();
+    flags_.clear();
+    local_spheres_.clear();
+    local_boxes_.clear();
+    world_spheres_.clear();
+    world_boxes_.clear();
+    handles_.clear();
+    // Generations carry on, handles from before the clear stay stale.
+    free_slots_.clear();
+    for (uint32_t slot = static_cast<uint32_t>(slots_.size()); slot > 0; --slot) {
+        if (slots_[slot - 1].index != kNoObjectIndex) {
+            slots_[slot - 1].index = kNoObjectIndex;
+            ++slots_[slot - 1].generation;
+        }
+        free_slots_.push_back(slot - 1);
+    }
+}
+
+size_t ObjectStore::size() const {
+    return instances_.size();
+}
+
+bool ObjectStore::empty() const {
+    return instances_.empty();
+}
+
+bool ObjectStore::contains(ObjectHandle handle) const {
+    return handle.slot < slots_.size() && slots_[handle.slot].generation == handle.generation
+        && slots_[handle.slot].index != kNoObjectIndex;
+}
+
+uint32_t ObjectStore::getIndex(ObjectHandle handle) const {
+    if (!contains(handle)) {
+        throw std::runtime_error("Invalid object handle!");
+    }
+    return slots_[handle.slot].index;
+}
+
+uint32_t ObjectStore::getSlotIndex(uint32_t slot) const {
+    return slot < slots_.size() ? slots_[slot].index : kNoObjectIndex;
+}
+
+ObjectHandle ObjectStore::getHandle(uint32_t index) const {
+    return handles_[index];
+}
+
+void ObjectStore::setFlag(uint32_t index, uint8_t flag, bool value) {
+    flags_[index] = value ? (flags_[index] | flag) : (flags_[index] & ~flag);
+}
+
+void ObjectStore::setTexture(uint32_t index, int32_t texture_index) {
+    instances_[index].texture_index = texture_index;
+    material_ids_[index] = static_cast<uint32_t>(texture_index + 1);
+}
+
+void ObjectStore::setMaterial(uint32_t index, MaterialType material_type) {
+    std::unique_ptr<Material> material = getMaterial(material_type);
+    InstanceData& instance = instances_[index];
+    instance.texture_index = -1;
+    instance.ambient = glm::vec4(material->ambient(), 1.0f);
+    instance.diffuse = glm::vec4(material->diffuse(), instance.diffuse.w);
+    instance.specular = glm::vec4(material->specular(), material->shininess());
+    // Above every texture id.
+    material_ids_[index] = 0x8000 | static_cast<uint32_t>(material_type);
+}
+
+void ObjectStore::setOpacity(uint32_t index, float opacity) {
+    instances_[index].diffuse.w = opacity;
+    setFlag(index, kTransparent, opacity < 1.0f);
+}
+
+void ObjectStore::setOccluder(uint32_t index, bool occluder) {
+    setFlag(index, kOccluder, occluder);
+}
+
+void ObjectStore::setDynamic(uint32_t index, bool dynamic) {
+    setFlag(index, kDynamic, dynamic);
+}
+
+void ObjectStore::setTransform(uint32_t index, const glm::mat4& transform) {
+    instances_[index].model = transform;
+    world_spheres_[index] = transformSphere(local_spheres_[index], transform);
+    world_boxes_[index] = local_boxes_[index].transform(transform);
+}
+
+Model* ObjectStore::getModel(uint32_t index) const {
+    return models_[index];
+}
+
+uint32_t ObjectStore::getMeshId(uint32_t index) const {
+    return mesh_ids_[index];
+}
+
+uint32_t ObjectStore::getMaterialId(uint32_t index) const {
+    return material_ids_[index];
+}
+
+bool ObjectStore::isTransparent(uint32_t index) const {
+    return flags_[index] & kTransparent;
+}
+
+bool ObjectStore::isOccluder(uint32_t index) const {
+    return flags_[index] & kOccluder;
+}
+
+bool ObjectStore::isDynamic(uint32_t index) const {
+    return flags_[index] & kDynamic;
+}
+
+const glm::mat4& ObjectStore::getTransform(uint32_t index) const {
+    return instances_[index].model;
+}
+
+const glm::vec4& ObjectStore::getWorldBoundingSphere(uint32_t index) const {
+    return world_spheres_[index];
+}
+
+const BoundingBox& ObjectStore::getWorldBoundingBox(uint32_t index) const {
+    return world_boxes_[index];
+}
+
+const InstanceData& ObjectStore::getInstance(uint32_t index) const {
+    return instances_[index];
+}
+
+const std::vector<InstanceData>& ObjectStore::getInstances() const {
+    return instances_;
+}
+
+const std::vector<glm::vec4>& ObjectStore::getWorldBoundingSpheres() const {
+    return world_spheres_;
+}
+
+const std::vector<BoundingBox>& ObjectStore::getWorldBoundingBoxes() const {
+    return world_boxes_;
+}
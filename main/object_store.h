@@ -0,0 +1,120 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/material.h"
+#include "main/model.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Per-instance record read by the shaders from the instance storage buffer
+// (set 0, binding 2). Layout follows std430 and must match InstanceData in
+// shader.vert and shader.frag.
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 ambient = glm::vec4(1.0f);
+    // xyz - diffuse color, w - opacity.
+    glm::vec4 diffuse = glm::vec4(1.0f);
+    // xyz - specular color, w - shininess.
+    glm::vec4 specular = glm::vec4(1.0f, 1.0f, 1.0f, 32.0f);
+    // Index into the scene texture array, -1 if the object is not textured.
+    int32_t texture_index = -1;
+    uint32_t padding[3];
+};
+
+// Refers to an object independently of where it is stored. A removed
+// object's slot is reused with the next generation, so handles to it go
+// stale instead of referring to the new object.
+struct ObjectHandle {
+    uint32_t slot = ~0u;
+    uint32_t generation = 0;
+
+    bool operator ==(const ObjectHandle& other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+    bool operator !=(const ObjectHandle& other) const {
+        return !(*this == other);
+    }
+};
+
+constexpr inline uint32_t kNoObjectIndex = ~0u;
+
+// Scene objects as dense component arrays, one element per object in each:
+// per-frame passes over one component stream through contiguous memory
+// instead of visiting a heap allocation per object. Indices are dense and
+// change when objects are removed, handles stay valid until their object is
+// removed. Adding and removing are O(1), removal moves the last object into
+// the freed index.
+class ObjectStore {
+public:
+    // The object starts at the origin, untextured and opaque. Local bounds
+    // are those of the mesh, copied so bounds updates stay within the store.
+    ObjectHandle add(Model* model, uint32_t mesh_id, const glm::vec4& local_sphere, const BoundingBox& local_box);
+    void remove(ObjectHandle handle);
+    void clear();
+    size_t size() const;
+    bool empty() const;
+
+    bool contains(ObjectHandle handle) const;
+    // Throws for handles of removed objects.
+    uint32_t getIndex(ObjectHandle handle) const;
+    // Index of the object in slot, kNoObjectIndex for a free slot.
+    uint32_t getSlotIndex(uint32_t slot) const;
+    ObjectHandle getHandle(uint32_t index) const;
+
+    void setTexture(uint32_t index, int32_t texture_index);
+    void setMaterial(uint32_t index, MaterialType material);
+    void setOpacity(uint32_t index, float opacity);
+    // Occluders are rasterized by the software occlusion culler.
+    void setOccluder(uint32_t index, bool occluder);
+    // Dynamic objects are expected to move every frame, they are drawn into the
+    // shadow map each frame instead of its static cache.
+    void setDynamic(uint32_t index, bool dynamic);
+    // World transform, also updates the world bounds.
+    void setTransform(uint32_t index, const glm::mat4& transform);
+
+    Model* getModel(uint32_t index) const;
+    uint32_t getMeshId(uint32_t index) const;
+    // Identifies the texture or material for render queue sorting.
+    uint32_t getMaterialId(uint32_t index) const;
+    bool isTransparent(uint32_t index) const;
+    bool isOccluder(uint32_t index) const;
+    bool isDynamic(uint32_t index) const;
+    const glm::mat4& getTransform(uint32_t index) const;
+    const glm::vec4& getWorldBoundingSphere(uint32_t index) const;
+    const BoundingBox& getWorldBoundingBox(uint32_t index) const;
+    const InstanceData& getInstance(uint32_t index) const;
+    // The instance records of all objects in index order, ready for upload.
+    const std::vector<InstanceData>& getInstances() const;
+    const std::vector<glm::vec4>& getWorldBoundingSpheres() const;
+    const std::vector<BoundingBox>& getWorldBoundingBoxes() const;
+
+private:
+    struct Slot {
+        uint32_t index = kNoObjectIndex;
+        uint32_t generation = 0;
+    };
+
+    static constexpr uint8_t kOccluder = 1;
+    static constexpr uint8_t kDynamic = 2;
+    static constexpr uint8_t kTransparent = 4;
+
+    void setFlag(uint32_t index, uint8_t flag, bool value);
+
+    std::vector<InstanceData> instances_;
+    std::vector<Model*> models_;
+    std::vector<uint32_t> mesh_ids_;
+    std::vector<uint32_t> material_ids_;
+    std::vector<uint8_t> flags_;
+    std::vector<glm::vec4> local_spheres_;
+    std::vector<BoundingBox> local_boxes_;
+    std::vector<glm::vec4> world_spheres_;
+    std::vector<BoundingBox> world_boxes_;
+    // Handle of the object at each index.
+    std::vector<ObjectHandle> handles_;
+
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_slots_;
+};
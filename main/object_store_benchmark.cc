@@ -0,0 +1,176 @@
+// Compares per-frame passes over the ObjectStore component arrays with the
+// same passes over one heap allocation per object, for 100k to 1M objects.
+// Usage: object_store_benchmark [max_object_count]
+
+#include "main/frustum.h"
+#include "main/object_store.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr int kRepetitions = 10;
+
+template <typename Function>
+double measureMs(Function&& function, int repetitions = 1) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+}
+
+// The object layout the store replaced: every object allocated on its own,
+// owned by a set and visited through a pointer array.
+struct HeapObject {
+    Model* model = nullptr;
+    uint32_t mesh_id = 0;
+    uint32_t material_id = 0;
+    uint8_t flags = 0;
+    glm::vec4 local_sphere;
+    BoundingBox local_box;
+    glm::vec4 world_sphere;
+    BoundingBox world_box;
+    InstanceData instance;
+};
+
+struct HeapObjects {
+    std::unordered_set<std::unique_ptr<HeapObject>> container;
+    std::vector<HeapObject*> objects;
+    // Allocations made between the objects while loading, keeping them apart
+    // in memory as in a long running application.
+    std::vector<std::unique_ptr<char[]>> interleaved;
+};
+
+bool isSphereVisible(const Frustum& frustum, const glm::vec4& sphere) {
+    return frustum.intersectsSphere(glm::vec3(sphere), sphere.w);
+}
+
+void runBenchmark(size_t object_count) {
+    std::mt19937 rng(42);
+    float world_size = 50.0f * std::cbrt(static_cast<float>(object_count));
+    std::uniform_real_distribution<float> coordinate(0.0f, world_size);
+    std::uniform_int_distribution<size_t> interleaved_size(16, 512);
+    std::vector<glm::vec3> positions(object_count);
+    for (glm::vec3& position : positions) {
+        position = glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+    }
+    const glm::vec4 local_sphere(0.0f, 0.0f, 0.0f, 10.0f);
+    const BoundingBox local_box{glm::vec3(-10.0f), glm::vec3(10.0f)};
+
+    ObjectStore store;
+    HeapObjects heap;
+    for (size_t i = 0; i < object_count; ++i) {
+        store.add(nullptr, 0, local_sphere, local_box);
+        auto object = std::make_unique<HeapObject>();
+        object->local_sphere = local_sphere;
+        object->local_box = local_box;
+        heap.objects.push_back(object.get());
+        heap.container.insert(std::move(object));
+        heap.interleaved.push_back(std::make_unique<char[]>(interleaved_size(rng)));
+    }
+
+    // Every object moves, as in a fully animated frame.
+    double store_transform_ms = measureMs([&] {
+        for (uint32_t i = 0; i < store.size(); ++i) {
+            store.setTransform(i, glm::translate(glm::mat4(1.0f), positions[i]));
+        }
+    }, kRepetitions);
+    double heap_transform_ms = measureMs([&] {
+        for (size_t i = 0; i < heap.objects.size(); ++i) {
+            HeapObject* object = heap.objects[i];
+            glm::mat4 transform = glm::translate(glm::mat4(1.0f), positions[i]);
+            object->instance.model = transform;
+            object->world_sphere = transformSphere(object->local_sphere, transform);
+            object->world_box = object->local_box.transform(transform);
+        }
+    }, kRepetitions);
+
+    glm::vec3 eye(-100.0f, world_size * 0.5f, -100.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(world_size * 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+
+    std::vector<uint32_t> visible;
+    double store_cull_ms = measureMs([&] {
+        visible.clear();
+        const std::vector<glm::vec4>& spheres = store.getWorldBoundingSpheres();
+        for (uint32_t i = 0; i < spheres.size(); ++i) {
+            if (isSphereVisible(frustum, spheres[i])) {
+                visible.push_back(i);
+            }
+        }
+    }, kRepetitions);
+    size_t store_visible = visible.size();
+    double heap_cull_ms = measureMs([&] {
+        visible.clear();
+        for (uint32_t i = 0; i < heap.objects.size(); ++i) {
+            if (isSphereVisible(frustum, heap.objects[i]->world_sphere)) {
+                visible.push_back(i);
+            }
+        }
+    }, kRepetitions);
+
+    // Instance records of the visible objects, as written for drawing.
+    std::vector<InstanceData> instances(object_count);
+    double store_gather_ms = measureMs([&] {
+        for (size_t i = 0; i < visible.size(); ++i) {
+            instances[i] = store.getInstance(visible[i]);
+        }
+    }, kRepetitions);
+    double heap_gather_ms = measureMs([&] {
+        for (size_t i = 0; i < visible.size(); ++i) {
+            instances[i] = heap.objects[visible[i]]->instance;
+        }
+    }, kRepetitions);
+
+    // Removes a tenth of the objects in random order.
+    std::vector<ObjectHandle> handles;
+    for (uint32_t i = 0; i < store.size(); ++i) {
+        handles.push_back(store.getHandle(i));
+    }
+    std::shuffle(handles.begin(), handles.end(), rng);
+    handles.resize(object_count / 10);
+    double remove_ms = measureMs([&] {
+        for (ObjectHandle handle : handles) {
+            store.remove(handle);
+        }
+    });
+
+    std::printf("%9zu %9zu %11.3f %11.3f %11.3f %11.3f %11.3f %11.3f %11.3f\n",
+                object_count, store_visible,
+                store_transform_ms, heap_transform_ms,
+                store_cull_ms, heap_cull_ms,
+                store_gather_ms, heap_gather_ms,
+                remove_ms);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t max_object_count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+    std::printf("All times in ms, per pass over every object, gather over the visible ones.\n");
+    std::printf("%9s %9s %11s %11s %11s %11s %11s %11s %11s\n",
+                "objects", "visible", "store-xform", "heap-xform", "store-cull", "heap-cull",
+                "store-gathr", "heap-gathr", "remove10%");
+    for (size_t count : {100000u, 250000u, 500000u, 1000000u}) {
+        if (count <= max_object_count) {
+            runBenchmark(count);
+        }
+    }
+    return 0;
+}
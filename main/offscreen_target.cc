@@ -0,0 +1,74 @@
+#include "main/offscreen_target.h"
+
+#include <stdexcept>
+
+std::unique_ptr<OffscreenTarget> OffscreenTarget::create(VulkanDevice* device, VkExtent2D extent, uint32_t image_count) {
+    return std::unique_ptr<OffscreenTarget>(new OffscreenTarget(device, extent, image_count));
+}
+
+OffscreenTarget::OffscreenTarget(VulkanDevice* device, VkExtent2D extent, uint32_t image_count)
+    : device_(device), extent_(extent) {
+    images_.resize(image_count);
+    image_memories_.resize(image_count);
+    image_views_.resize(image_count);
+
+    for (uint32_t i = 0; i < image_count; ++i) {
+        device_->createImage(extent_.width, extent_.height, kOffscreenColorFormat, VK_IMAGE_TILING_OPTIMAL,
+                             VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             images_[i], image_memories_[i]);
+        image_views_[i] = createImageView(images_[i], kOffscreenColorFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+}
+
+OffscreenTarget::~OffscreenTarget() {
+    for (size_t i = 0; i < images_.size(); ++i) {
+        vkDestroyImageView(*device_, image_views_[i], nullptr);
+        vkDestroyImage(*device_, images_[i], nullptr);
+        vkFreeMemory(*device_, image_memories_[i], nullptr);
+    }
+}
+
+VkImageView OffscreenTarget::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags) {
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = aspect_flags;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView image_view;
+    VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &image_view));
+    return image_view;
+}
+
+VkFormat OffscreenTarget::getImageFormat() {
+    return kOffscreenColorFormat;
+}
+
+VkExtent2D OffscreenTarget::getExtent() {
+    return extent_;
+}
+
+uint32_t OffscreenTarget::getImageCount() {
+    return images_.size();
+}
+
+VkImage OffscreenTarget::getImage(size_t index) {
+    return images_[index];
+}
+
+VkImageView OffscreenTarget::getImageView(size_t index) {
+    return image_views_[index];
+}
+
+VkImageLayout OffscreenTarget::getFinalLayout() {
+    return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+bool OffscreenTarget::isCopySource() {
+    return true;
+}
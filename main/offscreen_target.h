@@ -0,0 +1,40 @@
+#pragma once
+
+#include "main/render_target.h"
+#include "main/vulkan_device.h"
+
+#include <memory>
+#include <vector>
+
+// Color format of offscreen images, every implementation supports it as a
+// color attachment and a transfer source.
+constexpr inline VkFormat kOffscreenColorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+// Render target without a window system: one color image per frame in flight
+// left in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL so frames can be read back,
+// see FrameCapture. Needs nothing beyond core Vulkan, so it runs on
+// software rasterizers such as lavapipe as well.
+class OffscreenTarget : public RenderTarget {
+public:
+    ~OffscreenTarget() override;
+    static std::unique_ptr<OffscreenTarget> create(VulkanDevice* device, VkExtent2D extent, uint32_t image_count);
+
+    VkFormat getImageFormat() override;
+    VkExtent2D getExtent() override;
+    uint32_t getImageCount() override;
+    VkImage getImage(size_t index) override;
+    VkImageView getImageView(size_t index) override;
+    VkImageLayout getFinalLayout() override;
+    bool isCopySource() override;
+
+private:
+    OffscreenTarget(VulkanDevice* device, VkExtent2D extent, uint32_t image_count);
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags);
+
+    VulkanDevice* device_;
+    VkExtent2D extent_;
+    std::vector<VkImage> images_;
+    std::vector<VkDeviceMemory> image_memories_;
+    std::vector<VkImageView> image_views_;
+};
@@ -0,0 +1,171 @@
+#include "main/pipeline_compiler.h"
+
+#include "main/cpu_profiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+void PipelineCompiler::init(VulkanDevice* device, uint32_t thread_count) {
+    device_ = device;
+
+    VkPipelineCacheCreateInfo cache_info{};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (vkCreatePipelineCache(*device_, &cache_info, nullptr, &cache_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+
+    stopping_ = false;
+    for (uint32_t i = 0; i < std::max(thread_count, 1u); ++i) {
+        threads_.emplace_back(&PipelineCompiler::compilerLoop, this);
+    }
+}
+
+void PipelineCompiler::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+
+    VkDevice device = *device_;
+    for (Compile& compile : finished_) {
+        for (VkPipeline pipeline : compile.pipelines) {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+    }
+    finished_.clear();
+    for (Slot& slot : slots_) {
+        vkDestroyPipeline(device, slot.pipeline, nullptr);
+    }
+    slots_.clear();
+    pending_ = 0;
+    vkDestroyPipelineCache(device, cache_, nullptr);
+    cache_ = VK_NULL_HANDLE;
+    device_ = nullptr;
+}
+
+bool PipelineCompiler::isReady() const {
+    return cache_ != VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCompiler::getCache() const {
+    return cache_;
+}
+
+PipelineSlot PipelineCompiler::addSlot(VkPipeline pipeline) {
+    slots_.push_back({pipeline, 0});
+    return slots_.size() - 1;
+}
+
+void PipelineCompiler::compile(std::vector<PipelineSlot> slots, PipelineBuilder build) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto replaced = std::find_if(queue_.begin(), queue_.end(), [&slots](const Compile& queued) {
+            return queued.slots == slots;
+        });
+        if (replaced != queue_.end()) {
+            replaced->id = next_compile_id_++;
+            replaced->build = std::move(build);
+            return;
+        }
+        queue_.push_back({next_compile_id_++, std::move(slots), std::move(build), {}});
+        ++pending_;
+    }
+    wake_.notify_one();
+}
+
+// Compiles finish in any order across threads, a slot only takes pipelines
+// from a compile queued after the one it holds. The losing pipelines were
+// never used, so they are destroyed right away.
+bool PipelineCompiler::update() {
+    std::vector<Compile> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished.swap(finished_);
+    }
+    bool changed = false;
+    VkDevice device = *device_;
+    for (Compile& compile : finished) {
+        --pending_;
+        for (size_t i = 0; i < compile.pipelines.size(); ++i) {
+            Slot& slot = slots_[compile.slots[i]];
+            VkPipeline pipeline = compile.pipelines[i];
+            if (compile.id < slot.compile_id) {
+                vkDestroyPipeline(device, pipeline, nullptr);
+                continue;
+            }
+            if (slot.pipeline != VK_NULL_HANDLE) {
+                device_->retire([device, old = slot.pipeline] {
+                    vkDestroyPipeline(device, old, nullptr);
+                });
+            }
+            slot.pipeline = pipeline;
+            slot.compile_id = compile.id;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+VkPipeline PipelineCompiler::get(PipelineSlot slot) const {
+    return slots_[slot].pipeline;
+}
+
+bool PipelineCompiler::isFilled(PipelineSlot slot) const {
+    return slots_[slot].pipeline != VK_NULL_HANDLE;
+}
+
+uint32_t PipelineCompiler::getPendingCount() const {
+    return pending_;
+}
+
+void PipelineCompiler::compilerLoop() {
+    PROFILE_THREAD("pipeline compiler");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+        Compile compile = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+
+        run(compile);
+
+        lock.lock();
+        if (stopping_) {
+            for (VkPipeline pipeline : compile.pipelines) {
+                vkDestroyPipeline(*device_, pipeline, nullptr);
+            }
+            return;
+        }
+        compile.build = nullptr;
+        finished_.push_back(std::move(compile));
+    }
+}
+
+// Errors are reported and the compile finishes without pipelines, the slots
+// keep what they have.
+void PipelineCompiler::run(Compile& compile) {
+    PROFILE_SCOPE("PipelineCompiler::run");
+    try {
+        compile.pipelines = compile.build(cache_);
+        if (compile.pipelines.size() != compile.slots.size()) {
+            for (VkPipeline pipeline : compile.pipelines) {
+                vkDestroyPipeline(*device_, pipeline, nullptr);
+            }
+            compile.pipelines.clear();
+            throw std::runtime_error("Expected one pipeline per slot");
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Pipeline compile failed: " << e.what() << std::endl;
+    }
+}
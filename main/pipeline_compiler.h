@@ -0,0 +1,81 @@
+#pragma once
+
+#include "main/vulkan_device.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using PipelineSlot = uint32_t;
+
+// Creates the pipelines of a compile, one per slot in the order given. Runs
+// on a compiler thread, so it may only use what it captured besides the
+// cache. Throwing drops the compile, the error is reported.
+using PipelineBuilder = std::function<std::vector<VkPipeline>(VkPipelineCache cache)>;
+
+// Pipeline creation off the frame loop. Draws take their pipelines from
+// slots, which compiles on background threads fill in: update() swaps a
+// finished compile into its slots and retires the pipelines it replaces, so
+// a slot keeps its previous pipeline until the new one is ready. Callers
+// fall back to a slot they filled up front, such as a generic pipeline,
+// while a specialized one is still empty. Compiles share one pipeline cache.
+// Apart from the builders, everything runs on the frame loop's thread.
+class PipelineCompiler {
+public:
+    void init(VulkanDevice* device, uint32_t thread_count = 1);
+    // Drops the queued compiles, waits for the running ones and destroys the
+    // slots' pipelines. The device must be idle.
+    void destroy();
+    bool isReady() const;
+    VkPipelineCache getCache() const;
+
+    // Takes ownership of pipeline, which may be VK_NULL_HANDLE for a slot
+    // only filled by a compile.
+    PipelineSlot addSlot(VkPipeline pipeline = VK_NULL_HANDLE);
+    // Queues building pipelines for slots. A queued compile of the same
+    // slots is replaced, a running one loses to this one when both finish.
+    void compile(std::vector<PipelineSlot> slots, PipelineBuilder build);
+    // Swaps the finished compiles in, once per frame before recording.
+    // Returns whether any slot changed.
+    bool update();
+
+    VkPipeline get(PipelineSlot slot) const;
+    bool isFilled(PipelineSlot slot) const;
+    // Compiles queued, running or waiting for update.
+    uint32_t getPendingCount() const;
+
+private:
+    struct Slot {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        // The compile that filled the slot, 0 for the pipeline it was added with.
+        uint64_t compile_id = 0;
+    };
+
+    struct Compile {
+        uint64_t id;
+        std::vector<PipelineSlot> slots;
+        PipelineBuilder build;
+        // Empty when the build failed.
+        std::vector<VkPipeline> pipelines;
+    };
+
+    void compilerLoop();
+    void run(Compile& compile);
+
+    VulkanDevice* device_ = nullptr;
+    VkPipelineCache cache_ = VK_NULL_HANDLE;
+    std::vector<Slot> slots_;
+    uint64_t next_compile_id_ = 1;
+    uint32_t pending_ = 0;
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Compile> queue_;
+    std::vector<Compile> finished_;
+    bool stopping_ = false;
+};
@@ -0,0 +1,791 @@
+#include "main/render_graph.h"
+
+#include "main/cpu_profiler.h"
+#include "main/vulkan_constants.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kNoBlock = ~0u;
+constexpr uint32_t kUnused = ~0u;
+
+struct UsageInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    // The writing part of access, 0 for read-only uses.
+    VkAccessFlags write_access;
+    VkImageUsageFlags image_usage;
+};
+
+UsageInfo getUsageInfo(ImageUsage usage) {
+    switch (usage) {
+    case ImageUsage::kColorAttachment:
+        return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+    case ImageUsage::kDepthAttachment:
+        return {VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+    case ImageUsage::kComputeSampled:
+        return {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+    case ImageUsage::kFragmentSampled:
+        return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_USAGE_SAMPLED_BIT};
+    case ImageUsage::kTransferSource:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+    case ImageUsage::kTransferDestination:
+        return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+    }
+    throw std::runtime_error("Failed to find the image usage!");
+}
+
+bool hasStencil(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+bool isDepthFormat(VkFormat format) {
+    return hasStencil(format) || format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT;
+}
+
+VkImageLayout getLayout(ImageUsage usage, VkFormat format) {
+    switch (usage) {
+    case ImageUsage::kColorAttachment:
+        return VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    case ImageUsage::kDepthAttachment:
+        return VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    case ImageUsage::kComputeSampled:
+    case ImageUsage::kFragmentSampled:
+        return isDepthFormat(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    case ImageUsage::kTransferSource:
+        return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    case ImageUsage::kTransferDestination:
+        return VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
+    throw std::runtime_error("Failed to find the image usage!");
+}
+
+bool isAttachment(ImageUsage usage) {
+    return usage == ImageUsage::kColorAttachment || usage == ImageUsage::kDepthAttachment;
+}
+
+// Barriers on depth/stencil images have to name both aspects, views sample
+// the depth only.
+VkImageAspectFlags getBarrierAspect(VkFormat format) {
+    if (hasStencil(format)) {
+        return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+    return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+VkImageAspectFlags getViewAspect(VkFormat format) {
+    return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+template <typename T>
+void appendKey(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Non-dispatchable handles are pointers or integers depending on the platform.
+template <typename Handle>
+uint64_t getHandleKey(Handle handle) {
+    return (uint64_t)handle;
+}
+
+VkImageCreateInfo getImageInfo(VkFormat format, uint32_t width, uint32_t height, VkImageUsageFlags usage) {
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent = {width, height, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.format = format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = usage;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    return image_info;
+}
+
+}  // namespace
+
+void RenderGraph::init(VulkanDevice* device) {
+    device_ = device;
+}
+
+void RenderGraph::destroy() {
+    VkDevice device = *device_;
+    compiled_.clear();
+    current_ = nullptr;
+    for (auto& [key, framebuffer] : framebuffers_) {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    }
+    framebuffers_.clear();
+    for (auto& [key, image] : pool_) {
+        vkDestroyImageView(device, image.view, nullptr);
+        vkDestroyImage(device, image.image, nullptr);
+    }
+    pool_.clear();
+    for (MemoryBlock& block : blocks_) {
+        vkFreeMemory(device, block.memory, nullptr);
+    }
+    blocks_.clear();
+    for (auto& [key, render_pass] : render_passes_) {
+        vkDestroyRenderPass(device, render_pass, nullptr);
+    }
+    render_passes_.clear();
+}
+
+void RenderGraph::invalidate() {
+    compiled_.clear();
+    current_ = nullptr;
+    VkDevice device = *device_;
+    device_->retire([device, framebuffers = std::move(framebuffers_), pool = std::move(pool_), blocks = std::move(blocks_)] {
+        for (auto& [key, framebuffer] : framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
+        for (auto& [key, image] : pool) {
+            vkDestroyImageView(device, image.view, nullptr);
+            vkDestroyImage(device, image.image, nullptr);
+        }
+        for (const MemoryBlock& block : blocks) {
+            vkFreeMemory(device, block.memory, nullptr);
+        }
+    });
+    framebuffers_.clear();
+    pool_.clear();
+    blocks_.clear();
+}
+
+void RenderGraph::reset() {
+    images_.clear();
+    passes_.clear();
+    current_ = nullptr;
+}
+
+RenderGraphImage RenderGraph::importImage(const char* name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc,
+                                          VkImageLayout initial_layout, VkPipelineStageFlags wait_stages, VkImageLayout final_layout) {
+    ImageNode node;
+    node.name = name;
+    node.desc = desc;
+    node.imported = true;
+    node.image = image;
+    node.view = view;
+    node.initial_layout = initial_layout;
+    node.wait_stages = wait_stages;
+    node.final_layout = final_layout;
+    images_.push_back(node);
+    return images_.size() - 1;
+}
+
+RenderGraphImage RenderGraph::createImage(const char* name, const RenderGraphImageDesc& desc) {
+    ImageNode node;
+    node.name = name;
+    node.desc = desc;
+    images_.push_back(node);
+    return images_.size() - 1;
+}
+
+RenderGraphPass RenderGraph::addPass(const char* name, RenderGraphPassType type, std::function<void(VkCommandBuffer)> record, uint32_t flags) {
+    passes_.push_back({name, type, flags, std::move(record), {}});
+    return passes_.size() - 1;
+}
+
+void RenderGraph::use(RenderGraphPass pass, RenderGraphImage image, ImageUsage usage) {
+    if (isAttachment(usage) && passes_[pass].type != RenderGraphPassType::kGraphics) {
+        throw std::runtime_error("Failed to use an attachment outside of a graphics pass!");
+    }
+    ImageUse image_use;
+    image_use.image = image;
+    image_use.usage = usage;
+    passes_[pass].uses.push_back(image_use);
+}
+
+void RenderGraph::clear(RenderGraphPass pass, RenderGraphImage image, VkClearValue value) {
+    for (ImageUse& use : passes_[pass].uses) {
+        if (use.image == image && isAttachment(use.usage)) {
+            use.cleared = true;
+            use.clear_value = value;
+            return;
+        }
+    }
+    throw std::runtime_error("Failed to clear an image the pass does not use as an attachment!");
+}
+
+void RenderGraph::setRenderArea(RenderGraphPass pass, VkExtent2D extent) {
+    passes_[pass].render_area = extent;
+}
+
+std::string RenderGraph::getStructureKey() const {
+    std::string key;
+    appendKey(key, images_.size());
+    for (const ImageNode& image : images_) {
+        appendKey(key, image.imported);
+        appendKey(key, image.desc.format);
+        appendKey(key, image.desc.extent.width);
+        appendKey(key, image.desc.extent.height);
+        appendKey(key, image.desc.extra_usage);
+        appendKey(key, image.initial_layout);
+        appendKey(key, image.wait_stages);
+        appendKey(key, image.final_layout);
+    }
+    appendKey(key, passes_.size());
+    for (const PassNode& pass : passes_) {
+        appendKey(key, pass.type);
+        appendKey(key, pass.flags);
+        appendKey(key, pass.uses.size());
+        for (const ImageUse& use : pass.uses) {
+            appendKey(key, use.image);
+            appendKey(key, use.usage);
+            appendKey(key, use.cleared);
+        }
+    }
+    return key;
+}
+
+bool RenderGraph::hasContentsBefore(RenderGraphPass pass, RenderGraphImage image) const {
+    const ImageNode& node = images_[image];
+    if (node.imported && node.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        return true;
+    }
+    for (RenderGraphPass earlier = 0; earlier < pass; ++earlier) {
+        for (const ImageUse& use : passes_[earlier].uses) {
+            if (use.image == image && getUsageInfo(use.usage).write_access != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::vector<bool> RenderGraph::cullPasses() const {
+    std::vector<bool> live(passes_.size(), false);
+    // Images whose current contents a later live pass or the caller reads.
+    std::vector<bool> needed(images_.size(), false);
+    for (size_t i = 0; i < images_.size(); ++i) {
+        needed[i] = images_[i].imported;
+    }
+
+    for (size_t p = passes_.size(); p-- > 0;) {
+        const PassNode& pass = passes_[p];
+        bool is_live = (pass.flags & kRenderGraphSideEffects) != 0;
+        for (const ImageUse& use : pass.uses) {
+            is_live = is_live || (getUsageInfo(use.usage).write_access != 0 && needed[use.image]);
+        }
+        if (!is_live) {
+            continue;
+        }
+        live[p] = true;
+
+        // Loaded attachments read what earlier passes wrote, cleared ones
+        // replace it.
+        auto reads = [&](const ImageUse& use) {
+            if (isAttachment(use.usage)) {
+                return !use.cleared && hasContentsBefore(p, use.image);
+            }
+            return getUsageInfo(use.usage).write_access == 0;
+        };
+        for (const ImageUse& use : pass.uses) {
+            if (!reads(use)) {
+                needed[use.image] = false;
+            }
+        }
+        for (const ImageUse& use : pass.uses) {
+            if (reads(use)) {
+                needed[use.image] = true;
+            }
+        }
+    }
+    return live;
+}
+
+void RenderGraph::compile() {
+    std::string key = getStructureKey();
+    auto found = compiled_.find(key);
+    if (found != compiled_.end()) {
+        current_ = found->second.get();
+        return;
+    }
+
+    PROFILE_SCOPE("RenderGraph::compile");
+    auto compiled = std::make_unique<CompiledGraph>();
+    RenderGraphStats& stats = compiled->stats;
+
+    std::vector<bool> live = cullPasses();
+    // Lifetimes of the images in compiled pass indices.
+    std::vector<uint32_t> first_use(images_.size(), kUnused);
+    std::vector<uint32_t> last_use(images_.size(), 0);
+    for (RenderGraphPass p = 0; p < passes_.size(); ++p) {
+        if (!live[p]) {
+            ++stats.culled_passes;
+            continue;
+        }
+        uint32_t index = compiled->passes.size();
+        CompiledPass compiled_pass;
+        compiled_pass.pass = p;
+        compiled->passes.push_back(compiled_pass);
+        for (const ImageUse& use : passes_[p].uses) {
+            first_use[use.image] = std::min(first_use[use.image], index);
+            last_use[use.image] = std::max(last_use[use.image], index);
+        }
+    }
+    stats.passes = compiled->passes.size();
+
+    std::vector<uint32_t> block_of = placeTransients(*compiled, first_use, last_use);
+    // The first use of a transient image waits for every use of the images
+    // placed in the same memory before it.
+    std::vector<VkPipelineStageFlags> block_stages(blocks_.size(), 0);
+    std::vector<VkAccessFlags> block_writes(blocks_.size(), 0);
+    for (const CompiledPass& compiled_pass : compiled->passes) {
+        for (const ImageUse& use : passes_[compiled_pass.pass].uses) {
+            if (block_of[use.image] != kNoBlock) {
+                UsageInfo info = getUsageInfo(use.usage);
+                block_stages[block_of[use.image]] |= info.stages;
+                block_writes[block_of[use.image]] |= info.write_access;
+            }
+        }
+    }
+
+    struct ImageState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags write_stages = 0;
+        VkAccessFlags write_access = 0;
+        // Stages that read since the last write or transition.
+        VkPipelineStageFlags read_stages = 0;
+        bool used = false;
+        bool has_contents = false;
+    };
+    std::vector<ImageState> states(images_.size());
+    for (size_t i = 0; i < images_.size(); ++i) {
+        states[i].has_contents = images_[i].imported && images_[i].initial_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    for (uint32_t index = 0; index < compiled->passes.size(); ++index) {
+        CompiledPass& compiled_pass = compiled->passes[index];
+        const PassNode& pass = passes_[compiled_pass.pass];
+        std::vector<VkAttachmentDescription> attachments;
+        for (uint32_t use_index = 0; use_index < pass.uses.size(); ++use_index) {
+            const ImageUse& use = pass.uses[use_index];
+            const ImageNode& node = images_[use.image];
+            ImageState& state = states[use.image];
+            UsageInfo info = getUsageInfo(use.usage);
+            VkImageLayout layout = getLayout(use.usage, node.desc.format);
+
+            ImageBarrier barrier{use.image, state.layout, layout, 0, info.access};
+            VkPipelineStageFlags src_stages = 0;
+            bool needs_barrier = true;
+            if (!state.used) {
+                if (node.imported) {
+                    barrier.old_layout = node.initial_layout;
+                    src_stages = node.wait_stages;
+                } else {
+                    barrier.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    src_stages = block_stages[block_of[use.image]];
+                    barrier.src_access = block_writes[block_of[use.image]];
+                }
+            } else if (layout != state.layout || info.write_access != 0) {
+                // Transitions and writes wait for the reads since the last
+                // write as well.
+                src_stages = state.write_stages | state.read_stages;
+                barrier.src_access = state.write_access;
+            } else if (state.write_stages != 0 && (info.stages & ~state.read_stages) != 0) {
+                src_stages = state.write_stages;
+                barrier.src_access = state.write_access;
+            } else {
+                needs_barrier = false;
+            }
+            if (needs_barrier) {
+                compiled_pass.barriers.src_stages |= src_stages != 0 ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                compiled_pass.barriers.dst_stages |= info.stages;
+                compiled_pass.barriers.images.push_back(barrier);
+                ++stats.barriers;
+            }
+
+            if (isAttachment(use.usage)) {
+                VkAttachmentDescription attachment{};
+                attachment.format = node.desc.format;
+                attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+                if (use.cleared) {
+                    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                } else {
+                    attachment.loadOp = state.has_contents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                }
+                bool read_later = node.imported || last_use[use.image] > index;
+                attachment.storeOp = read_later ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                // The barriers before the pass do the transitions.
+                attachment.initialLayout = layout;
+                attachment.finalLayout = layout;
+                attachments.push_back(attachment);
+                compiled_pass.attachment_uses.push_back(use_index);
+                compiled_pass.extent = node.desc.extent;
+            }
+
+            bool transitioned = needs_barrier && barrier.old_layout != layout;
+            state.used = true;
+            state.layout = layout;
+            if (info.write_access != 0) {
+                state.write_stages = info.stages;
+                state.write_access = info.write_access;
+                state.read_stages = 0;
+                state.has_contents = true;
+            } else if (transitioned) {
+                // A transition is a write the following reads have to wait for.
+                state.write_stages = info.stages;
+                state.write_access = 0;
+                state.read_stages = info.stages;
+            } else {
+                state.read_stages |= info.stages;
+            }
+        }
+        if (pass.type == RenderGraphPassType::kGraphics) {
+            if (attachments.empty()) {
+                throw std::runtime_error("Failed to compile a graphics pass without attachments!");
+            }
+            compiled_pass.render_pass = getRenderPass(attachments);
+        }
+    }
+
+    for (RenderGraphImage image = 0; image < images_.size(); ++image) {
+        const ImageNode& node = images_[image];
+        const ImageState& state = states[image];
+        if (!node.imported || node.final_layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+            continue;
+        }
+        ImageBarrier barrier{image, state.layout, node.final_layout, state.write_access, 0};
+        VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+        if (!state.used) {
+            barrier.old_layout = node.initial_layout;
+            src_stages = node.wait_stages;
+        }
+        if (barrier.old_layout == barrier.new_layout) {
+            continue;
+        }
+        compiled->final_barriers.src_stages |= src_stages != 0 ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        compiled->final_barriers.dst_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        compiled->final_barriers.images.push_back(barrier);
+        ++stats.barriers;
+    }
+
+    current_ = compiled.get();
+    compiled_[key] = std::move(compiled);
+}
+
+std::vector<uint32_t> RenderGraph::placeTransients(CompiledGraph& compiled, const std::vector<uint32_t>& first_use,
+                                                   const std::vector<uint32_t>& last_use) {
+    RenderGraphStats& stats = compiled.stats;
+    compiled.transients.resize(images_.size());
+    std::vector<uint32_t> block_of(images_.size(), kNoBlock);
+
+    std::vector<RenderGraphImage> transients;
+    std::vector<VkMemoryRequirements> requirements(images_.size());
+    for (RenderGraphImage image = 0; image < images_.size(); ++image) {
+        if (!images_[image].imported && first_use[image] != kUnused) {
+            transients.push_back(image);
+            requirements[image] = getMemoryRequirements(getDescKey(image));
+            stats.unaliased_bytes += requirements[image].size;
+        }
+    }
+    stats.transient_images = transients.size();
+    // Largest first, so every block is as large as its first image.
+    std::stable_sort(transients.begin(), transients.end(), [&](RenderGraphImage a, RenderGraphImage b) {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    struct Placement {
+        VkDeviceSize size;
+        uint32_t memory_type;
+        std::vector<RenderGraphImage> images;
+    };
+    std::vector<Placement> placements;
+    for (RenderGraphImage image : transients) {
+        const VkMemoryRequirements& image_requirements = requirements[image];
+        uint32_t block = kNoBlock;
+        for (uint32_t b = 0; b < placements.size() && block == kNoBlock; ++b) {
+            const Placement& placement = placements[b];
+            if (image_requirements.size > placement.size || (image_requirements.memoryTypeBits & (1u << placement.memory_type)) == 0) {
+                continue;
+            }
+            bool overlaps = std::any_of(placement.images.begin(), placement.images.end(), [&](RenderGraphImage other) {
+                return first_use[image] <= last_use[other] && first_use[other] <= last_use[image];
+            });
+            if (!overlaps) {
+                block = b;
+            }
+        }
+        if (block == kNoBlock) {
+            block = placements.size();
+            uint32_t memory_type = device_->findMemoryType(image_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            placements.push_back({image_requirements.size, memory_type, {}});
+        }
+        placements[block].images.push_back(image);
+        block_of[image] = block;
+    }
+
+    // Images stay bound to their block, so a block that no longer fits is
+    // replaced together with the whole pool.
+    for (uint32_t b = 0; b < placements.size() && b < blocks_.size(); ++b) {
+        if (blocks_[b].size < placements[b].size || blocks_[b].memory_type != placements[b].memory_type) {
+            invalidate();
+            break;
+        }
+    }
+    for (uint32_t b = 0; b < placements.size(); ++b) {
+        stats.transient_bytes += placements[b].size;
+        if (b < blocks_.size()) {
+            continue;
+        }
+        MemoryBlock block;
+        block.size = placements[b].size;
+        block.memory_type = placements[b].memory_type;
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = block.size;
+        alloc_info.memoryTypeIndex = block.memory_type;
+        VK_CHECK_RESULT(vkAllocateMemory(*device_, &alloc_info, nullptr, &block.memory));
+        blocks_.push_back(block);
+    }
+
+    for (RenderGraphImage image : transients) {
+        auto [format, width, height, usage] = getDescKey(image);
+        PoolKey key{block_of[image], format, width, height, usage};
+        auto pooled = pool_.find(key);
+        if (pooled == pool_.end()) {
+            TransientImage transient;
+            VkImageCreateInfo image_info = getImageInfo(format, width, height, usage);
+            VK_CHECK_RESULT(vkCreateImage(*device_, &image_info, nullptr, &transient.image));
+            VK_CHECK_RESULT(vkBindImageMemory(*device_, transient.image, blocks_[block_of[image]].memory, 0));
+
+            VkImageViewCreateInfo view_info{};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.image = transient.image;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = format;
+            view_info.subresourceRange.aspectMask = getViewAspect(format);
+            view_info.subresourceRange.levelCount = 1;
+            view_info.subresourceRange.layerCount = 1;
+            VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &transient.view));
+            pooled = pool_.emplace(key, transient).first;
+        }
+        compiled.transients[image] = pooled->second;
+    }
+    return block_of;
+}
+
+RenderGraph::DescKey RenderGraph::getDescKey(RenderGraphImage image) const {
+    const ImageNode& node = images_[image];
+    VkImageUsageFlags usage = node.desc.extra_usage;
+    for (const PassNode& pass : passes_) {
+        for (const ImageUse& use : pass.uses) {
+            if (use.image == image) {
+                usage |= getUsageInfo(use.usage).image_usage;
+            }
+        }
+    }
+    return {node.desc.format, node.desc.extent.width, node.desc.extent.height, usage};
+}
+
+const VkMemoryRequirements& RenderGraph::getMemoryRequirements(const DescKey& key) {
+    auto found = requirements_.find(key);
+    if (found != requirements_.end()) {
+        return found->second;
+    }
+    // Requirements depend on the image parameters only, a probe image tells
+    // them before anything is allocated.
+    auto [format, width, height, usage] = key;
+    VkImageCreateInfo image_info = getImageInfo(format, width, height, usage);
+    VkImage image;
+    VK_CHECK_RESULT(vkCreateImage(*device_, &image_info, nullptr, &image));
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(*device_, image, &requirements);
+    vkDestroyImage(*device_, image, nullptr);
+    return requirements_.emplace(key, requirements).first->second;
+}
+
+VkImage RenderGraph::getImage(RenderGraphImage image) const {
+    return images_[image].imported ? images_[image].image : current_->transients[image].image;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphImage image) const {
+    if (images_[image].imported) {
+        return images_[image].view;
+    }
+    if (!current_) {
+        throw std::runtime_error("Failed to get the view of a transient image before compiling!");
+    }
+    return current_->transients[image].view;
+}
+
+const RenderGraphStats& RenderGraph::getStats() const {
+    return current_ ? current_->stats : empty_stats_;
+}
+
+VkRenderPass RenderGraph::getRenderPass(const std::vector<VkAttachmentDescription>& attachments) {
+    std::string key;
+    for (const VkAttachmentDescription& attachment : attachments) {
+        appendKey(key, attachment.format);
+        appendKey(key, attachment.loadOp);
+        appendKey(key, attachment.storeOp);
+        appendKey(key, attachment.finalLayout);
+    }
+    auto found = render_passes_.find(key);
+    if (found != render_passes_.end()) {
+        return found->second;
+    }
+
+    std::vector<VkAttachmentReference> color_refs;
+    VkAttachmentReference depth_ref{};
+    bool has_depth = false;
+    for (uint32_t i = 0; i < attachments.size(); ++i) {
+        if (attachments[i].finalLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+            color_refs.push_back({i, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL});
+        } else {
+            depth_ref = {i, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+            has_depth = true;
+        }
+    }
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = color_refs.size();
+    subpass.pColorAttachments = color_refs.data();
+    subpass.pDepthStencilAttachment = has_depth ? &depth_ref : nullptr;
+
+    // No layout transitions or dependencies, the barriers recorded before
+    // the render pass cover them.
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = attachments.size();
+    render_pass_info.pAttachments = attachments.data();
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+
+    VkRenderPass render_pass;
+    if (vkCreateRenderPass(*device_, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+    render_passes_.emplace(key, render_pass);
+    return render_pass;
+}
+
+VkRenderPass RenderGraph::getCompatibleRenderPass(const std::vector<VkFormat>& color_formats, VkFormat depth_format) {
+    // Compatibility ignores load and store operations and layouts.
+    std::vector<VkAttachmentDescription> attachments;
+    auto add = [&](VkFormat format, VkImageLayout layout) {
+        VkAttachmentDescription attachment{};
+        attachment.format = format;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = layout;
+        attachment.finalLayout = layout;
+        attachments.push_back(attachment);
+    };
+    for (VkFormat format : color_formats) {
+        add(format, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    }
+    if (depth_format != VK_FORMAT_UNDEFINED) {
+        add(depth_format, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    }
+    return getRenderPass(attachments);
+}
+
+VkFramebuffer RenderGraph::getFramebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, VkExtent2D extent) {
+    std::vector<uint64_t> key{getHandleKey(render_pass), extent.width, extent.height};
+    for (VkImageView view : views) {
+        key.push_back(getHandleKey(view));
+    }
+    auto found = framebuffers_.find(key);
+    if (found != framebuffers_.end()) {
+        return found->second;
+    }
+
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = render_pass;
+    framebuffer_info.attachmentCount = views.size();
+    framebuffer_info.pAttachments = views.data();
+    framebuffer_info.width = extent.width;
+    framebuffer_info.height = extent.height;
+    framebuffer_info.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(*device_, &framebuffer_info, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create framebuffer!");
+    }
+    framebuffers_.emplace(key, framebuffer);
+    return framebuffer;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer command_buffer, const BarrierBatch& batch) const {
+    if (batch.images.empty()) {
+        return;
+    }
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (const ImageBarrier& image_barrier : batch.images) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = image_barrier.old_layout;
+        barrier.newLayout = image_barrier.new_layout;
+        barrier.srcAccessMask = image_barrier.src_access;
+        barrier.dstAccessMask = image_barrier.dst_access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = getImage(image_barrier.image);
+        barrier.subresourceRange.aspectMask = getBarrierAspect(images_[image_barrier.image].desc.format);
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.layerCount = 1;
+        barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(command_buffer, batch.src_stages, batch.dst_stages, 0, 0, nullptr, 0, nullptr,
+                         barriers.size(), barriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer command_buffer, GpuProfiler* profiler) {
+    if (!current_) {
+        throw std::runtime_error("Failed to execute a render graph that is not compiled!");
+    }
+    for (const CompiledPass& compiled_pass : current_->passes) {
+        const PassNode& pass = passes_[compiled_pass.pass];
+        std::optional<GpuProfileScope> scope;
+        if (profiler && (pass.flags & kRenderGraphNoProfileScope) == 0) {
+            scope.emplace(profiler, command_buffer, pass.name);
+        }
+        recordBarriers(command_buffer, compiled_pass.barriers);
+        if (pass.type != RenderGraphPassType::kGraphics) {
+            pass.record(command_buffer);
+            continue;
+        }
+
+        std::vector<VkImageView> views;
+        std::vector<VkClearValue> clear_values;
+        for (uint32_t use_index : compiled_pass.attachment_uses) {
+            const ImageUse& use = pass.uses[use_index];
+            views.push_back(getImageView(use.image));
+            clear_values.push_back(use.clear_value);
+        }
+
+        VkRenderPassBeginInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        render_pass_info.renderPass = compiled_pass.render_pass;
+        render_pass_info.framebuffer = getFramebuffer(compiled_pass.render_pass, views, compiled_pass.extent);
+        render_pass_info.renderArea.offset = {0, 0};
+        render_pass_info.renderArea.extent = compiled_pass.extent;
+        if (pass.render_area.width != 0 && pass.render_area.height != 0) {
+            render_pass_info.renderArea.extent.width = std::min(pass.render_area.width, compiled_pass.extent.width);
+            render_pass_info.renderArea.extent.height = std::min(pass.render_area.height, compiled_pass.extent.height);
+        }
+        render_pass_info.clearValueCount = clear_values.size();
+        render_pass_info.pClearValues = clear_values.data();
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        pass.record(command_buffer);
+        vkCmdEndRenderPass(command_buffer);
+    }
+    recordBarriers(command_buffer, current_->final_barriers);
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "main/gpu_profiler.h"
+#include "main/vulkan_device.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Indices into the images and passes of the graph being declared.
+using RenderGraphImage = uint32_t;
+using RenderGraphPass = uint32_t;
+
+enum class RenderGraphPassType {
+    // Recorded inside a render pass the graph begins on the pass's attachments.
+    kGraphics,
+    kCompute,
+    kTransfer
+};
+
+enum RenderGraphPassFlags : uint32_t {
+    // Kept even when nothing reads what it writes, for passes writing buffers
+    // the graph does not track.
+    kRenderGraphSideEffects = 1,
+    // The pass opens its own profiler scopes instead of being wrapped in one.
+    kRenderGraphNoProfileScope = 2,
+};
+
+// How a pass uses an image, which decides the layout the image has to be in
+// and the stages and accesses it is synchronized on.
+enum class ImageUsage {
+    kColorAttachment,
+    kDepthAttachment,
+    // Depth images are sampled in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL.
+    kComputeSampled,
+    kFragmentSampled,
+    kTransferSource,
+    kTransferDestination
+};
+
+struct RenderGraphImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    // Added to the usage the passes declare. Transient images are shared by
+    // compiled frames with the same description and usage.
+    VkImageUsageFlags extra_usage = 0;
+};
+
+struct RenderGraphStats {
+    uint32_t passes = 0;
+    uint32_t culled_passes = 0;
+    // Image barriers recorded per frame, layout transitions included.
+    uint32_t barriers = 0;
+    uint32_t transient_images = 0;
+    // Memory of the transient images, and what it would be without aliasing.
+    VkDeviceSize transient_bytes = 0;
+    VkDeviceSize unaliased_bytes = 0;
+};
+
+// A frame as a list of passes declaring the images they use. From the
+// declarations the graph derives the barriers and layout transitions between
+// the passes and the load and store operations of the attachments, drops the
+// passes whose results nothing uses, and places transient images whose
+// lifetimes do not overlap in the same memory. Passes run in declaration
+// order; barriers on buffers stay with the passes that use them.
+//
+// The frame is declared again every frame. Compiling caches the result by the
+// frame's structure, so a frame with the same passes and images only looks up
+// its barriers, render passes and framebuffers.
+class RenderGraph {
+public:
+    void init(VulkanDevice* device);
+    void destroy();
+
+    // Starts declaring a frame, dropping the previous declaration.
+    void reset();
+    // An image owned elsewhere, such as a swapchain image. Its contents are
+    // kept unless initial_layout is VK_IMAGE_LAYOUT_UNDEFINED; its first use
+    // waits for wait_stages, which a semaphore wait of the submit may cover.
+    // It is left in final_layout.
+    RenderGraphImage importImage(const char* name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc,
+                                 VkImageLayout initial_layout, VkPipelineStageFlags wait_stages, VkImageLayout final_layout);
+    // An image owned by the graph whose contents only live within a frame.
+    RenderGraphImage createImage(const char* name, const RenderGraphImageDesc& desc);
+    // name must be a string literal, it names the pass's profiler scope.
+    RenderGraphPass addPass(const char* name, RenderGraphPassType type, std::function<void(VkCommandBuffer)> record, uint32_t flags = 0);
+    void use(RenderGraphPass pass, RenderGraphImage image, ImageUsage usage);
+    // An attachment use cleared when the pass begins.
+    void clear(RenderGraphPass pass, RenderGraphImage image, VkClearValue value);
+    // Limits a graphics pass to the top-left extent of its attachments, for
+    // rendering at a lower resolution into images sized for the full one.
+    // Only the recorded render area changes, not the compiled frame.
+    void setRenderArea(RenderGraphPass pass, VkExtent2D extent);
+
+    // Compiles the declared frame, or finds it compiled. Transient images have
+    // their views afterwards.
+    void compile();
+    VkImageView getImageView(RenderGraphImage image) const;
+    // Records the compiled frame, every pass in a profiler scope of its name.
+    void execute(VkCommandBuffer command_buffer, GpuProfiler* profiler = nullptr);
+    // Of the last compile.
+    const RenderGraphStats& getStats() const;
+
+    // Compatible with the render passes of graphics passes with these
+    // attachment formats, for creating pipelines.
+    VkRenderPass getCompatibleRenderPass(const std::vector<VkFormat>& color_formats, VkFormat depth_format);
+    // Drops the compiled frames, framebuffers and transient images, to be
+    // called when imported images are replaced. They are destroyed once the
+    // frames in flight are done with them, see VulkanDevice::retire.
+    void invalidate();
+
+private:
+    struct ImageNode {
+        const char* name;
+        RenderGraphImageDesc desc;
+        bool imported = false;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags wait_stages = 0;
+        VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct ImageUse {
+        RenderGraphImage image;
+        ImageUsage usage;
+        bool cleared = false;
+        VkClearValue clear_value{};
+    };
+
+    struct PassNode {
+        const char* name;
+        RenderGraphPassType type;
+        uint32_t flags;
+        std::function<void(VkCommandBuffer)> record;
+        std::vector<ImageUse> uses;
+        // Empty covers the attachments.
+        VkExtent2D render_area{};
+    };
+
+    struct ImageBarrier {
+        RenderGraphImage image;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+        VkAccessFlags src_access;
+        VkAccessFlags dst_access;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        std::vector<ImageBarrier> images;
+    };
+
+    struct CompiledPass {
+        RenderGraphPass pass;
+        BarrierBatch barriers;
+        // Graphics passes only. Attachments are indices into the pass's uses.
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        std::vector<uint32_t> attachment_uses;
+        VkExtent2D extent{};
+    };
+
+    // Where a transient image lives in the pool.
+    struct TransientImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+    };
+
+    struct CompiledGraph {
+        std::vector<CompiledPass> passes;
+        BarrierBatch final_barriers;
+        // Indexed by RenderGraphImage, empty for imported images.
+        std::vector<TransientImage> transients;
+        RenderGraphStats stats;
+    };
+
+    // Transient images are placed at the start of a block; images sharing a
+    // block are never alive at the same time.
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memory_type = 0;
+    };
+
+    // Block, format, width, height and usage.
+    using PoolKey = std::tuple<uint32_t, VkFormat, uint32_t, uint32_t, VkImageUsageFlags>;
+    // Format, width, height and usage.
+    using DescKey = std::tuple<VkFormat, uint32_t, uint32_t, VkImageUsageFlags>;
+
+    std::string getStructureKey() const;
+    // Whether each pass contributes to an imported image or has side effects.
+    std::vector<bool> cullPasses() const;
+    bool hasContentsBefore(RenderGraphPass pass, RenderGraphImage image) const;
+    // Assigns the transient images used in [first_use, last_use] of the
+    // compiled passes to memory blocks and returns the block of every image.
+    std::vector<uint32_t> placeTransients(CompiledGraph& compiled, const std::vector<uint32_t>& first_use, const std::vector<uint32_t>& last_use);
+    DescKey getDescKey(RenderGraphImage image) const;
+    const VkMemoryRequirements& getMemoryRequirements(const DescKey& key);
+    VkImage getImage(RenderGraphImage image) const;
+    VkRenderPass getRenderPass(const std::vector<VkAttachmentDescription>& attachments);
+    VkFramebuffer getFramebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, VkExtent2D extent);
+    void recordBarriers(VkCommandBuffer command_buffer, const BarrierBatch& batch) const;
+
+    VulkanDevice* device_ = nullptr;
+
+    // The frame being declared.
+    std::vector<ImageNode> images_;
+    std::vector<PassNode> passes_;
+
+    std::unordered_map<std::string, std::unique_ptr<CompiledGraph>> compiled_;
+    CompiledGraph* current_ = nullptr;
+    RenderGraphStats empty_stats_;
+
+    std::vector<MemoryBlock> blocks_;
+    std::map<PoolKey, TransientImage> pool_;
+    std::map<DescKey, VkMemoryRequirements> requirements_;
+    // Render passes only depend on the attachment descriptions and live until destroy.
+    std::unordered_map<std::string, VkRenderPass> render_passes_;
+    std::map<std::vector<uint64_t>, VkFramebuffer> framebuffers_;
+};
@@ -0,0 +1,77 @@
+#include "main/render_queue.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+
+constexpr int kPassShift = 62;
+
+// Non-negative IEEE floats order like their bit patterns, so the top 24 bits
+// of the distance (the sign bit is always 0) make a monotonic depth key.
+uint64_t depthBits(float depth) {
+    if (!(depth > 0.0f)) {
+        return 0;
+    }
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 7;
+}
+
+}  // namespace
+
+uint64_t RenderQueue::makeOpaqueKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth) {
+    return (static_cast<uint64_t>(RenderPass::kOpaque) << kPassShift)
+        | (static_cast<uint64_t>(pipeline & 0x3f) << 56)
+        | (static_cast<uint64_t>(mesh & 0xffff) << 40)
+        | (static_cast<uint64_t>(material & 0xffff) << 24)
+        | depthBits(depth);
+}
+
+uint64_t RenderQueue::makeTransparentKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth) {
+    return (static_cast<uint64_t>(RenderPass::kTransparent) << kPassShift)
+        | ((~depthBits(depth) & 0xffffff) << 38)
+        | (static_cast<uint64_t>(pipeline & 0x3f) << 32)
+        | (static_cast<uint64_t>(mesh & 0xffff) << 16)
+        | static_cast<uint64_t>(material & 0xffff);
+}
+
+RenderPass RenderQueue::getPass(uint64_t key) {
+    return static_cast<RenderPass>(key >> kPassShift);
+}
+
+void RenderQueue::clear() {
+    items_.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t object_index) {
+    items_.push_back({key, object_index});
+}
+
+void RenderQueue::sort() {
+    scratch_.resize(items_.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        std::array<size_t, 256> offsets{};
+        for (const RenderItem& item : items_) {
+            ++offsets[(item.key >> shift) & 0xff];
+        }
+        if (items_.empty() || offsets[(items_[0].key >> shift) & 0xff] == items_.size()) {
+            continue;
+        }
+
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (const RenderItem& item : items_) {
+            scratch_[offsets[(item.key >> shift) & 0xff]++] = item;
+        }
+        items_.swap(scratch_);
+    }
+}
+
+const std::vector<RenderItem>& RenderQueue::getItems() const {
+    return items_;
+}
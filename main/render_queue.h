@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class RenderPass : uint32_t {
+    kOpaque = 0,
+    kTransparent = 1
+};
+
+struct RenderItem {
+    uint64_t key;
+    uint32_t object_index;
+};
+
+// Draws of one frame ordered by a 64-bit sort key, most significant bits first:
+//   opaque:      pass:2 | pipeline:6 | mesh:16 | material:16 | depth:24
+//   transparent: pass:2 | inverted depth:24 | pipeline:6 | mesh:16 | material:16
+// Opaque draws are grouped by state and go front to back within a group;
+// transparent draws go strictly back to front.
+class RenderQueue {
+public:
+    static uint64_t makeOpaqueKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth);
+    static uint64_t makeTransparentKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth);
+    static RenderPass getPass(uint64_t key);
+
+    void clear();
+    void push(uint64_t key, uint32_t object_index);
+    // LSD radix sort on 8-bit digits; digits shared by every key are skipped.
+    void sort();
+    const std::vector<RenderItem>& getItems() const;
+
+private:
+    std::vector<RenderItem> items_;
+    std::vector<RenderItem> scratch_;
+};
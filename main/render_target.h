@@ -0,0 +1,24 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Color images the frame is rendered into: a window's swapchain
+// (VulkanSwapchain) or offscreen images (OffscreenTarget). The depth buffer is
+// a transient image of the render graph, see RenderGraph.
+class RenderTarget {
+public:
+    virtual ~RenderTarget() = default;
+
+    virtual VkFormat getImageFormat() = 0;
+    virtual VkExtent2D getExtent() = 0;
+    virtual uint32_t getImageCount() = 0;
+    virtual VkImage getImage(size_t index) = 0;
+    virtual VkImageView getImageView(size_t index) = 0;
+    // Layout a frame leaves the color image in.
+    virtual VkImageLayout getFinalLayout() = 0;
+    // Whether the color images can be copied from, see FrameCapture.
+    virtual bool isCopySource() = 0;
+};
@@ -1,53 +1,1298 @@
 #include "main/scene.h"
 
-void Scene::createObject(VulkanDevice* device, const std::string& model_path, const std::string& texture_path, glm::vec3 pos, uint32_t frames) {
-    std::unique_ptr<SceneObject> object = std::make_unique<SceneObject>(device);
-    object->loadModel(model_path);
-    object->loadTexture(texture_path);
-    object->createUniformBuffers(frames);
-    object->setPos(pos);
-    scene_objects_.push_back(object.get());
-    objects_container_.insert(std::move(object));
+#include "main/cpu_profiler.h"
+#include "main/upload_batch.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t kNoGpuObject = ~0u;
+// Smallest range of objects handed to a job by the per-object frame passes.
+constexpr uint32_t kObjectsPerJob = 256;
+
+}  // namespace
+
+void Scene::init(VulkanDevice* device, size_t thread_count) {
+    device_ = device;
+    jobs_ = std::make_unique<JobSystem>(thread_count);
+}
+
+JobSystem& Scene::getJobSystem() {
+    return *jobs_;
+}
+
+void Scene::setProfiler(GpuProfiler* profiler) {
+    profiler_ = profiler;
+}
+
+uint32_t Scene::loadModel(const std::string& model_path) {
+    auto it = model_ids_.find(model_path);
+    if (it != model_ids_.end()) {
+        return it->second;
+    }
+
+    uint32_t mesh_id = static_cast<uint32_t>(models_.size());
+    models_.push_back(Model::loadFromFile(model_path, device_));
+    model_ids_[model_path] = mesh_id;
+    // The geometry pool takes the new mesh on the next GPU upload.
+    ++scene_version_;
+    return mesh_id;
+}
+
+int32_t Scene::loadTexture(const std::string& texture_path) {
+    if (texture_path.empty()) {
+        return -1;
+    }
+
+    auto it = texture_ids_.find(texture_path);
+    if (it != texture_ids_.end()) {
+        return it->second;
+    }
+
+    if (textures_.size() >= kMaxTextures) {
+        throw std::runtime_error("Too many textures in the scene!");
+    }
+
+    int32_t texture_id = static_cast<int32_t>(textures_.size());
+    textures_.push_back(Texture::createFromFile(texture_path, device_));
+    texture_ids_[texture_path] = texture_id;
+    return texture_id;
+}
+
+ObjectHandle Scene::createObject(const std::string& model_path, const std::string& texture_path, glm::vec3 pos) {
+    int32_t texture_id = loadTexture(texture_path);
+    ObjectHandle handle = addObject(loadModel(model_path), pos);
+    objects_.setTexture(objects_.getIndex(handle), texture_id);
+    return handle;
+}
+
+ObjectHandle Scene::createObject(const std::string& model_path, MaterialType material, glm::vec3 pos) {
+    ObjectHandle handle = addObject(loadModel(model_path), pos);
+    objects_.setMaterial(objects_.getIndex(handle), material);
+    return handle;
+}
+
+// The transform node of an object is its handle's slot, reused along with it.
+// The object is appended to the per-object structures that are current.
+ObjectHandle Scene::addObject(uint32_t mesh_id, const glm::vec3& pos) {
+    Model* model = models_[mesh_id].get();
+    ObjectHandle handle = objects_.add(model, mesh_id, model->getBoundingSphere(), model->getBoundingBox());
+    uint32_t index = objects_.getIndex(handle);
+    objects_.setTransform(index, glm::translate(glm::mat4(1.0f), pos));
+    if (handle.slot == transforms_.size()) {
+        transforms_.create(pos);
+    } else {
+        transforms_.reset(handle.slot, pos);
+    }
+
+    if (culler_version_ == scene_version_) {
+        culler_.resize(objects_.size());
+        culler_.setBounds(index, objects_.getWorldBoundingSphere(index), objects_.getWorldBoundingBox(index));
+    }
+    if (bvh_version_ == scene_version_) {
+        bvh_.add(objects_.getWorldBoundingBox(index));
+    }
+    // New objects are opaque.
+    if (gpu_objects_version_ == scene_version_) {
+        gpu_object_slots_.push_back(gpu_object_count_);
+        gpu_object_indices_.push_back(index);
+        ++gpu_object_count_;
+        queueGpuUpload(index);
+    }
+    invalidateStaticShadows(objects_.getWorldBoundingSphere(index));
+    return handle;
+}
+
+// The last object takes the removed one's index, the per-object structures
+// that are current do the same. On the GPU, the last GpuObject also takes the
+// removed one's place, so the records of both moves are rewritten.
+void Scene::removeObject(ObjectHandle handle) {
+    uint32_t index = objects_.getIndex(handle);
+    if (!objects_.isDynamic(index)) {
+        invalidateStaticShadows(objects_.getWorldBoundingSphere(index));
+    }
+    objects_.remove(handle);
+    transforms_.reset(handle.slot, glm::vec3(0.0f));
+
+    if (culler_version_ == scene_version_) {
+        culler_.remove(index);
+    }
+    if (bvh_version_ == scene_version_) {
+        bvh_.remove(index);
+    }
+    if (gpu_objects_version_ != scene_version_) {
+        return;
+    }
+    uint32_t gpu_slot = gpu_object_slots_[index];
+    if (gpu_slot != kNoGpuObject) {
+        gpu_object_indices_[gpu_slot] = gpu_object_indices_.back();
+        gpu_object_slots_[gpu_object_indices_[gpu_slot]] = gpu_slot;
+        gpu_object_indices_.pop_back();
+        --gpu_object_count_;
+    }
+    uint32_t last = static_cast<uint32_t>(objects_.size());
+    if (index != last) {
+        gpu_object_slots_[index] = gpu_object_slots_[last];
+        if (gpu_object_slots_[index] != kNoGpuObject) {
+            gpu_object_indices_[gpu_object_slots_[index]] = index;
+        }
+        queueGpuUpload(index);
+    }
+    gpu_object_slots_.pop_back();
+    if (gpu_slot < gpu_object_count_) {
+        queueGpuUpload(gpu_object_indices_[gpu_slot]);
+    }
 }
 
-void Scene::createObject(VulkanDevice* device, const std::string& model_path, MaterialType material, glm::vec3 pos, uint32_t frames) {
-    std::unique_ptr<SceneObject> object = std::make_unique<SceneObject>(device);
-    object->loadModel(model_path);
-    object->setMaterial(material);
-    object->createUniformBuffers(frames);
-    object->setPos(pos);
-    scene_objects_.push_back(object.get());
-    objects_container_.insert(std::move(object));
+AssetLoadStats Scene::loadAssets(const std::vector<std::string>& model_paths, const std::vector<std::string>& texture_paths) {
+    PROFILE_SCOPE("Scene::loadAssets");
+    std::vector<std::string> new_models;
+    for (const std::string& path : model_paths) {
+        if (model_ids_.count(path) == 0 && std::find(new_models.begin(), new_models.end(), path) == new_models.end()) {
+            new_models.push_back(path);
+        }
+    }
+    std::vector<std::string> new_textures;
+    for (const std::string& path : texture_paths) {
+        if (!path.empty() && texture_ids_.count(path) == 0 && std::find(new_textures.begin(), new_textures.end(), path) == new_textures.end()) {
+            new_textures.push_back(path);
+        }
+    }
+    if (textures_.size() + new_textures.size() > kMaxTextures) {
+        throw std::runtime_error("Too many textures in the scene!");
+    }
+
+    AssetLoadStats stats;
+    stats.meshes = static_cast<uint32_t>(new_models.size());
+    stats.textures = static_cast<uint32_t>(new_textures.size());
+    if (new_models.empty() && new_textures.empty()) {
+        return stats;
+    }
+
+    // Jobs must not throw, the first error is rethrown once all of them are done.
+    auto decode_start = std::chrono::steady_clock::now();
+    std::vector<MeshData> meshes(new_models.size());
+    std::vector<TextureData> images(new_textures.size());
+    std::vector<std::exception_ptr> errors(new_models.size() + new_textures.size());
+    jobs_->parallelFor(static_cast<uint32_t>(errors.size()), [&](uint32_t task) {
+        try {
+            if (task < new_models.size()) {
+                meshes[task] = Model::loadMeshData(new_models[task]);
+            } else {
+                images[task - new_models.size()] = Texture::loadPixels(new_textures[task - new_models.size()]);
+            }
+        } catch (...) {
+            errors[task] = std::current_exception();
+        }
+    });
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    auto upload_start = std::chrono::steady_clock::now();
+
+    // Registered once the upload is done, a failure leaves nothing half loaded.
+    UploadBatch batch(device_);
+    std::vector<std::unique_ptr<Model>> models;
+    for (const MeshData& mesh : meshes) {
+        models.push_back(Model::create(mesh, device_, batch));
+    }
+    std::vector<std::unique_ptr<Texture>> textures;
+    for (const TextureData& image : images) {
+        textures.push_back(Texture::create(image, device_, batch));
+    }
+    stats.uploaded_bytes = batch.getUploadedBytes();
+    batch.submit();
+    for (size_t i = 0; i < models.size(); ++i) {
+        model_ids_[new_models[i]] = static_cast<uint32_t>(models_.size());
+        models_.push_back(std::move(models[i]));
+    }
+    if (!models.empty()) {
+        ++scene_version_;
+    }
+    for (size_t i = 0; i < textures.size(); ++i) {
+        texture_ids_[new_textures[i]] = static_cast<int32_t>(textures_.size());
+        textures_.push_back(std::move(textures[i]));
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    stats.decode_ms = std::chrono::duration<float, std::milli>(upload_start - decode_start).count();
+    stats.upload_ms = std::chrono::duration<float, std::milli>(end - upload_start).count();
+    return stats;
 }
 
+BoundingBox Scene::getBounds() const {
+    if (objects_.empty()) {
+        return {};
+    }
+    BoundingBox bounds = emptyBox();
+    for (const BoundingBox& box : objects_.getWorldBoundingBoxes()) {
+        bounds.expand(box);
+    }
+    return bounds;
+}
 
 void Scene::clear() {
-    scene_objects_.clear();
-    objects_container_.clear();
+    destroyFrameResources();
+    light_clustering_.destroy();
+    lights_.clear();
+    shadow_map_.destroy();
+    shadows_enabled_ = false;
+    shadows_active_ = false;
+    depth_pyramid_.destroy();
+    gpu_culling_.destroy();
+    geometry_pool_.destroy();
+    gpu_culling_ready_ = false;
+    occlusion_culling_ready_ = false;
+    objects_.clear();
+    transforms_.clear();
+    gpu_moved_objects_.clear();
+    gpu_object_slots_.clear();
+    gpu_object_indices_.clear();
+    gpu_object_count_ = 0;
+    batches_.clear();
+    visible_objects_.clear();
+    culler_.resize(0);
+    bvh_.build({});
+    textures_.clear();
+    texture_ids_.clear();
+    models_.clear();
+    model_ids_.clear();
+    ++scene_version_;
+}
+
+void Scene::initLighting(const std::vector<char>& shader_code) {
+    light_clustering_.init(device_, shader_code);
+}
+
+void Scene::initShadows(const std::vector<char>& shader_code) {
+    shadow_map_.init(device_, shader_code);
+    shadows_enabled_ = true;
 }
 
 void Scene::createDescriptorSets(VkDescriptorSetLayout descriptor_set_layout) {
-    for (auto& obj : scene_objects_) {
-        obj->createDescriptorSets(descriptor_set_layout);
+    descriptor_set_layout_ = descriptor_set_layout;
+    createFrameResources(std::max<size_t>(objects_.size(), 1));
+}
+
+void Scene::initGpuCulling(const std::vector<char>& shader_code) {
+    gpu_culling_.init(device_, shader_code);
+    gpu_culling_ready_ = true;
+    gpu_driven_ = true;
+    if (instance_capacity_ > 0) {
+        gpu_culling_.resize(instance_capacity_);
     }
+    gpu_uploaded_version_.assign(device_->getFramesInFlight(), ~0ull);
+}
+
+void Scene::initOcclusionCulling(const std::vector<char>& pyramid_shader_code) {
+    depth_pyramid_.init(device_, pyramid_shader_code);
+    occlusion_culling_ready_ = true;
+    occlusion_culling_ = true;
+}
+
+// The pyramid follows the depth buffer, so this runs again whenever the swapchain is recreated.
+void Scene::setDepthBuffer(VkImageView depth_view, VkExtent2D extent) {
+    if (!occlusion_culling_ready_) {
+        return;
+    }
+    depth_pyramid_.resize(depth_view, extent);
+    depth_pyramid_.setRenderedExtent(render_extent_);
+    gpu_culling_.setDepthPyramid(depth_pyramid_.getView(), depth_pyramid_.getSampler(), depth_pyramid_.getExtent(), depth_pyramid_.getLevelCount());
+}
+
+void Scene::createFrameResources(size_t instance_capacity) {
+    uint32_t frame_count = device_->getFramesInFlight();
+    instance_capacity_ = instance_capacity;
+    frame_uniform_buffers_.resize(frame_count);
+    instance_buffers_.resize(frame_count);
+
+    for (uint32_t i = 0; i < frame_count; ++i) {
+        Buffer& uniform_buffer = frame_uniform_buffers_[i];
+        uniform_buffer.size = sizeof(FrameUniforms);
+        uniform_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        uniform_buffer.usage_flags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        uniform_buffer.device = *device_;
+        device_->createBuffer(uniform_buffer);
+        uniform_buffer.map();
+
+        Buffer& instance_buffer = instance_buffers_[i];
+        instance_buffer.size = sizeof(InstanceData) * instance_capacity_;
+        instance_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        instance_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        instance_buffer.device = *device_;
+        device_->createBuffer(instance_buffer);
+        instance_buffer.map();
+    }
+
+    std::vector<VkDescriptorPoolSize> pool_sizes{};
+    // Frame and cluster uniforms.
+    VkDescriptorPoolSize uniform_buffer_descriptor;
+    uniform_buffer_descriptor.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniform_buffer_descriptor.descriptorCount = 2 * frame_count;
+    pool_sizes.push_back(uniform_buffer_descriptor);
+
+    VkDescriptorPoolSize texture_sampler;
+    texture_sampler.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    // Textures and the shadow map.
+    texture_sampler.descriptorCount = (kMaxTextures + 1) * frame_count;
+    pool_sizes.push_back(texture_sampler);
+
+    // Instances, lights and clusters.
+    VkDescriptorPoolSize instance_buffer_descriptor;
+    instance_buffer_descriptor.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    instance_buffer_descriptor.descriptorCount = 3 * frame_count;
+    pool_sizes.push_back(instance_buffer_descriptor);
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = pool_sizes.size();
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = frame_count;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = frame_count;
+    alloc_info.pSetLayouts = layouts.data();
+
+    descriptor_sets_.resize(frame_count);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, descriptor_sets_.data()));
+
+    writeDescriptorSets();
+
+    if (gpu_culling_ready_) {
+        gpu_culling_.resize(instance_capacity_);
+        gpu_uploaded_version_.assign(frame_count, ~0ull);
+    }
+}
+
+void Scene::destroyFrameResources() {
+    for (Buffer& buffer : frame_uniform_buffers_) {
+        buffer.unmap();
+        buffer.destroy();
+    }
+    for (Buffer& buffer : instance_buffers_) {
+        buffer.unmap();
+        buffer.destroy();
+    }
+    frame_uniform_buffers_.clear();
+    instance_buffers_.clear();
+    descriptor_sets_.clear();
+
+    if (descriptor_pool_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+        descriptor_pool_ = VK_NULL_HANDLE;
+    }
+    instance_capacity_ = 0;
+}
+
+// Frames in flight may still read the old buffers through the old sets, they
+// are destroyed once those frames have completed.
+void Scene::retireFrameResources() {
+    VkDevice device = *device_;
+    device_->retire([device, uniform_buffers = std::move(frame_uniform_buffers_), instance_buffers = std::move(instance_buffers_),
+                     descriptor_pool = descriptor_pool_] {
+        for (const std::vector<Buffer>* buffers : {&uniform_buffers, &instance_buffers}) {
+            for (Buffer buffer : *buffers) {
+                buffer.unmap();
+                buffer.destroy();
+            }
+        }
+        vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    });
+    frame_uniform_buffers_.clear();
+    instance_buffers_.clear();
+    descriptor_sets_.clear();
+    descriptor_pool_ = VK_NULL_HANDLE;
+    instance_capacity_ = 0;
+}
+
+void Scene::writeDescriptorSets() {
+    std::vector<VkDescriptorImageInfo> image_infos;
+    for (const auto& texture : textures_) {
+        image_infos.push_back(*texture->getDescriptor());
+    }
+
+    for (uint32_t i = 0; i < device_->getFramesInFlight(); ++i) {
+        VkDescriptorBufferInfo uniform_buffer_info{};
+        uniform_buffer_info.buffer = frame_uniform_buffers_[i].buffer;
+        uniform_buffer_info.offset = 0;
+        uniform_buffer_info.range = sizeof(FrameUniforms);
+
+        VkDescriptorBufferInfo instance_buffer_info{};
+        instance_buffer_info.buffer = instance_buffers_[i].buffer;
+        instance_buffer_info.offset = 0;
+        instance_buffer_info.range = VK_WHOLE_SIZE;
+
+        std::vector<VkWriteDescriptorSet> descriptor_writes{};
+        {
+            // Frame uniforms
+            VkWriteDescriptorSet descriptor_write{};
+            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write.dstSet = descriptor_sets_[i];
+            descriptor_write.dstBinding = 0;
+            descriptor_write.dstArrayElement = 0;
+            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptor_write.descriptorCount = 1;
+            descriptor_write.pBufferInfo = &uniform_buffer_info;
+            descriptor_writes.push_back(descriptor_write);
+        }
+        if (!image_infos.empty()) {
+            // Texture array, indexed by InstanceData::texture_index
+            VkWriteDescriptorSet descriptor_write{};
+            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write.dstSet = descriptor_sets_[i];
+            descriptor_write.dstBinding = 1;
+            descriptor_write.dstArrayElement = 0;
+            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptor_write.descriptorCount = static_cast<uint32_t>(image_infos.size());
+            descriptor_write.pImageInfo = image_infos.data();
+            descriptor_writes.push_back(descriptor_write);
+        }
+        {
+            // Instance buffer
+            VkWriteDescriptorSet descriptor_write{};
+            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write.dstSet = descriptor_sets_[i];
+            descriptor_write.dstBinding = 2;
+            descriptor_write.dstArrayElement = 0;
+            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptor_write.descriptorCount = 1;
+            descriptor_write.pBufferInfo = &instance_buffer_info;
+            descriptor_writes.push_back(descriptor_write);
+        }
+
+        // Light list, cluster light lists and cluster uniforms.
+        std::array<VkDescriptorBufferInfo, 3> lighting_buffer_infos{};
+        if (light_clustering_.isReady()) {
+            lighting_buffer_infos[0].buffer = light_clustering_.getLightBuffer(i).buffer;
+            lighting_buffer_infos[1].buffer = light_clustering_.getClusterBuffer(i).buffer;
+            lighting_buffer_infos[2].buffer = light_clustering_.getUniformBuffer(i).buffer;
+            for (uint32_t j = 0; j < lighting_buffer_infos.size(); ++j) {
+                lighting_buffer_infos[j].offset = 0;
+                lighting_buffer_infos[j].range = VK_WHOLE_SIZE;
+
+                VkWriteDescriptorSet descriptor_write{};
+                descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptor_write.dstSet = descriptor_sets_[i];
+                descriptor_write.dstBinding = 3 + j;
+                descriptor_write.dstArrayElement = 0;
+                descriptor_write.descriptorType = j == 2 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptor_write.descriptorCount = 1;
+                descriptor_write.pBufferInfo = &lighting_buffer_infos[j];
+                descriptor_writes.push_back(descriptor_write);
+            }
+        }
+
+        VkDescriptorImageInfo shadow_map_info{};
+        if (shadow_map_.isReady()) {
+            // Shadow cube map
+            shadow_map_info = shadow_map_.getDescriptor();
+            VkWriteDescriptorSet descriptor_write{};
+            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write.dstSet = descriptor_sets_[i];
+            descriptor_write.dstBinding = 6;
+            descriptor_write.dstArrayElement = 0;
+            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptor_write.descriptorCount = 1;
+            descriptor_write.pImageInfo = &shadow_map_info;
+            descriptor_writes.push_back(descriptor_write);
+        }
+
+        vkUpdateDescriptorSets(*device_, descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
+    }
+}
+
+void Scene::setPipelines(const ScenePipelines& pipelines) {
+    pipelines_ = pipelines;
+}
+
+void Scene::bindFrameResources(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index) {
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_sets_[image_index], 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ScenePushConstant), &push_constants_);
 }
 
 void Scene::draw(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index) {
-    for (auto& object : scene_objects_) {
-        object->draw(command_buffer, pipeline_layout, image_index, camera_.getPosition());
+    bindFrameResources(command_buffer, pipeline_layout, image_index);
+
+    draw_call_count_ = 0;
+    if (isGpuDriven()) {
+        drawOpaqueIndirect(command_buffer, image_index, isOcclusionCulling() ? CullPhase::kEarly : CullPhase::kFrustum);
+        if (!isOcclusionCulling()) {
+            drawTransparentObjects(command_buffer);
+        }
+        return;
+    }
+
+    // Opaque batches come first, the pre-pass lays down their depth so the
+    // color pass shades each pixel once.
+    const Model* bound_model = nullptr;
+    if (isDepthPrepass()) {
+        GpuProfileScope scope(profiler_, command_buffer, "depth pre-pass");
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines_.depth_prepass);
+        for (const DrawBatch& batch : batches_) {
+            if (batch.pass != RenderPass::kOpaque) {
+                break;
+            }
+            if (batch.model != bound_model) {
+                batch.model->bindPositions(command_buffer);
+                bound_model = batch.model;
+            }
+            batch.model->draw(command_buffer, batch.instance_count, batch.first_instance);
+            ++draw_call_count_;
+        }
+        bound_model = nullptr;
+    }
+
+    // Batches come out of the render queue sorted by pass, then mesh, so state
+    // only changes at the boundaries.
+    std::optional<RenderPass> bound_pass;
+    for (const DrawBatch& batch : batches_) {
+        if (batch.pass != bound_pass) {
+            if (profiler_) {
+                if (bound_pass) {
+                    profiler_->endScope(command_buffer);
+                }
+                profiler_->beginScope(command_buffer, batch.pass == RenderPass::kOpaque ? "opaque" : "transparent");
+            }
+            VkPipeline pipeline = batch.pass == RenderPass::kOpaque ? getOpaquePipeline() : pipelines_.transparent;
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            bound_pass = batch.pass;
+        }
+        if (batch.model != bound_model) {
+            batch.model->bind(command_buffer);
+            bound_model = batch.model;
+        }
+        batch.model->draw(command_buffer, batch.instance_count, batch.first_instance);
+        ++draw_call_count_;
+    }
+    if (profiler_ && bound_pass) {
+        profiler_->endScope(command_buffer);
     }
 }
 
+void Scene::drawLate(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index) {
+    if (!isOcclusionCulling()) {
+        return;
+    }
+
+    bindFrameResources(command_buffer, pipeline_layout, image_index);
+    drawOpaqueIndirect(command_buffer, image_index, CullPhase::kLate);
+    drawTransparentObjects(command_buffer);
+}
+
+// The pre-pass replays the same indirect commands with the position stream.
+void Scene::drawOpaqueIndirect(VkCommandBuffer command_buffer, uint32_t image_index, CullPhase phase) {
+    if (gpu_object_count_ == 0) {
+        return;
+    }
+
+    if (isDepthPrepass()) {
+        GpuProfileScope scope(profiler_, command_buffer, "depth pre-pass");
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines_.depth_prepass);
+        geometry_pool_.bindPositions(command_buffer);
+        gpu_culling_.draw(command_buffer, image_index, phase);
+        ++draw_call_count_;
+    }
+    GpuProfileScope scope(profiler_, command_buffer, "opaque");
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getOpaquePipeline());
+    geometry_pool_.bind(command_buffer);
+    gpu_culling_.draw(command_buffer, image_index, phase);
+    ++draw_call_count_;
+}
+
+VkPipeline Scene::getOpaquePipeline() const {
+    return isDepthPrepass() ? pipelines_.opaque_depth_equal : pipelines_.opaque;
+}
+
+void Scene::drawTransparentObjects(VkCommandBuffer command_buffer) {
+    if (transparent_objects_.empty()) {
+        return;
+    }
+
+    GpuProfileScope scope(profiler_, command_buffer, "transparent");
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines_.transparent);
+    const Model* bound_model = nullptr;
+    for (uint32_t index : transparent_objects_) {
+        Model* model = objects_.getModel(index);
+        if (model != bound_model) {
+            model->bind(command_buffer);
+            bound_model = model;
+        }
+        model->draw(command_buffer, 1, index);
+        ++draw_call_count_;
+    }
+}
+
+// Must run before the frame's command buffer is recorded: the instance buffer
+// is written in the order the draws are issued.
+// Objects are moved, then culled and batched on the jobs, while this thread
+// bins the lights and, once the objects have moved, gathers the shadow casters.
 void Scene::updateUniformBuffers(uint32_t image_index) {
-    for (auto& obj : scene_objects_) {
-        obj->updateUniformBuffer(image_index, camera_);
+    PROFILE_SCOPE("Scene::updateUniformBuffers");
+    push_constants_.camera_pos_ = camera_.getPosition();
+
+    if (objects_.size() > instance_capacity_) {
+        retireFrameResources();
+        createFrameResources(objects_.size() * 2);
+    }
+
+    FrameUniforms ubo{};
+    ubo.view = camera_.getViewMatrix();
+    ubo.proj = camera_.getPerspectiveMatrix();
+    std::memcpy(frame_uniform_buffers_[image_index].mapped, &ubo, sizeof(ubo));
+    frustum_ = Frustum::fromMatrix(ubo.proj * ubo.view);
+    bool gpu_driven = isGpuDriven();
+    // The CPU paths reorder the instance buffer, the GPU path needs it reuploaded.
+    if (!gpu_driven && gpu_culling_ready_) {
+        gpu_uploaded_version_[image_index] = ~0ull;
+    }
+
+    // The BVH is brought up to date with the transforms, culling and the
+    // shadows then only read it while they run side by side.
+    JobCounter transformed;
+    jobs_->run([this] {
+        updateTransforms();
+        if (culling_mode_ == CullingMode::kBvh || shadows_enabled_) {
+            updateBvh();
+        }
+    }, &transformed);
+    JobCounter batched;
+    if (!gpu_driven) {
+        glm::mat4 view_proj = ubo.proj * ubo.view;
+        jobs_->runAfter(transformed, [this, image_index, view_proj] {
+            cullObjects();
+            occluded_count_ = 0;
+            if (software_occlusion_enabled_) {
+                cullOccludedObjects(view_proj);
+            }
+            visible_count_ = static_cast<uint32_t>(visible_objects_.size());
+            buildBatches(static_cast<InstanceData*>(instance_buffers_[image_index].mapped));
+        }, &batched);
     }
+
+    if (light_clustering_.isReady()) {
+        light_clustering_.update(image_index, lights_, ubo.view, ubo.proj, render_extent_.width, render_extent_.height);
+    }
+    jobs_->wait(transformed);
+    updateShadows(image_index);
+
+    if (gpu_driven) {
+        if (gpu_objects_version_ != scene_version_) {
+            buildGpuObjects();
+        }
+        if (gpu_uploaded_version_[image_index] != scene_version_) {
+            uploadGpuObjects(image_index);
+        } else {
+            uploadMovedObjects(image_index);
+        }
+        gpu_culling_.update(image_index, frustum_, ubo.view, ubo.proj, gpu_object_count_);
+        sortTransparentObjects();
+        visible_count_ = gpu_culling_.getVisibleCount(image_index) + static_cast<uint32_t>(transparent_objects_.size());
+        occluded_count_ = gpu_culling_.getOccludedCount(image_index);
+        return;
+    }
+    jobs_->wait(batched);
+}
+
+void Scene::cullObjects() {
+    PROFILE_SCOPE("Scene::cullObjects");
+    if (culling_mode_ == CullingMode::kNone) {
+        visible_objects_.resize(objects_.size());
+        for (uint32_t i = 0; i < visible_objects_.size(); ++i) {
+            visible_objects_[i] = i;
+        }
+        return;
+    }
+
+    if (culling_mode_ == CullingMode::kBvh) {
+        updateBvh();
+        bvh_.queryFrustum(frustum_, visible_objects_);
+        return;
+    }
+
+    if (culler_version_ != scene_version_) {
+        culler_.resize(objects_.size());
+        for (uint32_t i = 0; i < objects_.size(); ++i) {
+            culler_.setBounds(i, objects_.getWorldBoundingSphere(i), objects_.getWorldBoundingBox(i));
+        }
+        culler_version_ = scene_version_;
+    }
+    culler_.cull(frustum_, visible_objects_, *jobs_);
+}
+
+// Rasterizes the visible occluders, then drops the visible objects hidden
+// behind them. Occluders themselves are always kept.
+void Scene::cullOccludedObjects(const glm::mat4& view_proj) {
+    PROFILE_SCOPE("Scene::cullOccludedObjects");
+    auto start = std::chrono::high_resolution_clock::now();
+
+    software_occlusion_.begin(view_proj);
+    for (uint32_t index : visible_objects_) {
+        if (objects_.isOccluder(index)) {
+            const Model* model = objects_.getModel(index);
+            software_occlusion_.addOccluder(model->getPositions(), model->getIndices(), objects_.getTransform(index));
+        }
+    }
+    software_occlusion_.rasterize(*jobs_);
+
+    occlusion_results_.resize(visible_objects_.size());
+    jobs_->parallelFor(static_cast<uint32_t>(visible_objects_.size()), kObjectsPerJob, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t index = visible_objects_[i];
+            occlusion_results_[i] = objects_.isOccluder(index) || software_occlusion_.isVisible(objects_.getWorldBoundingBox(index));
+        }
+    });
+
+    size_t visible = 0;
+    for (size_t i = 0; i < visible_objects_.size(); ++i) {
+        if (occlusion_results_[i]) {
+            visible_objects_[visible++] = visible_objects_[i];
+        }
+    }
+    occluded_count_ = static_cast<uint32_t>(visible_objects_.size() - visible);
+    visible_objects_.resize(visible);
+
+    software_occlusion_ms_ = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+float Scene::getViewDepth(uint32_t object_index) const {
+    return glm::distance(glm::vec3(objects_.getWorldBoundingSphere(object_index)), camera_.getPosition());
+}
+
+uint64_t Scene::makeSortKey(uint32_t object_index) const {
+    if (objects_.isTransparent(object_index)) {
+        return RenderQueue::makeTransparentKey(static_cast<uint32_t>(RenderPass::kTransparent), objects_.getMeshId(object_index),
+                                               objects_.getMaterialId(object_index), getViewDepth(object_index));
+    }
+    return RenderQueue::makeOpaqueKey(static_cast<uint32_t>(RenderPass::kOpaque), objects_.getMeshId(object_index),
+                                      objects_.getMaterialId(object_index), getViewDepth(object_index));
+}
+
+// Sorts the visible objects through the render queue and writes their instances
+// in draw order. With instancing, consecutive objects of one pass and mesh
+// become one instanced draw; without it every object is its own draw.
+void Scene::buildBatches(InstanceData* instances) {
+    PROFILE_SCOPE("Scene::buildBatches");
+    uint32_t visible_count = static_cast<uint32_t>(visible_objects_.size());
+    sort_keys_.resize(visible_count);
+    jobs_->parallelFor(visible_count, kObjectsPerJob, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            sort_keys_[i] = makeSortKey(visible_objects_[i]);
+        }
+    });
+    render_queue_.clear();
+    for (uint32_t i = 0; i < visible_count; ++i) {
+        render_queue_.push(sort_keys_[i], visible_objects_[i]);
+    }
+    render_queue_.sort();
+
+    const std::vector<RenderItem>& items = render_queue_.getItems();
+    jobs_->parallelFor(visible_count, kObjectsPerJob, [&items, instances, this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            instances[i] = objects_.getInstance(items[i].object_index);
+        }
+    });
+
+    batches_.clear();
+    for (uint32_t i = 0; i < items.size(); ++i) {
+        Model* model = objects_.getModel(items[i].object_index);
+        RenderPass pass = RenderQueue::getPass(items[i].key);
+        if (instancing_ && !batches_.empty() && batches_.back().pass == pass && batches_.back().model == model) {
+            ++batches_.back().instance_count;
+        } else {
+            batches_.push_back({pass, model, i, 1});
+        }
+    }
+}
+
+// Transparent objects bypass the GPU culling, their instances stay in object
+// order and only the draw order is sorted, back to front.
+void Scene::sortTransparentObjects() {
+    render_queue_.clear();
+    for (uint32_t i = 0; i < objects_.size(); ++i) {
+        if (!objects_.isTransparent(i)) {
+            continue;
+        }
+        const glm::vec4& sphere = objects_.getWorldBoundingSphere(i);
+        if (frustum_.intersectsSphere(glm::vec3(sphere), sphere.w)) {
+            render_queue_.push(makeSortKey(i), i);
+        }
+    }
+    render_queue_.sort();
+
+    transparent_objects_.clear();
+    for (const RenderItem& item : render_queue_.getItems()) {
+        transparent_objects_.push_back(item.object_index);
+    }
+}
+
+// Rebuilds the geometry pool for new meshes and the GpuObject order, which
+// every frame then uploads in full.
+void Scene::buildGpuObjects() {
+    PROFILE_SCOPE("Scene::buildGpuObjects");
+    if (geometry_pool_.getMeshCount() != models_.size()) {
+        vkDeviceWaitIdle(*device_);
+        std::vector<Model*> models;
+        for (const auto& model : models_) {
+            models.push_back(model.get());
+        }
+        geometry_pool_.build(device_, models);
+    }
+
+    gpu_object_slots_.resize(objects_.size());
+    gpu_object_indices_.clear();
+    for (uint32_t i = 0; i < objects_.size(); ++i) {
+        if (objects_.isTransparent(i)) {
+            gpu_object_slots_[i] = kNoGpuObject;
+            continue;
+        }
+        gpu_object_slots_[i] = static_cast<uint32_t>(gpu_object_indices_.size());
+        gpu_object_indices_.push_back(i);
+    }
+    gpu_object_count_ = static_cast<uint32_t>(gpu_object_indices_.size());
+    gpu_objects_version_ = scene_version_;
+    gpu_uploaded_version_.assign(gpu_uploaded_version_.size(), ~0ull);
+}
+
+void Scene::writeGpuObject(GpuObject& gpu_object, uint32_t object_index) const {
+    const MeshRange& range = geometry_pool_.getMeshRange(objects_.getMeshId(object_index));
+    gpu_object.sphere = objects_.getWorldBoundingSphere(object_index);
+    gpu_object.index_count = range.index_count;
+    gpu_object.first_index = range.first_index;
+    gpu_object.vertex_offset = range.vertex_offset;
+    gpu_object.instance_index = object_index;
+}
+
+// Frames still holding the current GpuObject order get the object's records
+// rewritten on their next upload. Past half the scene a full upload is as cheap.
+void Scene::queueGpuUpload(uint32_t object_index) {
+    gpu_moved_objects_.resize(gpu_uploaded_version_.size());
+    for (size_t frame = 0; frame < gpu_uploaded_version_.size(); ++frame) {
+        std::vector<uint32_t>& moved = gpu_moved_objects_[frame];
+        if (gpu_uploaded_version_[frame] != scene_version_) {
+            continue;
+        }
+        if (moved.size() + 1 > objects_.size() / 2) {
+            gpu_uploaded_version_[frame] = ~0ull;
+            moved.clear();
+        } else {
+            moved.push_back(object_index);
+        }
+    }
+}
+
+// Instances stay in object order: the cull shader draws each opaque object with
+// firstInstance = its object index.
+void Scene::uploadGpuObjects(uint32_t image_index) {
+    PROFILE_SCOPE("Scene::uploadGpuObjects");
+    InstanceData* instances = static_cast<InstanceData*>(instance_buffers_[image_index].mapped);
+    std::memcpy(instances, objects_.getInstances().data(), objects_.size() * sizeof(InstanceData));
+    GpuObject* objects = gpu_culling_.getObjects(image_index);
+    for (uint32_t i = 0; i < gpu_object_count_; ++i) {
+        writeGpuObject(objects[i], gpu_object_indices_[i]);
+    }
+    gpu_uploaded_version_[image_index] = scene_version_;
+    gpu_moved_objects_.resize(gpu_uploaded_version_.size());
+    gpu_moved_objects_[image_index].clear();
+}
+
+// Rewrites the instances and GpuObjects of the objects added, removed or moved
+// since the frame's buffers were last written, a static scene writes nothing.
+void Scene::uploadMovedObjects(uint32_t image_index) {
+    std::vector<uint32_t>& moved = gpu_moved_objects_[image_index];
+    if (moved.empty()) {
+        return;
+    }
+    PROFILE_SCOPE("Scene::uploadMovedObjects");
+    InstanceData* instances = static_cast<InstanceData*>(instance_buffers_[image_index].mapped);
+    GpuObject* objects = gpu_culling_.getObjects(image_index);
+    for (uint32_t index : moved) {
+        // Removed since, along with the last index.
+        if (index >= objects_.size()) {
+            continue;
+        }
+        instances[index] = objects_.getInstance(index);
+        if (gpu_object_slots_[index] != kNoGpuObject) {
+            writeGpuObject(objects[gpu_object_slots_[index]], index);
+        }
+    }
+    moved.clear();
+}
+
+// Only casters within reach of the light are in the static cache.
+void Scene::invalidateStaticShadows(const glm::vec4& sphere) {
+    if (lights_.empty()) {
+        return;
+    }
+    const glm::vec4& light = lights_[0].position;
+    if (glm::distance(glm::vec3(sphere), glm::vec3(light)) <= sphere.w + light.w) {
+        shadow_map_.invalidateStatic();
+    }
+}
+
+// Shadow casters are gathered from the BVH around the light, independently of
+// the camera: objects behind the camera still cast into the view.
+void Scene::updateShadows(uint32_t image_index) {
+    PROFILE_SCOPE("Scene::updateShadows");
+    shadows_active_ = shadows_enabled_ && !lights_.empty();
+    if (!shadows_active_) {
+        push_constants_.shadow_light.w = 0.0f;
+        return;
+    }
+
+    const PointLight& light = lights_[0];
+    glm::vec3 light_pos(light.position.x, light.position.y, light.position.z);
+    shadow_map_.setLight(light_pos, light.position.w);
+    if (shadow_version_ != scene_version_) {
+        shadow_map_.invalidateStatic();
+        shadow_version_ = scene_version_;
+    }
+
+    updateBvh();
+    shadow_candidates_.clear();
+    bvh_.querySphere(light_pos, light.position.w, shadow_candidates_);
+
+    bool collect_static = shadow_map_.isStaticDirty();
+    static_casters_.clear();
+    dynamic_casters_.clear();
+    for (uint32_t index : shadow_candidates_) {
+        bool dynamic = objects_.isDynamic(index);
+        if (objects_.isTransparent(index) || (!dynamic && !collect_static)) {
+            continue;
+        }
+        ShadowCaster caster{objects_.getModel(index), objects_.getTransform(index), objects_.getWorldBoundingSphere(index)};
+        (dynamic ? dynamic_casters_ : static_casters_).push_back(caster);
+    }
+    shadow_map_.update(image_index, static_casters_, dynamic_casters_);
+
+    glm::vec2 depth = shadow_map_.getDepthParameters();
+    push_constants_.shadow_light = light.position;
+    push_constants_.shadow_depth = glm::vec4(depth.x, depth.y, 0.0f, 0.0f);
+}
+
+void Scene::dispatchCulling(VkCommandBuffer command_buffer, uint32_t image_index) {
+    if (light_clustering_.isReady()) {
+        GpuProfileScope scope(profiler_, command_buffer, "light clustering");
+        light_clustering_.dispatch(command_buffer, image_index);
+    }
+    if (shadows_active_) {
+        GpuProfileScope scope(profiler_, command_buffer, "shadows");
+        shadow_map_.record(command_buffer, image_index);
+    }
+    if (isGpuDriven() && gpu_object_count_ > 0) {
+        GpuProfileScope scope(profiler_, command_buffer, "culling");
+        gpu_culling_.dispatch(command_buffer, image_index, isOcclusionCulling() ? CullPhase::kEarly : CullPhase::kFrustum);
+    }
+}
+
+void Scene::dispatchOcclusionCulling(VkCommandBuffer command_buffer, uint32_t image_index) {
+    if (isOcclusionCulling() && gpu_object_count_ > 0) {
+        {
+            GpuProfileScope scope(profiler_, command_buffer, "depth pyramid");
+            depth_pyramid_.build(command_buffer);
+        }
+        GpuProfileScope scope(profiler_, command_buffer, "late culling");
+        gpu_culling_.dispatch(command_buffer, image_index, CullPhase::kLate);
+    }
+}
+
+void Scene::setGpuDriven(bool enabled) {
+    gpu_driven_ = enabled;
+}
+
+bool Scene::isGpuDriven() const {
+    return gpu_driven_ && gpu_culling_ready_;
+}
+
+void Scene::setOcclusionCulling(bool enabled) {
+    occlusion_culling_ = enabled;
+}
+
+bool Scene::isOcclusionCulling() const {
+    return occlusion_culling_ && isGpuDriven() && depth_pyramid_.isReady();
+}
+
+void Scene::setDepthPrepass(bool enabled) {
+    depth_prepass_ = enabled;
+}
+
+bool Scene::isDepthPrepass() const {
+    return depth_prepass_ && pipelines_.depth_prepass != VK_NULL_HANDLE && pipelines_.opaque_depth_equal != VK_NULL_HANDLE;
+}
+
+void Scene::setSoftwareOcclusion(bool enabled) {
+    software_occlusion_enabled_ = enabled;
+}
+
+bool Scene::isSoftwareOcclusion() const {
+    return software_occlusion_enabled_;
+}
+
+float Scene::getSoftwareOcclusionMs() const {
+    return software_occlusion_ms_;
+}
+
+void Scene::dumpOcclusionBuffer(const std::string& path) const {
+    software_occlusion_.writeDebugImage(path);
+}
+
+uint32_t Scene::getOccludedCount() const {
+    return occluded_count_;
+}
+
+uint32_t Scene::getVisibleCount() const {
+    return visible_count_;
+}
+
+uint32_t Scene::getCulledCount() const {
+    return static_cast<uint32_t>(objects_.size()) - std::min<uint32_t>(visible_count_, objects_.size());
+}
+
+void Scene::setCullingMode(CullingMode mode) {
+    culling_mode_ = mode;
+}
+
+CullingMode Scene::getCullingMode() const {
+    return culling_mode_;
+}
+
+// Applies the transforms changed since the last call to their objects and
+// keeps the culling structures in sync without rebuilding them.
+void Scene::updateTransforms() {
+    const std::vector<uint32_t>& updated = transforms_.update(jobs_.get());
+    if (updated.empty()) {
+        return;
+    }
+    PROFILE_SCOPE("Scene::updateTransforms");
+    moved_objects_.clear();
+    for (uint32_t node : updated) {
+        // Nodes of removed objects are reset, which reports them too.
+        uint32_t index = objects_.getSlotIndex(node);
+        if (index != kNoObjectIndex) {
+            moved_objects_.push_back(index);
+        }
+    }
+
+    // Every object is written by one job, the BVH queues its changes and stays serial.
+    bool culler_current = culler_version_ == scene_version_;
+    jobs_->parallelFor(static_cast<uint32_t>(moved_objects_.size()), kObjectsPerJob, [this, culler_current](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t index = moved_objects_[i];
+            objects_.setTransform(index, transforms_.getWorldMatrix(objects_.getHandle(index).slot));
+            if (culler_current) {
+                culler_.setBounds(index, objects_.getWorldBoundingSphere(index), objects_.getWorldBoundingBox(index));
+            }
+        }
+    });
+    bool bvh_current = bvh_version_ == scene_version_;
+    bool static_moved = false;
+    for (uint32_t index : moved_objects_) {
+        if (bvh_current) {
+            bvh_.setBounds(index, objects_.getWorldBoundingBox(index));
+        }
+        static_moved = static_moved || !objects_.isDynamic(index);
+    }
+    if (static_moved) {
+        shadow_map_.invalidateStatic();
+    }
+
+    // Frames still holding the current scene get the moved records only. Past
+    // half the scene a full upload is as cheap.
+    gpu_moved_objects_.resize(gpu_uploaded_version_.size());
+    for (size_t frame = 0; frame < gpu_uploaded_version_.size(); ++frame) {
+        std::vector<uint32_t>& moved = gpu_moved_objects_[frame];
+        if (gpu_uploaded_version_[frame] != scene_version_) {
+            continue;
+        }
+        if (moved.size() + moved_objects_.size() > objects_.size() / 2) {
+            gpu_uploaded_version_[frame] = ~0ull;
+            moved.clear();
+        } else {
+            moved.insert(moved.end(), moved_objects_.begin(), moved_objects_.end());
+        }
+    }
+}
+
+void Scene::updateBvh() {
+    if (bvh_version_ != scene_version_) {
+        bvh_.build(objects_.getWorldBoundingBoxes());
+        bvh_version_ = scene_version_;
+    } else {
+        bvh_.update();
+    }
+}
+
+uint32_t Scene::addPointLight(const PointLight& light) {
+    if (lights_.size() >= kMaxPointLights) {
+        throw std::runtime_error("Too many point lights in the scene!");
+    }
+    lights_.push_back(light);
+    return static_cast<uint32_t>(lights_.size() - 1);
+}
+
+void Scene::setPointLight(uint32_t light_index, const PointLight& light) {
+    if (light_index >= lights_.size()) {
+        throw std::runtime_error("Invalid point light index!");
+    }
+    lights_[light_index] = light;
+}
+
+size_t Scene::getPointLightCount() const {
+    return lights_.size();
+}
+
+void Scene::setShadows(bool enabled) {
+    shadows_enabled_ = enabled && shadow_map_.isReady();
+}
+
+bool Scene::isShadows() const {
+    return shadows_enabled_;
+}
+
+uint32_t Scene::getShadowDrawCount() const {
+    return shadows_active_ ? shadow_map_.getDrawCallCount() : 0;
+}
+
+bool Scene::isShadowCacheRebuilt() const {
+    return shadows_active_ && shadow_map_.wasStaticRendered();
+}
+
+// Takes effect on the next updateTransforms, which refits the culling
+// structures around the moved objects.
+void Scene::setObjectPosition(ObjectHandle object, const glm::vec3& pos) {
+    objects_.getIndex(object);
+    transforms_.setTranslation(object.slot, pos);
+}
+
+void Scene::setObjectRotation(ObjectHandle object, const glm::quat& rotation) {
+    objects_.getIndex(object);
+    transforms_.setRotation(object.slot, rotation);
+}
+
+void Scene::setObjectScale(ObjectHandle object, const glm::vec3& scale) {
+    objects_.getIndex(object);
+    transforms_.setScale(object.slot, scale);
+}
+
+void Scene::setObjectParent(ObjectHandle object, ObjectHandle parent) {
+    objects_.getIndex(object);
+    if (parent == ObjectHandle{}) {
+        transforms_.setParent(object.slot, kNoParent);
+        return;
+    }
+    objects_.getIndex(parent);
+    transforms_.setParent(object.slot, parent.slot);
+}
+
+void Scene::setObjectOpacity(ObjectHandle object, float opacity) {
+    objects_.setOpacity(objects_.getIndex(object), opacity);
+    shadow_map_.invalidateStatic();
+    // Bounds are unchanged, but the object may move between the GPU-culled and
+    // the sorted transparent set, which reorders the GpuObjects.
+    gpu_objects_version_ = ~0ull;
+}
+
+void Scene::setObjectOccluder(ObjectHandle object, bool occluder) {
+    objects_.setOccluder(objects_.getIndex(object), occluder);
+}
+
+void Scene::setObjectDynamic(ObjectHandle object, bool dynamic) {
+    objects_.setDynamic(objects_.getIndex(object), dynamic);
+    shadow_map_.invalidateStatic();
+}
+
+std::vector<ObjectHandle> Scene::queryRadius(const glm::vec3& center, float radius) {
+    updateTransforms();
+    updateBvh();
+    std::vector<uint32_t> indices;
+    bvh_.querySphere(center, radius, indices);
+    return getHandles(indices);
+}
+
+std::vector<ObjectHandle> Scene::queryBox(const BoundingBox& box) {
+    updateTransforms();
+    updateBvh();
+    std::vector<uint32_t> indices;
+    bvh_.queryBox(box, indices);
+    return getHandles(indices);
+}
+
+std::vector<ObjectHandle> Scene::getHandles(const std::vector<uint32_t>& object_indices) const {
+    std::vector<ObjectHandle> handles;
+    handles.reserve(object_indices.size());
+    for (uint32_t index : object_indices) {
+        handles.push_back(objects_.getHandle(index));
+    }
+    return handles;
+}
+
+std::optional<PickResult> Scene::pick(float u, float v, bool precise) {
+    updateTransforms();
+    updateBvh();
+    Ray ray = camera_.getRay(u, v);
+
+    Bvh::ItemIntersector intersect_mesh;
+    if (precise) {
+        intersect_mesh = [this](uint32_t object_index, const Ray& ray, float max_distance) {
+            // The direction is not renormalized, so distances along both rays match.
+            glm::mat4 to_model = glm::inverse(objects_.getTransform(object_index));
+            Ray model_ray{glm::vec3(to_model * glm::vec4(ray.origin, 1.0f)), glm::vec3(to_model * glm::vec4(ray.direction, 0.0f))};
+            return objects_.getModel(object_index)->intersectRay(model_ray, max_distance);
+        };
+    }
+
+    std::optional<RayHit> hit = bvh_.raycast(ray, std::numeric_limits<float>::max(), intersect_mesh);
+    if (!hit) {
+        return std::nullopt;
+    }
+    return PickResult{objects_.getHandle(hit->item), hit->distance};
+}
+
+void Scene::setInstancing(bool enabled) {
+    instancing_ = enabled;
+}
+
+bool Scene::isInstancing() const {
+    return instancing_;
+}
+
+size_t Scene::getObjectCount() const {
+    return objects_.size();
+}
+
+uint32_t Scene::getDrawCallCount() const {
+    return draw_call_count_;
 }
 
 void Scene::setScreenSize(size_t width, size_t height) {
     width_ = width;
     height_ = height;
     camera_.setScreenSize(width, height);
+    render_extent_ = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    // A quarter of the screen resolution is enough for coarse visibility.
+    software_occlusion_.resize(static_cast<uint32_t>(width / 4), static_cast<uint32_t>(height / 4));
+}
+
+void Scene::setRenderExtent(VkExtent2D extent) {
+    render_extent_ = extent;
+    if (occlusion_culling_ready_) {
+        depth_pyramid_.setRenderedExtent(extent);
+    }
 }
 
 void Scene::moveCamera(float dx, float dy) {
@@ -56,4 +1301,8 @@ void Scene::moveCamera(float dx, float dy) {
 
 void Scene::rotateCamera(float dx, float dy) {
     camera_.rotateBy(dx, dy);
-}
\ No newline at end of file
+}
+
+void Scene::setCamera(const glm::vec3& position, const glm::vec3& target) {
+    camera_.lookAt(position, target);
+}
@@ -1,27 +1,331 @@
 #pragma once
 
+#include "main/bvh.h"
 #include "main/camera.h"
-#include "main/scene_object.h"
+#include "main/depth_pyramid.h"
+#include "main/frustum.h"
+#include "main/frustum_culler.h"
+#include "main/geometry_pool.h"
+#include "main/gpu_profiler.h"
+#include "main/gpu_culling.h"
+#include "main/job_system.h"
+#include "main/light_clustering.h"
+#include "main/object_store.h"
+#include "main/render_queue.h"
+#include "main/shadow_map.h"
+#include "main/software_occlusion.h"
+#include "main/texture.h"
+#include "main/transform_system.h"
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
 
-#include <unordered_set>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 proj;
+};
+
+// Point lights come from the clustered light list, see LightClustering.
+struct ScenePushConstant {
+    alignas(16) glm::vec3 light_ambient = glm::vec3(1.0f, 1.0f, 1.0f);
+    alignas(16) glm::vec3 camera_pos_;
+    // xyz - position of the shadow casting light, w - its radius, 0 without shadows.
+    alignas(16) glm::vec4 shadow_light = glm::vec4(0.0f);
+    // x - P22, y - P32 of the shadow cube face projection, see ShadowMap::getDepthParameters.
+    alignas(16) glm::vec4 shadow_depth = glm::vec4(0.0f);
+};
+
+// Pipelines for the passes of the render queue, created by the application.
+struct ScenePipelines {
+    VkPipeline opaque = VK_NULL_HANDLE;
+    // Blended, depth tested without depth writes.
+    VkPipeline transparent = VK_NULL_HANDLE;
+    // Depth pre-pass: depth.vert alone on the position stream, writing depth only.
+    VkPipeline depth_prepass = VK_NULL_HANDLE;
+    // Opaque shading after the pre-pass, EQUAL depth test without depth writes.
+    VkPipeline opaque_depth_equal = VK_NULL_HANDLE;
+};
+
+// A run of instances sharing one mesh and pass, drawn with a single instanced call.
+struct DrawBatch {
+    RenderPass pass;
+    Model* model;
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+enum class CullingMode {
+    kNone,
+    // SIMD test of every object, fastest when a large part of the scene is visible.
+    kLinear,
+    // Hierarchical test through the scene BVH, rejects off-screen regions wholesale.
+    kBvh
+};
+
+// What Scene::loadAssets loaded and where its time went.
+struct AssetLoadStats {
+    uint32_t meshes = 0;
+    uint32_t textures = 0;
+    // Parsing and decoding the files on the worker threads.
+    float decode_ms = 0.0f;
+    // Creating the GPU resources and the batched upload.
+    float upload_ms = 0.0f;
+    uint64_t uploaded_bytes = 0;
+};
+
+struct PickResult {
+    ObjectHandle object;
+    float distance;
+};
+
 class Scene {
 public:
-    void createObject(VulkanDevice* device, const std::string& model_path, const std::string& texture_path, glm::vec3 pos, uint32_t frames = kMaxFramesInFlight);
-    void createObject(VulkanDevice* device, const std::string& model_path, MaterialType material, glm::vec3 pos, uint32_t frames = kMaxFramesInFlight);
+    // thread_count as for JobSystem, 1 keeps all CPU work on the calling thread.
+    void init(VulkanDevice* device, size_t thread_count = 0);
+    // Runs the frame's transform updates, culling and draw list building, and
+    // the asset decoding. Its stats show how that work spreads over the threads.
+    JobSystem& getJobSystem();
+    // Wraps the recorded passes in profiler scopes, nullptr turns it off.
+    void setProfiler(GpuProfiler* profiler);
+    ObjectHandle createObject(const std::string& model_path, const std::string& texture_path, glm::vec3 pos);
+    ObjectHandle createObject(const std::string& model_path, MaterialType material, glm::vec3 pos);
+    // Children of the object stay in the scene, keeping their local transform
+    // as their world transform. Throws for stale handles, as do the other
+    // object functions.
+    void removeObject(ObjectHandle object);
+    // Loads the meshes and textures that are not loaded yet, which createObject
+    // then finds loaded: the files are parsed in parallel and uploaded in one
+    // batch instead of one after another.
+    AssetLoadStats loadAssets(const std::vector<std::string>& model_paths, const std::vector<std::string>& texture_paths);
+    // World bounds of all objects, an empty box without objects.
+    BoundingBox getBounds() const;
     void clear();
+    // Must be called before createDescriptorSets, shader_code is the SPIR-V of cluster.comp.
+    void initLighting(const std::vector<char>& shader_code);
+    // Must be called before createDescriptorSets, shader_code is the SPIR-V of shadow.vert.
+    void initShadows(const std::vector<char>& shader_code);
     void createDescriptorSets(VkDescriptorSetLayout descriptor_set_layout);
+    void setPipelines(const ScenePipelines& pipelines);
+    // Enables the GPU-driven path, shader_code is the SPIR-V of cull.comp.
+    void initGpuCulling(const std::vector<char>& shader_code);
+    // Adds two-phase occlusion culling to the GPU-driven path, shader_code is the
+    // SPIR-V of depth_pyramid.comp. Needs setDepthBuffer before it takes effect.
+    void initOcclusionCulling(const std::vector<char>& pyramid_shader_code);
+    void setDepthBuffer(VkImageView depth_view, VkExtent2D extent);
+    // Records work that has to happen before the render pass begins: light
+    // clustering, shadow maps and, on the GPU-driven path, culling.
+    void dispatchCulling(VkCommandBuffer command_buffer, uint32_t image_index);
     void draw(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index);
+    // With occlusion culling the frame is drawn in two render passes. The first
+    // one is draw(), which then skips transparent objects. Between the passes,
+    // dispatchOcclusionCulling builds the depth pyramid from the first pass's
+    // depth and culls against it; drawLate draws what it found plus the
+    // transparent objects. The calls do nothing when isOcclusionCulling() is false.
+    void dispatchOcclusionCulling(VkCommandBuffer command_buffer, uint32_t image_index);
+    void drawLate(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index);
     void updateUniformBuffers(uint32_t image_index);
     void setScreenSize(size_t width, size_t height);
+    // The top-left part of the screen sized targets drawn into when rendering
+    // below the screen resolution. Light clustering and the depth pyramid
+    // follow it, the camera keeps the screen's aspect. setScreenSize resets it.
+    void setRenderExtent(VkExtent2D extent);
     void moveCamera(float x_pos, float y_pos);
     void rotateCamera(float x_pos, float y_pos);
+    void setCamera(const glm::vec3& position, const glm::vec3& target);
+
+    void setInstancing(bool enabled);
+    bool isInstancing() const;
+    void setGpuDriven(bool enabled);
+    bool isGpuDriven() const;
+    void setOcclusionCulling(bool enabled);
+    bool isOcclusionCulling() const;
+    // Draws opaque objects to depth first, then shades only the visible
+    // fragments. Needs the depth_prepass and opaque_depth_equal pipelines.
+    void setDepthPrepass(bool enabled);
+    bool isDepthPrepass() const;
+    // Occlusion culling on the CPU paths against the objects flagged as occluders.
+    void setSoftwareOcclusion(bool enabled);
+    bool isSoftwareOcclusion() const;
+    // CPU time of the last frame's software occlusion pass.
+    float getSoftwareOcclusionMs() const;
+    // Writes the last frame's software occlusion buffer as a PGM image.
+    void dumpOcclusionBuffer(const std::string& path) const;
+    size_t getObjectCount() const;
+    // CPU frustum culling, the GPU-driven path always culls on the GPU.
+    void setCullingMode(CullingMode mode);
+    CullingMode getCullingMode() const;
+    // Objects that passed frustum culling in the last frame.
+    uint32_t getVisibleCount() const;
+    uint32_t getCulledCount() const;
+    // Objects inside the frustum rejected by the occlusion test, part of the culled count.
+    uint32_t getOccludedCount() const;
+
+    // Both return the index of the light, at most kMaxPointLights.
+    uint32_t addPointLight(const PointLight& light);
+    void setPointLight(uint32_t light_index, const PointLight& light);
+    size_t getPointLightCount() const;
+    // Omnidirectional shadows of the first point light. Needs initShadows.
+    void setShadows(bool enabled);
+    bool isShadows() const;
+    // Shadow map draws of the last frame, and whether it re-rendered the static casters.
+    uint32_t getShadowDrawCount() const;
+    bool isShadowCacheRebuilt() const;
+
+    // Transforms are relative to the parent object, if any, and take effect
+    // with the next frame or spatial query.
+    void setObjectPosition(ObjectHandle object, const glm::vec3& pos);
+    void setObjectRotation(ObjectHandle object, const glm::quat& rotation);
+    void setObjectScale(ObjectHandle object, const glm::vec3& scale);
+    // The object follows parent, a default constructed handle detaches it.
+    // Throws if it would become its own ancestor.
+    void setObjectParent(ObjectHandle object, ObjectHandle parent);
+    // Objects with opacity below 1 are blended in the transparent pass.
+    void setObjectOpacity(ObjectHandle object, float opacity);
+    // Large meshes hiding much of the scene, such as the ground, make good occluders.
+    void setObjectOccluder(ObjectHandle object, bool occluder);
+    // Objects moving every frame should be dynamic, moving a static one
+    // re-renders every static shadow caster.
+    void setObjectDynamic(ObjectHandle object, bool dynamic);
+    // Spatial queries.
+    std::vector<ObjectHandle> queryRadius(const glm::vec3& center, float radius);
+    std::vector<ObjectHandle> queryBox(const BoundingBox& box);
+    // Object under a screen point in [0, 1] from the top left corner. Precise
+    // picks test the mesh triangles, otherwise the object bounds are hit.
+    std::optional<PickResult> pick(float u, float v, bool precise = true);
+    uint32_t getDrawCallCount() const;
 
 private:
-    std::unordered_set<std::unique_ptr<SceneObject>> objects_container_;
-    std::vector<SceneObject*> scene_objects_;
+    uint32_t loadModel(const std::string& model_path);
+    ObjectHandle addObject(uint32_t mesh_id, const glm::vec3& pos);
+    std::vector<ObjectHandle> getHandles(const std::vector<uint32_t>& object_indices) const;
+    int32_t loadTexture(const std::string& texture_path);
+    void createFrameResources(size_t instance_capacity);
+    void destroyFrameResources();
+    void retireFrameResources();
+    void writeDescriptorSets();
+    void bindFrameResources(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, uint32_t image_index);
+    void drawTransparentObjects(VkCommandBuffer command_buffer);
+    void drawOpaqueIndirect(VkCommandBuffer command_buffer, uint32_t image_index, CullPhase phase);
+    VkPipeline getOpaquePipeline() const;
+    void cullObjects();
+    void cullOccludedObjects(const glm::mat4& view_proj);
+    void updateTransforms();
+    void updateBvh();
+    float getViewDepth(uint32_t object_index) const;
+    uint64_t makeSortKey(uint32_t object_index) const;
+    void buildBatches(InstanceData* instances);
+    void sortTransparentObjects();
+    void buildGpuObjects();
+    void writeGpuObject(GpuObject& gpu_object, uint32_t object_index) const;
+    void queueGpuUpload(uint32_t object_index);
+    void uploadGpuObjects(uint32_t image_index);
+    void uploadMovedObjects(uint32_t image_index);
+    void invalidateStaticShadows(const glm::vec4& sphere);
+    void updateShadows(uint32_t image_index);
+
+    VulkanDevice* device_ = nullptr;
+    GpuProfiler* profiler_ = nullptr;
+    std::unique_ptr<JobSystem> jobs_;
+
+    // Per-object state is indexed by the dense index of the store: culling
+    // results, the BVH items and the instance buffer slots.
+    ObjectStore objects_;
+    // One node per handle slot of the store.
+    TransformSystem transforms_;
+    // Objects moved by the last updateTransforms.
+    std::vector<uint32_t> moved_objects_;
+
+    // Meshes and textures are loaded once and shared by every object using them.
+    std::vector<std::unique_ptr<Model>> models_;
+    std::unordered_map<std::string, uint32_t> model_ids_;
+    std::vector<std::unique_ptr<Texture>> textures_;
+    std::unordered_map<std::string, int32_t> texture_ids_;
+
+    // Per frame in flight.
+    std::vector<Buffer> frame_uniform_buffers_;
+    std::vector<Buffer> instance_buffers_;
+    std::vector<VkDescriptorSet> descriptor_sets_;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    size_t instance_capacity_ = 0;
+
+    // CPU paths: objects surviving culling this frame, in draw order.
+    CullingMode culling_mode_ = CullingMode::kLinear;
+    FrustumCuller culler_;
+    uint64_t culler_version_ = ~0ull;
+    std::vector<uint32_t> visible_objects_;
+    // Sort keys of visible_objects_, computed on jobs before they are queued.
+    std::vector<uint64_t> sort_keys_;
+
+    // World bounds of every object, built lazily for culling and queries.
+    Bvh bvh_;
+    uint64_t bvh_version_ = ~0ull;
+
+    ScenePipelines pipelines_;
+    RenderQueue render_queue_;
+    bool instancing_ = true;
+    bool depth_prepass_ = false;
+    std::vector<DrawBatch> batches_;
+    uint32_t draw_call_count_ = 0;
+
+    // GPU-driven path. The GpuObject order is rebuilt when scene_version_
+    // changes and every frame then uploads in full; in between, added, removed
+    // and moved objects only rewrite their own records.
+    GeometryPool geometry_pool_;
+    GpuCulling gpu_culling_;
+    bool gpu_culling_ready_ = false;
+    bool gpu_driven_ = false;
+    Frustum frustum_;
+    // Changes with the loaded meshes, which the geometry pool holds.
+    uint64_t scene_version_ = 0;
+    uint64_t gpu_objects_version_ = ~0ull;
+    std::vector<uint64_t> gpu_uploaded_version_;
+    // Per frame in flight, objects moved since its buffers were written.
+    std::vector<std::vector<uint32_t>> gpu_moved_objects_;
+    // GpuObject index of every object, kNoGpuObject for transparent ones.
+    std::vector<uint32_t> gpu_object_slots_;
+    // Object index of every GpuObject, the inverse of gpu_object_slots_.
+    std::vector<uint32_t> gpu_object_indices_;
+    // Only opaque objects are culled on the GPU, transparent ones are sorted
+    // on the CPU every frame and drawn after the indirect draw.
+    uint32_t gpu_object_count_ = 0;
+    std::vector<uint32_t> transparent_objects_;
+    uint32_t visible_count_ = 0;
+
+    // Occlusion culling, on top of the GPU-driven path.
+    DepthPyramid depth_pyramid_;
+    bool occlusion_culling_ready_ = false;
+    bool occlusion_culling_ = false;
+    uint32_t occluded_count_ = 0;
+
+    // Software occlusion culling, on top of the CPU paths.
+    SoftwareOcclusion software_occlusion_;
+    bool software_occlusion_enabled_ = false;
+    std::vector<uint8_t> occlusion_results_;
+    float software_occlusion_ms_ = 0.0f;
+
+    // Uploaded every frame, lights are expected to move.
+    std::vector<PointLight> lights_;
+    LightClustering light_clustering_;
+
+    // Casts the shadows of lights_[0]. The static cache is invalidated when
+    // scene_version_ changes or a static object moves, is added or is removed.
+    ShadowMap shadow_map_;
+    bool shadows_enabled_ = false;
+    bool shadows_active_ = false;
+    uint64_t shadow_version_ = ~0ull;
+    std::vector<uint32_t> shadow_candidates_;
+    std::vector<ShadowCaster> static_casters_;
+    std::vector<ShadowCaster> dynamic_casters_;
+
+    ScenePushConstant push_constants_;
     Camera camera_;
     size_t width_;
     size_t height_;
-};
\ No newline at end of file
+    VkExtent2D render_extent_{};
+};
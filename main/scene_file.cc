@@ -0,0 +1,404 @@
+#include "main/scene_file.h"
+
+#include "main/cpu_profiler.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+constexpr char kBinaryMagic[8] = {'K', 'V', '3', 'D', 'S', 'C', 'N', '\0'};
+constexpr uint32_t kBinaryVersion = 1;
+
+struct BinaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t mesh_count;
+    uint32_t texture_count;
+    uint32_t object_count;
+    uint32_t light_count;
+};
+
+enum BinaryObjectFlags : uint32_t {
+    kOccluder = 1 << 0,
+    kDynamic = 1 << 1,
+};
+
+struct BinaryObject {
+    uint32_t mesh;
+    int32_t texture;
+    uint32_t material;
+    uint32_t flags;
+    float position[3];
+    float opacity;
+};
+
+std::runtime_error lineError(const std::string& path, size_t line, const std::string& message) {
+    return std::runtime_error(path + ":" + std::to_string(line) + ": " + message);
+}
+
+glm::vec3 parseVec3(std::string_view value) {
+    glm::vec3 result;
+    std::string rest(value);
+    for (int i = 0; i < 3; ++i) {
+        size_t separator = rest.find(',');
+        if ((separator == std::string::npos) != (i == 2)) {
+            throw std::runtime_error("Expected three comma separated numbers: " + std::string(value));
+        }
+        result[i] = std::stof(rest.substr(0, separator));
+        rest = separator == std::string::npos ? "" : rest.substr(separator + 1);
+    }
+    return result;
+}
+
+SceneDescription readSceneText(const std::string& path, const std::string& text) {
+    SceneDescription description;
+    std::unordered_map<std::string, uint32_t> mesh_names;
+    std::unordered_map<std::string, int32_t> texture_names;
+
+    std::istringstream lines(text);
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(lines, line)) {
+        ++line_number;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+        std::istringstream tokens(line);
+        std::string kind;
+        if (!(tokens >> kind)) {
+            continue;
+        }
+
+        try {
+            if (kind == "mesh" || kind == "texture") {
+                std::string name, asset_path, extra;
+                if (!(tokens >> name >> asset_path) || (tokens >> extra)) {
+                    throw std::runtime_error("Expected " + kind + " NAME PATH");
+                }
+                if (kind == "mesh") {
+                    mesh_names[name] = description.addMesh(asset_path);
+                } else {
+                    texture_names[name] = description.addTexture(asset_path);
+                }
+            } else if (kind == "object") {
+                SceneFileObject object;
+                bool has_mesh = false;
+                bool has_material = false;
+                std::string token;
+                while (tokens >> token) {
+                    size_t separator = token.find('=');
+                    std::string key = token.substr(0, separator);
+                    std::string value = separator == std::string::npos ? "" : token.substr(separator + 1);
+                    if (key == "mesh") {
+                        auto it = mesh_names.find(value);
+                        if (it == mesh_names.end()) {
+                            throw std::runtime_error("Unknown mesh: " + value);
+                        }
+                        object.mesh = it->second;
+                        has_mesh = true;
+                    } else if (key == "texture") {
+                        auto it = texture_names.find(value);
+                        if (it == texture_names.end()) {
+                            throw std::runtime_error("Unknown texture: " + value);
+                        }
+                        object.texture = it->second;
+                    } else if (key == "material") {
+                        object.material = parseMaterial(value);
+                        has_material = true;
+                    } else if (key == "position") {
+                        object.position = parseVec3(value);
+                    } else if (key == "opacity") {
+                        object.opacity = std::stof(value);
+                    } else if (token == "occluder") {
+                        object.occluder = true;
+                    } else if (token == "dynamic") {
+                        object.dynamic = true;
+                    } else {
+                        throw std::runtime_error("Unknown object property: " + token);
+                    }
+                }
+                if (!has_mesh) {
+                    throw std::runtime_error("Object without a mesh");
+                }
+                if (has_material && object.texture >= 0) {
+                    throw std::runtime_error("Object with both a texture and a material");
+                }
+                description.objects.push_back(object);
+            } else if (kind == "light") {
+                PointLight light;
+                std::string token;
+                while (tokens >> token) {
+                    size_t separator = token.find('=');
+                    std::string key = token.substr(0, separator);
+                    std::string value = separator == std::string::npos ? "" : token.substr(separator + 1);
+                    if (key == "position") {
+                        light.position = glm::vec4(parseVec3(value), light.position.w);
+                    } else if (key == "radius") {
+                        light.position.w = std::stof(value);
+                    } else if (key == "color") {
+                        light.color = glm::vec4(parseVec3(value), 1.0f);
+                    } else {
+                        throw std::runtime_error("Unknown light property: " + token);
+                    }
+                }
+                description.lights.push_back(light);
+            } else {
+                throw std::runtime_error("Unknown entry: " + kind);
+            }
+        } catch (const std::logic_error&) {
+            // std::stof throws invalid_argument and out_of_range.
+            throw lineError(path, line_number, "Malformed number");
+        } catch (const std::runtime_error& e) {
+            throw lineError(path, line_number, e.what());
+        }
+    }
+    return description;
+}
+
+// Flat arrays behind a header, read with one copy per array.
+class BinaryReader {
+public:
+    BinaryReader(const std::string& path, const std::string& data) : path_(path), data_(data) {}
+
+    // Checked before arrays are allocated, against bogus counts.
+    void expect(uint64_t size) const {
+        if (size > data_.size() - offset_) {
+            throw std::runtime_error("Truncated scene file " + path_ + "!");
+        }
+    }
+
+    void read(void* out, size_t size) {
+        expect(size);
+        std::memcpy(out, data_.data() + offset_, size);
+        offset_ += size;
+    }
+
+    std::string readString() {
+        uint32_t length;
+        read(&length, sizeof(length));
+        std::string result(length, '\0');
+        read(result.data(), length);
+        return result;
+    }
+
+private:
+    const std::string& path_;
+    const std::string& data_;
+    size_t offset_ = 0;
+};
+
+SceneDescription readSceneBinary(const std::string& path, const std::string& data) {
+    BinaryReader reader(path, data);
+    BinaryHeader header;
+    reader.read(&header, sizeof(header));
+    if (header.version != kBinaryVersion) {
+        throw std::runtime_error("Unsupported scene file version in " + path + "!");
+    }
+
+    SceneDescription description;
+    // Every string takes at least its length.
+    reader.expect((static_cast<uint64_t>(header.mesh_count) + header.texture_count) * sizeof(uint32_t));
+    description.meshes.resize(header.mesh_count);
+    for (std::string& mesh : description.meshes) {
+        mesh = reader.readString();
+    }
+    description.textures.resize(header.texture_count);
+    for (std::string& texture : description.textures) {
+        texture = reader.readString();
+    }
+
+    reader.expect(static_cast<uint64_t>(header.object_count) * sizeof(BinaryObject) + static_cast<uint64_t>(header.light_count) * sizeof(PointLight));
+    std::vector<BinaryObject> objects(header.object_count);
+    reader.read(objects.data(), objects.size() * sizeof(BinaryObject));
+    description.objects.resize(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const BinaryObject& in = objects[i];
+        if (in.mesh >= header.mesh_count || in.texture >= static_cast<int32_t>(header.texture_count) || in.material > static_cast<uint32_t>(MaterialType::kPlastic)) {
+            throw std::runtime_error("Invalid object in scene file " + path + "!");
+        }
+        SceneFileObject& out = description.objects[i];
+        out.mesh = in.mesh;
+        out.texture = in.texture < 0 ? -1 : in.texture;
+        out.material = static_cast<MaterialType>(in.material);
+        out.position = glm::vec3(in.position[0], in.position[1], in.position[2]);
+        out.opacity = in.opacity;
+        out.occluder = (in.flags & kOccluder) != 0;
+        out.dynamic = (in.flags & kDynamic) != 0;
+    }
+
+    description.lights.resize(header.light_count);
+    reader.read(description.lights.data(), description.lights.size() * sizeof(PointLight));
+    return description;
+}
+
+std::ofstream openForWriting(const std::string& path) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    return file;
+}
+
+void writeString(std::ofstream& file, const std::string& value) {
+    uint32_t length = static_cast<uint32_t>(value.size());
+    file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    file.write(value.data(), value.size());
+}
+
+}  // namespace
+
+uint32_t SceneDescription::addMesh(const std::string& path) {
+    for (uint32_t i = 0; i < meshes.size(); ++i) {
+        if (meshes[i] == path) {
+            return i;
+        }
+    }
+    meshes.push_back(path);
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+int32_t SceneDescription::addTexture(const std::string& path) {
+    for (uint32_t i = 0; i < textures.size(); ++i) {
+        if (textures[i] == path) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    textures.push_back(path);
+    return static_cast<int32_t>(textures.size() - 1);
+}
+
+SceneDescription readSceneFile(const std::string& path) {
+    PROFILE_SCOPE("readSceneFile");
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() >= sizeof(kBinaryMagic) && std::memcmp(data.data(), kBinaryMagic, sizeof(kBinaryMagic)) == 0) {
+        return readSceneBinary(path, data);
+    }
+    return readSceneText(path, data);
+}
+
+void writeSceneText(const std::string& path, const SceneDescription& description) {
+    std::ofstream file = openForWriting(path);
+    // Enough digits for the floats to read back unchanged.
+    file << std::setprecision(std::numeric_limits<float>::max_digits10);
+    // Assets are named after their index, names only have to be unique.
+    for (size_t i = 0; i < description.meshes.size(); ++i) {
+        file << "mesh m" << i << " " << description.meshes[i] << "\n";
+    }
+    for (size_t i = 0; i < description.textures.size(); ++i) {
+        file << "texture t" << i << " " << description.textures[i] << "\n";
+    }
+    for (const SceneFileObject& object : description.objects) {
+        file << "object mesh=m" << object.mesh;
+        if (object.texture >= 0) {
+            file << " texture=t" << object.texture;
+        } else {
+            file << " material=" << materialName(object.material);
+        }
+        file << " position=" << object.position.x << "," << object.position.y << "," << object.position.z;
+        if (object.opacity != 1.0f) {
+            file << " opacity=" << object.opacity;
+        }
+        if (object.occluder) {
+            file << " occluder";
+        }
+        if (object.dynamic) {
+            file << " dynamic";
+        }
+        file << "\n";
+    }
+    for (const PointLight& light : description.lights) {
+        file << "light position=" << light.position.x << "," << light.position.y << "," << light.position.z
+             << " radius=" << light.position.w
+             << " color=" << light.color.x << "," << light.color.y << "," << light.color.z << "\n";
+    }
+    if (!file.good()) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+void writeSceneBinary(const std::string& path, const SceneDescription& description) {
+    std::ofstream file = openForWriting(path);
+    BinaryHeader header;
+    std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+    header.version = kBinaryVersion;
+    header.mesh_count = static_cast<uint32_t>(description.meshes.size());
+    header.texture_count = static_cast<uint32_t>(description.textures.size());
+    header.object_count = static_cast<uint32_t>(description.objects.size());
+    header.light_count = static_cast<uint32_t>(description.lights.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const std::string& mesh : description.meshes) {
+        writeString(file, mesh);
+    }
+    for (const std::string& texture : description.textures) {
+        writeString(file, texture);
+    }
+
+    std::vector<BinaryObject> objects(description.objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const SceneFileObject& in = description.objects[i];
+        BinaryObject& out = objects[i];
+        out.mesh = in.mesh;
+        out.texture = in.texture;
+        out.material = static_cast<uint32_t>(in.material);
+        out.flags = (in.occluder ? kOccluder : 0) | (in.dynamic ? kDynamic : 0);
+        out.position[0] = in.position.x;
+        out.position[1] = in.position.y;
+        out.position[2] = in.position.z;
+        out.opacity = in.opacity;
+    }
+    file.write(reinterpret_cast<const char*>(objects.data()), objects.size() * sizeof(BinaryObject));
+    file.write(reinterpret_cast<const char*>(description.lights.data()), description.lights.size() * sizeof(PointLight));
+    if (!file.good()) {
+        throw std::runtime_error("Failed to write " + path + "!");
+    }
+}
+
+void writeSceneFile(const std::string& path, const SceneDescription& description) {
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    if (binary) {
+        writeSceneBinary(path, description);
+    } else {
+        writeSceneText(path, description);
+    }
+}
+
+SceneLoadStats instantiateScene(Scene& scene, const SceneDescription& description) {
+    PROFILE_SCOPE("instantiateScene");
+    SceneLoadStats stats;
+    stats.assets = scene.loadAssets(description.meshes, description.textures);
+
+    auto build_start = std::chrono::steady_clock::now();
+    stats.handles.reserve(description.objects.size());
+    for (const SceneFileObject& object : description.objects) {
+        const std::string& mesh = description.meshes.at(object.mesh);
+        ObjectHandle handle = object.texture >= 0 ? scene.createObject(mesh, description.textures.at(object.texture), object.position)
+                                                  : scene.createObject(mesh, object.material, object.position);
+        if (object.opacity != 1.0f) {
+            scene.setObjectOpacity(handle, object.opacity);
+        }
+        if (object.occluder) {
+            scene.setObjectOccluder(handle, true);
+        }
+        if (object.dynamic) {
+            scene.setObjectDynamic(handle, true);
+        }
+        stats.handles.push_back(handle);
+    }
+    stats.objects = static_cast<uint32_t>(description.objects.size());
+    stats.build_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+    return stats;
+}
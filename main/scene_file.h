@@ -0,0 +1,69 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/light_clustering.h"
+#include "main/material.h"
+#include "main/scene.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SceneFileObject {
+    // Index into SceneDescription::meshes.
+    uint32_t mesh = 0;
+    // Index into SceneDescription::textures, -1 uses the material instead.
+    int32_t texture = -1;
+    MaterialType material = MaterialType::kPlastic;
+    glm::vec3 position = glm::vec3(0.0f);
+    float opacity = 1.0f;
+    bool occluder = false;
+    bool dynamic = false;
+};
+
+// Contents of a scene file. Every mesh and texture is listed once and
+// referenced by index, which gives the loader the unique assets up front.
+struct SceneDescription {
+    std::vector<std::string> meshes;
+    std::vector<std::string> textures;
+    std::vector<SceneFileObject> objects;
+    std::vector<PointLight> lights;
+
+    // Both return the index of the path, adding it when it is new.
+    uint32_t addMesh(const std::string& path);
+    int32_t addTexture(const std::string& path);
+};
+
+// The text form has one entry per line, # starts a comment:
+//
+//   mesh sphere main/models/sphere.obj
+//   texture marble main/textures/Blue_Marble_002_COLOR.png
+//   object mesh=sphere texture=marble position=-50,0,0
+//   object mesh=sphere material=gold position=0,50,0 opacity=0.6 dynamic
+//   light position=0,200,200 radius=1000 color=1,1,1
+//
+// Names are local to the file. Objects take texture= or material=, plus the
+// optional opacity=, occluder and dynamic. The binary form holds the same
+// data as flat arrays and loads without parsing; it is little-endian.
+//
+// Reads either form, the binary one is recognized by its header. Throws on
+// malformed files, naming the line for the text form.
+SceneDescription readSceneFile(const std::string& path);
+void writeSceneText(const std::string& path, const SceneDescription& description);
+void writeSceneBinary(const std::string& path, const SceneDescription& description);
+// Binary for a .bin extension, text otherwise.
+void writeSceneFile(const std::string& path, const SceneDescription& description);
+
+struct SceneLoadStats {
+    AssetLoadStats assets;
+    uint32_t objects = 0;
+    // Creating the objects once the assets are loaded.
+    float build_ms = 0.0f;
+    // Of the objects created, in file order.
+    std::vector<ObjectHandle> handles;
+};
+
+// Loads the assets of the description in one parallel, batched step, then
+// adds its objects to the scene. The lights are left to the caller, which
+// decides their order: the first light of the scene casts the shadows.
+SceneLoadStats instantiateScene(Scene& scene, const SceneDescription& description);
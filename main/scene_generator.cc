@@ -0,0 +1,147 @@
+#include "main/scene_generator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+const std::string kFloorModelPath = "main/models/plane.obj";
+const std::string kFloorTexturePath = "main/textures/Stone_Tiles_003_COLOR.png";
+// plane.obj is 400 units wide.
+constexpr float kFloorTileSize = 400.0f;
+// Floor height of the buried variant.
+constexpr float kFloorHeight = -25.0f;
+// Objects per clump of the clustered distribution.
+constexpr uint32_t kObjectsPerCluster = 256;
+
+const std::array<std::pair<std::string_view, SceneDistribution>, 3> kDistributions = {{
+    {"grid", SceneDistribution::kGrid},
+    {"uniform", SceneDistribution::kUniform},
+    {"clustered", SceneDistribution::kClustered},
+}};
+
+const std::array<MaterialType, 3> kMaterials = {MaterialType::kGold, MaterialType::kEmerald, MaterialType::kPlastic};
+
+}  // namespace
+
+std::string_view distributionName(SceneDistribution distribution) {
+    for (const auto& [name, value] : kDistributions) {
+        if (value == distribution) {
+            return name;
+        }
+    }
+    return "unknown";
+}
+
+SceneDistribution parseDistribution(std::string_view name) {
+    for (const auto& [distribution_name, value] : kDistributions) {
+        if (distribution_name == name) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Unknown scene distribution: " + std::string(name));
+}
+
+BoundingBox generateScene(Scene& scene, const SceneGeneratorConfig& config) {
+    SceneDescription description;
+    BoundingBox volume = generateSceneDescription(config, description);
+    instantiateScene(scene, description);
+    return volume;
+}
+
+BoundingBox generateSceneDescription(const SceneGeneratorConfig& config, SceneDescription& description) {
+    if (config.object_count == 0) {
+        return {};
+    }
+    if (config.models.empty()) {
+        throw std::runtime_error("Scene generator needs at least one model!");
+    }
+
+    std::mt19937 random(config.seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // The grid fills a cube in front of the default camera, growing away from
+    // it. The other distributions use the same volume.
+    const float spacing = config.spacing;
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(config.object_count))));
+    float half_width = side / 2.0f * spacing;
+    BoundingBox volume;
+    if (config.buried) {
+        volume = {glm::vec3(-half_width, -(side + 1.0f) * spacing, -(side - 1.0f) * spacing), glm::vec3(half_width, -2.0f * spacing, 0.0f)};
+    } else {
+        volume = {glm::vec3(-half_width, 0.0f, -(side - 1.0f) * spacing), glm::vec3(half_width, (side - 1.0f) * spacing, 0.0f)};
+    }
+    glm::vec3 volume_size = volume.max - volume.min;
+
+    std::vector<glm::vec3> cluster_centers;
+    float cluster_radius = 0.0f;
+    if (config.distribution == SceneDistribution::kClustered) {
+        uint32_t cluster_count = std::max(1u, config.object_count / kObjectsPerCluster);
+        for (uint32_t i = 0; i < cluster_count; ++i) {
+            cluster_centers.push_back(volume.min + glm::vec3(unit(random), unit(random), unit(random)) * volume_size);
+        }
+        // A clump packs its objects at twice the grid density.
+        cluster_radius = 0.5f * spacing * std::cbrt(static_cast<float>(kObjectsPerCluster));
+    }
+    std::normal_distribution<float> cluster_offset(0.0f, cluster_radius * 0.5f);
+
+    for (uint32_t i = 0; i < config.object_count; ++i) {
+        glm::vec3 pos;
+        switch (config.distribution) {
+            case SceneDistribution::kGrid: {
+                uint32_t x = i % side;
+                uint32_t y = (i / side) % side;
+                uint32_t z = i / (side * side);
+                pos = glm::vec3(volume.min.x + static_cast<float>(x) * spacing,
+                                config.buried ? volume.max.y - static_cast<float>(y) * spacing : volume.min.y + static_cast<float>(y) * spacing,
+                                -static_cast<float>(z) * spacing);
+                break;
+            }
+            case SceneDistribution::kUniform:
+                pos = volume.min + glm::vec3(unit(random), unit(random), unit(random)) * volume_size;
+                break;
+            case SceneDistribution::kClustered: {
+                const glm::vec3& center = cluster_centers[i % cluster_centers.size()];
+                pos = glm::clamp(center + glm::vec3(cluster_offset(random), cluster_offset(random), cluster_offset(random)), volume.min, volume.max);
+                break;
+            }
+        }
+
+        SceneFileObject object;
+        object.mesh = description.addMesh(config.models[i % config.models.size()]);
+        object.position = pos;
+        bool textured = !config.textures.empty() && unit(random) < config.textured_fraction;
+        if (textured) {
+            object.texture = description.addTexture(config.textures[random() % config.textures.size()]);
+        } else {
+            object.material = kMaterials[random() % kMaterials.size()];
+        }
+        if (unit(random) < config.transparent_fraction) {
+            object.opacity = 0.5f;
+        }
+        description.objects.push_back(object);
+    }
+
+    if (config.buried) {
+        // Floor tiles covering the objects and the default camera.
+        float floor_half_width = half_width + kFloorTileSize;
+        for (float x = -floor_half_width; x <= floor_half_width; x += kFloorTileSize) {
+            for (float z = 2.0f * kFloorTileSize; z >= volume.min.z - kFloorTileSize; z -= kFloorTileSize) {
+                SceneFileObject tile;
+                tile.mesh = description.addMesh(kFloorModelPath);
+                tile.texture = description.addTexture(kFloorTexturePath);
+                tile.position = glm::vec3(x, kFloorHeight, z);
+                tile.occluder = true;
+                description.objects.push_back(tile);
+            }
+        }
+    }
+
+    volume.min -= glm::vec3(spacing);
+    volume.max += glm::vec3(spacing);
+    return volume;
+}
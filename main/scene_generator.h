@@ -0,0 +1,46 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/scene.h"
+#include "main/scene_file.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SceneDistribution {
+    // Cube-shaped grid in front of the camera.
+    kGrid,
+    // Uniformly random positions in the volume the grid would fill.
+    kUniform,
+    // Normally distributed clumps around random centers in the same volume,
+    // dense spots with empty space in between.
+    kClustered
+};
+
+struct SceneGeneratorConfig {
+    uint32_t object_count = 0;
+    SceneDistribution distribution = SceneDistribution::kGrid;
+    // Every object picks one of the meshes, and one of the textures or a material.
+    std::vector<std::string> models = {"main/models/sphere.obj"};
+    std::vector<std::string> textures = {"main/textures/Stone_Tiles_003_COLOR.png", "main/textures/Blue_Marble_002_COLOR.png"};
+    float textured_fraction = 0.4f;
+    // Objects going through the sorted transparent pass.
+    float transparent_fraction = 0.1f;
+    // Distance between grid neighbours, the other distributions keep the same density.
+    float spacing = 50.0f;
+    // Hangs the objects below a floor of occluder tiles, a test case for
+    // occlusion culling.
+    bool buried = false;
+    uint32_t seed = 42;
+};
+
+std::string_view distributionName(SceneDistribution distribution);
+SceneDistribution parseDistribution(std::string_view name);
+
+// Adds config.object_count objects to the scene, the same ones for the same
+// config. Returns the volume they were placed in.
+BoundingBox generateScene(Scene& scene, const SceneGeneratorConfig& config);
+// Appends the objects to a description instead, to be saved as a scene file.
+BoundingBox generateSceneDescription(const SceneGeneratorConfig& config, SceneDescription& description);
@@ -0,0 +1,71 @@
+#include "main/shader_watcher.h"
+
+#include "main/cpu_profiler.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+// Often enough to feel immediate after saving.
+constexpr std::chrono::milliseconds kPollInterval(250);
+
+// Files being saved can be missing for a moment, they read as unchanged.
+std::filesystem::file_time_type getWriteTime(const std::filesystem::path& path) {
+    std::error_code error;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    return error ? std::filesystem::file_time_type::min() : time;
+}
+
+}  // namespace
+
+ShaderWatcher::ShaderWatcher(std::string source_dir, std::string compiler)
+    : source_dir_(std::move(source_dir)), compiler_(std::move(compiler)) {}
+
+void ShaderWatcher::watch(const std::string& name) {
+    files_.push_back({name, getWriteTime(source_dir_ / name)});
+}
+
+std::vector<std::string> ShaderWatcher::poll() {
+    std::vector<std::string> changed;
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_poll_ < kPollInterval) {
+        return changed;
+    }
+    last_poll_ = now;
+
+    for (WatchedFile& file : files_) {
+        std::filesystem::file_time_type time = getWriteTime(source_dir_ / file.name);
+        if (time != std::filesystem::file_time_type::min() && time != file.write_time) {
+            file.write_time = time;
+            changed.push_back(file.name);
+        }
+    }
+    return changed;
+}
+
+std::vector<char> ShaderWatcher::compile(const std::string& name) const {
+    PROFILE_SCOPE("ShaderWatcher::compile");
+    std::filesystem::path source = source_dir_ / name;
+    std::filesystem::path output = std::filesystem::temp_directory_path() /
+                                   ("kv3d_" + std::to_string(output_count_++) + "_" + source.filename().string() + ".spv");
+    std::string command = compiler_ + " -o \"" + output.string() + "\" \"" + source.string() + "\"";
+    if (std::system(command.c_str()) != 0) {
+        std::filesystem::remove(output);
+        throw std::runtime_error("Failed to compile " + source.string() + "!");
+    }
+
+    std::ifstream file(output, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + output.string() + "!");
+    }
+    std::vector<char> code(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(code.data(), code.size());
+    file.close();
+    std::filesystem::remove(output);
+    return code;
+}
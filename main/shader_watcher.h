@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Development mode shader hot reloading: notices edits to GLSL sources and
+// compiles them to SPIR-V with an external compiler, glslc or any other
+// taking "-o OUTPUT INPUT".
+class ShaderWatcher {
+public:
+    ShaderWatcher(std::string source_dir, std::string compiler);
+
+    // name is relative to the source directory.
+    void watch(const std::string& name);
+    // The watched sources modified since the previous poll. The files are
+    // checked at most a few times per second, so this can run every frame.
+    std::vector<std::string> poll();
+    // Compiles a source to SPIR-V, from any thread. The compiler reports
+    // errors on standard error, and this throws.
+    std::vector<char> compile(const std::string& name) const;
+
+private:
+    struct WatchedFile {
+        std::string name;
+        std::filesystem::file_time_type write_time;
+    };
+
+    std::filesystem::path source_dir_;
+    std::string compiler_;
+    std::vector<WatchedFile> files_;
+    std::chrono::steady_clock::time_point last_poll_;
+    // Keeps the outputs of concurrent compiles apart.
+    mutable std::atomic<uint32_t> output_count_{0};
+};
@@ -0,0 +1,30 @@
+#version 450
+
+// Depth pre-pass: positions only, no fragment shader. gl_Position must come
+// out bit-identical to shader.vert for the color pass's EQUAL depth test.
+
+struct InstanceData {
+    mat4 model;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    int texture_index;
+};
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+    mat4 view;
+    mat4 proj;
+} frame;
+
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+    mat4 model = instances[gl_InstanceIndex].model;
+    gl_Position = frame.proj * frame.view * model * vec4(inPosition, 1.0);
+}
@@ -1,61 +1,158 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
-layout(push_constant) uniform SceneObjectPushConsts {
+struct InstanceData {
+    mat4 model;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    int texture_index;
+};
+
+struct PointLight {
+    // xyz - world position, w - radius of influence.
+    vec4 position;
+    // rgb - color times intensity.
+    vec4 color;
+};
+
+layout(push_constant) uniform ScenePushConsts {
     vec3 light_ambient;
-    vec3 light_diffuse;
-    vec3 light_specular;
-    vec3 light_pos;
     vec3 camera_pos;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float shininess;
-    uint is_textured;
+    // xyz - position of the shadow casting light, w - its radius, 0 without shadows.
+    vec4 shadow_light;
+    // x - P22, y - P32 of the shadow cube face projection.
+    vec4 shadow_depth;
 } pushConstants;
 
-layout(set = 0, binding = 1) uniform sampler2D texSampler;
+// Must match kMaxTextures in vulkan_constants.h.
+layout(set = 0, binding = 1) uniform sampler2D texSamplers[64];
+
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer LightBuffer {
+    PointLight lights[];
+};
+
+// Must match kMaxLightsPerCluster + 1 in light_clustering.h.
+const uint kClusterStride = 256;
+
+// Per cluster: the light count, then the indices of its lights. Written by cluster.comp.
+layout(std430, set = 0, binding = 4) readonly buffer ClusterBuffer {
+    uint clusters[];
+};
+
+layout(std140, set = 0, binding = 5) uniform ClusterUniforms {
+    mat4 view;
+    vec4 projection;
+    uvec4 grid;
+    vec2 screenSize;
+    float sliceScale;
+    float sliceBias;
+    float znear;
+    float zfar;
+} cluster;
+
+// Distances from the shadow casting light, see ShadowMap.
+layout(set = 0, binding = 6) uniform samplerCubeShadow shadowMap;
+
+// False in the pipelines specialized for drawing without shadows, which
+// compiles the shadow lookup out.
+layout(constant_id = 0) const bool kShadows = true;
 
 layout(location = 0) in vec2 fragTexCoord;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec3 fragPos;
+layout(location = 4) flat in uint inInstance;
 
 layout(location = 0) out vec4 outColor;
 
+uint clusterIndex() {
+    // View depth from the zero-to-one projected depth.
+    float depth = cluster.projection.w / (gl_FragCoord.z + cluster.projection.z);
+    uint slice = uint(clamp(log(depth) * cluster.sliceScale + cluster.sliceBias, 0.0, float(cluster.grid.z - 1)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / cluster.screenSize * vec2(cluster.grid.xy)), cluster.grid.xy - 1);
+    return tile.x + cluster.grid.x * (tile.y + cluster.grid.y * slice);
+}
+
+// 1 where the shadow casting light reaches the fragment, 0 in its shadow.
+float shadowFactor() {
+    if (!kShadows || pushConstants.shadow_light.w <= 0.0) {
+        return 1.0;
+    }
+    vec3 light_to_frag = fragPos - pushConstants.shadow_light.xyz;
+    // The cube face is picked by the major axis, whose distance is the view depth in that face.
+    vec3 d = abs(light_to_frag);
+    float major = max(d.x, max(d.y, d.z));
+    if (major >= pushConstants.shadow_light.w) {
+        return 1.0;
+    }
+    float depth = -pushConstants.shadow_depth.x + pushConstants.shadow_depth.y / major;
+    return texture(shadowMap, vec4(light_to_frag, depth - 1e-4));
+}
+
 void main() {
+    InstanceData instance = instances[inInstance];
+    bool is_textured = instance.texture_index >= 0;
 
-    bool is_textured = bool(pushConstants.is_textured > 0);
+    vec3 tex_color = vec3(1.0);
+    if (is_textured) {
+        tex_color = texture(texSamplers[nonuniformEXT(instance.texture_index)], fragTexCoord).rgb;
+    }
 
     vec3 ambient = pushConstants.light_ambient;
     if (is_textured) {
-        ambient *= texture(texSampler, fragTexCoord).rgb;
+        ambient *= tex_color;
     } else {
-        ambient *= pushConstants.ambient;
+        ambient *= instance.ambient.rgb;
     }
 
-    // diffuse
+    // Only the lights binned into this fragment's cluster.
     vec3 norm = normalize(inNormal);
-    vec3 lightDir = normalize(pushConstants.light_pos - fragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * pushConstants.light_diffuse;
-    if (is_textured) {
-        diffuse *= texture(texSampler, fragTexCoord).rgb;
-    } else { 
-        diffuse *= pushConstants.diffuse;
+    vec3 view_dir = normalize(pushConstants.camera_pos - fragPos);
+    vec3 diffuse_light = vec3(0.0);
+    vec3 specular_light = vec3(0.0);
+    uint first = clusterIndex() * kClusterStride;
+    uint light_count = clusters[first];
+    for (uint i = 0; i < light_count; ++i) {
+        uint light_index = clusters[first + 1 + i];
+        PointLight light = lights[light_index];
+        vec3 to_light = light.position.xyz - fragPos;
+        float distance = length(to_light);
+        if (distance >= light.position.w) {
+            continue;
+        }
+        // Smooth falloff reaching zero at the radius.
+        float falloff = 1.0 - (distance * distance) / (light.position.w * light.position.w);
+        falloff *= falloff;
+        // Light 0 is the scene light, the only one casting shadows.
+        if (light_index == 0) {
+            falloff *= shadowFactor();
+        }
+
+        vec3 light_dir = to_light / max(distance, 1e-4);
+        float diff = max(dot(norm, light_dir), 0.0);
+        diffuse_light += diff * falloff * light.color.rgb;
+
+        vec3 reflect_dir = reflect(-light_dir, norm);
+        float spec = pow(max(dot(view_dir, reflect_dir), 0.0), instance.specular.w);
+        specular_light += spec * falloff * light.color.rgb;
     }
 
-    // specular
-    vec3 view_dir = normalize(pushConstants.camera_pos - fragPos);
-    vec3 reflect_dir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(view_dir, reflect_dir), 0.0), pushConstants.shininess);
-    vec3 specular = spec * pushConstants.light_specular;
+    vec3 diffuse = diffuse_light;
+    vec3 specular = specular_light;
     if (is_textured) {
-        specular *= texture(texSampler, fragTexCoord).rgb;
-    } else { 
-        specular *= pushConstants.specular;
+        diffuse *= tex_color;
+        specular *= tex_color;
+    } else {
+        diffuse *= instance.diffuse.rgb;
+        specular *= instance.specular.rgb;
     }
 
     vec3 result = ambient + diffuse + specular;
     
-    outColor = vec4(result, 1.0f);
-}
\ No newline at end of file
+    outColor = vec4(result, instance.diffuse.a);
+}
@@ -1,10 +1,21 @@
 #version 450
 
-layout(set = 0, binding = 0) uniform UniformBufferObject {
+struct InstanceData {
     mat4 model;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    int texture_index;
+};
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-} ubo;
+} frame;
+
+layout(std430, set = 0, binding = 2) readonly buffer InstanceBuffer {
+    InstanceData instances[];
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -15,11 +26,17 @@ layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec3 outColor;
 layout(location = 2) out vec3 outNormal;
 layout(location = 3) out vec3 outPos;
+layout(location = 4) flat out uint outInstance;
+
+// Matches depth.vert, so the depth pre-pass and this pass agree exactly.
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    mat4 model = instances[gl_InstanceIndex].model;
+    gl_Position = frame.proj * frame.view * model * vec4(inPosition, 1.0);
     fragTexCoord = inTexCoord;
     outColor = inColor;
-    outNormal = mat3(transpose(inverse(ubo.model))) * inNormal;
-    outPos = vec3(ubo.model * vec4(inPosition, 1.0));
-}
\ No newline at end of file
+    outNormal = mat3(transpose(inverse(model))) * inNormal;
+    outPos = vec3(model * vec4(inPosition, 1.0));
+    outInstance = gl_InstanceIndex;
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// Shadow cube faces: positions only, no fragment shader. Instances index the
+// caster matrices written by ShadowMap::update.
+
+layout(push_constant) uniform ShadowPushConsts {
+    mat4 view_proj;
+} pushConstants;
+
+layout(std430, set = 0, binding = 0) readonly buffer CasterBuffer {
+    mat4 models[];
+};
+
+layout(location = 0) in vec3 inPosition;
+
+void main() {
+    gl_Position = pushConstants.view_proj * models[gl_InstanceIndex] * vec4(inPosition, 1.0);
+}
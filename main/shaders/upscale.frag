@@ -0,0 +1,42 @@
+#version 450
+
+// Upscales the rendered part of the scene image to the target with a bilinear
+// fetch, then sharpens it against its four neighbors. The amount adapts to the
+// local contrast as in AMD's contrast adaptive sharpening: flat areas get the
+// full amount, edges that are already sharp get less, which keeps the negative
+// lobe from ringing.
+
+layout(binding = 0) uniform sampler2D sceneImage;
+
+// Must match UpscalePushConstant in upscaler.h.
+layout(push_constant) uniform UpscaleConsts {
+    // Target pixel to scene image coordinates.
+    vec2 uvPerPixel;
+    // The rendered part of the scene image, less half a texel.
+    vec2 uvMax;
+    vec2 texelSize;
+    float sharpness;
+} upscale;
+
+layout(location = 0) out vec4 outColor;
+
+vec3 fetch(vec2 uv) {
+    return texture(sceneImage, clamp(uv, upscale.texelSize * 0.5, upscale.uvMax)).rgb;
+}
+
+void main() {
+    vec2 uv = gl_FragCoord.xy * upscale.uvPerPixel;
+    vec3 center = fetch(uv);
+    vec3 north = fetch(uv - vec2(0.0, upscale.texelSize.y));
+    vec3 south = fetch(uv + vec2(0.0, upscale.texelSize.y));
+    vec3 west = fetch(uv - vec2(upscale.texelSize.x, 0.0));
+    vec3 east = fetch(uv + vec2(upscale.texelSize.x, 0.0));
+
+    vec3 low = min(center, min(min(north, south), min(west, east)));
+    vec3 high = max(center, max(max(north, south), max(west, east)));
+    vec3 amount = sqrt(clamp(min(low, 1.0 - high) / max(high, vec3(1e-4)), 0.0, 1.0));
+    vec3 weight = -amount * mix(0.125, 0.2, upscale.sharpness);
+
+    vec3 color = (center + (north + south + west + east) * weight) / (1.0 + 4.0 * weight);
+    outColor = vec4(clamp(color, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,9 @@
+#version 450
+
+// One triangle covering the target, no vertex buffer: vertices 0, 1 and 2
+// land at (-1, -1), (3, -1) and (-1, 3).
+
+void main() {
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
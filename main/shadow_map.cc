@@ -0,0 +1,601 @@
+#include "main/shadow_map.h"
+
+#include "main/vertex.h"
+#include "main/vulkan_constants.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+constexpr VkFormat kShadowFormat = VK_FORMAT_D32_SFLOAT;
+
+// Slope-scaled bias applied while rendering the casters, against acne on
+// surfaces facing away from the light at grazing angles.
+constexpr float kDepthBiasConstant = 1.25f;
+constexpr float kDepthBiasSlope = 1.75f;
+
+// Face order and orientation of a Vulkan cube map: +X, -X, +Y, -Y, +Z, -Z.
+// The faces are rendered with an unflipped viewport, so the up vectors point
+// towards -t of every face.
+const std::array<glm::vec3, kCubeFaceCount> kFaceDirections = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+const std::array<glm::vec3, kCubeFaceCount> kFaceUps = {
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)};
+
+}  // namespace
+
+void ShadowMap::init(VulkanDevice* device, const std::vector<char>& shader_code) {
+    uint32_t frame_count = device_->getFramesInFlight();
+    device_ = device;
+    createRenderPasses();
+    createPipeline(shader_code);
+    createImages();
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = frame_count;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = frame_count;
+    alloc_info.pSetLayouts = layouts.data();
+
+    descriptor_sets_.resize(frame_count);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, descriptor_sets_.data()));
+
+    matrix_capacity_ = 1024;
+    createFrameResources();
+    static_dirty_ = true;
+}
+
+void ShadowMap::createRenderPasses() {
+    // Static casters: cleared, then handed to the copy into the sampled cube.
+    // Dynamic casters: drawn over that copy, then sampled by the scene.
+    for (bool is_static : {true, false}) {
+        VkAttachmentDescription depth_attachment{};
+        depth_attachment.format = kShadowFormat;
+        depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depth_attachment.loadOp = is_static ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depth_attachment.initialLayout = is_static ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depth_attachment.finalLayout = is_static ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkAttachmentReference depth_attachment_ref{};
+        depth_attachment_ref.attachment = 0;
+        depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 0;
+        subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        // The static cube was last read by the previous copy, the sampled one written by this frame's copy.
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[0].srcAccessMask = is_static ? 0 : VK_ACCESS_TRANSFER_WRITE_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = is_static ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].dstAccessMask = is_static ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+
+        VkRenderPassCreateInfo render_pass_info{};
+        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        render_pass_info.attachmentCount = 1;
+        render_pass_info.pAttachments = &depth_attachment;
+        render_pass_info.subpassCount = 1;
+        render_pass_info.pSubpasses = &subpass;
+        render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        render_pass_info.pDependencies = dependencies.data();
+
+        VkRenderPass& render_pass = is_static ? static_render_pass_ : dynamic_render_pass_;
+        if (vkCreateRenderPass(*device_, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create shadow map render pass!");
+        }
+    }
+}
+
+void ShadowMap::createPipeline(const std::vector<char>& shader_code) {
+    VkDescriptorSetLayoutBinding matrix_binding{};
+    matrix_binding.binding = 0;
+    matrix_binding.descriptorCount = 1;
+    matrix_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    matrix_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &matrix_binding;
+
+    if (vkCreateDescriptorSetLayout(*device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map descriptor set layout!");
+    }
+
+    // The face view-projection.
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(glm::mat4);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader_code.size();
+    module_info.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+
+    VkShaderModule shader_module;
+    if (vkCreateShaderModule(*device_, &module_info, nullptr, &shader_module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map shader module!");
+    }
+
+    VkPipelineShaderStageCreateInfo vert_stage_info{};
+    vert_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_stage_info.module = shader_module;
+    vert_stage_info.pName = "main";
+
+    auto binding_description = Vertex::getPositionBindingDescription();
+    auto attribute_description = Vertex::getPositionAttributeDescription();
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = 1;
+    vertex_input_info.pVertexBindingDescriptions = &binding_description;
+    vertex_input_info.vertexAttributeDescriptionCount = 1;
+    vertex_input_info.pVertexAttributeDescriptions = &attribute_description;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(kShadowMapSize);
+    viewport.height = static_cast<float>(kShadowMapSize);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = {kShadowMapSize, kShadowMapSize};
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.pViewports = &viewport;
+    viewport_state.scissorCount = 1;
+    viewport_state.pScissors = &scissor;
+
+    // Both sides are drawn: the unflipped viewport reverses the winding of the
+    // scene pipelines, and thin or open meshes still cast shadows.
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_TRUE;
+    rasterizer.depthBiasConstantFactor = kDepthBiasConstant;
+    rasterizer.depthBiasSlopeFactor = kDepthBiasSlope;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.attachmentCount = 0;
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 1;
+    pipeline_info.pStages = &vert_stage_info;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pDepthStencilState = &depth_stencil;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.layout = pipeline_layout_;
+    pipeline_info.renderPass = static_render_pass_;
+    pipeline_info.subpass = 0;
+
+    // The dynamic render pass only differs in load and store layouts, so it is compatible.
+    VkResult result = vkCreateGraphicsPipelines(*device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    vkDestroyShaderModule(*device_, shader_module, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map pipeline!");
+    }
+}
+
+void ShadowMap::createImages() {
+    device_->createImage(kShadowMapSize, kShadowMapSize, kShadowFormat, VK_IMAGE_TILING_OPTIMAL,
+                         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image_, image_memory_, 1, kCubeFaceCount,
+                         VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+    device_->createImage(kShadowMapSize, kShadowMapSize, kShadowFormat, VK_IMAGE_TILING_OPTIMAL,
+                         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, static_image_, static_image_memory_, 1, kCubeFaceCount);
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image_;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+    view_info.format = kShadowFormat;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = kCubeFaceCount;
+    VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &cube_view_));
+
+    VkFramebufferCreateInfo framebuffer_info{};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.attachmentCount = 1;
+    framebuffer_info.width = kShadowMapSize;
+    framebuffer_info.height = kShadowMapSize;
+    framebuffer_info.layers = 1;
+
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.subresourceRange.layerCount = 1;
+    for (uint32_t face = 0; face < kCubeFaceCount; ++face) {
+        view_info.subresourceRange.baseArrayLayer = face;
+
+        view_info.image = image_;
+        VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &face_views_[face]));
+        framebuffer_info.renderPass = dynamic_render_pass_;
+        framebuffer_info.pAttachments = &face_views_[face];
+        VK_CHECK_RESULT(vkCreateFramebuffer(*device_, &framebuffer_info, nullptr, &framebuffers_[face]));
+
+        view_info.image = static_image_;
+        VK_CHECK_RESULT(vkCreateImageView(*device_, &view_info, nullptr, &static_face_views_[face]));
+        framebuffer_info.renderPass = static_render_pass_;
+        framebuffer_info.pAttachments = &static_face_views_[face];
+        VK_CHECK_RESULT(vkCreateFramebuffer(*device_, &framebuffer_info, nullptr, &static_framebuffers_[face]));
+    }
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    // Hardware 2x2 percentage-closer filtering.
+    sampler_info.compareEnable = VK_TRUE;
+    sampler_info.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = 0.0f;
+
+    if (vkCreateSampler(*device_, &sampler_info, nullptr, &sampler_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create shadow map sampler!");
+    }
+
+    // Nothing casts a shadow until the first update.
+    VkCommandBuffer command_buffer = device_->beginCommandBuffer();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image_;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = kCubeFaceCount;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearDepthStencilValue clear_value = {1.0f, 0};
+    vkCmdClearDepthStencilImage(command_buffer, image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_value, 1, &barrier.subresourceRange);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    device_->submitCommandBuffer(command_buffer, device_->getGraphicsQueue());
+}
+
+void ShadowMap::createFrameResources() {
+    matrix_buffers_.resize(device_->getFramesInFlight());
+    for (uint32_t i = 0; i < device_->getFramesInFlight(); ++i) {
+        Buffer& matrix_buffer = matrix_buffers_[i];
+        matrix_buffer.size = sizeof(glm::mat4) * matrix_capacity_;
+        matrix_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        matrix_buffer.usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        matrix_buffer.device = *device_;
+        device_->createBuffer(matrix_buffer);
+        matrix_buffer.map();
+
+        VkDescriptorBufferInfo buffer_info{};
+        buffer_info.buffer = matrix_buffer.buffer;
+        buffer_info.offset = 0;
+        buffer_info.range = VK_WHOLE_SIZE;
+
+        VkWriteDescriptorSet descriptor_write{};
+        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet = descriptor_sets_[i];
+        descriptor_write.dstBinding = 0;
+        descriptor_write.dstArrayElement = 0;
+        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptor_write.descriptorCount = 1;
+        descriptor_write.pBufferInfo = &buffer_info;
+        vkUpdateDescriptorSets(*device_, 1, &descriptor_write, 0, nullptr);
+    }
+}
+
+void ShadowMap::destroy() {
+    if (device_ == nullptr) {
+        return;
+    }
+
+    for (Buffer& buffer : matrix_buffers_) {
+        buffer.unmap();
+        buffer.destroy();
+    }
+    matrix_buffers_.clear();
+    descriptor_sets_.clear();
+    vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+
+    for (uint32_t face = 0; face < kCubeFaceCount; ++face) {
+        vkDestroyFramebuffer(*device_, framebuffers_[face], nullptr);
+        vkDestroyFramebuffer(*device_, static_framebuffers_[face], nullptr);
+        vkDestroyImageView(*device_, face_views_[face], nullptr);
+        vkDestroyImageView(*device_, static_face_views_[face], nullptr);
+    }
+    vkDestroyImageView(*device_, cube_view_, nullptr);
+    vkDestroyImage(*device_, image_, nullptr);
+    vkFreeMemory(*device_, image_memory_, nullptr);
+    vkDestroyImage(*device_, static_image_, nullptr);
+    vkFreeMemory(*device_, static_image_memory_, nullptr);
+    vkDestroySampler(*device_, sampler_, nullptr);
+
+    vkDestroyPipeline(*device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(*device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(*device_, descriptor_set_layout_, nullptr);
+    vkDestroyRenderPass(*device_, static_render_pass_, nullptr);
+    vkDestroyRenderPass(*device_, dynamic_render_pass_, nullptr);
+
+    *this = ShadowMap{};
+}
+
+bool ShadowMap::isReady() const {
+    return device_ != nullptr;
+}
+
+void ShadowMap::setLight(const glm::vec3& position, float radius) {
+    if (position == light_position_ && radius == light_radius_) {
+        return;
+    }
+    light_position_ = position;
+    light_radius_ = radius;
+    static_dirty_ = true;
+
+    projection_ = glm::perspective(glm::radians(90.0f), 1.0f, kShadowNearPlane, std::max(radius, kShadowNearPlane * 2.0f));
+    for (uint32_t face = 0; face < kCubeFaceCount; ++face) {
+        glm::mat4 view = glm::lookAt(position, position + kFaceDirections[face], kFaceUps[face]);
+        face_view_projections_[face] = projection_ * view;
+        face_frusta_[face] = Frustum::fromMatrix(face_view_projections_[face]);
+    }
+}
+
+void ShadowMap::invalidateStatic() {
+    static_dirty_ = true;
+}
+
+bool ShadowMap::isStaticDirty() const {
+    return static_dirty_;
+}
+
+void ShadowMap::update(uint32_t frame, const std::vector<ShadowCaster>& static_casters, const std::vector<ShadowCaster>& dynamic_casters) {
+    render_static_ = static_dirty_;
+    size_t worst_case = kCubeFaceCount * (dynamic_casters.size() + (render_static_ ? static_casters.size() : 0));
+    if (worst_case > matrix_capacity_) {
+        vkDeviceWaitIdle(*device_);
+        for (Buffer& buffer : matrix_buffers_) {
+            buffer.unmap();
+            buffer.destroy();
+        }
+        matrix_capacity_ = worst_case * 2;
+        createFrameResources();
+    }
+
+    glm::mat4* matrices = static_cast<glm::mat4*>(matrix_buffers_[frame].mapped);
+    uint32_t matrix_count = 0;
+    static_batches_.clear();
+    dynamic_batches_.clear();
+    if (render_static_) {
+        cullCasters(static_casters, static_batches_, matrices, matrix_count);
+    }
+    cullCasters(dynamic_casters, dynamic_batches_, matrices, matrix_count);
+
+    // A rebuilt cache has to reach the sampled cube, and so does a cube
+    // freshly emptied of dynamic casters.
+    refresh_sampled_ = render_static_ || has_dynamic_ || !dynamic_batches_.empty();
+    has_dynamic_ = !dynamic_batches_.empty();
+    static_dirty_ = false;
+}
+
+void ShadowMap::cullCasters(const std::vector<ShadowCaster>& casters, std::vector<ShadowBatch>& batches, glm::mat4* matrices, uint32_t& matrix_count) {
+    for (uint32_t face = 0; face < kCubeFaceCount; ++face) {
+        face_casters_.clear();
+        for (uint32_t i = 0; i < casters.size(); ++i) {
+            const glm::vec4& sphere = casters[i].sphere;
+            if (face_frusta_[face].intersectsSphere(glm::vec3(sphere), sphere.w)) {
+                face_casters_.push_back(i);
+            }
+        }
+        // Casters sharing a mesh become one instanced draw.
+        std::sort(face_casters_.begin(), face_casters_.end(), [&casters](uint32_t a, uint32_t b) {
+            return std::less<Model*>()(casters[a].model, casters[b].model);
+        });
+        for (uint32_t index : face_casters_) {
+            const ShadowCaster& caster = casters[index];
+            if (batches.empty() || batches.back().face != face || batches.back().model != caster.model) {
+                batches.push_back({face, caster.model, matrix_count, 0});
+            }
+            matrices[matrix_count++] = caster.transform;
+            ++batches.back().instance_count;
+        }
+    }
+}
+
+void ShadowMap::record(VkCommandBuffer command_buffer, uint32_t frame) {
+    if (!refresh_sampled_) {
+        return;
+    }
+
+    if (render_static_) {
+        drawFaces(command_buffer, frame, static_render_pass_, static_framebuffers_, static_batches_);
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image_;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = kCubeFaceCount;
+    // The previous frame's shading has to be done sampling it.
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkImageCopy region{};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    region.srcSubresource.mipLevel = 0;
+    region.srcSubresource.baseArrayLayer = 0;
+    region.srcSubresource.layerCount = kCubeFaceCount;
+    region.dstSubresource = region.srcSubresource;
+    region.extent = {kShadowMapSize, kShadowMapSize, 1};
+    vkCmdCopyImage(command_buffer, static_image_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // Every face passes through the render pass, empty or not, for the layout change.
+    drawFaces(command_buffer, frame, dynamic_render_pass_, framebuffers_, dynamic_batches_);
+}
+
+void ShadowMap::drawFaces(VkCommandBuffer command_buffer, uint32_t frame, VkRenderPass render_pass,
+                          const std::array<VkFramebuffer, kCubeFaceCount>& framebuffers, const std::vector<ShadowBatch>& batches) {
+    VkClearValue clear_depth{};
+    clear_depth.depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    render_pass_info.renderPass = render_pass;
+    render_pass_info.renderArea.offset = {0, 0};
+    render_pass_info.renderArea.extent = {kShadowMapSize, kShadowMapSize};
+    render_pass_info.clearValueCount = 1;
+    render_pass_info.pClearValues = &clear_depth;
+
+    size_t batch = 0;
+    for (uint32_t face = 0; face < kCubeFaceCount; ++face) {
+        render_pass_info.framebuffer = framebuffers[face];
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+        if (batch < batches.size() && batches[batch].face == face) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_sets_[frame], 0, nullptr);
+            vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &face_view_projections_[face]);
+
+            const Model* bound_model = nullptr;
+            for (; batch < batches.size() && batches[batch].face == face; ++batch) {
+                Model* model = batches[batch].model;
+                if (model != bound_model) {
+                    model->bindPositions(command_buffer);
+                    bound_model = model;
+                }
+                model->draw(command_buffer, batches[batch].instance_count, batches[batch].first_instance);
+            }
+        }
+        vkCmdEndRenderPass(command_buffer);
+    }
+}
+
+VkDescriptorImageInfo ShadowMap::getDescriptor() const {
+    VkDescriptorImageInfo image_info{};
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_info.imageView = cube_view_;
+    image_info.sampler = sampler_;
+    return image_info;
+}
+
+glm::vec2 ShadowMap::getDepthParameters() const {
+    return glm::vec2(projection_[2][2], projection_[3][2]);
+}
+
+uint32_t ShadowMap::getDrawCallCount() const {
+    if (!refresh_sampled_) {
+        return 0;
+    }
+    return static_cast<uint32_t>((render_static_ ? static_batches_.size() : 0) + dynamic_batches_.size());
+}
+
+bool ShadowMap::wasStaticRendered() const {
+    return render_static_;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "main/frustum.h"
+#include "main/model.h"
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <array>
+#include <vector>
+
+// Edge of every cube face in texels.
+constexpr inline uint32_t kShadowMapSize = 1024;
+constexpr inline uint32_t kCubeFaceCount = 6;
+// Shadow casters closer to the light than this are clipped.
+constexpr inline float kShadowNearPlane = 0.5f;
+
+struct ShadowCaster {
+    Model* model;
+    glm::mat4 transform;
+    // World bounding sphere, xyz - center, w - radius.
+    glm::vec4 sphere;
+};
+
+// Instanced draw of one mesh into one cube face.
+struct ShadowBatch {
+    uint32_t face;
+    Model* model;
+    uint32_t first_instance;
+    uint32_t instance_count;
+};
+
+// Omnidirectional shadow map of a point light: a depth cube map rendered with
+// a 90 degree projection per face.
+// Static casters are rendered once into a cached cube and only re-rendered when
+// the light or one of them moves. Frames with dynamic casters in range copy the
+// cache into the sampled cube and draw the dynamic casters on top; frames
+// without them leave the sampled cube untouched.
+// Every face is culled separately on the CPU and drawn in its own render pass
+// with positions only (shadow.vert, no fragment shader).
+class ShadowMap {
+public:
+    // shader_code is the SPIR-V of shadow.vert.
+    void init(VulkanDevice* device, const std::vector<char>& shader_code);
+    void destroy();
+    bool isReady() const;
+
+    // Moving the light or changing its radius invalidates the static cache.
+    void setLight(const glm::vec3& position, float radius);
+    // Must be called when a static caster moves, appears or disappears.
+    void invalidateStatic();
+    // Whether the next update renders the static casters again. Callers may
+    // skip collecting them otherwise.
+    bool isStaticDirty() const;
+
+    // Culls the casters against every face and writes the frame's instance
+    // data. static_casters are ignored unless isStaticDirty().
+    void update(uint32_t frame, const std::vector<ShadowCaster>& static_casters, const std::vector<ShadowCaster>& dynamic_casters);
+    // Must be recorded outside of a render pass, before the draws sampling the map.
+    void record(VkCommandBuffer command_buffer, uint32_t frame);
+
+    // In VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL outside of record().
+    VkDescriptorImageInfo getDescriptor() const;
+    // x - P22, y - P32 of the face projection, to turn distances along the major
+    // axis back into depth: depth = -P22 + P32 / distance.
+    glm::vec2 getDepthParameters() const;
+    // Draws recorded by the last update, and whether it rebuilt the static cache.
+    uint32_t getDrawCallCount() const;
+    bool wasStaticRendered() const;
+
+private:
+    void createRenderPasses();
+    void createPipeline(const std::vector<char>& shader_code);
+    void createImages();
+    void createFrameResources();
+    void cullCasters(const std::vector<ShadowCaster>& casters, std::vector<ShadowBatch>& batches, glm::mat4* matrices, uint32_t& matrix_count);
+    void drawFaces(VkCommandBuffer command_buffer, uint32_t frame, VkRenderPass render_pass,
+                   const std::array<VkFramebuffer, kCubeFaceCount>& framebuffers, const std::vector<ShadowBatch>& batches);
+
+    VulkanDevice* device_ = nullptr;
+    VkRenderPass static_render_pass_ = VK_NULL_HANDLE;
+    VkRenderPass dynamic_render_pass_ = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+
+    // Sampled cube, static casters plus the dynamic ones of the last update.
+    VkImage image_ = VK_NULL_HANDLE;
+    VkDeviceMemory image_memory_ = VK_NULL_HANDLE;
+    VkImageView cube_view_ = VK_NULL_HANDLE;
+    std::array<VkImageView, kCubeFaceCount> face_views_{};
+    std::array<VkFramebuffer, kCubeFaceCount> framebuffers_{};
+    // Static casters only, kept in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL.
+    VkImage static_image_ = VK_NULL_HANDLE;
+    VkDeviceMemory static_image_memory_ = VK_NULL_HANDLE;
+    std::array<VkImageView, kCubeFaceCount> static_face_views_{};
+    std::array<VkFramebuffer, kCubeFaceCount> static_framebuffers_{};
+
+    // Per frame in flight: caster matrices, grouped by face and mesh.
+    std::vector<Buffer> matrix_buffers_;
+    std::vector<VkDescriptorSet> descriptor_sets_;
+    size_t matrix_capacity_ = 0;
+
+    glm::vec3 light_position_ = glm::vec3(0.0f);
+    float light_radius_ = 0.0f;
+    glm::mat4 projection_ = glm::mat4(1.0f);
+    std::array<glm::mat4, kCubeFaceCount> face_view_projections_;
+    std::array<Frustum, kCubeFaceCount> face_frusta_;
+
+    bool static_dirty_ = true;
+    // The sampled cube holds dynamic casters that have to be cleared out.
+    bool has_dynamic_ = false;
+    std::vector<ShadowBatch> static_batches_;
+    std::vector<ShadowBatch> dynamic_batches_;
+    // What the last update asked record() to do.
+    bool render_static_ = false;
+    bool refresh_sampled_ = false;
+    std::vector<uint32_t> face_casters_;
+};
@@ -0,0 +1,331 @@
+#include "main/software_occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KV3D_OCCLUSION_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KV3D_OCCLUSION_SSE2
+#endif
+
+namespace {
+
+// Depth of an empty pixel, the far plane.
+constexpr float kClearDepth = 1.0f;
+
+// Point on the segment from a to b where clip space z crosses 0, the near plane.
+glm::vec4 clipNear(const glm::vec4& a, const glm::vec4& b) {
+    float t = a.z / (a.z - b.z);
+    return a + (b - a) * t;
+}
+
+}
+
+void SoftwareOcclusion::resize(uint32_t width, uint32_t height) {
+    tiles_x_ = std::max((width + kTileSize - 1) / kTileSize, 1u);
+    tiles_y_ = std::max((height + kTileSize - 1) / kTileSize, 1u);
+    width_ = tiles_x_ * kTileSize;
+    height_ = tiles_y_ * kTileSize;
+    depth_.assign(width_ * height_, kClearDepth);
+    tile_max_depth_.assign(tiles_x_ * tiles_y_, kClearDepth);
+}
+
+uint32_t SoftwareOcclusion::getWidth() const {
+    return width_;
+}
+
+uint32_t SoftwareOcclusion::getHeight() const {
+    return height_;
+}
+
+void SoftwareOcclusion::begin(const glm::mat4& view_proj) {
+    view_proj_ = view_proj;
+    triangles_.clear();
+}
+
+void SoftwareOcclusion::addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& model) {
+    glm::mat4 model_view_proj = view_proj_ * model;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        addTriangle(model_view_proj * glm::vec4(positions[indices[i]], 1.0f),
+                    model_view_proj * glm::vec4(positions[indices[i + 1]], 1.0f),
+                    model_view_proj * glm::vec4(positions[indices[i + 2]], 1.0f));
+    }
+}
+
+uint32_t SoftwareOcclusion::getTriangleCount() const {
+    return static_cast<uint32_t>(triangles_.size());
+}
+
+// Clip space triangle, clipped against the near plane before setup. The other
+// planes are handled by clamping to the screen.
+void SoftwareOcclusion::addTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2) {
+    const glm::vec4* v[3] = {&v0, &v1, &v2};
+    for (int axis = 0; axis < 2; ++axis) {
+        if ((v0[axis] > v0.w && v1[axis] > v1.w && v2[axis] > v2.w) ||
+            (v0[axis] < -v0.w && v1[axis] < -v1.w && v2[axis] < -v2.w)) {
+            return;
+        }
+    }
+    if (v0.z > v0.w && v1.z > v1.w && v2.z > v2.w) {
+        return;
+    }
+
+    int inside_count = 0;
+    for (const glm::vec4* vertex : v) {
+        inside_count += vertex->z >= 0.0f ? 1 : 0;
+    }
+    if (inside_count == 0) {
+        return;
+    }
+    if (inside_count == 3) {
+        setupTriangle(v0, v1, v2);
+        return;
+    }
+
+    // One or two vertices behind the near plane leave a triangle or a quad.
+    glm::vec4 polygon[4];
+    int polygon_size = 0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4& a = *v[i];
+        const glm::vec4& b = *v[(i + 1) % 3];
+        if (a.z >= 0.0f) {
+            polygon[polygon_size++] = a;
+        }
+        if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+            polygon[polygon_size++] = clipNear(a, b);
+        }
+    }
+    for (int i = 1; i + 1 < polygon_size; ++i) {
+        setupTriangle(polygon[0], polygon[i], polygon[i + 1]);
+    }
+}
+
+void SoftwareOcclusion::setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2) {
+    // The viewport is flipped, NDC +y is the top row.
+    glm::vec3 s[3];
+    const glm::vec4* v[3] = {&v0, &v1, &v2};
+    for (int i = 0; i < 3; ++i) {
+        glm::vec3 ndc = glm::vec3(*v[i]) / v[i]->w;
+        s[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width_, (0.5f - ndc.y * 0.5f) * height_, ndc.z);
+    }
+
+    Triangle triangle;
+    float min_x = std::min({s[0].x, s[1].x, s[2].x});
+    float max_x = std::max({s[0].x, s[1].x, s[2].x});
+    float min_y = std::min({s[0].y, s[1].y, s[2].y});
+    float max_y = std::max({s[0].y, s[1].y, s[2].y});
+    triangle.min_x = static_cast<int32_t>(std::max(std::floor(min_x), 0.0f));
+    triangle.min_y = static_cast<int32_t>(std::max(std::floor(min_y), 0.0f));
+    triangle.max_x = static_cast<int32_t>(std::min(std::floor(max_x), static_cast<float>(width_ - 1)));
+    triangle.max_y = static_cast<int32_t>(std::min(std::floor(max_y), static_cast<float>(height_ - 1)));
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+        return;
+    }
+
+    // Edge i runs from vertex i to the next one. Both windings are accepted,
+    // occluders like the ground plane are seen from either side.
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3& p = s[i];
+        const glm::vec3& q = s[(i + 1) % 3];
+        triangle.edge_a[i] = p.y - q.y;
+        triangle.edge_b[i] = q.x - p.x;
+        triangle.edge_c[i] = p.x * q.y - p.y * q.x;
+    }
+    float area = triangle.edge_a[0] * s[2].x + triangle.edge_b[0] * s[2].y + triangle.edge_c[0];
+    if (std::abs(area) < 1e-6f) {
+        return;
+    }
+    if (area < 0.0f) {
+        for (int i = 0; i < 3; ++i) {
+            triangle.edge_a[i] = -triangle.edge_a[i];
+            triangle.edge_b[i] = -triangle.edge_b[i];
+            triangle.edge_c[i] = -triangle.edge_c[i];
+        }
+    }
+
+    float dx1 = s[1].x - s[0].x;
+    float dy1 = s[1].y - s[0].y;
+    float dz1 = s[1].z - s[0].z;
+    float dx2 = s[2].x - s[0].x;
+    float dy2 = s[2].y - s[0].y;
+    float dz2 = s[2].z - s[0].z;
+    float det = dx1 * dy2 - dx2 * dy1;
+    triangle.depth_a = (dz1 * dy2 - dz2 * dy1) / det;
+    triangle.depth_b = (dx1 * dz2 - dx2 * dz1) / det;
+    triangle.depth_c = s[0].z - triangle.depth_a * s[0].x - triangle.depth_b * s[0].y
+        + 0.5f * (std::abs(triangle.depth_a) + std::abs(triangle.depth_b));
+    triangle.max_depth = std::max({s[0].z, s[1].z, s[2].z});
+    triangles_.push_back(triangle);
+}
+
+void SoftwareOcclusion::rasterize(JobSystem& jobs) {
+    jobs.parallelFor(tiles_y_, [this](uint32_t tile_row) {
+        rasterizeTileRow(tile_row);
+    });
+}
+
+// Every row of tiles is owned by one task, so no two tasks write the same pixel.
+void SoftwareOcclusion::rasterizeTileRow(uint32_t tile_row) {
+    int32_t first_y = static_cast<int32_t>(tile_row * kTileSize);
+    int32_t last_y = first_y + static_cast<int32_t>(kTileSize) - 1;
+    std::fill(depth_.begin() + first_y * width_, depth_.begin() + (last_y + 1) * width_, kClearDepth);
+
+    for (const Triangle& triangle : triangles_) {
+        if (triangle.max_y < first_y || triangle.min_y > last_y) {
+            continue;
+        }
+        for (int32_t y = std::max(first_y, triangle.min_y); y <= std::min(last_y, triangle.max_y); ++y) {
+            rasterizeSpan(triangle, static_cast<uint32_t>(y), triangle.min_x, triangle.max_x);
+        }
+    }
+
+    for (uint32_t tile_x = 0; tile_x < tiles_x_; ++tile_x) {
+        float max_depth = 0.0f;
+        for (uint32_t y = 0; y < kTileSize; ++y) {
+            const float* row = &depth_[(first_y + y) * width_ + tile_x * kTileSize];
+            max_depth = std::max(max_depth, *std::max_element(row, row + kTileSize));
+        }
+        tile_max_depth_[tile_row * tiles_x_ + tile_x] = max_depth;
+    }
+}
+
+// Keeps the nearer of the buffer and the triangle on every pixel of row y
+// whose center the triangle covers. Rows are whole tiles wide, so the span can
+// start at a vector boundary without running past the row.
+void SoftwareOcclusion::rasterizeSpan(const Triangle& triangle, uint32_t y, int32_t first_x, int32_t last_x) {
+    float* row = &depth_[y * width_];
+    float center_y = static_cast<float>(y) + 0.5f;
+    float edge_row[3];
+    for (int i = 0; i < 3; ++i) {
+        edge_row[i] = triangle.edge_b[i] * center_y + triangle.edge_c[i];
+    }
+    float depth_row = triangle.depth_b * center_y + triangle.depth_c;
+
+#if defined(KV3D_OCCLUSION_AVX2)
+    const __m256 lane_offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 max_depth = _mm256_set1_ps(triangle.max_depth);
+    for (int32_t x = first_x & ~7; x <= last_x; x += 8) {
+        __m256 center_x = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane_offsets);
+        __m256 covered = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int i = 0; i < 3; ++i) {
+            __m256 edge = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.edge_a[i]), center_x), _mm256_set1_ps(edge_row[i]));
+            covered = _mm256_and_ps(covered, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+        }
+        if (_mm256_movemask_ps(covered) == 0) {
+            continue;
+        }
+        __m256 depth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.depth_a), center_x), _mm256_set1_ps(depth_row));
+        depth = _mm256_min_ps(depth, max_depth);
+        __m256 current = _mm256_loadu_ps(row + x);
+        _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, depth), covered));
+    }
+#elif defined(KV3D_OCCLUSION_SSE2)
+    const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 max_depth = _mm_set1_ps(triangle.max_depth);
+    for (int32_t x = first_x & ~3; x <= last_x; x += 4) {
+        __m128 center_x = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lane_offsets);
+        __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int i = 0; i < 3; ++i) {
+            __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edge_a[i]), center_x), _mm_set1_ps(edge_row[i]));
+            covered = _mm_and_ps(covered, _mm_cmpge_ps(edge, zero));
+        }
+        if (_mm_movemask_ps(covered) == 0) {
+            continue;
+        }
+        __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depth_a), center_x), _mm_set1_ps(depth_row));
+        depth = _mm_min_ps(depth, max_depth);
+        __m128 current = _mm_loadu_ps(row + x);
+        __m128 nearer = _mm_min_ps(current, depth);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, nearer), _mm_andnot_ps(covered, current)));
+    }
+#else
+    for (int32_t x = first_x; x <= last_x; ++x) {
+        float center_x = static_cast<float>(x) + 0.5f;
+        bool covered = true;
+        for (int i = 0; i < 3; ++i) {
+            covered = covered && triangle.edge_a[i] * center_x + edge_row[i] >= 0.0f;
+        }
+        if (covered) {
+            float depth = std::min(triangle.depth_a * center_x + depth_row, triangle.max_depth);
+            row[x] = std::min(row[x], depth);
+        }
+    }
+#endif
+}
+
+bool SoftwareOcclusion::isVisible(const BoundingBox& box) const {
+    glm::vec2 min_ndc(1.0f);
+    glm::vec2 max_ndc(-1.0f);
+    float nearest = kClearDepth;
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = view_proj_ * glm::vec4(corner, 1.0f);
+        // Boxes crossing the near plane are too close to be hidden.
+        if (clip.z < 0.0f || clip.w <= 0.0f) {
+            return true;
+        }
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        min_ndc = glm::min(min_ndc, glm::vec2(ndc.x, ndc.y));
+        max_ndc = glm::max(max_ndc, glm::vec2(ndc.x, ndc.y));
+        nearest = std::min(nearest, ndc.z);
+    }
+
+    int32_t first_x = std::max(static_cast<int32_t>(std::floor((min_ndc.x * 0.5f + 0.5f) * width_)), 0);
+    int32_t last_x = std::min(static_cast<int32_t>(std::floor((max_ndc.x * 0.5f + 0.5f) * width_)), static_cast<int32_t>(width_) - 1);
+    int32_t first_y = std::max(static_cast<int32_t>(std::floor((0.5f - max_ndc.y * 0.5f) * height_)), 0);
+    int32_t last_y = std::min(static_cast<int32_t>(std::floor((0.5f - min_ndc.y * 0.5f) * height_)), static_cast<int32_t>(height_) - 1);
+    if (first_x > last_x || first_y > last_y) {
+        return false;
+    }
+
+    for (int32_t tile_y = first_y / kTileSize; tile_y <= last_y / static_cast<int32_t>(kTileSize); ++tile_y) {
+        for (int32_t tile_x = first_x / kTileSize; tile_x <= last_x / static_cast<int32_t>(kTileSize); ++tile_x) {
+            // Every occluder in the tile is nearer than the box.
+            if (tile_max_depth_[tile_y * tiles_x_ + tile_x] < nearest) {
+                continue;
+            }
+            int32_t y_end = std::min(last_y, tile_y * static_cast<int32_t>(kTileSize) + static_cast<int32_t>(kTileSize) - 1);
+            int32_t x_end = std::min(last_x, tile_x * static_cast<int32_t>(kTileSize) + static_cast<int32_t>(kTileSize) - 1);
+            for (int32_t y = std::max(first_y, tile_y * static_cast<int32_t>(kTileSize)); y <= y_end; ++y) {
+                for (int32_t x = std::max(first_x, tile_x * static_cast<int32_t>(kTileSize)); x <= x_end; ++x) {
+                    if (depth_[y * width_ + x] >= nearest) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void SoftwareOcclusion::writeDebugImage(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path + "!");
+    }
+
+    // Projected depth bunches up near 1, stretch the covered range over the gray levels.
+    float min_depth = kClearDepth;
+    float max_depth = 0.0f;
+    for (float depth : depth_) {
+        if (depth < kClearDepth) {
+            min_depth = std::min(min_depth, depth);
+            max_depth = std::max(max_depth, depth);
+        }
+    }
+    float range = std::max(max_depth - min_depth, 1e-6f);
+
+    std::vector<uint8_t> pixels(depth_.size());
+    for (size_t i = 0; i < depth_.size(); ++i) {
+        pixels[i] = depth_[i] < kClearDepth ? static_cast<uint8_t>(255.0f - 223.0f * (depth_[i] - min_depth) / range) : 0;
+    }
+    file << "P5\n" << width_ << " " << height_ << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "main/bounds.h"
+#include "main/job_system.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU occlusion culling for when culling on the GPU is not available. Large
+// occluder meshes are rasterized into a small depth buffer, then object boxes
+// are tested against it. Rasterization runs 8 pixels per instruction (AVX2),
+// 4 (SSE2) or scalar, spread over rows of 8x8 tiles on the job system.
+//
+// The buffer keeps the nearest occluder depth per pixel. A pixel is covered by
+// a triangle when its center is, and takes the triangle's farthest depth over
+// the pixel, so depths are never closer than the occluder really is.
+// Every tile also keeps its farthest depth, which rejects most box tests
+// without touching the pixels.
+class SoftwareOcclusion {
+public:
+    static constexpr uint32_t kTileSize = 8;
+
+    // Rounds the size up to whole tiles.
+    void resize(uint32_t width, uint32_t height);
+    uint32_t getWidth() const;
+    uint32_t getHeight() const;
+
+    // Starts a frame, dropping the queued occluders. rasterize clears the buffer.
+    void begin(const glm::mat4& view_proj);
+    // Queues the triangles of a mesh, positions in model space.
+    void addOccluder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& model);
+    void rasterize(JobSystem& jobs);
+    // Whether any part of a world space box in front of the occluders is on
+    // screen. Thread safe once rasterize returns.
+    bool isVisible(const BoundingBox& box) const;
+
+    uint32_t getTriangleCount() const;
+    // Writes the buffer as a binary PGM, near occluders bright, empty pixels black.
+    void writeDebugImage(const std::string& path) const;
+
+private:
+    // Screen space triangle. Edge functions are positive inside, depth is a
+    // plane in screen space since z/w is linear there.
+    struct Triangle {
+        float edge_a[3];
+        float edge_b[3];
+        float edge_c[3];
+        float depth_a;
+        float depth_b;
+        // Depth at the pixel origin plus the slope across half a pixel.
+        float depth_c;
+        float max_depth;
+        int32_t min_x;
+        int32_t min_y;
+        int32_t max_x;
+        int32_t max_y;
+    };
+
+    void addTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+    void setupTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+    void rasterizeTileRow(uint32_t tile_row);
+    void rasterizeSpan(const Triangle& triangle, uint32_t y, int32_t first_x, int32_t last_x);
+
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t tiles_x_ = 0;
+    uint32_t tiles_y_ = 0;
+    glm::mat4 view_proj_ = glm::mat4(1.0f);
+    std::vector<float> depth_;
+    std::vector<float> tile_max_depth_;
+    std::vector<Triangle> triangles_;
+};
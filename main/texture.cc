@@ -1,5 +1,7 @@
 #include "main/texture.h"
 
+#include "main/cpu_profiler.h"
+#include "main/upload_batch.h"
 #include "main/vulkan_buffer.h"
 #include "main/vulkan_device.h"
 #define STB_IMAGE_IMPLEMENTATION
@@ -10,6 +12,15 @@
 
 
 std::unique_ptr<Texture> Texture::createFromFile(const std::string &file, VulkanDevice* device) {
+    PROFILE_SCOPE("Texture::createFromFile");
+    UploadBatch batch(device);
+    std::unique_ptr<Texture> texture = create(loadPixels(file), device, batch);
+    batch.submit();
+    return texture;
+}
+
+TextureData Texture::loadPixels(const std::string& file) {
+    PROFILE_SCOPE("Texture::loadPixels");
     int tex_width, tex_height, tex_channels;
     stbi_uc* pixels = stbi_load(file.c_str(), &tex_width, &tex_height, &tex_channels, STBI_rgb_alpha);
 
@@ -17,25 +28,18 @@ std::unique_ptr<Texture> Texture::createFromFile(const std::string &file, Vulkan
         throw std::runtime_error("Failed to load texture image!");
     }
 
-    Buffer staging_buffer;
-    staging_buffer.size = tex_width * tex_height * 4;
-    staging_buffer.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    staging_buffer.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    staging_buffer.device = *device;
-    device->createBuffer(staging_buffer);
-
-    void* data;
-    staging_buffer.map();
-    staging_buffer.copyTo(pixels, staging_buffer.size);
-    staging_buffer.unmap();
+    TextureData data;
+    data.width = static_cast<uint32_t>(tex_width);
+    data.height = static_cast<uint32_t>(tex_height);
+    data.pixels.assign(pixels, pixels + static_cast<size_t>(tex_width) * tex_height * 4);
     stbi_image_free(pixels);
+    return data;
+}
 
+std::unique_ptr<Texture> Texture::create(const TextureData& data, VulkanDevice* device, UploadBatch& batch) {
     auto texture = std::unique_ptr<Texture>(new Texture(*device));
-    texture->initImage(device, tex_width, tex_height, staging_buffer);
+    texture->initImage(device, data, batch);
     texture->initSampler(device);
-    
-    staging_buffer.destroy();
-
     return texture;
 }
 
@@ -48,13 +52,9 @@ Texture::~Texture() {
 
 Texture::Texture(VkDevice device) : device_(device) {}
 
-void Texture::initImage(VulkanDevice* device, uint32_t width, uint32_t height, Buffer& staging_buffer) {
-    device->createImage(width, height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image_, texture_image_memory_);
-    VkCommandBuffer command_buffer = device->beginCommandBuffer();
-    transitionImageLayoutCmd(command_buffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImageCmd(command_buffer, width, height, staging_buffer);
-    transitionImageLayoutCmd(command_buffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    device->submitCommandBuffer(command_buffer, device->getGraphicsQueue());
+void Texture::initImage(VulkanDevice* device, const TextureData& data, UploadBatch& batch) {
+    device->createImage(data.width, data.height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture_image_, texture_image_memory_);
+    batch.uploadImage(texture_image_, data.width, data.height, data.pixels.data());
 
     VkImageViewCreateInfo view_info{};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -95,44 +95,6 @@ void Texture::initSampler(VulkanDevice* device) {
     descriptor_.sampler = sampler_;
 }
 
-void Texture::transitionImageLayoutCmd(VkCommandBuffer command_buffer, VkImageLayout old_layout, VkImageLayout new_layout) {
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = old_layout;
-    barrier.newLayout = new_layout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = texture_image_;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = 0;
-    VkPipelineStageFlags source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    vkCmdPipelineBarrier(command_buffer, source_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-}
-
-void Texture::copyBufferToImageCmd(VkCommandBuffer command_buffer, uint32_t width, uint32_t height, Buffer& staging_buffer) {
-    VkBufferImageCopy region{};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {
-        width, height, 1
-    };
-    vkCmdCopyBufferToImage(command_buffer, staging_buffer.buffer, texture_image_, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-}
-
 VkDescriptorImageInfo* Texture::getDescriptor() {
     return &descriptor_;
 }
\ No newline at end of file
@@ -3,24 +3,37 @@
 #include "main/vulkan_buffer.h"
 #include "vulkan/vulkan.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
+class UploadBatch;
 class VulkanDevice;
 
+// Decoded RGBA8 pixels of an image file. Decoding touches no Vulkan objects,
+// so images can be decoded in parallel.
+struct TextureData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
 class Texture {
 public:
     static std::unique_ptr<Texture> createFromFile(const std::string& file, VulkanDevice* device);
+    static TextureData loadPixels(const std::string& file);
+    // Records the upload of the pixels into batch, the texture can be sampled
+    // once the batch has been submitted.
+    static std::unique_ptr<Texture> create(const TextureData& data, VulkanDevice* device, UploadBatch& batch);
     ~Texture();
 
     VkDescriptorImageInfo* getDescriptor();
 
 private:
     Texture(VkDevice device);
-    void initImage(VulkanDevice* device, uint32_t width, uint32_t height, Buffer& staging_buffer);
+    void initImage(VulkanDevice* device, const TextureData& data, UploadBatch& batch);
     void initSampler(VulkanDevice* device);
-    void transitionImageLayoutCmd(VkCommandBuffer command_buffer, VkImageLayout old_layout, VkImageLayout new_layout);
-    void copyBufferToImageCmd(VkCommandBuffer command_buffer, uint32_t width, uint32_t height, Buffer& staging_buffer);
 
     VkImage texture_image_;
     VkDeviceMemory texture_image_memory_;
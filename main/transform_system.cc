@@ -0,0 +1,354 @@
+#include "main/transform_system.h"
+
+#include "main/cpu_profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KV3D_TRANSFORM_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define KV3D_TRANSFORM_SSE2
+#endif
+
+namespace {
+
+constexpr size_t kBatchSize = 8;
+// Smaller updates are not worth waking the workers for.
+constexpr size_t kParallelNodeCount = 4096;
+// Batches per job range, 1024 nodes.
+constexpr uint32_t kParallelGrain = 128;
+
+// Rows of the batch input, one lane per node.
+enum InputRow { kQx, kQy, kQz, kQw, kSx, kSy, kSz, kInputRowCount };
+// The upper 3x3 of the local matrices, column major, one lane per node.
+constexpr size_t kBasisRowCount = 9;
+
+// Rotation matrix of the quaternion, as glm::mat4_cast, with its columns
+// multiplied by the scale.
+void composeBasis(const float in[kInputRowCount][kBatchSize], float out[kBasisRowCount][kBatchSize]) {
+#if defined(KV3D_TRANSFORM_AVX2)
+    const __m256 one = _mm256_set1_ps(1.0f);
+    __m256 x = _mm256_load_ps(in[kQx]);
+    __m256 y = _mm256_load_ps(in[kQy]);
+    __m256 z = _mm256_load_ps(in[kQz]);
+    __m256 w = _mm256_load_ps(in[kQw]);
+    __m256 x2 = _mm256_add_ps(x, x);
+    __m256 y2 = _mm256_add_ps(y, y);
+    __m256 z2 = _mm256_add_ps(z, z);
+    __m256 xx = _mm256_mul_ps(x, x2);
+    __m256 yy = _mm256_mul_ps(y, y2);
+    __m256 zz = _mm256_mul_ps(z, z2);
+    __m256 xy = _mm256_mul_ps(x, y2);
+    __m256 xz = _mm256_mul_ps(x, z2);
+    __m256 yz = _mm256_mul_ps(y, z2);
+    __m256 wx = _mm256_mul_ps(w, x2);
+    __m256 wy = _mm256_mul_ps(w, y2);
+    __m256 wz = _mm256_mul_ps(w, z2);
+    __m256 sx = _mm256_load_ps(in[kSx]);
+    __m256 sy = _mm256_load_ps(in[kSy]);
+    __m256 sz = _mm256_load_ps(in[kSz]);
+
+    _mm256_store_ps(out[0], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx));
+    _mm256_store_ps(out[1], _mm256_mul_ps(_mm256_add_ps(xy, wz), sx));
+    _mm256_store_ps(out[2], _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx));
+    _mm256_store_ps(out[3], _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy));
+    _mm256_store_ps(out[4], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy));
+    _mm256_store_ps(out[5], _mm256_mul_ps(_mm256_add_ps(yz, wx), sy));
+    _mm256_store_ps(out[6], _mm256_mul_ps(_mm256_add_ps(xz, wy), sz));
+    _mm256_store_ps(out[7], _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz));
+    _mm256_store_ps(out[8], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz));
+#elif defined(KV3D_TRANSFORM_SSE2)
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (size_t lane = 0; lane < kBatchSize; lane += 4) {
+        __m128 x = _mm_load_ps(&in[kQx][lane]);
+        __m128 y = _mm_load_ps(&in[kQy][lane]);
+        __m128 z = _mm_load_ps(&in[kQz][lane]);
+        __m128 w = _mm_load_ps(&in[kQw][lane]);
+        __m128 x2 = _mm_add_ps(x, x);
+        __m128 y2 = _mm_add_ps(y, y);
+        __m128 z2 = _mm_add_ps(z, z);
+        __m128 xx = _mm_mul_ps(x, x2);
+        __m128 yy = _mm_mul_ps(y, y2);
+        __m128 zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2);
+        __m128 xz = _mm_mul_ps(x, z2);
+        __m128 yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2);
+        __m128 wy = _mm_mul_ps(w, y2);
+        __m128 wz = _mm_mul_ps(w, z2);
+        __m128 sx = _mm_load_ps(&in[kSx][lane]);
+        __m128 sy = _mm_load_ps(&in[kSy][lane]);
+        __m128 sz = _mm_load_ps(&in[kSz][lane]);
+
+        _mm_store_ps(&out[0][lane], _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx));
+        _mm_store_ps(&out[1][lane], _mm_mul_ps(_mm_add_ps(xy, wz), sx));
+        _mm_store_ps(&out[2][lane], _mm_mul_ps(_mm_sub_ps(xz, wy), sx));
+        _mm_store_ps(&out[3][lane], _mm_mul_ps(_mm_sub_ps(xy, wz), sy));
+        _mm_store_ps(&out[4][lane], _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy));
+        _mm_store_ps(&out[5][lane], _mm_mul_ps(_mm_add_ps(yz, wx), sy));
+        _mm_store_ps(&out[6][lane], _mm_mul_ps(_mm_add_ps(xz, wy), sz));
+        _mm_store_ps(&out[7][lane], _mm_mul_ps(_mm_sub_ps(yz, wx), sz));
+        _mm_store_ps(&out[8][lane], _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz));
+    }
+#else
+    for (size_t lane = 0; lane < kBatchSize; ++lane) {
+        float x = in[kQx][lane];
+        float y = in[kQy][lane];
+        float z = in[kQz][lane];
+        float w = in[kQw][lane];
+        float xx = 2.0f * x * x;
+        float yy = 2.0f * y * y;
+        float zz = 2.0f * z * z;
+        float xy = 2.0f * x * y;
+        float xz = 2.0f * x * z;
+        float yz = 2.0f * y * z;
+        float wx = 2.0f * w * x;
+        float wy = 2.0f * w * y;
+        float wz = 2.0f * w * z;
+        float sx = in[kSx][lane];
+        float sy = in[kSy][lane];
+        float sz = in[kSz][lane];
+
+        out[0][lane] = (1.0f - (yy + zz)) * sx;
+        out[1][lane] = (xy + wz) * sx;
+        out[2][lane] = (xz - wy) * sx;
+        out[3][lane] = (xy - wz) * sy;
+        out[4][lane] = (1.0f - (xx + zz)) * sy;
+        out[5][lane] = (yz + wx) * sy;
+        out[6][lane] = (xz + wy) * sz;
+        out[7][lane] = (yz - wx) * sz;
+        out[8][lane] = (1.0f - (xx + yy)) * sz;
+    }
+#endif
+}
+
+}  // namespace
+
+uint32_t TransformSystem::create(const glm::vec3& translation) {
+    uint32_t node = static_cast<uint32_t>(parents_.size());
+    translation_x_.push_back(translation.x);
+    translation_y_.push_back(translation.y);
+    translation_z_.push_back(translation.z);
+    rotation_x_.push_back(0.0f);
+    rotation_y_.push_back(0.0f);
+    rotation_z_.push_back(0.0f);
+    rotation_w_.push_back(1.0f);
+    scale_x_.push_back(1.0f);
+    scale_y_.push_back(1.0f);
+    scale_z_.push_back(1.0f);
+    parents_.push_back(kNoParent);
+    local_matrices_.push_back(glm::mat4(1.0f));
+    world_matrices_.push_back(glm::mat4(1.0f));
+    local_dirty_.push_back(0);
+    world_dirty_.push_back(0);
+    order_dirty_ = true;
+    markDirty(node);
+    return node;
+}
+
+void TransformSystem::reset(uint32_t node, const glm::vec3& translation) {
+    if (child_count_ > 0) {
+        for (uint32_t child = 0; child < parents_.size(); ++child) {
+            if (parents_[child] == node) {
+                setParent(child, kNoParent);
+            }
+        }
+        setParent(node, kNoParent);
+    }
+    setTranslation(node, translation);
+    setRotation(node, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    setScale(node, glm::vec3(1.0f));
+}
+
+void TransformSystem::clear() {
+    for (std::vector<float>* values : {&translation_x_, &translation_y_, &translation_z_,
+                                       &rotation_x_, &rotation_y_, &rotation_z_, &rotation_w_,
+                                       &scale_x_, &scale_y_, &scale_z_}) {
+        values->clear();
+    }
+    parents_.clear();
+    local_matrices_.clear();
+    world_matrices_.clear();
+    local_dirty_.clear();
+    local_dirty_nodes_.clear();
+    child_count_ = 0;
+    order_.clear();
+    order_dirty_ = false;
+    world_dirty_.clear();
+    updated_nodes_.clear();
+}
+
+size_t TransformSystem::size() const {
+    return parents_.size();
+}
+
+void TransformSystem::markDirty(uint32_t node) {
+    if (!local_dirty_[node]) {
+        local_dirty_[node] = 1;
+        local_dirty_nodes_.push_back(node);
+    }
+}
+
+void TransformSystem::setTranslation(uint32_t node, const glm::vec3& translation) {
+    translation_x_[node] = translation.x;
+    translation_y_[node] = translation.y;
+    translation_z_[node] = translation.z;
+    markDirty(node);
+}
+
+void TransformSystem::setRotation(uint32_t node, const glm::quat& rotation) {
+    rotation_x_[node] = rotation.x;
+    rotation_y_[node] = rotation.y;
+    rotation_z_[node] = rotation.z;
+    rotation_w_[node] = rotation.w;
+    markDirty(node);
+}
+
+void TransformSystem::setScale(uint32_t node, const glm::vec3& scale) {
+    scale_x_[node] = scale.x;
+    scale_y_[node] = scale.y;
+    scale_z_[node] = scale.z;
+    markDirty(node);
+}
+
+glm::vec3 TransformSystem::getTranslation(uint32_t node) const {
+    return glm::vec3(translation_x_[node], translation_y_[node], translation_z_[node]);
+}
+
+void TransformSystem::setParent(uint32_t node, uint32_t parent) {
+    if (parents_[node] == parent) {
+        return;
+    }
+    for (uint32_t ancestor = parent; ancestor != kNoParent; ancestor = parents_[ancestor]) {
+        if (ancestor == node) {
+            throw std::runtime_error("Failed to set the parent, it would form a cycle!");
+        }
+    }
+
+    child_count_ += (parent != kNoParent) - (parents_[node] != kNoParent);
+    parents_[node] = parent;
+    order_dirty_ = true;
+    markDirty(node);
+}
+
+uint32_t TransformSystem::getParent(uint32_t node) const {
+    return parents_[node];
+}
+
+const glm::mat4& TransformSystem::getWorldMatrix(uint32_t node) const {
+    return world_matrices_[node];
+}
+
+void TransformSystem::rebuildOrder() {
+    std::vector<uint32_t> depths(parents_.size());
+    uint32_t max_depth = 0;
+    for (uint32_t node = 0; node < parents_.size(); ++node) {
+        uint32_t depth = 0;
+        for (uint32_t ancestor = parents_[node]; ancestor != kNoParent; ancestor = parents_[ancestor]) {
+            ++depth;
+        }
+        depths[node] = depth;
+        max_depth = std::max(max_depth, depth);
+    }
+
+    // Counting sort, keeping the node order within a level.
+    std::vector<uint32_t> offsets(max_depth + 2, 0);
+    for (uint32_t depth : depths) {
+        ++offsets[depth + 1];
+    }
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    order_.resize(parents_.size());
+    for (uint32_t node = 0; node < parents_.size(); ++node) {
+        order_[offsets[depths[node]]++] = node;
+    }
+    order_dirty_ = false;
+}
+
+// Gathers the rotation and scale of up to kBatchSize dirty nodes into one
+// batch, builds their bases together and scatters the matrices back.
+void TransformSystem::composeLocalMatrices(size_t first, size_t last) {
+    alignas(32) float in[kInputRowCount][kBatchSize];
+    alignas(32) float out[kBasisRowCount][kBatchSize];
+    for (size_t begin = first; begin < last; begin += kBatchSize) {
+        size_t count = std::min(kBatchSize, last - begin);
+        for (size_t lane = 0; lane < kBatchSize; ++lane) {
+            // Unused lanes repeat the last node.
+            uint32_t node = local_dirty_nodes_[begin + std::min(lane, count - 1)];
+            in[kQx][lane] = rotation_x_[node];
+            in[kQy][lane] = rotation_y_[node];
+            in[kQz][lane] = rotation_z_[node];
+            in[kQw][lane] = rotation_w_[node];
+            in[kSx][lane] = scale_x_[node];
+            in[kSy][lane] = scale_y_[node];
+            in[kSz][lane] = scale_z_[node];
+        }
+
+        composeBasis(in, out);
+
+        for (size_t lane = 0; lane < count; ++lane) {
+            uint32_t node = local_dirty_nodes_[begin + lane];
+            glm::mat4& m = local_matrices_[node];
+            m[0] = glm::vec4(out[0][lane], out[1][lane], out[2][lane], 0.0f);
+            m[1] = glm::vec4(out[3][lane], out[4][lane], out[5][lane], 0.0f);
+            m[2] = glm::vec4(out[6][lane], out[7][lane], out[8][lane], 0.0f);
+            m[3] = glm::vec4(translation_x_[node], translation_y_[node], translation_z_[node], 1.0f);
+        }
+    }
+}
+
+const std::vector<uint32_t>& TransformSystem::update(JobSystem* jobs) {
+    updated_nodes_.clear();
+    if (local_dirty_nodes_.empty()) {
+        return updated_nodes_;
+    }
+    PROFILE_SCOPE("TransformSystem::update");
+    size_t dirty_count = local_dirty_nodes_.size();
+    if (jobs && dirty_count >= kParallelNodeCount) {
+        // Ranges of whole batches, every node is written by one range.
+        uint32_t batch_count = static_cast<uint32_t>((dirty_count + kBatchSize - 1) / kBatchSize);
+        jobs->parallelFor(batch_count, kParallelGrain, [this, dirty_count](uint32_t begin, uint32_t end) {
+            composeLocalMatrices(begin * kBatchSize, std::min(dirty_count, end * kBatchSize));
+        });
+    } else {
+        composeLocalMatrices(0, dirty_count);
+    }
+
+    if (child_count_ == 0) {
+        for (uint32_t node : local_dirty_nodes_) {
+            world_matrices_[node] = local_matrices_[node];
+            local_dirty_[node] = 0;
+        }
+        updated_nodes_.swap(local_dirty_nodes_);
+        return updated_nodes_;
+    }
+
+    // A node is dirty when its own transform or any ancestor's changed; in
+    // depth order the parent's flag is final before its children are reached.
+    if (order_dirty_) {
+        rebuildOrder();
+    }
+    for (uint32_t node : order_) {
+        uint32_t parent = parents_[node];
+        bool dirty = local_dirty_[node] || (parent != kNoParent && world_dirty_[parent]);
+        world_dirty_[node] = dirty;
+        if (!dirty) {
+            continue;
+        }
+        world_matrices_[node] = parent == kNoParent ? local_matrices_[node] : world_matrices_[parent] * local_matrices_[node];
+        updated_nodes_.push_back(node);
+    }
+
+    for (uint32_t node : local_dirty_nodes_) {
+        local_dirty_[node] = 0;
+    }
+    local_dirty_nodes_.clear();
+    for (uint32_t node : updated_nodes_) {
+        world_dirty_[node] = 0;
+    }
+    return updated_nodes_;
+}
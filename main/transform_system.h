@@ -0,0 +1,78 @@
+#pragma once
+
+#include "main/job_system.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+constexpr inline uint32_t kNoParent = ~0u;
+
+// Node transforms of a parent/child hierarchy. The local translation, rotation
+// and scale are kept as a structure of arrays so the local matrices of the
+// changed nodes are built 8 (AVX2) or 4 (SSE2) at a time; builds without
+// either fall back to a scalar loop. A node's world matrix is its parent's
+// world matrix times its local matrix.
+//
+// Setters only mark the node dirty, update() then recomputes the dirty nodes
+// and their descendants, parents before children. Without changes update()
+// returns right away, a static hierarchy costs nothing per frame.
+class TransformSystem {
+public:
+    // Returns the index of the new node, a root with identity rotation and scale.
+    uint32_t create(const glm::vec3& translation);
+    // Makes node a root at translation with identity rotation and scale, for
+    // reuse. Its children become roots, keeping their local transforms.
+    void reset(uint32_t node, const glm::vec3& translation);
+    void clear();
+    size_t size() const;
+
+    void setTranslation(uint32_t node, const glm::vec3& translation);
+    void setRotation(uint32_t node, const glm::quat& rotation);
+    void setScale(uint32_t node, const glm::vec3& scale);
+    glm::vec3 getTranslation(uint32_t node) const;
+    // Makes the local transform of node relative to parent, kNoParent makes it
+    // a root. Throws if parent is node itself or one of its descendants.
+    void setParent(uint32_t node, uint32_t parent);
+    uint32_t getParent(uint32_t node) const;
+
+    // Recomputes the world matrices of the dirty nodes and their descendants
+    // and returns those nodes, parents before children. The list is valid
+    // until the next update. Large updates build the local matrices on jobs.
+    const std::vector<uint32_t>& update(JobSystem* jobs = nullptr);
+    // As of the last update.
+    const glm::mat4& getWorldMatrix(uint32_t node) const;
+
+private:
+    void markDirty(uint32_t node);
+    // Sorts the nodes by depth, which puts every parent before its children.
+    void rebuildOrder();
+    // Builds the local matrices of local_dirty_nodes_[first, last).
+    void composeLocalMatrices(size_t first, size_t last);
+
+    std::vector<float> translation_x_;
+    std::vector<float> translation_y_;
+    std::vector<float> translation_z_;
+    std::vector<float> rotation_x_;
+    std::vector<float> rotation_y_;
+    std::vector<float> rotation_z_;
+    std::vector<float> rotation_w_;
+    std::vector<float> scale_x_;
+    std::vector<float> scale_y_;
+    std::vector<float> scale_z_;
+    std::vector<uint32_t> parents_;
+    std::vector<glm::mat4> local_matrices_;
+    std::vector<glm::mat4> world_matrices_;
+
+    // Nodes whose local transform changed since the last update, each once.
+    std::vector<uint8_t> local_dirty_;
+    std::vector<uint32_t> local_dirty_nodes_;
+    // Flat hierarchies skip the propagation pass over order_.
+    uint32_t child_count_ = 0;
+    std::vector<uint32_t> order_;
+    bool order_dirty_ = false;
+    std::vector<uint8_t> world_dirty_;
+    std::vector<uint32_t> updated_nodes_;
+};
@@ -0,0 +1,133 @@
+#include "main/upload_batch.h"
+
+#include "main/cpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Covers the offset alignment of buffer copies and of 4-byte texel copies.
+constexpr VkDeviceSize kStagingAlignment = 16;
+
+}  // namespace
+
+UploadBatch::UploadBatch(VulkanDevice* device) : device_(device) {}
+
+UploadBatch::~UploadBatch() {
+    if (command_buffer_ != VK_NULL_HANDLE) {
+        vkEndCommandBuffer(command_buffer_);
+        vkFreeCommandBuffers(*device_, device_->getCommandPool(), 1, &command_buffer_);
+    }
+    freeStaging();
+}
+
+VkDeviceSize UploadBatch::allocate(VkDeviceSize size, VkBuffer& buffer, void*& mapped) {
+    VkDeviceSize offset = (chunk_offset_ + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment;
+    if (staging_buffers_.empty() || offset + size > staging_buffers_.back().size) {
+        Buffer staging;
+        staging.size = std::max(size, kStagingChunkSize);
+        staging.property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        staging.usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        staging.device = *device_;
+        device_->createBuffer(staging);
+        staging.map();
+        staging_buffers_.push_back(staging);
+        offset = 0;
+    }
+
+    Buffer& staging = staging_buffers_.back();
+    chunk_offset_ = offset + size;
+    uploaded_bytes_ += size;
+    buffer = staging.buffer;
+    mapped = static_cast<char*>(staging.mapped) + offset;
+    return offset;
+}
+
+VkCommandBuffer UploadBatch::getCommandBuffer() {
+    if (command_buffer_ == VK_NULL_HANDLE) {
+        command_buffer_ = device_->beginCommandBuffer();
+    }
+    return command_buffer_;
+}
+
+void UploadBatch::uploadBuffer(VkBuffer buffer, const void* data, VkDeviceSize size, VkDeviceSize offset) {
+    if (size == 0) {
+        return;
+    }
+    VkBuffer staging;
+    void* mapped;
+    VkDeviceSize staging_offset = allocate(size, staging, mapped);
+    std::memcpy(mapped, data, size);
+
+    VkBufferCopy copy_region{};
+    copy_region.srcOffset = staging_offset;
+    copy_region.dstOffset = offset;
+    copy_region.size = size;
+    vkCmdCopyBuffer(getCommandBuffer(), staging, buffer, 1, &copy_region);
+}
+
+void UploadBatch::uploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels) {
+    VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+    VkBuffer staging;
+    void* mapped;
+    VkDeviceSize staging_offset = allocate(size, staging, mapped);
+    std::memcpy(mapped, pixels, size);
+    VkCommandBuffer command_buffer = getCommandBuffer();
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = staging_offset;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {width, height, 1};
+    vkCmdCopyBufferToImage(command_buffer, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void UploadBatch::submit() {
+    if (command_buffer_ != VK_NULL_HANDLE) {
+        PROFILE_SCOPE("UploadBatch::submit");
+        device_->submitCommandBuffer(command_buffer_, device_->getGraphicsQueue());
+        command_buffer_ = VK_NULL_HANDLE;
+    }
+    freeStaging();
+}
+
+VkDeviceSize UploadBatch::getUploadedBytes() const {
+    return uploaded_bytes_;
+}
+
+void UploadBatch::freeStaging() {
+    for (Buffer& staging : staging_buffers_) {
+        staging.unmap();
+        staging.destroy();
+    }
+    staging_buffers_.clear();
+    chunk_offset_ = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "main/vulkan_buffer.h"
+#include "main/vulkan_device.h"
+
+#include <vector>
+
+// Staging memory is allocated in chunks of this size, larger uploads get a
+// buffer of their own.
+constexpr inline VkDeviceSize kStagingChunkSize = 64ull << 20;
+
+// Collects the copies of many buffer and image uploads into one command
+// buffer, submitted and waited for once. Loading assets one submit each
+// stalls on the queue for every mesh and texture.
+class UploadBatch {
+public:
+    explicit UploadBatch(VulkanDevice* device);
+    // Frees the staging memory, copies recorded since the last submit are
+    // dropped.
+    ~UploadBatch();
+    UploadBatch(const UploadBatch&) = delete;
+    UploadBatch& operator =(const UploadBatch&) = delete;
+
+    // Copies data into staging memory right away and records its copy into
+    // buffer, which needs VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+    void uploadBuffer(VkBuffer buffer, const void* data, VkDeviceSize size, VkDeviceSize offset = 0);
+    // Same for the first mip level of a 2D color image with four bytes per
+    // texel. The image goes from UNDEFINED to SHADER_READ_ONLY_OPTIMAL.
+    void uploadImage(VkImage image, uint32_t width, uint32_t height, const void* pixels);
+    // Submits the recorded copies and waits for them. The batch can be reused.
+    void submit();
+    VkDeviceSize getUploadedBytes() const;
+
+private:
+    // Staging range for size bytes, mapped.
+    VkDeviceSize allocate(VkDeviceSize size, VkBuffer& buffer, void*& mapped);
+    VkCommandBuffer getCommandBuffer();
+    void freeStaging();
+
+    VulkanDevice* device_;
+    VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+    std::vector<Buffer> staging_buffers_;
+    // Used bytes of the last staging buffer.
+    VkDeviceSize chunk_offset_ = 0;
+    VkDeviceSize uploaded_bytes_ = 0;
+};
@@ -0,0 +1,236 @@
+#include "main/upscaler.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+void Upscaler::init(VulkanDevice* device, VkRenderPass render_pass, const std::vector<char>& vert_code, const std::vector<char>& frag_code) {
+    device_ = device;
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = 0.0f;
+
+    if (vkCreateSampler(*device_, &sampler_info, nullptr, &sampler_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale sampler!");
+    }
+
+    VkDescriptorSetLayoutBinding source_binding{};
+    source_binding.binding = 0;
+    source_binding.descriptorCount = 1;
+    source_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    source_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &source_binding;
+
+    if (vkCreateDescriptorSetLayout(*device_, &layout_info, nullptr, &descriptor_set_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor set layout!");
+    }
+
+    uint32_t frame_count = device_->getFramesInFlight();
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = frame_count;
+
+    if (vkCreateDescriptorPool(*device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, descriptor_set_layout_);
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool_;
+    alloc_info.descriptorSetCount = frame_count;
+    alloc_info.pSetLayouts = layouts.data();
+    descriptor_sets_.resize(frame_count);
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(*device_, &alloc_info, descriptor_sets_.data()));
+    sources_.assign(frame_count, VK_NULL_HANDLE);
+
+    createPipeline(render_pass, vert_code, frag_code);
+}
+
+void Upscaler::createPipeline(VkRenderPass render_pass, const std::vector<char>& vert_code, const std::vector<char>& frag_code) {
+    VkPushConstantRange push_constant_range{};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(UpscalePushConstant);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = 1;
+    pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+    pipeline_layout_info.pushConstantRangeCount = 1;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+    if (vkCreatePipelineLayout(*device_, &pipeline_layout_info, nullptr, &pipeline_layout_) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale pipeline layout!");
+    }
+
+    std::array<VkShaderModule, 2> shader_modules{};
+    std::array<const std::vector<char>*, 2> codes = {&vert_code, &frag_code};
+    for (size_t i = 0; i < shader_modules.size(); ++i) {
+        VkShaderModuleCreateInfo module_info{};
+        module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        module_info.codeSize = codes[i]->size();
+        module_info.pCode = reinterpret_cast<const uint32_t*>(codes[i]->data());
+        if (vkCreateShaderModule(*device_, &module_info, nullptr, &shader_modules[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upscale shader module!");
+        }
+    }
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages[0].module = shader_modules[0];
+    stages[0].pName = "main";
+    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages[1].module = shader_modules[1];
+    stages[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo color_blending{};
+    color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending.attachmentCount = 1;
+    color_blending.pAttachments = &color_blend_attachment;
+
+    std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamic_state{};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.dynamicStateCount = dynamic_states.size();
+    dynamic_state.pDynamicStates = dynamic_states.data();
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = stages.size();
+    pipeline_info.pStages = stages.data();
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+    pipeline_info.pViewportState = &viewport_state;
+    pipeline_info.pRasterizationState = &rasterizer;
+    pipeline_info.pMultisampleState = &multisampling;
+    pipeline_info.pColorBlendState = &color_blending;
+    pipeline_info.pDynamicState = &dynamic_state;
+    pipeline_info.layout = pipeline_layout_;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = 0;
+
+    VkResult result = vkCreateGraphicsPipelines(*device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline_);
+    for (VkShaderModule shader_module : shader_modules) {
+        vkDestroyShaderModule(*device_, shader_module, nullptr);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale pipeline!");
+    }
+}
+
+void Upscaler::destroy() {
+    if (device_ == nullptr) {
+        return;
+    }
+    vkDestroyDescriptorPool(*device_, descriptor_pool_, nullptr);
+    vkDestroyPipeline(*device_, pipeline_, nullptr);
+    vkDestroyPipelineLayout(*device_, pipeline_layout_, nullptr);
+    vkDestroyDescriptorSetLayout(*device_, descriptor_set_layout_, nullptr);
+    vkDestroySampler(*device_, sampler_, nullptr);
+    descriptor_sets_.clear();
+    sources_.clear();
+    device_ = nullptr;
+}
+
+bool Upscaler::isReady() const {
+    return device_ != nullptr;
+}
+
+void Upscaler::setSharpness(float sharpness) {
+    sharpness_ = std::clamp(sharpness, 0.0f, 1.0f);
+}
+
+void Upscaler::record(VkCommandBuffer command_buffer, uint32_t frame, VkImageView source, VkExtent2D source_extent, VkExtent2D rendered,
+                      VkExtent2D target_extent) {
+    if (sources_[frame] != source) {
+        VkDescriptorImageInfo source_info{};
+        source_info.sampler = sampler_;
+        source_info.imageView = source;
+        source_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet descriptor_write{};
+        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet = descriptor_sets_[frame];
+        descriptor_write.dstBinding = 0;
+        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_write.descriptorCount = 1;
+        descriptor_write.pImageInfo = &source_info;
+        vkUpdateDescriptorSets(*device_, 1, &descriptor_write, 0, nullptr);
+        sources_[frame] = source;
+    }
+
+    float texel_width = 1.0f / source_extent.width;
+    float texel_height = 1.0f / source_extent.height;
+    UpscalePushConstant push_constant{};
+    push_constant.uv_per_pixel[0] = static_cast<float>(rendered.width) / target_extent.width * texel_width;
+    push_constant.uv_per_pixel[1] = static_cast<float>(rendered.height) / target_extent.height * texel_height;
+    push_constant.uv_max[0] = (rendered.width - 0.5f) * texel_width;
+    push_constant.uv_max[1] = (rendered.height - 0.5f) * texel_height;
+    push_constant.texel_size[0] = texel_width;
+    push_constant.texel_size[1] = texel_height;
+    push_constant.sharpness = sharpness_;
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(target_extent.width);
+    viewport.height = static_cast<float>(target_extent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = target_extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1, &descriptor_sets_[frame], 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout_, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscalePushConstant), &push_constant);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "main/vulkan_device.h"
+
+#include <vector>
+
+// Must match UpscaleConsts in upscale.frag.
+struct UpscalePushConstant {
+    float uv_per_pixel[2];
+    float uv_max[2];
+    float texel_size[2];
+    float sharpness;
+};
+
+// Draws the part of a scene image rendered at a lower resolution over the
+// whole target, with a sharpening upsample, see upscale.frag.
+class Upscaler {
+public:
+    // render_pass must be compatible with the render passes record is
+    // recorded in: one color attachment of the target's format.
+    void init(VulkanDevice* device, VkRenderPass render_pass, const std::vector<char>& vert_code, const std::vector<char>& frag_code);
+    void destroy();
+    bool isReady() const;
+
+    // 0 is the mildest sharpening, 1 the strongest.
+    void setSharpness(float sharpness);
+
+    // Records into a render pass on the target. The source is sampled in
+    // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, source_extent being its size
+    // and rendered the part drawn into, from its top-left corner.
+    void record(VkCommandBuffer command_buffer, uint32_t frame, VkImageView source, VkExtent2D source_extent, VkExtent2D rendered,
+                VkExtent2D target_extent);
+
+private:
+    void createPipeline(VkRenderPass render_pass, const std::vector<char>& vert_code, const std::vector<char>& frag_code);
+
+    VulkanDevice* device_ = nullptr;
+    VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+    VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+    VkPipeline pipeline_ = VK_NULL_HANDLE;
+    VkSampler sampler_ = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+    // One per frame in flight, rewritten when the frame's source changes
+    // since the frame's previous use has completed by then.
+    std::vector<VkDescriptorSet> descriptor_sets_;
+    std::vector<VkImageView> sources_;
+    float sharpness_ = 0.5f;
+};
@@ -34,6 +34,25 @@ std::array<VkVertexInputAttributeDescription, 4> Vertex::getAttributeDescription
     return attribute_descriptions;
 }
 
+VkVertexInputBindingDescription Vertex::getPositionBindingDescription() {
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 0;
+    binding_description.stride = sizeof(glm::vec3);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return binding_description;
+}
+
+VkVertexInputAttributeDescription Vertex::getPositionAttributeDescription() {
+    VkVertexInputAttributeDescription attribute_description{};
+    attribute_description.binding = 0;
+    attribute_description.location = 0;
+    attribute_description.format = VK_FORMAT_R32G32B32_SFLOAT;
+    attribute_description.offset = 0;
+
+    return attribute_description;
+}
+
 bool Vertex::operator==(const Vertex& other) const {
     return pos == other.pos && color == other.color && tex_coords == other.tex_coords;
 }
\ No newline at end of file
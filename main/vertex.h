@@ -20,6 +20,10 @@ struct Vertex {
 
     static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions();
 
+    // Tightly packed positions, a separate stream for depth-only passes.
+    static VkVertexInputBindingDescription getPositionBindingDescription();
+    static VkVertexInputAttributeDescription getPositionAttributeDescription();
+
     bool operator==(const Vertex& other) const;
 };
 
@@ -24,8 +24,19 @@ constexpr std::array<const char*, 2> kDeviceExtensions = {
     VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 };
 
+// Enabled only when the device supports them, see VulkanDevice::isExtensionEnabled.
+constexpr std::array<const char*, 1> kOptionalDeviceExtensions = {
+    VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME
+};
+
 constexpr const char* kValidationLayers[] = {
     "VK_LAYER_KHRONOS_validation"
 };
 
-constexpr inline int kMaxFramesInFlight = 2;
\ No newline at end of file
+// Frames the CPU may record ahead of the GPU, see VulkanDevice::setFramesInFlight.
+// More frames raise throughput when either side stalls, fewer cut input latency.
+constexpr inline uint32_t kDefaultFramesInFlight = 2;
+constexpr inline uint32_t kMaxFramesInFlight = 4;
+
+// Size of the texture array bound at set 0, binding 1. Must match shader.frag.
+constexpr inline uint32_t kMaxTextures = 64;
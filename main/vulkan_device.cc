@@ -5,6 +5,7 @@
 #include <GLFW/glfw3.h>
 #include <set>
 #include <string>
+#include <string_view>
 
 
 VkSurfaceFormatKHR SwapChainSupportDetails::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& available_formats) {
@@ -17,9 +18,9 @@ VkSurfaceFormatKHR SwapChainSupportDetails::chooseSwapSurfaceFormat(const std::v
     return available_formats[0];
 }
 
-VkPresentModeKHR SwapChainSupportDetails::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available_present_modes) {
+VkPresentModeKHR SwapChainSupportDetails::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available_present_modes, VkPresentModeKHR preferred) {
     for (const auto& present_mode : available_present_modes) {
-        if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        if (present_mode == preferred) {
             return present_mode;
         }
     }
@@ -73,12 +74,14 @@ SwapChainSupportDetails SwapChainSupportDetails::querySupport(VkPhysicalDevice d
 VulkanDevice::VulkanDevice(VkInstance instance, VkSurfaceKHR surface)
     : surface_(surface) {
     pickPhysicalDevice(instance);
+    vkGetPhysicalDeviceProperties(physical_device_, &properties_);
     queue_family_indices_ = QueueFamilyIndices(physical_device_, surface);
     createLogicalDevice();
     command_pool_ = createCommandPool();
 }
 
 VulkanDevice::~VulkanDevice() {
+    flushRetired();
     vkDestroyCommandPool(logical_device_, command_pool_, nullptr);
     vkDestroyDevice(logical_device_, nullptr);
 }
@@ -96,12 +99,24 @@ void VulkanDevice::createLogicalDevice() {
         queue_create_infos.push_back(queue_create_info);
     }
 
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+
     VkPhysicalDeviceFeatures device_features{};
     device_features.samplerAnisotropy = VK_TRUE;
+    // Optional, GPU-driven rendering is only available with these.
+    device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+    device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+    // Optional, the depth pyramid writes its levels through a storage image array.
+    device_features.shaderStorageImageArrayDynamicIndexing = supported_features.shaderStorageImageArrayDynamicIndexing;
+    // Optional, the GPU profiler adds pipeline statistics to its scopes with it.
+    device_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+    features_ = device_features;
 
     VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
     indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
     indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+    indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 
     VkPhysicalDeviceFeatures2 device_features_ext{};
     device_features_ext.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
@@ -116,8 +131,23 @@ void VulkanDevice::createLogicalDevice() {
     create_info.pNext = &device_features_ext;
     
 
-    create_info.enabledExtensionCount = kDeviceExtensions.size();
-    create_info.ppEnabledExtensionNames = kDeviceExtensions.data();
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+    for (const auto& extension : available_extensions) {
+        supported_extensions_.push_back(extension.extensionName);
+    }
+
+    enabled_extensions_ = getRequiredExtensions();
+    for (const char* extension : kOptionalDeviceExtensions) {
+        if (std::find(supported_extensions_.begin(), supported_extensions_.end(), extension) != supported_extensions_.end()) {
+            enabled_extensions_.push_back(extension);
+        }
+    }
+
+    create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions_.size());
+    create_info.ppEnabledExtensionNames = enabled_extensions_.data();
 
     if (kEnableValidationLayers) {
         create_info.enabledLayerCount = static_cast<uint32_t>(std::size(kValidationLayers));
@@ -159,6 +189,79 @@ VkPhysicalDevice VulkanDevice::getPhysicalDevice() {
     return physical_device_;
 }
 
+const VkPhysicalDeviceProperties& VulkanDevice::getProperties() const {
+    return properties_;
+}
+
+const VkPhysicalDeviceFeatures& VulkanDevice::getEnabledFeatures() const {
+    return features_;
+}
+
+uint32_t VulkanDevice::getTimestampValidBits() const {
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &queue_family_count, queue_families.data());
+    return queue_families[queue_family_indices_.graphics_family.value()].timestampValidBits;
+}
+
+void VulkanDevice::setFramesInFlight(uint32_t frame_count) {
+    frames_in_flight_ = std::clamp<uint32_t>(frame_count, 1, kMaxFramesInFlight);
+}
+
+uint32_t VulkanDevice::getFramesInFlight() const {
+    return frames_in_flight_;
+}
+
+void VulkanDevice::retire(std::function<void()> destroy) {
+    // Waiting for the fence of a frame slot means the frame submitted
+    // frames_in_flight_ submissions earlier has completed, along with every
+    // frame before it.
+    retired_.push_back({submitted_frames_ + frames_in_flight_, std::move(destroy)});
+}
+
+void VulkanDevice::endFrame() {
+    ++submitted_frames_;
+}
+
+void VulkanDevice::collectRetired() {
+    while (!retired_.empty() && retired_.front().frame <= submitted_frames_) {
+        retired_.front().destroy();
+        retired_.pop_front();
+    }
+}
+
+void VulkanDevice::flushRetired() {
+    for (RetiredResource& resource : retired_) {
+        resource.destroy();
+    }
+    retired_.clear();
+}
+
+bool VulkanDevice::isHeadless() const {
+    return surface_ == VK_NULL_HANDLE;
+}
+
+std::vector<const char*> VulkanDevice::getRequiredExtensions() const {
+    std::vector<const char*> extensions;
+    for (const char* extension : kDeviceExtensions) {
+        if (isHeadless() && std::string_view(extension) == VK_KHR_SWAPCHAIN_EXTENSION_NAME) {
+            continue;
+        }
+        extensions.push_back(extension);
+    }
+    return extensions;
+}
+
+bool VulkanDevice::isExtensionEnabled(const std::string& extension) const {
+    for (const char* enabled : enabled_extensions_) {
+        if (extension == enabled) {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t VulkanDevice::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) {
     VkPhysicalDeviceMemoryProperties mem_properties;
     vkGetPhysicalDeviceMemoryProperties(physical_device_, &mem_properties);
@@ -193,22 +296,23 @@ VkCommandBuffer VulkanDevice::beginCommandBuffer() {
     return command_buffer;
 }
 
-void VulkanDevice::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory) {
+void VulkanDevice::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory, uint32_t mip_levels,
+                               uint32_t array_layers, VkImageCreateFlags flags) {
     VkImageCreateInfo image_info{};
     image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_info.imageType = VK_IMAGE_TYPE_2D;
     image_info.extent.width = width;
     image_info.extent.height = height;
     image_info.extent.depth = 1;
-    image_info.mipLevels = 1;
-    image_info.arrayLayers = 1;
+    image_info.mipLevels = mip_levels;
+    image_info.arrayLayers = array_layers;
     image_info.format = format;
     image_info.tiling = tiling;
     image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     image_info.usage = usage;
     image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image_info.samples = VK_SAMPLE_COUNT_1_BIT;
-    image_info.flags = 0;
+    image_info.flags = flags;
     
     VK_CHECK_RESULT(vkCreateImage(logical_device_, &image_info, nullptr, &image));
 
@@ -317,11 +421,12 @@ bool VulkanDevice::isDeviceSuitable(VkPhysicalDevice device) {
     if (!extensions_supported)
         return false;
 
-    bool swap_chain_adequate = false;
-    SwapChainSupportDetails swap_chain_support = SwapChainSupportDetails::querySupport(device, surface_);
-    swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
-    if (!swap_chain_adequate)
-        return false;
+    if (!isHeadless()) {
+        SwapChainSupportDetails swap_chain_support = SwapChainSupportDetails::querySupport(device, surface_);
+        bool swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
+        if (!swap_chain_adequate)
+            return false;
+    }
 
     VkPhysicalDeviceFeatures supported_features;
     vkGetPhysicalDeviceFeatures(device, &supported_features);
@@ -338,7 +443,8 @@ bool VulkanDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     std::vector<VkExtensionProperties> available_extensions(extension_count);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
 
-    std::set<std::string> required_extensions(kDeviceExtensions.begin(), kDeviceExtensions.end());
+    std::vector<const char*> required = getRequiredExtensions();
+    std::set<std::string> required_extensions(required.begin(), required.end());
 
     for (const auto& extension : available_extensions) {
         required_extensions.erase(extension.extensionName);
@@ -5,6 +5,9 @@
 #include "main/vulkan_buffer.h"
 
 #include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <optional>
 #include <set>
 #include <string>
@@ -19,7 +22,8 @@ struct SwapChainSupportDetails {
 
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& available_formats);
 
-    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available_present_modes);
+    // Falls back to FIFO, the only mode every device has to support.
+    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available_present_modes, VkPresentModeKHR preferred);
 
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow* window);
 
@@ -45,8 +49,13 @@ struct QueueFamilyIndices {
             if (isComplete())
                 break;
 
+            // Without a surface nothing is presented, the graphics queue stands in.
             VkBool32 presentation_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
+            if (surface != VK_NULL_HANDLE) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentation_support);
+            } else {
+                presentation_support = (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+            }
             if (presentation_support) {
                 presentation_family = i;
             }
@@ -70,6 +79,8 @@ struct QueueFamilyIndices {
 class VulkanDevice {
 public:
     VulkanDevice() = default;
+    // A null surface creates a headless device: no presentation support or
+    // swapchain extension is required, see OffscreenTarget.
     VulkanDevice(VkInstance instance, VkSurfaceKHR surface);
     ~VulkanDevice();
 
@@ -85,6 +96,31 @@ public:
 
     VkPhysicalDevice getPhysicalDevice();
 
+    const VkPhysicalDeviceProperties& getProperties() const;
+
+    const VkPhysicalDeviceFeatures& getEnabledFeatures() const;
+
+    // Bits of the graphics queue's timestamps that are meaningful, 0 if it has none.
+    uint32_t getTimestampValidBits() const;
+
+    bool isExtensionEnabled(const std::string& extension) const;
+
+    bool isHeadless() const;
+
+    // Clamped to [1, kMaxFramesInFlight]. Per-frame resources are sized from
+    // it when they are created, so it has to be set before any of them.
+    void setFramesInFlight(uint32_t frame_count);
+    uint32_t getFramesInFlight() const;
+
+    // Deferred destruction of resources that frames in flight may still use.
+    // destroy runs once every frame submitted before the call has completed:
+    // endFrame marks a submission, collectRetired must be called after waiting
+    // for a frame's fence and flushRetired once the device is idle.
+    void retire(std::function<void()> destroy);
+    void endFrame();
+    void collectRetired();
+    void flushRetired();
+
     uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
 
     VkCommandBuffer beginCommandBuffer();
@@ -92,7 +128,8 @@ public:
         return command_pool_;
     }
 
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory);
+    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory, uint32_t mip_levels = 1,
+                     uint32_t array_layers = 1, VkImageCreateFlags flags = 0);
 
     void submitCommandBuffer(VkCommandBuffer command_buffer, VkQueue queue);
 
@@ -109,6 +146,7 @@ private:
     bool isDeviceSuitable(VkPhysicalDevice device);
     VkCommandPool createCommandPool();
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    std::vector<const char*> getRequiredExtensions() const;
 
     QueueFamilyIndices queue_family_indices_;
     VkCommandPool command_pool_;
@@ -117,9 +155,18 @@ private:
     VkPhysicalDeviceProperties properties_;
     VkPhysicalDeviceFeatures features_;
     VkPhysicalDeviceMemoryProperties memory_properties_;
-    VkSurfaceKHR surface_;
+    VkSurfaceKHR surface_ = VK_NULL_HANDLE;
     std::vector<VkQueueFamilyProperties> queue_family_properties_;
     std::vector<std::string> supported_extensions_;
+    std::vector<const char*> enabled_extensions_;
     VkQueue graphics_queue_;
     VkQueue presentation_queue_;
+    uint32_t frames_in_flight_ = kDefaultFramesInFlight;
+
+    struct RetiredResource {
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+    std::deque<RetiredResource> retired_;
+    uint64_t submitted_frames_ = 0;
 };
\ No newline at end of file
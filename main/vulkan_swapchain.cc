@@ -1,14 +1,17 @@
 #include "vulkan_swapchain.h"
 
+#include <algorithm>
+
 std::unique_ptr<VulkanSwapchain> VulkanSwapchain::createSwapChain(
-    VulkanDevice* device, VkSurfaceKHR surface, GLFWwindow* window) {
+    VulkanDevice* device, VkSurfaceKHR surface, GLFWwindow* window, const SwapchainConfig& config, VkSwapchainKHR old_swapchain) {
     SwapChainSupportDetails swap_chain_support = SwapChainSupportDetails::querySupport(device->getPhysicalDevice(), surface);
 
     VkSurfaceFormatKHR surface_format = swap_chain_support.chooseSwapSurfaceFormat(swap_chain_support.formats);
-    VkPresentModeKHR present_mode = swap_chain_support.chooseSwapPresentMode(swap_chain_support.present_modes);
+    VkPresentModeKHR present_mode = swap_chain_support.chooseSwapPresentMode(swap_chain_support.present_modes, config.present_mode);
     VkExtent2D extent = swap_chain_support.chooseSwapExtent(swap_chain_support.capabilities, window);
 
-    uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
+    uint32_t image_count = config.image_count > 0 ? config.image_count : swap_chain_support.capabilities.minImageCount + 1;
+    image_count = std::max(image_count, swap_chain_support.capabilities.minImageCount);
     if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
         image_count = swap_chain_support.capabilities.maxImageCount;
     }
@@ -21,7 +24,8 @@ std::unique_ptr<VulkanSwapchain> VulkanSwapchain::createSwapChain(
     create_info.imageColorSpace = surface_format.colorSpace;
     create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
-    create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // Copying out of the images is optional, for frame captures.
+    create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (swap_chain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
 
     QueueFamilyIndices indices(device->getPhysicalDevice(), surface);
     uint32_t queue_family_indices[] = {indices.graphics_family.value(), indices.presentation_family.value()};
@@ -39,7 +43,7 @@ std::unique_ptr<VulkanSwapchain> VulkanSwapchain::createSwapChain(
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode = present_mode;
     create_info.clipped = VK_TRUE;
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    create_info.oldSwapchain = old_swapchain;
     create_info.pNext = nullptr;
     create_info.flags = 0;
 
@@ -50,17 +54,13 @@ std::unique_ptr<VulkanSwapchain> VulkanSwapchain::createSwapChain(
     swap_chain_images.resize(image_count);
     VK_CHECK_RESULT(vkGetSwapchainImagesKHR(*device, swap_chain, &image_count, swap_chain_images.data()));
 
-    return std::unique_ptr<VulkanSwapchain>(new VulkanSwapchain(device, swap_chain, extent, surface_format.format, swap_chain_images));
+    return std::unique_ptr<VulkanSwapchain>(new VulkanSwapchain(device, swap_chain, extent, surface_format.format, present_mode, create_info.imageUsage, swap_chain_images));
 }
 
 VkFormat VulkanSwapchain::getImageFormat() {
     return image_format_;
 }
 
-VkFormat VulkanSwapchain::getDepthFormat() {
-    return depth_format_;
-}
-
 VkExtent2D VulkanSwapchain::getExtent() {
     return swap_chain_extent_;
 }
@@ -69,27 +69,35 @@ uint32_t VulkanSwapchain::getImageCount() {
     return swap_chain_images_.size();
 }
 
+VkPresentModeKHR VulkanSwapchain::getPresentMode() {
+    return present_mode_;
+}
+
+VkImage VulkanSwapchain::getImage(size_t index) {
+    return swap_chain_images_[index];
+}
+
 VkImageView VulkanSwapchain::getImageView(size_t index) {
     return swap_chain_image_views_[index];
 
 }
 
-VkImageView VulkanSwapchain::getDepthImageView() {
-    return depth_image_view_;
+VkImageLayout VulkanSwapchain::getFinalLayout() {
+    return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+bool VulkanSwapchain::isCopySource() {
+    return (usage_ & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
 }
 
-VulkanSwapchain::VulkanSwapchain(VulkanDevice* device, VkSwapchainKHR swap_chain, VkExtent2D extent, VkFormat format, std::vector<VkImage>& swap_chain_images)
-: device_(device), swap_chain_(swap_chain), image_format_(format), swap_chain_extent_(extent) {
+VulkanSwapchain::VulkanSwapchain(VulkanDevice* device, VkSwapchainKHR swap_chain, VkExtent2D extent, VkFormat format, VkPresentModeKHR present_mode,
+                                 VkImageUsageFlags usage, std::vector<VkImage>& swap_chain_images)
+: device_(device), swap_chain_(swap_chain), image_format_(format), present_mode_(present_mode), usage_(usage), swap_chain_extent_(extent) {
     swap_chain_images_.swap(swap_chain_images);
     createImageViews();
-    createDepthResources();
 }
 
 VulkanSwapchain::~VulkanSwapchain() {
-    vkDestroyImageView(*device_, depth_image_view_, nullptr);
-    vkDestroyImage(*device_, depth_image_, nullptr);
-    vkFreeMemory(*device_, depth_image_memory_, nullptr);
-
     for (auto& image_view : swap_chain_image_views_) {
         vkDestroyImageView(*device_, image_view, nullptr);
     }
@@ -123,40 +131,3 @@ VkImageView VulkanSwapchain::createImageView(VkImage image, VkFormat format, VkI
     return image_view;
 }
 
-VkFormat VulkanSwapchain::findDepthFormat() {
-    return device_->findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-}
-
-void VulkanSwapchain::createDepthResources() {
-    VkFormat depth_format = findDepthFormat();
-    depth_format_ = depth_format;
-    device_->createImage(swap_chain_extent_.width, swap_chain_extent_.height, depth_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depth_image_, depth_image_memory_);
-    depth_image_view_ = createImageView(depth_image_, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    VkCommandBuffer command_buffer = device_->beginCommandBuffer();
-
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = depth_image_;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    if (depth_format == VK_FORMAT_D32_SFLOAT_S8_UINT || depth_format == VK_FORMAT_D24_UNORM_S8_UINT) {
-        barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-    }
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-    VkPipelineStageFlags    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-
-    vkCmdPipelineBarrier(command_buffer, source_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    device_->submitCommandBuffer(command_buffer, device_->getGraphicsQueue());
-}
@@ -2,46 +2,59 @@
 
 #include <memory>
 
+#include "main/render_target.h"
 #include "vulkan_device.h"
 
 
 struct GLFWwindow;
 
-class VulkanSwapchain {
+struct SwapchainConfig {
+    // Images to request, 0 for minImageCount + 1. Clamped to what the surface supports.
+    uint32_t image_count = 0;
+    // FIFO caps the frame rate at the refresh rate with the most queued latency,
+    // MAILBOX replaces queued images instead of waiting for them, IMMEDIATE and
+    // FIFO_RELAXED may tear.
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+};
+
+class VulkanSwapchain : public RenderTarget {
 public:
-    ~VulkanSwapchain();
+    ~VulkanSwapchain() override;
+    // Passing the swapchain being replaced as old_swapchain lets the presentation
+    // engine hand over its queued images. It has to be destroyed separately,
+    // once nothing in flight uses its images.
     static std::unique_ptr<VulkanSwapchain> createSwapChain(
-        VulkanDevice* device, VkSurfaceKHR surface, GLFWwindow* window);
-
-    VkFormat getImageFormat();
-    VkFormat getDepthFormat();
-    VkExtent2D getExtent();
-    uint32_t getImageCount();
-    VkImageView getImageView(size_t index);
-    VkImageView getDepthImageView();
+        VulkanDevice* device, VkSurfaceKHR surface, GLFWwindow* window, const SwapchainConfig& config = {},
+        VkSwapchainKHR old_swapchain = VK_NULL_HANDLE);
+
+    VkFormat getImageFormat() override;
+    VkExtent2D getExtent() override;
+    uint32_t getImageCount() override;
+    // What the surface granted, which may differ from the requested config.
+    VkPresentModeKHR getPresentMode();
+    VkImage getImage(size_t index) override;
+    VkImageView getImageView(size_t index) override;
+    VkImageLayout getFinalLayout() override;
+    bool isCopySource() override;
 
     operator VkSwapchainKHR() const {
         return swap_chain_;
     }
 
 private:
-    VulkanSwapchain(VulkanDevice* device, VkSwapchainKHR swap_chain, VkExtent2D extent, VkFormat format, std::vector<VkImage>& swap_chain_images); 
+    VulkanSwapchain(VulkanDevice* device, VkSwapchainKHR swap_chain, VkExtent2D extent, VkFormat format, VkPresentModeKHR present_mode,
+                    VkImageUsageFlags usage, std::vector<VkImage>& swap_chain_images);
 
     void createImageViews();
 
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags);
-    VkFormat findDepthFormat();
-
-    void createDepthResources();
 
     VkSwapchainKHR swap_chain_;
     VkExtent2D swap_chain_extent_;
     std::vector<VkImage> swap_chain_images_;
     std::vector<VkImageView> swap_chain_image_views_;
-    VkImage depth_image_;
-    VkImageView depth_image_view_;
-    VkDeviceMemory depth_image_memory_;
-    VkFormat depth_format_;
     VkFormat image_format_;
+    VkPresentModeKHR present_mode_;
+    VkImageUsageFlags usage_;
     VulkanDevice* device_;
 };
\ No newline at end of file